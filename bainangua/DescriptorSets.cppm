@@ -5,6 +5,16 @@ module;
 #include "RowType.hpp"
 #include "vk_result_to_string.h"
 
+#include <boost/container_hash/hash.hpp>
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
 
 export module DescriptorSets;
 
@@ -244,4 +254,470 @@ export struct CreateCombinedDescriptorSetsStage {
 };
 
 
-}
\ No newline at end of file
+// How many descriptors of a type to reserve for each set a pool can hold. A pool sized for N sets gets
+// N * perSet descriptors of each type.
+export struct DescriptorPoolRatio {
+	vk::DescriptorType type;
+	float perSet;
+};
+
+// A chain of descriptor pools that grows instead of failing. When the current pool runs out another one, bigger
+// than the last, gets added. Sets can't be freed one at a time; reset() gives all of them back at once and keeps
+// the pools around for reuse.
+export class GrowableDescriptorPool {
+public:
+	GrowableDescriptorPool(vk::Device device, std::vector<DescriptorPoolRatio> ratios, uint32_t initialSetCount = 64)
+		: device_(device), ratios_(ratios), nextSetCount_(initialSetCount) {}
+	~GrowableDescriptorPool() {
+		for (vk::DescriptorPool pool : readyPools_) { device_.destroyDescriptorPool(pool); }
+		for (vk::DescriptorPool pool : fullPools_) { device_.destroyDescriptorPool(pool); }
+	}
+
+	GrowableDescriptorPool(const GrowableDescriptorPool&) = delete;
+	GrowableDescriptorPool& operator=(const GrowableDescriptorPool&) = delete;
+
+	auto allocate(vk::DescriptorSetLayout layout) -> bng_expected<vk::DescriptorSet> {
+		// a fresh pool that still can't fit the set means the layout itself is too big, so only try twice
+		for (int attempt = 0; attempt < 2; attempt++) {
+			auto poolResult = currentPool();
+			if (!poolResult) {
+				return tl::make_unexpected(poolResult.error());
+			}
+
+			vk::DescriptorSetAllocateInfo allocInfo(poolResult.value(), 1, &layout);
+			vk::DescriptorSet set;
+			vk::Result allocResult = device_.allocateDescriptorSets(&allocInfo, &set);
+			if (allocResult == vk::Result::eSuccess) {
+				return set;
+			}
+			if (allocResult != vk::Result::eErrorOutOfPoolMemory && allocResult != vk::Result::eErrorFragmentedPool) {
+				return formatVkResultError("GrowableDescriptorPool: could not allocate descriptor set", allocResult);
+			}
+
+			fullPools_.push_back(readyPools_.back());
+			readyPools_.pop_back();
+		}
+		return tl::make_unexpected("GrowableDescriptorPool: descriptor set layout doesn't fit in a new pool");
+	}
+
+	// Every set allocated so far becomes invalid.
+	void reset() {
+		std::ranges::move(fullPools_, std::back_inserter(readyPools_));
+		fullPools_.clear();
+		for (vk::DescriptorPool pool : readyPools_) {
+			device_.resetDescriptorPool(pool);
+		}
+	}
+
+	size_t poolCount() const { return readyPools_.size() + fullPools_.size(); }
+
+private:
+	auto currentPool() -> bng_expected<vk::DescriptorPool> {
+		if (!readyPools_.empty()) {
+			return readyPools_.back();
+		}
+
+		std::vector<vk::DescriptorPoolSize> poolSizes;
+		for (const DescriptorPoolRatio& ratio : ratios_) {
+			poolSizes.emplace_back(ratio.type, std::max(1u, static_cast<uint32_t>(ratio.perSet * static_cast<float>(nextSetCount_))));
+		}
+		vk::DescriptorPoolCreateInfo poolInfo({}, nextSetCount_, poolSizes);
+
+		vk::DescriptorPool pool;
+		vk::Result createResult = device_.createDescriptorPool(&poolInfo, nullptr, &pool);
+		if (createResult != vk::Result::eSuccess) {
+			return formatVkResultError("GrowableDescriptorPool: could not create descriptor pool", createResult);
+		}
+		readyPools_.push_back(pool);
+		nextSetCount_ = std::min(nextSetCount_ + nextSetCount_ / 2, MaxSetsPerPool);
+		return pool;
+	}
+
+	static constexpr uint32_t MaxSetsPerPool = 4096;
+
+	vk::Device device_;
+	std::vector<DescriptorPoolRatio> ratios_;
+	uint32_t nextSetCount_;
+	std::vector<vk::DescriptorPool> readyPools_; //< the back one is where allocations go
+	std::vector<vk::DescriptorPool> fullPools_;
+};
+
+// One thing bound into a descriptor set. Fill in buffer for buffer types and image for image/sampler types.
+export struct DescriptorBinding {
+	uint32_t binding;
+	vk::DescriptorType type;
+	vk::DescriptorBufferInfo buffer;
+	vk::DescriptorImageInfo image;
+
+	bool operator==(const DescriptorBinding&) const = default;
+};
+
+// Writes all the bindings into a set with a single updateDescriptorSets call.
+export auto writeDescriptorSet(vk::Device device, vk::DescriptorSet set, std::span<const DescriptorBinding> bindings) -> void {
+	constexpr size_t MaxWrites = 16;
+	std::array<vk::WriteDescriptorSet, MaxWrites> writes;
+	size_t writeCount = 0;
+	for (const DescriptorBinding& b : bindings) {
+		const bool isImage = (b.type == vk::DescriptorType::eCombinedImageSampler || b.type == vk::DescriptorType::eSampledImage
+			|| b.type == vk::DescriptorType::eStorageImage || b.type == vk::DescriptorType::eSampler || b.type == vk::DescriptorType::eInputAttachment);
+		writes[writeCount++] = vk::WriteDescriptorSet(set, b.binding, 0, 1, b.type, isImage ? &b.image : nullptr, isImage ? nullptr : &b.buffer, nullptr);
+		if (writeCount == MaxWrites) {
+			device.updateDescriptorSets(static_cast<uint32_t>(writeCount), writes.data(), 0, nullptr);
+			writeCount = 0;
+		}
+	}
+	if (writeCount > 0) {
+		device.updateDescriptorSets(static_cast<uint32_t>(writeCount), writes.data(), 0, nullptr);
+	}
+}
+
+// Hands out descriptor sets in two flavors:
+//
+// Frame sets live until the next time their frame slot comes around. Each frame slot has its own
+// GrowableDescriptorPool, and beginFrame() resets it wholesale, so allocating a set per draw costs about as much as
+// a pointer bump in the driver. StandardMultiFrameLoop skips beginFrame when it replays a buffer from a
+// CommandBufferCache, and has the cache re-record the slot's other buffers when the reset frees sets they use.
+//
+// Cached sets are looked up by layout and what's bound, so asking twice for the same bindings gives back the same
+// set without touching the device. The key is made of raw handles, so when a buffer, image view or sampler gets
+// destroyed, invalidate() it; otherwise a new resource that happens to get the same handle would be handed a set
+// pointing at the old one. Invalidated sets get reused for their layout once every frame in flight has finished.
+//
+// Not thread-safe; it's meant to be used from the thread recording the frame.
+export class DescriptorAllocator {
+public:
+	DescriptorAllocator(vk::Device device, std::vector<DescriptorPoolRatio> ratios) : device_(device), longLived_(device, ratios) {
+		for (size_t i = 0; i < MultiFrameCount; i++) {
+			framePools_.push_back(std::make_unique<GrowableDescriptorPool>(device, ratios));
+		}
+	}
+
+	// Call once the fence for the frame slot has been waited on.
+	void beginFrame(size_t multiFrameIndex) {
+		framePools_[multiFrameIndex]->reset();
+		frameSetCounts_[multiFrameIndex] = 0;
+
+		// a set retired during some frame is free once each slot, that frame's included, has come around again
+		std::erase_if(retiredSets_, [&](RetiredSet& retired) {
+			if (--retired.framesLeft > 0) {
+				return false;
+			}
+			spareSets_[static_cast<VkDescriptorSetLayout>(retired.layout)].push_back(retired.set);
+			return true;
+		});
+	}
+
+	// whether beginFrame would free anything
+	bool hasFrameSets(size_t multiFrameIndex) const { return frameSetCounts_[multiFrameIndex] > 0; }
+
+	auto allocateFrameSet(size_t multiFrameIndex, vk::DescriptorSetLayout layout) -> bng_expected<vk::DescriptorSet> {
+		auto setResult = framePools_[multiFrameIndex]->allocate(layout);
+		if (setResult) {
+			frameSetCounts_[multiFrameIndex]++;
+		}
+		return setResult;
+	}
+
+	auto allocateFrameSet(size_t multiFrameIndex, vk::DescriptorSetLayout layout, std::span<const DescriptorBinding> bindings) -> bng_expected<vk::DescriptorSet> {
+		return allocateFrameSet(multiFrameIndex, layout)
+			.map([&](vk::DescriptorSet set) {
+				writeDescriptorSet(device_, set, bindings);
+				return set;
+			});
+	}
+
+	auto cachedSet(vk::DescriptorSetLayout layout, std::span<const DescriptorBinding> bindings) -> bng_expected<vk::DescriptorSet> {
+		CacheKey key{ layout, std::vector<DescriptorBinding>(bindings.begin(), bindings.end()) };
+		auto found = cache_.find(key);
+		if (found != cache_.end()) {
+			return found->second;
+		}
+
+		bng_expected<vk::DescriptorSet> setResult;
+		auto spare = spareSets_.find(static_cast<VkDescriptorSetLayout>(layout));
+		if (spare != spareSets_.end() && !spare->second.empty()) {
+			setResult = spare->second.back();
+			spare->second.pop_back();
+		}
+		else {
+			setResult = longLived_.allocate(layout);
+			if (!setResult) {
+				return setResult;
+			}
+		}
+		writeDescriptorSet(device_, setResult.value(), bindings);
+		cache_.emplace(std::move(key), setResult.value());
+		return setResult;
+	}
+
+	// Drop every cached set that refers to the resource. Call these when destroying it. Returns how many were dropped.
+	size_t invalidate(vk::Buffer buffer) {
+		return invalidateWhere([&](const DescriptorBinding& b) { return b.buffer.buffer == buffer; });
+	}
+	size_t invalidate(vk::ImageView imageView) {
+		return invalidateWhere([&](const DescriptorBinding& b) { return b.image.imageView == imageView; });
+	}
+	size_t invalidate(vk::Sampler sampler) {
+		return invalidateWhere([&](const DescriptorBinding& b) { return b.image.sampler == sampler; });
+	}
+
+	// Goes up whenever an invalidate() drops something, so code that holds on to cached sets knows to look them up again.
+	uint64_t generation() const { return generation_; }
+
+	size_t cachedSetCount() const { return cache_.size(); }
+
+private:
+	struct CacheKey {
+		vk::DescriptorSetLayout layout;
+		std::vector<DescriptorBinding> bindings;
+
+		bool operator==(const CacheKey&) const = default;
+	};
+
+	struct RetiredSet {
+		vk::DescriptorSetLayout layout;
+		vk::DescriptorSet set;
+		size_t framesLeft;
+	};
+
+	template <typename Matches>
+	size_t invalidateWhere(Matches matches) {
+		size_t dropped = std::erase_if(cache_, [&](const auto& entry) {
+			if (std::ranges::none_of(entry.first.bindings, matches)) {
+				return false;
+			}
+			retiredSets_.push_back(RetiredSet{ entry.first.layout, entry.second, MultiFrameCount });
+			return true;
+		});
+		if (dropped > 0) {
+			generation_++;
+		}
+		return dropped;
+	}
+
+	struct CacheKeyHash {
+		size_t operator()(const CacheKey& k) const {
+			size_t seed = 0;
+			boost::hash_combine(seed, static_cast<VkDescriptorSetLayout>(k.layout));
+			for (const DescriptorBinding& b : k.bindings) {
+				boost::hash_combine(seed, b.binding);
+				boost::hash_combine(seed, static_cast<int>(b.type));
+				boost::hash_combine(seed, static_cast<VkBuffer>(b.buffer.buffer));
+				boost::hash_combine(seed, b.buffer.offset);
+				boost::hash_combine(seed, b.buffer.range);
+				boost::hash_combine(seed, static_cast<VkSampler>(b.image.sampler));
+				boost::hash_combine(seed, static_cast<VkImageView>(b.image.imageView));
+				boost::hash_combine(seed, static_cast<int>(b.image.imageLayout));
+			}
+			return seed;
+		}
+	};
+
+	vk::Device device_;
+	std::vector<std::unique_ptr<GrowableDescriptorPool>> framePools_;
+	std::array<size_t, MultiFrameCount> frameSetCounts_{};
+	GrowableDescriptorPool longLived_;
+	std::unordered_map<CacheKey, vk::DescriptorSet, CacheKeyHash> cache_;
+	std::vector<RetiredSet> retiredSets_;
+	std::unordered_map<VkDescriptorSetLayout, std::vector<vk::DescriptorSet>> spareSets_;
+	uint64_t generation_{ 0 };
+};
+
+// One big descriptor set holding every texture and storage buffer, for the opt-in bindless mode (needs
+// VulkanContextConfig::useBindless). Binding 0 is an array of combined image samplers and binding 1 an array of
+// storage buffers. Each resource gets a slot index that stays put until it's removed, and shaders pick resources
+// by that index (passed in push constants) instead of through per-material descriptor sets. The set is bound once
+// per frame, no matter how many materials get drawn.
+//
+// The bindings are update-after-bind and partially bound, so adding a resource is fine while the set is bound in
+// a command buffer that's being recorded or executed, as long as that command buffer doesn't use the slot. Don't
+// remove something a frame in flight might still use. Adds and removes can come from several loader threads at once.
+export class BindlessTable {
+public:
+	static constexpr uint32_t TextureBinding = 0;
+	static constexpr uint32_t StorageBufferBinding = 1;
+
+	static auto create(vk::Device device, uint32_t maxTextures, uint32_t maxStorageBuffers) -> bng_expected<std::shared_ptr<BindlessTable>> {
+		std::array<vk::DescriptorSetLayoutBinding, 2> bindings{
+			vk::DescriptorSetLayoutBinding(TextureBinding, vk::DescriptorType::eCombinedImageSampler, maxTextures, vk::ShaderStageFlagBits::eAll, nullptr),
+			vk::DescriptorSetLayoutBinding(StorageBufferBinding, vk::DescriptorType::eStorageBuffer, maxStorageBuffers, vk::ShaderStageFlagBits::eAll, nullptr)
+		};
+		std::array<vk::DescriptorBindingFlags, 2> bindingFlags{
+			vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::ePartiallyBound,
+			vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::ePartiallyBound
+		};
+		vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo(bindingFlags);
+		vk::DescriptorSetLayoutCreateInfo layoutInfo(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool, bindings, &bindingFlagsInfo);
+
+		vk::DescriptorSetLayout layout;
+		vk::Result layoutResult = device.createDescriptorSetLayout(&layoutInfo, nullptr, &layout);
+		if (layoutResult != vk::Result::eSuccess) {
+			return formatVkResultError("BindlessTable: could not create descriptor set layout", layoutResult);
+		}
+
+		std::array<vk::DescriptorPoolSize, 2> poolSizes{
+			vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, maxTextures),
+			vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, maxStorageBuffers)
+		};
+		vk::DescriptorPoolCreateInfo poolInfo(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind, 1, poolSizes);
+		vk::DescriptorPool pool;
+		vk::Result poolResult = device.createDescriptorPool(&poolInfo, nullptr, &pool);
+		if (poolResult != vk::Result::eSuccess) {
+			device.destroyDescriptorSetLayout(layout);
+			return formatVkResultError("BindlessTable: could not create descriptor pool", poolResult);
+		}
+
+		vk::DescriptorSetAllocateInfo allocInfo(pool, 1, &layout);
+		vk::DescriptorSet set;
+		vk::Result allocResult = device.allocateDescriptorSets(&allocInfo, &set);
+		if (allocResult != vk::Result::eSuccess) {
+			device.destroyDescriptorPool(pool);
+			device.destroyDescriptorSetLayout(layout);
+			return formatVkResultError("BindlessTable: could not allocate descriptor set", allocResult);
+		}
+
+		return std::make_shared<BindlessTable>(device, layout, pool, set, maxTextures, maxStorageBuffers);
+	}
+
+	BindlessTable(vk::Device device, vk::DescriptorSetLayout layout, vk::DescriptorPool pool, vk::DescriptorSet set, uint32_t maxTextures, uint32_t maxStorageBuffers)
+		: device_(device), layout_(layout), pool_(pool), set_(set), textureSlots_(maxTextures), bufferSlots_(maxStorageBuffers) {}
+	~BindlessTable() {
+		device_.destroyDescriptorPool(pool_);
+		device_.destroyDescriptorSetLayout(layout_);
+	}
+
+	BindlessTable(const BindlessTable&) = delete;
+	BindlessTable& operator=(const BindlessTable&) = delete;
+
+	auto addTexture(vk::ImageView imageView, vk::Sampler sampler) -> bng_expected<uint32_t> {
+		std::scoped_lock lock(mutex_);
+		auto slot = textureSlots_.take();
+		if (!slot) {
+			return tl::make_unexpected("BindlessTable: out of texture slots");
+		}
+		vk::DescriptorImageInfo imageInfo(sampler, imageView, vk::ImageLayout::eShaderReadOnlyOptimal);
+		vk::WriteDescriptorSet write(set_, TextureBinding, slot.value(), 1, vk::DescriptorType::eCombinedImageSampler, &imageInfo, nullptr, nullptr);
+		device_.updateDescriptorSets(1, &write, 0, nullptr);
+		return slot.value();
+	}
+
+	auto addStorageBuffer(vk::Buffer buffer, vk::DeviceSize offset = 0, vk::DeviceSize range = VK_WHOLE_SIZE) -> bng_expected<uint32_t> {
+		std::scoped_lock lock(mutex_);
+		auto slot = bufferSlots_.take();
+		if (!slot) {
+			return tl::make_unexpected("BindlessTable: out of storage buffer slots");
+		}
+		vk::DescriptorBufferInfo bufferInfo(buffer, offset, range);
+		vk::WriteDescriptorSet write(set_, StorageBufferBinding, slot.value(), 1, vk::DescriptorType::eStorageBuffer, nullptr, &bufferInfo, nullptr);
+		device_.updateDescriptorSets(1, &write, 0, nullptr);
+		return slot.value();
+	}
+
+	// The slot is reused by a later add, so only remove once no frame in flight uses it.
+	void removeTexture(uint32_t index) {
+		std::scoped_lock lock(mutex_);
+		textureSlots_.give(index);
+	}
+	void removeStorageBuffer(uint32_t index) {
+		std::scoped_lock lock(mutex_);
+		bufferSlots_.give(index);
+	}
+
+	vk::DescriptorSetLayout layout() const { return layout_; }
+	vk::DescriptorSet set() const { return set_; }
+
+private:
+	// Hands out indices 0..capacity-1, lowest first, so the array stays dense.
+	struct SlotList {
+		SlotList(uint32_t capacity) : capacity_(capacity) {}
+
+		std::optional<uint32_t> take() {
+			if (!freed_.empty()) {
+				uint32_t index = freed_.back();
+				freed_.pop_back();
+				return index;
+			}
+			if (next_ < capacity_) {
+				return next_++;
+			}
+			return std::nullopt;
+		}
+		void give(uint32_t index) { freed_.push_back(index); }
+
+		uint32_t capacity_;
+		uint32_t next_{ 0 };
+		std::vector<uint32_t> freed_;
+	};
+
+	vk::Device device_;
+	vk::DescriptorSetLayout layout_;
+	vk::DescriptorPool pool_;
+	vk::DescriptorSet set_;
+	// guards the slot lists and the set's descriptor writes, which Vulkan requires to be externally synchronized
+	std::mutex mutex_;
+	SlotList textureSlots_;
+	SlotList bufferSlots_;
+};
+
+// Adds a BindlessTable as "bindlessTable". The device has to have been created with useBindless set.
+export struct BindlessTableStage {
+	BindlessTableStage(uint32_t maxTextures = 4096, uint32_t maxStorageBuffers = 1024) : maxTextures_(maxTextures), maxStorageBuffers_(maxStorageBuffers) {}
+
+	uint32_t maxTextures_;
+	uint32_t maxStorageBuffers_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	requires RowType::has_named_field<Row, BOOST_HANA_STRING("device"), vk::Device>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+
+		if constexpr (boost::hana::contains(r, BOOST_HANA_STRING("config"))) {
+			const VulkanContextConfig& config = boost::hana::at_key(r, BOOST_HANA_STRING("config"));
+			if (!config.useBindless) {
+				return tl::make_unexpected("BindlessTableStage: the device was created without useBindless");
+			}
+		}
+
+		auto tableResult = BindlessTable::create(device, maxTextures_, maxStorageBuffers_);
+		if (!tableResult) {
+			return tl::make_unexpected(tableResult.error());
+		}
+		auto rWithTable = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("bindlessTable"), tableResult.value()));
+		return f.applyRow(rWithTable);
+	}
+};
+
+// Adds a DescriptorAllocator as "descriptorAllocator". StandardMultiFrameLoop resets its frame sets as frame
+// slots come back around.
+export struct DescriptorAllocatorStage {
+	DescriptorAllocatorStage() : ratios_{
+			DescriptorPoolRatio{ vk::DescriptorType::eUniformBuffer, 2.0f },
+			DescriptorPoolRatio{ vk::DescriptorType::eCombinedImageSampler, 2.0f },
+			DescriptorPoolRatio{ vk::DescriptorType::eStorageBuffer, 1.0f }
+		} {}
+	DescriptorAllocatorStage(std::vector<DescriptorPoolRatio> ratios) : ratios_(ratios) {}
+
+	std::vector<DescriptorPoolRatio> ratios_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	requires RowType::has_named_field<Row, BOOST_HANA_STRING("device"), vk::Device>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+
+		auto allocator = std::make_shared<DescriptorAllocator>(device, ratios_);
+		auto rWithAllocator = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("descriptorAllocator"), allocator));
+		return f.applyRow(rWithAllocator);
+	}
+};
+
+}
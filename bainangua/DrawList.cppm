@@ -0,0 +1,300 @@
+/**
+* A draw list: instead of binding and drawing as they go, callers push draw packets tagged with a 64-bit sort key.
+* record() sorts the packets by key and replays them into a command buffer, only binding a pipeline, descriptor
+* set, vertex buffer or index buffer when it differs from what's already bound.
+*
+* The key decides how much binding gets skipped. From the top bit down it holds:
+*
+*   - the pass (4 bits), so e.g. opaque geometry is drawn before transparent,
+*   - the pipeline (12 bits), the most expensive thing to switch,
+*   - the material (20 bits), usually one descriptor set,
+*   - the view depth (28 bits), front to back to help early depth rejection, or back to front for blending.
+*
+* Pipeline and material numbers are whatever small ids the caller hands out; the packet itself carries the real
+* handles. record() returns how many of each bind it made, so the effect of a sort order can be measured per frame.
+*/
+module;
+
+#include "bainangua.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ranges>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+export module DrawList;
+
+namespace bainangua {
+
+export
+enum class DepthOrder { FrontToBack, BackToFront };
+
+export
+struct SortKeyLayout {
+	static constexpr unsigned PassBits = 4;
+	static constexpr unsigned PipelineBits = 12;
+	static constexpr unsigned MaterialBits = 20;
+	static constexpr unsigned DepthBits = 28;
+
+	static constexpr unsigned DepthShift = 0;
+	static constexpr unsigned MaterialShift = DepthShift + DepthBits;
+	static constexpr unsigned PipelineShift = MaterialShift + MaterialBits;
+	static constexpr unsigned PassShift = PipelineShift + PipelineBits;
+	static_assert(PassShift + PassBits == 64);
+};
+
+// Ids wider than their field get truncated. Depth is the distance along the view direction; negative values sort
+// as zero.
+export
+constexpr uint64_t makeSortKey(uint32_t pass, uint32_t pipeline, uint32_t material, float viewDepth, DepthOrder order = DepthOrder::FrontToBack) {
+	using L = SortKeyLayout;
+	constexpr uint32_t depthMask = (1u << L::DepthBits) - 1;
+
+	// non-negative floats sort the same way as their bit patterns; dropping the low mantissa bits keeps the order
+	uint32_t depth = std::bit_cast<uint32_t>(viewDepth > 0.0f ? viewDepth : 0.0f) >> (31 - L::DepthBits);
+	if (order == DepthOrder::BackToFront) {
+		depth = depthMask - depth;
+	}
+
+	return (uint64_t(pass & ((1u << L::PassBits) - 1)) << L::PassShift)
+		| (uint64_t(pipeline & ((1u << L::PipelineBits) - 1)) << L::PipelineShift)
+		| (uint64_t(material & ((1u << L::MaterialBits) - 1)) << L::MaterialShift)
+		| (uint64_t(depth & depthMask) << L::DepthShift);
+}
+
+export
+struct DrawSortEntry {
+	uint64_t key;
+	uint32_t index;
+};
+
+// A stable LSD radix sort on the keys, a byte at a time. Bytes that are the same in every key (the pass, usually,
+// and any unused id bits) are skipped. scratch gets resized to match; the sorted result ends up in entries.
+export
+void radixSortDrawKeys(std::vector<DrawSortEntry>& entries, std::vector<DrawSortEntry>& scratch) {
+	if (entries.size() < 2) {
+		return;
+	}
+	scratch.resize(entries.size());
+
+	// one pass over the data fills in the histograms for all eight bytes
+	std::array<std::array<uint32_t, 256>, 8> counts{};
+	for (const DrawSortEntry& entry : entries) {
+		for (unsigned byte = 0; byte < 8; byte++) {
+			counts[byte][(entry.key >> (byte * 8)) & 0xff]++;
+		}
+	}
+
+	for (unsigned byte = 0; byte < 8; byte++) {
+		std::array<uint32_t, 256>& count = counts[byte];
+		if (count[(entries[0].key >> (byte * 8)) & 0xff] == entries.size()) {
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (uint32_t& bucket : count) {
+			uint32_t size = bucket;
+			bucket = offset;
+			offset += size;
+		}
+		for (const DrawSortEntry& entry : entries) {
+			scratch[count[(entry.key >> (byte * 8)) & 0xff]++] = entry;
+		}
+		entries.swap(scratch);
+	}
+}
+
+export
+struct DrawPacket {
+	static constexpr uint32_t MaxDescriptorSets = 4; // the minimum maxBoundDescriptorSets
+	static constexpr uint32_t MaxVertexBuffers = 4;
+
+	uint64_t sortKey;
+
+	vk::Pipeline pipeline;
+	vk::PipelineLayout layout;
+
+	// bound starting at set 0
+	std::array<vk::DescriptorSet, MaxDescriptorSets> descriptorSets{};
+	uint32_t descriptorSetCount{ 0 };
+
+	// bound starting at binding 0
+	std::array<vk::Buffer, MaxVertexBuffers> vertexBuffers{};
+	std::array<vk::DeviceSize, MaxVertexBuffers> vertexBufferOffsets{};
+	uint32_t vertexBufferCount{ 0 };
+
+	vk::Buffer indexBuffer;
+	vk::DeviceSize indexBufferOffset{ 0 };
+	vk::IndexType indexType{ vk::IndexType::eUint32 };
+
+	uint32_t indexCount{ 0 };
+	uint32_t instanceCount{ 1 };
+	uint32_t firstIndex{ 0 };
+	int32_t vertexOffset{ 0 };
+	uint32_t firstInstance{ 0 };
+
+	// which stages see the push constants given to DrawList::add, if any
+	vk::ShaderStageFlags pushConstantStages{};
+};
+
+export
+struct DrawListStats {
+	uint32_t draws{ 0 };
+	uint32_t pipelineBinds{ 0 };
+	uint32_t descriptorSetBinds{ 0 };
+	uint32_t vertexBufferBinds{ 0 };
+	uint32_t indexBufferBinds{ 0 };
+	uint32_t pushConstantUpdates{ 0 };
+
+	// binds that drawing every packet on its own would have needed, but were already in place
+	uint32_t skippedBinds{ 0 };
+};
+
+export
+class DrawList {
+public:
+	// Starts a new frame's list. Keeps the allocations around.
+	void clear() {
+		packets_.clear();
+		pushRanges_.clear();
+		pushData_.clear();
+		entries_.clear();
+	}
+
+	void add(const DrawPacket& packet) {
+		add(packet, std::span<const std::byte>());
+	}
+
+	// The push constants are copied in and pushed (at offset 0) right before this packet's draw.
+	void add(const DrawPacket& packet, std::span<const std::byte> pushConstants) {
+		entries_.push_back(DrawSortEntry{ packet.sortKey, static_cast<uint32_t>(packets_.size()) });
+		packets_.push_back(packet);
+		pushRanges_.push_back(PushRange{ static_cast<uint32_t>(pushData_.size()), static_cast<uint32_t>(pushConstants.size()) });
+		pushData_.insert(pushData_.end(), pushConstants.begin(), pushConstants.end());
+	}
+
+	// One struct's worth of push constants, copied as raw bytes. Containers don't qualify; pass their bytes as a span.
+	template <typename PushConstants>
+		requires std::is_trivially_copyable_v<PushConstants> && (!std::ranges::range<PushConstants>)
+	void add(const DrawPacket& packet, const PushConstants& pushConstants) {
+		add(packet, std::as_bytes(std::span(&pushConstants, 1)));
+	}
+
+	size_t size() const { return packets_.size(); }
+
+	// Sorts the list and records it. CommandBuffer is normally vk::CommandBuffer; anything with the same bind and
+	// draw calls will do. The list stays as it is, so it can be recorded again.
+	template <typename CommandBuffer>
+	DrawListStats record(CommandBuffer cmd) {
+		radixSortDrawKeys(entries_, scratch_);
+
+		DrawListStats stats;
+		vk::Pipeline boundPipeline;
+		vk::PipelineLayout boundLayout;
+		std::array<vk::DescriptorSet, DrawPacket::MaxDescriptorSets> boundSets{};
+		uint32_t boundSetCount = 0;
+		std::array<vk::Buffer, DrawPacket::MaxVertexBuffers> boundVertexBuffers{};
+		std::array<vk::DeviceSize, DrawPacket::MaxVertexBuffers> boundVertexOffsets{};
+		uint32_t boundVertexCount = 0;
+		vk::Buffer boundIndexBuffer;
+		vk::DeviceSize boundIndexOffset = 0;
+		vk::IndexType boundIndexType = vk::IndexType::eUint32;
+
+		for (const DrawSortEntry& entry : entries_) {
+			const DrawPacket& packet = packets_[entry.index];
+
+			if (packet.pipeline != boundPipeline) {
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, packet.pipeline);
+				boundPipeline = packet.pipeline;
+				stats.pipelineBinds++;
+			}
+			else {
+				stats.skippedBinds++;
+			}
+
+			// sets bound through a different layout might not be compatible, so start over
+			if (packet.layout != boundLayout) {
+				boundLayout = packet.layout;
+				boundSetCount = 0;
+			}
+			uint32_t firstSet = 0;
+			while (firstSet < packet.descriptorSetCount && firstSet < boundSetCount && boundSets[firstSet] == packet.descriptorSets[firstSet]) {
+				firstSet++;
+			}
+			if (firstSet < packet.descriptorSetCount) {
+				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, packet.layout, firstSet, packet.descriptorSetCount - firstSet, &packet.descriptorSets[firstSet], 0, nullptr);
+				std::copy(packet.descriptorSets.begin() + firstSet, packet.descriptorSets.begin() + packet.descriptorSetCount, boundSets.begin() + firstSet);
+				boundSetCount = std::max(boundSetCount, packet.descriptorSetCount);
+				stats.descriptorSetBinds++;
+			}
+			else if (packet.descriptorSetCount > 0) {
+				stats.skippedBinds++;
+			}
+
+			uint32_t firstVertexBuffer = 0;
+			while (firstVertexBuffer < packet.vertexBufferCount && firstVertexBuffer < boundVertexCount
+				&& boundVertexBuffers[firstVertexBuffer] == packet.vertexBuffers[firstVertexBuffer]
+				&& boundVertexOffsets[firstVertexBuffer] == packet.vertexBufferOffsets[firstVertexBuffer]) {
+				firstVertexBuffer++;
+			}
+			if (firstVertexBuffer < packet.vertexBufferCount) {
+				uint32_t count = packet.vertexBufferCount - firstVertexBuffer;
+				cmd.bindVertexBuffers(firstVertexBuffer, count, &packet.vertexBuffers[firstVertexBuffer], &packet.vertexBufferOffsets[firstVertexBuffer]);
+				std::copy_n(packet.vertexBuffers.begin() + firstVertexBuffer, count, boundVertexBuffers.begin() + firstVertexBuffer);
+				std::copy_n(packet.vertexBufferOffsets.begin() + firstVertexBuffer, count, boundVertexOffsets.begin() + firstVertexBuffer);
+				boundVertexCount = std::max(boundVertexCount, packet.vertexBufferCount);
+				stats.vertexBufferBinds++;
+			}
+			else if (packet.vertexBufferCount > 0) {
+				stats.skippedBinds++;
+			}
+
+			if (packet.indexBuffer != boundIndexBuffer || packet.indexBufferOffset != boundIndexOffset || packet.indexType != boundIndexType) {
+				cmd.bindIndexBuffer(packet.indexBuffer, packet.indexBufferOffset, packet.indexType);
+				boundIndexBuffer = packet.indexBuffer;
+				boundIndexOffset = packet.indexBufferOffset;
+				boundIndexType = packet.indexType;
+				stats.indexBufferBinds++;
+			}
+			else {
+				stats.skippedBinds++;
+			}
+
+			const PushRange& push = pushRanges_[entry.index];
+			if (push.size > 0) {
+				cmd.pushConstants(packet.layout, packet.pushConstantStages, 0, push.size, pushData_.data() + push.offset);
+				stats.pushConstantUpdates++;
+			}
+
+			cmd.drawIndexed(packet.indexCount, packet.instanceCount, packet.firstIndex, packet.vertexOffset, packet.firstInstance);
+			stats.draws++;
+		}
+
+		lastStats_ = stats;
+		return stats;
+	}
+
+	// what the last record() did
+	const DrawListStats& lastStats() const { return lastStats_; }
+
+private:
+	struct PushRange {
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	std::vector<DrawPacket> packets_;
+	std::vector<PushRange> pushRanges_;
+	std::vector<std::byte> pushData_;
+	std::vector<DrawSortEntry> entries_;
+	std::vector<DrawSortEntry> scratch_;
+	DrawListStats lastStats_;
+};
+
+}
@@ -0,0 +1,417 @@
+//
+// GPU timing using timestamp queries. Each frame in flight gets its own query pool. Results for a frame slot are
+// read back the next time that slot comes around, after its fence has been waited on, so reading them never stalls.
+//
+// Queries are handed out in ranges, one per command buffer, and each range is reset inside the command buffer that
+// uses it, at that buffer's first scope (which therefore has to be outside a render pass). Several command buffers
+// can be timed in the same frame, recorded on different threads, without one's reset wiping another's queries.
+//
+// Upload command buffers don't belong to a frame. They take their ranges from a separate pool and hand them back
+// in finishUpload once their submission has completed; UploadProfiling wraps that up for the upload paths.
+// Timestamp support is checked for the queue family each command buffer is submitted to, since families differ.
+//
+module;
+
+#include "bainangua.hpp"
+#include "RowType.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+export module GPUProfiler;
+
+namespace bainangua {
+
+export
+struct GPUScopeStatistics {
+	double lastMs{ 0.0 };
+	double averageMs{ 0.0 };
+	double minMs{ 0.0 };
+	double maxMs{ 0.0 };
+	uint64_t sampleCount{ 0 };
+};
+
+export
+class GPUProfiler
+{
+public:
+	// queueFamilyIndex is where the frame's command buffers go. Each frame can time up to commandBuffersPerFrame
+	// command buffers, and up to uploadCommandBuffers uploads can be timed at once.
+	GPUProfiler(vk::Device device, vk::PhysicalDevice physicalDevice, uint32_t queueFamilyIndex, uint32_t framesInFlight, uint32_t maxScopesPerCommandBuffer,
+				uint32_t commandBuffersPerFrame = 4, uint32_t uploadCommandBuffers = 16)
+		: device_(device), queueFamilyIndex_(queueFamilyIndex), scopesPerRange_(maxScopesPerCommandBuffer), rangesPerFrame_(commandBuffersPerFrame)
+	{
+		vk::PhysicalDeviceProperties properties = physicalDevice.getProperties();
+		timestampPeriodNs_ = properties.limits.timestampPeriod;
+		for (const vk::QueueFamilyProperties& family : physicalDevice.getQueueFamilyProperties()) {
+			uint32_t validBits = family.timestampValidBits;
+			timestampMasks_.push_back((validBits >= 64) ? ~uint64_t(0) : ((uint64_t(1) << validBits) - 1));
+		}
+		enabled_ = timestampMask(queueFamilyIndex) != 0;
+
+		if (enabled_) {
+			for (uint32_t ix = 0; ix < framesInFlight; ix++) {
+				vk::QueryPoolCreateInfo poolInfo({}, vk::QueryType::eTimestamp, rangesPerFrame_ * queriesPerRange());
+				frameSlots_.push_back(FrameSlot{ device.createQueryPool(poolInfo) });
+			}
+		}
+		if (std::ranges::any_of(timestampMasks_, [](uint64_t mask) { return mask != 0; })) {
+			vk::QueryPoolCreateInfo poolInfo({}, vk::QueryType::eTimestamp, uploadCommandBuffers * queriesPerRange());
+			uploadPool_ = device.createQueryPool(poolInfo);
+			uploadRanges_.resize(uploadCommandBuffers);
+		}
+	}
+	~GPUProfiler() {
+		std::ranges::for_each(frameSlots_, [&](FrameSlot& slot) { device_.destroyQueryPool(slot.queryPool); });
+		if (uploadPool_) {
+			device_.destroyQueryPool(uploadPool_);
+		}
+	}
+
+	GPUProfiler(const GPUProfiler&) = delete;
+	GPUProfiler& operator=(const GPUProfiler&) = delete;
+
+	// whether the frame's queue family supports timestamps; uploads are checked separately
+	bool enabled() const { return enabled_; }
+
+	// Call once per frame after the fence for this frame slot has been waited on. Collects whatever the slot
+	// recorded last time around.
+	void beginFrame(size_t multiFrameIndex) {
+		if (!enabled_) { return; }
+
+		std::scoped_lock lock(allocation_mutex_);
+		currentSlot_ = multiFrameIndex;
+		FrameSlot& slot = frameSlots_[currentSlot_];
+		collectResults(slot);
+
+		slot.ranges.clear();
+		slot.frameNumber = frameNumber_++;
+	}
+
+	// Instead of beginFrame when the frame submits a command buffer recorded earlier (see CommandBufferCache).
+	// Collects the slot's results the same way, but keeps its scopes, since the replayed commands reset and write
+	// the same queries under the same names.
+	void replayFrame(size_t multiFrameIndex) {
+		if (!enabled_) { return; }
+
+		std::scoped_lock lock(allocation_mutex_);
+		currentSlot_ = multiFrameIndex;
+		FrameSlot& slot = frameSlots_[currentSlot_];
+		collectResults(slot);
+
+		slot.frameNumber = frameNumber_++;
+	}
+
+	// Opens a named scope in one of the frame's command buffers. The first scope in each command buffer also resets
+	// that buffer's queries, so it has to be recorded outside of a render pass. Returns an id to pass to endScope.
+	uint32_t beginScope(vk::CommandBuffer buffer, std::string_view name, vk::PipelineStageFlagBits stage = vk::PipelineStageFlagBits::eTopOfPipe) {
+		if (!enabled_) { return NoScope; }
+
+		std::scoped_lock lock(allocation_mutex_);
+		FrameSlot& slot = frameSlots_[currentSlot_];
+		auto range = std::ranges::find(slot.ranges, buffer, &QueryRange::buffer);
+		if (range == slot.ranges.end()) {
+			if (slot.ranges.size() >= rangesPerFrame_) { return NoScope; }
+			range = slot.ranges.insert(slot.ranges.end(), QueryRange{ buffer, queueFamilyIndex_ });
+			buffer.resetQueryPool(slot.queryPool, rangeStart(slot.ranges.size() - 1), queriesPerRange());
+		}
+		return openScope(buffer, slot.queryPool, *range, static_cast<uint32_t>(range - slot.ranges.begin()), name, stage);
+	}
+
+	// Opens a named scope in an upload command buffer, which may be recorded on any thread and submitted to any
+	// queue family. As with beginScope, the first scope in the buffer resets its queries. Once the buffer's
+	// submission has completed, or failed, call finishUpload.
+	uint32_t beginUploadScope(vk::CommandBuffer buffer, uint32_t queueFamilyIndex, std::string_view name, vk::PipelineStageFlagBits stage = vk::PipelineStageFlagBits::eTopOfPipe) {
+		if (!uploadPool_ || timestampMask(queueFamilyIndex) == 0) { return NoScope; }
+
+		std::scoped_lock lock(allocation_mutex_);
+		auto range = std::ranges::find(uploadRanges_, buffer, &QueryRange::buffer);
+		if (range == uploadRanges_.end()) {
+			range = std::ranges::find(uploadRanges_, vk::CommandBuffer(), &QueryRange::buffer);
+			if (range == uploadRanges_.end()) { return NoScope; } // too many uploads being timed at once
+			*range = QueryRange{ buffer, queueFamilyIndex };
+			buffer.resetQueryPool(uploadPool_, rangeStart(range - uploadRanges_.begin()), queriesPerRange());
+		}
+		uint32_t scopeId = openScope(buffer, uploadPool_, *range, static_cast<uint32_t>(range - uploadRanges_.begin()), name, stage);
+		return (scopeId == NoScope) ? NoScope : (scopeId | UploadScopeBit);
+	}
+
+	void endScope(vk::CommandBuffer buffer, uint32_t scopeId, vk::PipelineStageFlagBits stage = vk::PipelineStageFlagBits::eBottomOfPipe) {
+		if (scopeId == NoScope) { return; }
+
+		vk::QueryPool queryPool;
+		{
+			std::scoped_lock lock(allocation_mutex_);
+			queryPool = (scopeId & UploadScopeBit) ? uploadPool_ : frameSlots_[currentSlot_].queryPool;
+		}
+		buffer.writeTimestamp(stage, queryPool, (scopeId & ~UploadScopeBit) * 2 + 1);
+	}
+
+	// Collects an upload command buffer's timings and hands its queries back for another upload to use.
+	void finishUpload(vk::CommandBuffer buffer) {
+		if (!uploadPool_) { return; }
+
+		std::scoped_lock lock(allocation_mutex_);
+		auto range = std::ranges::find(uploadRanges_, buffer, &QueryRange::buffer);
+		if (range == uploadRanges_.end()) { return; }
+
+		collectRange(uploadPool_, rangeStart(range - uploadRanges_.begin()), *range, frameNumber_, "GPU uploads");
+		*range = QueryRange{};
+	}
+
+	std::map<std::string, GPUScopeStatistics> statistics() const {
+		std::scoped_lock lock(results_mutex_);
+
+		std::map<std::string, GPUScopeStatistics> result;
+		for (const auto& [name, history] : history_) {
+			if (history.samples.empty()) { continue; }
+			GPUScopeStatistics stats;
+			stats.lastMs = history.samples.back();
+			stats.minMs = *std::ranges::min_element(history.samples);
+			stats.maxMs = *std::ranges::max_element(history.samples);
+			double total = 0.0;
+			for (double sample : history.samples) { total += sample; }
+			stats.averageMs = total / static_cast<double>(history.samples.size());
+			stats.sampleCount = history.sampleCount;
+			result[name] = stats;
+		}
+		return result;
+	}
+
+	// Writes the recent events as a Chrome trace-event file, viewable in chrome://tracing or Perfetto.
+	bng_expected<void> writeChromeTrace(std::filesystem::path tracePath) const {
+		std::ofstream out(tracePath, std::ios_base::out | std::ios_base::trunc);
+		if (!out) {
+			return bng_unexpected(std::format("GPUProfiler: could not open trace file {}", tracePath.string()));
+		}
+
+		std::scoped_lock lock(results_mutex_);
+		out << "{\"traceEvents\":[";
+		bool first = true;
+		for (const TraceEvent& e : traceEvents_) {
+			out << std::format("{}{{\"name\":\"{}\",\"cat\":\"gpu\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":1,\"tid\":\"{}\",\"args\":{{\"frame\":{}}}}}",
+				first ? "" : ",\n", tracing::jsonEscaped(e.name), e.startUs, e.durationUs, e.track, e.frameNumber);
+			first = false;
+		}
+		out << "],\"displayTimeUnit\":\"ms\"}\n";
+		return {};
+	}
+
+	static constexpr uint32_t NoScope = ~uint32_t(0);
+	static constexpr size_t StatisticsWindow = 120;
+	static constexpr size_t MaxTraceEvents = 16384;
+
+private:
+	// the queries of one command buffer
+	struct QueryRange {
+		vk::CommandBuffer buffer;
+		uint32_t queueFamilyIndex{ 0 };
+		std::vector<std::string> scopes;
+	};
+
+	struct FrameSlot {
+		vk::QueryPool queryPool;
+		std::vector<QueryRange> ranges;
+		uint64_t frameNumber{ 0 };
+	};
+
+	struct ScopeHistory {
+		std::deque<double> samples;
+		uint64_t sampleCount{ 0 };
+	};
+
+	struct TraceEvent {
+		std::string name;
+		const char* track;
+		uint64_t frameNumber;
+		double startUs;
+		double durationUs;
+	};
+
+	// marks scope ids that live in the upload pool
+	static constexpr uint32_t UploadScopeBit = uint32_t(1) << 31;
+
+	uint32_t queriesPerRange() const { return scopesPerRange_ * 2; }
+	uint32_t rangeStart(size_t rangeIndex) const { return static_cast<uint32_t>(rangeIndex) * queriesPerRange(); }
+
+	uint64_t timestampMask(uint32_t queueFamilyIndex) const {
+		return (queueFamilyIndex < timestampMasks_.size()) ? timestampMasks_[queueFamilyIndex] : 0;
+	}
+
+	uint32_t openScope(vk::CommandBuffer buffer, vk::QueryPool queryPool, QueryRange& range, uint32_t rangeIndex, std::string_view name, vk::PipelineStageFlagBits stage) {
+		if (range.scopes.size() >= scopesPerRange_) { return NoScope; }
+
+		uint32_t scopeId = rangeIndex * scopesPerRange_ + static_cast<uint32_t>(range.scopes.size());
+		range.scopes.push_back(std::string(name));
+		buffer.writeTimestamp(stage, queryPool, scopeId * 2);
+		return scopeId;
+	}
+
+	void collectResults(const FrameSlot& slot) {
+		for (size_t rangeIndex = 0; rangeIndex < slot.ranges.size(); rangeIndex++) {
+			collectRange(slot.queryPool, rangeStart(rangeIndex), slot.ranges[rangeIndex], slot.frameNumber, "GPU");
+		}
+	}
+
+	void collectRange(vk::QueryPool queryPool, uint32_t firstQuery, const QueryRange& range, uint64_t frameNumber, const char* track) {
+		if (range.scopes.empty()) { return; }
+
+		// pairs of (timestamp, availability) for each query
+		uint32_t queryCount = static_cast<uint32_t>(range.scopes.size() * 2);
+		std::vector<uint64_t> data(queryCount * 2);
+		vk::Result result = device_.getQueryPoolResults(
+			queryPool, firstQuery, queryCount,
+			data.size() * sizeof(uint64_t), data.data(), 2 * sizeof(uint64_t),
+			vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+		if (result != vk::Result::eSuccess && result != vk::Result::eNotReady) {
+			return;
+		}
+
+		uint64_t timestampMask = this->timestampMask(range.queueFamilyIndex);
+		std::scoped_lock lock(results_mutex_);
+		for (size_t scopeId = 0; scopeId < range.scopes.size(); scopeId++) {
+			const uint64_t* beginQuery = &data[scopeId * 4];
+			const uint64_t* endQuery = &data[scopeId * 4 + 2];
+			if (beginQuery[1] == 0 || endQuery[1] == 0) {
+				continue; // scope was never closed, or its command buffer went to another submission that isn't done
+			}
+			uint64_t beginTicks = beginQuery[0] & timestampMask;
+			uint64_t endTicks = endQuery[0] & timestampMask;
+			if (!firstTimestamp_.has_value()) {
+				firstTimestamp_ = beginTicks;
+			}
+
+			double durationMs = static_cast<double>((endTicks - beginTicks) & timestampMask) * timestampPeriodNs_ / 1.0e6;
+			double startUs = static_cast<double>((beginTicks - firstTimestamp_.value()) & timestampMask) * timestampPeriodNs_ / 1.0e3;
+
+			ScopeHistory& history = history_[range.scopes[scopeId]];
+			history.samples.push_back(durationMs);
+			history.sampleCount++;
+			if (history.samples.size() > StatisticsWindow) {
+				history.samples.pop_front();
+			}
+
+			traceEvents_.push_back(TraceEvent{ range.scopes[scopeId], track, frameNumber, startUs, durationMs * 1.0e3 });
+			if (traceEvents_.size() > MaxTraceEvents) {
+				traceEvents_.pop_front();
+			}
+		}
+	}
+
+	vk::Device device_;
+	uint32_t queueFamilyIndex_;
+	uint32_t scopesPerRange_;
+	uint32_t rangesPerFrame_;
+	bool enabled_{ false };
+	float timestampPeriodNs_{ 1.0f };
+	std::vector<uint64_t> timestampMasks_; // per queue family, zero where timestamps aren't supported
+
+	// guards the frame slots and upload ranges, since scopes can be opened from several threads
+	mutable std::mutex allocation_mutex_;
+	std::vector<FrameSlot> frameSlots_;
+	size_t currentSlot_{ 0 };
+	uint64_t frameNumber_{ 0 };
+	vk::QueryPool uploadPool_;
+	std::vector<QueryRange> uploadRanges_;
+
+	mutable std::mutex results_mutex_;
+	std::optional<uint64_t> firstTimestamp_;
+	std::map<std::string, ScopeHistory> history_;
+	std::deque<TraceEvent> traceEvents_;
+};
+
+// Where an upload reports its timing: the profiler (empty for none) and the queue family its command buffer is
+// submitted to. Upload helpers take one of these and cost nothing when there's no profiler.
+export
+struct UploadProfiling {
+	std::shared_ptr<GPUProfiler> profiler;
+	uint32_t queueFamilyIndex{ 0 };
+
+	uint32_t beginScope(vk::CommandBuffer buffer, std::string_view name) const {
+		return profiler ? profiler->beginUploadScope(buffer, queueFamilyIndex, name) : GPUProfiler::NoScope;
+	}
+	void endScope(vk::CommandBuffer buffer, uint32_t scopeId) const {
+		if (profiler) { profiler->endScope(buffer, scopeId); }
+	}
+	// call once the command buffer's submission is done, whether or not it succeeded
+	void finish(vk::CommandBuffer buffer) const {
+		if (profiler) { profiler->finishUpload(buffer); }
+	}
+};
+
+// Helpers for stages that want to time themselves when a profiler is present in the row, and cost nothing when not.
+export
+template <typename Row>
+uint32_t beginProfileScope(const Row& r, vk::CommandBuffer buffer, std::string_view name) {
+	if constexpr (RowType::has_field<Row>(BOOST_HANA_STRING("gpuProfiler"))) {
+		std::shared_ptr<GPUProfiler> profiler = boost::hana::at_key(r, BOOST_HANA_STRING("gpuProfiler"));
+		return profiler->beginScope(buffer, name);
+	}
+	else {
+		return GPUProfiler::NoScope;
+	}
+}
+
+export
+template <typename Row>
+void endProfileScope(const Row& r, vk::CommandBuffer buffer, uint32_t scopeId) {
+	if constexpr (RowType::has_field<Row>(BOOST_HANA_STRING("gpuProfiler"))) {
+		std::shared_ptr<GPUProfiler> profiler = boost::hana::at_key(r, BOOST_HANA_STRING("gpuProfiler"));
+		profiler->endScope(buffer, scopeId);
+	}
+}
+
+/**
+* Creates a GPUProfiler with one query pool per frame in flight and one for uploads. The standard frame loop and the
+* rendering stages pick it up from the row if it's there, and so do the ResourceLoaderStage and CreateGeometryArena
+* for their uploads when they come after it. If a trace path is given, a Chrome trace is written when the stage exits.
+*/
+export
+struct GPUProfilerStage {
+	GPUProfilerStage(uint32_t framesInFlight, uint32_t maxScopesPerCommandBuffer = 64) : framesInFlight_(framesInFlight), maxScopesPerCommandBuffer_(maxScopesPerCommandBuffer) {}
+	GPUProfilerStage(uint32_t framesInFlight, std::filesystem::path tracePath, uint32_t maxScopesPerCommandBuffer = 64)
+		: framesInFlight_(framesInFlight), maxScopesPerCommandBuffer_(maxScopesPerCommandBuffer), tracePath_(tracePath) {}
+
+	uint32_t framesInFlight_;
+	uint32_t maxScopesPerCommandBuffer_;
+	std::optional<std::filesystem::path> tracePath_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+		requires   RowType::has_named_field<Row, BOOST_HANA_STRING("device"), vk::Device>
+				&& RowType::has_named_field<Row, BOOST_HANA_STRING("physicalDevice"), vk::PhysicalDevice>
+				&& RowType::has_named_field<Row, BOOST_HANA_STRING("graphicsQueueFamilyIndex"), uint32_t>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+		vk::PhysicalDevice physicalDevice = boost::hana::at_key(r, BOOST_HANA_STRING("physicalDevice"));
+		uint32_t graphicsQueueIndex = boost::hana::at_key(r, BOOST_HANA_STRING("graphicsQueueFamilyIndex"));
+
+		std::shared_ptr<GPUProfiler> profiler = std::make_shared<GPUProfiler>(device, physicalDevice, graphicsQueueIndex, framesInFlight_, maxScopesPerCommandBuffer_);
+
+		auto rWithProfiler = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("gpuProfiler"), profiler));
+		auto result = f.applyRow(rWithProfiler);
+
+		if (tracePath_.has_value()) {
+			// a failed trace write shouldn't turn a successful run into a failure, so the result is ignored
+			(void)profiler->writeChromeTrace(tracePath_.value());
+		}
+
+		return result;
+	}
+};
+
+}
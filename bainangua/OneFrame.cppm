@@ -6,32 +6,155 @@ module;
 #include <coroutine>
 #include <expected.hpp>
 #include <functional>
+#include <memory>
+#include <vector>
 
 export module OneFrame;
 
+import DescriptorSets;
+import GPUProfiler;
 import VulkanContext;
 import PresentationLayer;
 import Pipeline;
 
 namespace bainangua {
 
-export
-tl::expected<std::shared_ptr<PresentationLayer>,vk::Result> drawOneFrame(
+// Throughput pacing polls input at the end of a frame and then waits on the next frame's fence, so input can be
+// stale by the time commands are recorded. LowLatency pacing waits on the fence and acquires the image first, and
+// samples input just before recording.
+export enum class FramePacing {
+	Throughput,
+	LowLatency
+};
+
+// Everything about the swapchain image a frame renders into. The framebuffer is null when the pipeline uses
+// dynamic rendering, since then the presentation layer never builds any.
+export struct FrameTarget {
+	uint32_t imageIndex;
+	vk::Image image;
+	vk::ImageView imageView;
+	vk::Framebuffer framebuffer;
+	vk::Extent2D extent;
+	vk::Format format;
+	uint64_t generation; //< the presentation layer's generation_ when this target was handed out
+};
+
+// Keeps recorded command buffers around so a frame whose commands haven't changed can just be submitted again.
+// There's one buffer per (swapchain image, frame slot) pair: the framebuffer differs per image, and per-frame
+// resources like descriptor sets differ per slot. A buffer is only ever submitted from its own slot, so once that
+// slot's fence has been waited on it can't be pending and is safe to reset.
+//
+// A buffer is re-recorded when the swapchain is rebuilt, when the pipeline changes, or after contentChanged().
+// Call contentChanged() whenever something the recorded commands refer to is replaced, e.g. a vertex buffer
+// that was reallocated or a descriptor set that was rewritten to point somewhere else.
+export class CommandBufferCache {
+public:
+	// commandPool has to allow resetting individual buffers (eResetCommandBuffer)
+	CommandBufferCache(vk::Device device, vk::CommandPool commandPool) : device_(device), commandPool_(commandPool) {}
+	~CommandBufferCache() {
+		for (const Entry& e : entries_) {
+			if (e.buffer) {
+				device_.freeCommandBuffers(commandPool_, e.buffer);
+			}
+		}
+	}
+
+	CommandBufferCache(const CommandBufferCache&) = delete;
+	CommandBufferCache& operator=(const CommandBufferCache&) = delete;
+
+	struct Lookup {
+		vk::CommandBuffer buffer;
+		bool needsRecording; //< if false, buffer already holds this frame's commands
+	};
+
+	// Only call this once the fence for multiFrameIndex has been waited on.
+	Lookup lookup(const FrameTarget& target, size_t multiFrameIndex, const PipelineBundle& pipeline) {
+		size_t index = target.imageIndex * MultiFrameCount + multiFrameIndex;
+		if (index >= entries_.size()) {
+			entries_.resize(index + 1);
+		}
+		Entry& e = entries_[index];
+		if (!e.buffer) {
+			e.buffer = device_.allocateCommandBuffers(vk::CommandBufferAllocateInfo(commandPool_, vk::CommandBufferLevel::ePrimary, 1))[0];
+		}
+
+		Version version{
+			target.generation,
+			pipeline.graphicsPipelines.empty() ? vk::Pipeline() : pipeline.graphicsPipelines[0],
+			pipeline.pipelineLayout,
+			pipeline.renderPass,
+			contentVersion_
+		};
+		if (e.recorded && e.version == version) {
+			return Lookup{ e.buffer, false };
+		}
+
+		e.buffer.reset();
+		e.version = version;
+		e.recorded = true;
+		recordCount_++;
+		return Lookup{ e.buffer, true };
+	}
+
+	void contentChanged() { contentVersion_++; }
+
+	// Something this frame slot's buffers depend on was reset, e.g. the slot's frame descriptor sets: every buffer
+	// for the slot gets re-recorded, except the one for current, which is being recorded right now.
+	void frameSlotReset(size_t multiFrameIndex, const FrameTarget& current) {
+		for (size_t index = multiFrameIndex; index < entries_.size(); index += MultiFrameCount) {
+			if (index != current.imageIndex * MultiFrameCount + multiFrameIndex) {
+				entries_[index].recorded = false;
+			}
+		}
+	}
+
+	size_t recordCount() const { return recordCount_; }
+
+private:
+	// everything a recorded buffer depends on
+	struct Version {
+		uint64_t targetGeneration;
+		vk::Pipeline pipeline;
+		vk::PipelineLayout pipelineLayout;
+		vk::RenderPass renderPass;
+		uint64_t contentVersion;
+
+		bool operator==(const Version&) const = default;
+	};
+
+	struct Entry {
+		vk::CommandBuffer buffer;
+		Version version{};
+		bool recorded{ false };
+	};
+
+	vk::Device device_;
+	vk::CommandPool commandPool_;
+	std::vector<Entry> entries_;
+	uint64_t contentVersion_{ 0 };
+	size_t recordCount_{ 0 };
+};
+
+// The wait/acquire/submit/present part of a frame. recordFrame fills in a command buffer for the target and
+// returns it, and that's what gets submitted.
+tl::expected<std::shared_ptr<PresentationLayer>, vk::Result> presentOneFrame(
 	vk::Device device,
 	vk::Queue graphicsQueue,
 	vk::Queue presentQueue,
-	std::shared_ptr<PresentationLayer> presenterptr, 
-	const PipelineBundle& pipeline, 
-	vk::CommandBuffer buffer, 
-	size_t multiFrameIndex, 
-	std::function<void(vk::CommandBuffer, vk::Framebuffer)> drawCommands)
+	std::shared_ptr<PresentationLayer> presenterptr,
+	const PipelineBundle& pipeline,
+	size_t multiFrameIndex,
+	const std::function<vk::CommandBuffer(const FrameTarget&)>& recordFrame,
+	const std::function<void()>& beforeRecord)
 {
 	uint32_t retryLimit = 100;
 
 	// This is called from two different places.
 	auto rebuildPresenter = [&]() {
 			presenterptr = presenterptr->rebuildSwapChain();
-			presenterptr->connectRenderPass(pipeline.renderPass);
+			if (pipeline.renderPass) {
+				presenterptr->connectRenderPass(pipeline.renderPass);
+			}
 		};
 
 	while (retryLimit > 0) {
@@ -42,23 +165,40 @@ tl::expected<std::shared_ptr<PresentationLayer>,vk::Result> drawOneFrame(
 		{
 			return tl::make_unexpected(waitResult);
 		}
+		// everything this frame slot submitted earlier is done, which may free up a retired swapchain
+		presenterptr->frameSlotCompleted(multiFrameIndex);
 
 		// we don't use the "enhanced" version of acquireNextImageKHR since it throws on an OutOfDateKHR result
 		uint32_t imageIndex = 0;
 		vk::Result acquireResult = device.acquireNextImageKHR(presenterptr->swapChain_, UINT64_MAX, presenterptr->imageAvailableSemaphores_[multiFrameIndex], VK_NULL_HANDLE, &imageIndex);
-		if (acquireResult == vk::Result::eErrorOutOfDateKHR || acquireResult == vk::Result::eSuboptimalKHR /* || s.windowResized*/) {
-			//s.windowResized = false;
+		if (acquireResult == vk::Result::eErrorOutOfDateKHR) {
 			rebuildPresenter();
 			continue; // retry and rebuild swapchain
 		}
-		else if (acquireResult != vk::Result::eSuccess) {
+		else if (acquireResult != vk::Result::eSuccess && acquireResult != vk::Result::eSuboptimalKHR) {
 			return tl::make_unexpected(acquireResult);
 		}
+		// A suboptimal image is still acquired and its semaphore will be signaled, so draw and present it
+		// and rebuild afterwards.
+		bool rebuildAfterPresent = (acquireResult == vk::Result::eSuboptimalKHR);
 
 		device.resetFences(presenterptr->inFlightFences_[multiFrameIndex]);
 
-		buffer.reset();
-		drawCommands(buffer, presenterptr->swapChainFramebuffers_[imageIndex]);
+		if (beforeRecord) {
+			beforeRecord();
+		}
+
+		FrameTarget target{
+			imageIndex,
+			presenterptr->swapChainImages_[imageIndex],
+			presenterptr->swapChainImageViews_[imageIndex],
+			(imageIndex < presenterptr->swapChainFramebuffers_.size()) ? presenterptr->swapChainFramebuffers_[imageIndex] : vk::Framebuffer(),
+			presenterptr->swapChainExtent2D_,
+			presenterptr->swapChainFormat_,
+			presenterptr->generation_
+		};
+
+		vk::CommandBuffer buffer = recordFrame(target);
 
 		vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
 		vk::SubmitInfo submitInfo(presenterptr->imageAvailableSemaphores_[multiFrameIndex], waitStages, buffer, presenterptr->renderFinishedSemaphores_[multiFrameIndex]);
@@ -75,9 +215,16 @@ tl::expected<std::shared_ptr<PresentationLayer>,vk::Result> drawOneFrame(
 			rebuildPresenter();
 			continue; // retry the wait/acquire
 		}
+		else if (presentResult == vk::Result::eSuboptimalKHR) {
+			rebuildAfterPresent = true;
+		}
 		else if (presentResult != vk::Result::eSuccess) {
 			return tl::make_unexpected(presentResult);
 		}
+
+		if (rebuildAfterPresent) {
+			rebuildPresenter();
+		}
 		break; // don't retry
 	}
 
@@ -89,12 +236,80 @@ tl::expected<std::shared_ptr<PresentationLayer>,vk::Result> drawOneFrame(
 	return presenterptr;
 }
 
+export
+tl::expected<std::shared_ptr<PresentationLayer>,vk::Result> drawOneFrame(
+	vk::Device device,
+	vk::Queue graphicsQueue,
+	vk::Queue presentQueue,
+	std::shared_ptr<PresentationLayer> presenterptr, 
+	const PipelineBundle& pipeline, 
+	vk::CommandBuffer buffer, 
+	size_t multiFrameIndex, 
+	std::function<void(vk::CommandBuffer, const FrameTarget&)> drawCommands,
+	std::function<void()> beforeRecord = {})
+{
+	return presentOneFrame(device, graphicsQueue, presentQueue, presenterptr, pipeline, multiFrameIndex,
+		[&](const FrameTarget& target) {
+			buffer.reset();
+			drawCommands(buffer, target);
+			return buffer;
+		},
+		beforeRecord);
+}
+
+// Like drawOneFrame, but the commands come from a CommandBufferCache. frameCommands is called every frame so it
+// can still do per-frame work like updating uniform buffers; it should only record into the buffer when
+// recordCommands is true; otherwise the buffer already holds commands that are still good.
+export
+tl::expected<std::shared_ptr<PresentationLayer>, vk::Result> drawOneFrameCached(
+	vk::Device device,
+	vk::Queue graphicsQueue,
+	vk::Queue presentQueue,
+	std::shared_ptr<PresentationLayer> presenterptr,
+	const PipelineBundle& pipeline,
+	CommandBufferCache& cache,
+	size_t multiFrameIndex,
+	std::function<void(vk::CommandBuffer, const FrameTarget&, bool recordCommands)> frameCommands,
+	std::function<void()> beforeRecord = {})
+{
+	return presentOneFrame(device, graphicsQueue, presentQueue, presenterptr, pipeline, multiFrameIndex,
+		[&](const FrameTarget& target) {
+			CommandBufferCache::Lookup lookup = cache.lookup(target, multiFrameIndex, pipeline);
+			frameCommands(lookup.buffer, target, lookup.needsRecording);
+			return lookup.buffer;
+		},
+		beforeRecord);
+}
+
+// Adds a CommandBufferCache as "commandBufferCache". StandardMultiFrameLoop picks it up and only re-records a
+// frame's commands when they go stale.
+export struct CommandBufferCacheStage {
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	requires   RowType::has_named_field<Row, BOOST_HANA_STRING("device"), vk::Device>
+			&& RowType::has_named_field<Row, BOOST_HANA_STRING("commandPool"), vk::CommandPool>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row&& r) {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+		vk::CommandPool commandPool = boost::hana::at_key(r, BOOST_HANA_STRING("commandPool"));
+
+		auto cache = std::make_shared<CommandBufferCache>(device, commandPool);
+		return f.applyRow(boost::hana::insert(std::forward<Row>(r), boost::hana::make_pair(BOOST_HANA_STRING("commandBufferCache"), cache)));
+	}
+};
+
 export
 struct StandardMultiFrameLoop {
 	StandardMultiFrameLoop() = default;
 	StandardMultiFrameLoop(size_t autoClose) : autoClose_(autoClose) {}
+	StandardMultiFrameLoop(FramePacing pacing) : pacing_(pacing) {}
+	StandardMultiFrameLoop(size_t autoClose, FramePacing pacing) : autoClose_(autoClose), pacing_(pacing) {}
 
 	std::optional<size_t> autoClose_; //< If present, then automatically close after this many frames.
+	FramePacing pacing_{ FramePacing::Throughput };
 
 	using row_tag = RowType::RowWrapperTag;
 
@@ -108,36 +323,96 @@ struct StandardMultiFrameLoop {
 		vk::Queue presentQueue = boost::hana::at_key(r, BOOST_HANA_STRING("presentQueue"));
 		GLFWwindow* glfwWindow = boost::hana::at_key(r, BOOST_HANA_STRING("glfwWindow"));
 		std::shared_ptr<bainangua::PresentationLayer> presenterptr = boost::hana::at_key(r, BOOST_HANA_STRING("presenterptr"));
-		bainangua::PipelineBundle pipeline = boost::hana::at_key(r, BOOST_HANA_STRING("pipelineBundle"));
 
 		std::coroutine_handle<> endOfFrame = boost::hana::at_key(r, BOOST_HANA_STRING("endOfFrameCallback"));
 
+		// The per-frame row is built once, and its per-frame fields are overwritten in place each frame. The frame
+		// wrappers get it by reference, so recording a frame never copies the row or the vectors inside it.
+		auto frameRow = RowType::extendRow(std::move(r),
+			boost::hana::make_pair(BOOST_HANA_STRING("primaryCommandBuffer"), vk::CommandBuffer()),
+			boost::hana::make_pair(BOOST_HANA_STRING("targetFrameBuffer"), vk::Framebuffer()),
+			boost::hana::make_pair(BOOST_HANA_STRING("targetImage"), vk::Image()),
+			boost::hana::make_pair(BOOST_HANA_STRING("targetImageView"), vk::ImageView()),
+			boost::hana::make_pair(BOOST_HANA_STRING("viewportExtent"), presenterptr->swapChainExtent2D_),
+			boost::hana::make_pair(BOOST_HANA_STRING("multiFrameIndex"), size_t(0)),
+			boost::hana::make_pair(BOOST_HANA_STRING("recordCommands"), true)
+		);
 
-		std::vector<vk::CommandBuffer> commandBuffers = boost::hana::at_key(r, BOOST_HANA_STRING("commandBuffers"));
-
+		const bainangua::PipelineBundle& pipeline = boost::hana::at_key(frameRow, BOOST_HANA_STRING("pipelineBundle"));
+		const std::vector<vk::CommandBuffer>& commandBuffers = boost::hana::at_key(frameRow, BOOST_HANA_STRING("commandBuffers"));
 
 		size_t multiFrameIndex = 0;
 
+		const bool lowLatency = (pacing_ == FramePacing::LowLatency);
+		std::function<void()> sampleInput;
+		if (lowLatency) {
+			sampleInput = []() { glfwPollEvents(); };
+		}
+
+		// The row function runs every frame. When the row has a commandBufferCache and this frame's commands are
+		// still good, recordCommands is false and the rendering stages skip recording (and everything inside them),
+		// but per-frame wrappers outside them, like uniform buffer updates, still run.
+		auto frameCommands = [&](vk::CommandBuffer commandBuffer, const FrameTarget& target, bool recordCommands) {
+			boost::hana::at_key(frameRow, BOOST_HANA_STRING("primaryCommandBuffer")) = commandBuffer;
+			boost::hana::at_key(frameRow, BOOST_HANA_STRING("targetFrameBuffer")) = target.framebuffer;
+			boost::hana::at_key(frameRow, BOOST_HANA_STRING("targetImage")) = target.image;
+			boost::hana::at_key(frameRow, BOOST_HANA_STRING("targetImageView")) = target.imageView;
+			boost::hana::at_key(frameRow, BOOST_HANA_STRING("viewportExtent")) = target.extent;
+			boost::hana::at_key(frameRow, BOOST_HANA_STRING("multiFrameIndex")) = multiFrameIndex;
+			boost::hana::at_key(frameRow, BOOST_HANA_STRING("recordCommands")) = recordCommands;
+
+			// This frame slot's fence has been waited on, so its timestamps from last time are ready. A replayed
+			// buffer writes the same queries again, so the profiler keeps the slot's scopes instead of starting over.
+			if constexpr (boost::hana::contains(frameRow, BOOST_HANA_STRING("gpuProfiler"))) {
+				const std::shared_ptr<GPUProfiler>& profiler = boost::hana::at_key(frameRow, BOOST_HANA_STRING("gpuProfiler"));
+				if (recordCommands) {
+					profiler->beginFrame(multiFrameIndex);
+				}
+				else {
+					profiler->replayFrame(multiFrameIndex);
+				}
+			}
+
+			// Likewise the descriptor sets it allocated for that frame are free to go, unless the buffer is replayed
+			// and still uses them. Other cached buffers for this slot might use them too, so those get re-recorded.
+			if constexpr (boost::hana::contains(frameRow, BOOST_HANA_STRING("descriptorAllocator"))) {
+				const std::shared_ptr<DescriptorAllocator>& descriptorAllocator = boost::hana::at_key(frameRow, BOOST_HANA_STRING("descriptorAllocator"));
+				if (recordCommands) {
+					if constexpr (boost::hana::contains(frameRow, BOOST_HANA_STRING("commandBufferCache"))) {
+						if (descriptorAllocator->hasFrameSets(multiFrameIndex)) {
+							const std::shared_ptr<CommandBufferCache>& cache = boost::hana::at_key(frameRow, BOOST_HANA_STRING("commandBufferCache"));
+							cache->frameSlotReset(multiFrameIndex, target);
+						}
+					}
+					descriptorAllocator->beginFrame(multiFrameIndex);
+				}
+			}
+
+			auto drawResult = f.applyRow(frameRow);
+		};
+
+		auto drawFrame = [&]() {
+			if constexpr (boost::hana::contains(frameRow, BOOST_HANA_STRING("commandBufferCache"))) {
+				const std::shared_ptr<CommandBufferCache>& cache = boost::hana::at_key(frameRow, BOOST_HANA_STRING("commandBufferCache"));
+				return bainangua::drawOneFrameCached(device, graphicsQueue, presentQueue, presenterptr, pipeline, *cache, multiFrameIndex, frameCommands, sampleInput);
+			}
+			else {
+				return bainangua::drawOneFrame(device, graphicsQueue, presentQueue, presenterptr, pipeline, commandBuffers[multiFrameIndex], multiFrameIndex, [&](vk::CommandBuffer commandBuffer, const FrameTarget& target) {
+					frameCommands(commandBuffer, target, true);
+				}, sampleInput);
+			}
+		};
+
 		while (!glfwWindowShouldClose(glfwWindow)) {
 
 			tl::expected<std::shared_ptr<bainangua::PresentationLayer>, vk::Result> result =
-				bainangua::drawOneFrame(device, graphicsQueue, presentQueue, presenterptr, pipeline, commandBuffers[multiFrameIndex], multiFrameIndex, [&](vk::CommandBuffer commandBuffer, vk::Framebuffer frameBuffer) {
-					auto newFields = boost::hana::make_map(
-						boost::hana::make_pair(BOOST_HANA_STRING("primaryCommandBuffer"), commandBuffer),
-						boost::hana::make_pair(BOOST_HANA_STRING("targetFrameBuffer"), frameBuffer),
-						boost::hana::make_pair(BOOST_HANA_STRING("viewportExtent"), presenterptr->swapChainExtent2D_),
-						boost::hana::make_pair(BOOST_HANA_STRING("multiFrameIndex"), multiFrameIndex)
-					);
-					auto rWithNewFields = boost::hana::fold_left(r, newFields, boost::hana::insert);
-
-					auto drawResult = f.applyRow(rWithNewFields);
-					/*updateUniformBuffer(presenterptr->swapChainExtent2D_, uniformBuffers[multiFrameIndex]);
-					recordCommandBuffer(commandBuffer, frameBuffer, presenterptr->swapChainExtent2D_, pipeline, vertexBuffer, indexBuffer, descriptorSets[multiFrameIndex]);*/
-				})
+				drawFrame()
 				.and_then([&](std::shared_ptr<bainangua::PresentationLayer> newPresenter) {
 					presenterptr = newPresenter;
 
-					glfwPollEvents();
+					if (!lowLatency) {
+						glfwPollEvents();
+					}
 					endOfFrame();
 					multiFrameIndex = (multiFrameIndex + 1) % bainangua::MultiFrameCount;
 
@@ -155,22 +430,55 @@ struct StandardMultiFrameLoop {
 	}
 };
 
+// Rendering stages check this first. It's false when the row's commandBufferCache already holds this frame's
+// commands, in which case the stage shouldn't touch the command buffer or run what's inside it.
+export
+template <typename Row>
+constexpr bool recordsCommands(const Row& r) {
+	if constexpr (RowType::has_field<Row>(BOOST_HANA_STRING("recordCommands"))) {
+		return boost::hana::at_key(r, BOOST_HANA_STRING("recordCommands"));
+	}
+	else {
+		return true;
+	}
+}
+
+// What BasicRendering and DynamicRendering record ahead of the pass when they aren't given anything else.
+export
+struct NoPrePassCommands {
+	template <typename Row>
+	constexpr void operator()(const Row&, vk::CommandBuffer) const {}
+};
+
+// prePass gets the row and the command buffer once it's begun, before the render pass starts. That's the place for
+// work that isn't allowed inside one, like compute dispatches.
 export
+template <typename PrePass = NoPrePassCommands>
 struct BasicRendering {
+	BasicRendering(PrePass prePass = PrePass()) : prePass_(prePass) {}
+
+	PrePass prePass_;
+
 	using row_tag = RowType::RowWrapperTag;
 
 	template <typename WrappedReturnType>
 	using return_type_transformer = tl::expected<int, std::pmr::string>;
 
 	template <typename RowFunction, typename Row>
-	constexpr tl::expected<int, std::pmr::string> wrapRowFunction(RowFunction f, Row r) {
+	constexpr tl::expected<int, std::pmr::string> wrapRowFunction(RowFunction f, Row&& r) {
+		if (!recordsCommands(r)) {
+			return 0;
+		}
+
 		vk::CommandBuffer buffer = boost::hana::at_key(r, BOOST_HANA_STRING("primaryCommandBuffer"));
 		vk::Framebuffer targetFrameBuffer = boost::hana::at_key(r, BOOST_HANA_STRING("targetFrameBuffer"));
-		bainangua::PipelineBundle pipeline = boost::hana::at_key(r, BOOST_HANA_STRING("pipelineBundle"));
+		const bainangua::PipelineBundle& pipeline = boost::hana::at_key(r, BOOST_HANA_STRING("pipelineBundle"));
 		vk::Extent2D viewportExtent = boost::hana::at_key(r, BOOST_HANA_STRING("viewportExtent"));
 
 		vk::CommandBufferBeginInfo beginInfo({}, {});
 		buffer.begin(beginInfo);
+		uint32_t profileScope = beginProfileScope(r, buffer, "BasicRendering");
+		prePass_(r, buffer);
 
 		std::array<vk::ClearValue, 1> clearColors{ vk::ClearValue() };
 
@@ -201,12 +509,121 @@ struct BasicRendering {
 
 		buffer.endRenderPass();
 
+		endProfileScope(r, buffer, profileScope);
 		buffer.end();
 
 		return 0;
 	}
 };
 
+// The frame stage for pipelines built with CreateDynamicRenderingTarget. The swapchain image is attached directly
+// at beginRendering, with barriers doing the layout transitions a render pass would have done. prePass works as it
+// does for BasicRendering.
+export
+template <typename PrePass = NoPrePassCommands>
+struct DynamicRendering {
+	DynamicRendering(PrePass prePass = PrePass()) : prePass_(prePass) {}
+
+	PrePass prePass_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = tl::expected<int, std::pmr::string>;
+
+	// these are extension functions, so they have to be looked up from the device
+	PFN_vkCmdBeginRenderingKHR beginRendering_{ nullptr };
+	PFN_vkCmdEndRenderingKHR endRendering_{ nullptr };
+
+	template <typename RowFunction, typename Row>
+	constexpr tl::expected<int, std::pmr::string> wrapRowFunction(RowFunction f, Row&& r) {
+		if (!recordsCommands(r)) {
+			return 0;
+		}
+
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+		vk::CommandBuffer buffer = boost::hana::at_key(r, BOOST_HANA_STRING("primaryCommandBuffer"));
+		vk::Image targetImage = boost::hana::at_key(r, BOOST_HANA_STRING("targetImage"));
+		vk::ImageView targetImageView = boost::hana::at_key(r, BOOST_HANA_STRING("targetImageView"));
+		const bainangua::PipelineBundle& pipeline = boost::hana::at_key(r, BOOST_HANA_STRING("pipelineBundle"));
+		vk::Extent2D viewportExtent = boost::hana::at_key(r, BOOST_HANA_STRING("viewportExtent"));
+
+		if (beginRendering_ == nullptr) {
+			beginRendering_ = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(device.getProcAddr("vkCmdBeginRenderingKHR"));
+			endRendering_ = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(device.getProcAddr("vkCmdEndRenderingKHR"));
+			if (beginRendering_ == nullptr || endRendering_ == nullptr) {
+				return tl::make_unexpected(std::pmr::string("DynamicRendering: VK_KHR_dynamic_rendering is not enabled on this device"));
+			}
+		}
+
+		vk::CommandBufferBeginInfo beginInfo({}, {});
+		buffer.begin(beginInfo);
+		uint32_t profileScope = beginProfileScope(r, buffer, "DynamicRendering");
+		prePass_(r, buffer);
+
+		const vk::ImageSubresourceRange colorRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+
+		vk::ImageMemoryBarrier toAttachment(
+			vk::AccessFlags(),
+			vk::AccessFlagBits::eColorAttachmentWrite,
+			vk::ImageLayout::eUndefined,
+			vk::ImageLayout::eColorAttachmentOptimal,
+			VK_QUEUE_FAMILY_IGNORED,
+			VK_QUEUE_FAMILY_IGNORED,
+			targetImage,
+			colorRange
+		);
+		buffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eColorAttachmentOutput, {}, nullptr, nullptr, toAttachment);
+
+		vk::RenderingAttachmentInfoKHR colorAttachment(
+			targetImageView,
+			vk::ImageLayout::eColorAttachmentOptimal,
+			vk::ResolveModeFlagBits::eNone,
+			{},
+			vk::ImageLayout::eUndefined,
+			vk::AttachmentLoadOp::eClear,
+			vk::AttachmentStoreOp::eStore,
+			vk::ClearValue()
+		);
+		vk::RenderingInfoKHR renderingInfo({}, vk::Rect2D({ 0,0 }, viewportExtent), 1, 0, colorAttachment);
+		beginRendering_(buffer, &static_cast<const VkRenderingInfoKHR&>(renderingInfo));
+
+		buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.graphicsPipelines[0]);
+
+		vk::Viewport viewport(
+			0.0f,
+			0.0f,
+			static_cast<float>(viewportExtent.width),
+			static_cast<float>(viewportExtent.height),
+			0.0f,
+			1.0f
+		);
+		buffer.setViewport(0, 1, &viewport);
+
+		vk::Rect2D scissor({ 0,0 }, viewportExtent);
+		buffer.setScissor(0, 1, &scissor);
+
+		f.applyRow(r);
 
+		endRendering_(buffer);
+
+		vk::ImageMemoryBarrier toPresent(
+			vk::AccessFlagBits::eColorAttachmentWrite,
+			vk::AccessFlags(),
+			vk::ImageLayout::eColorAttachmentOptimal,
+			vk::ImageLayout::ePresentSrcKHR,
+			VK_QUEUE_FAMILY_IGNORED,
+			VK_QUEUE_FAMILY_IGNORED,
+			targetImage,
+			colorRange
+		);
+		buffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, nullptr, toPresent);
+
+		endProfileScope(r, buffer, profileScope);
+		buffer.end();
+
+		return 0;
+	}
+};
 
 }
@@ -8,16 +8,19 @@ module;
 #include "RowType.hpp"
 #include "vk_result_to_string.h"
 
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 #include <optional>
 #include <ranges>
+#include <tuple>
 #include <vector>
 
 export module Pipeline;
 
 import PresentationLayer;
 import VertBuffer;
+import VertexBuffer;
 import UniformBuffer;
 import DescriptorSets;
 
@@ -65,9 +68,19 @@ struct PipelineBundle
 	std::optional<vk::DescriptorSetLayout> descriptorLayout;
 };
 
+export
+struct ComputePipelineBundle
+{
+	vk::Pipeline computePipeline;
+	vk::PipelineLayout pipelineLayout;
+	vk::ShaderModule computeShaderModule;
+	std::optional<vk::DescriptorSetLayout> descriptorLayout;
+};
+
 template <typename RowFunction, typename Row>
 concept RowExpectsPipeline = requires (RowFunction f, Row r) {
-	{ f.applyRow(r) } -> std::convertible_to<tl::expected<PipelineBundle, bng_errorobject>>;
+	requires std::convertible_to<decltype(f.applyRow(r)), tl::expected<PipelineBundle, bng_errorobject>>
+		|| std::convertible_to<decltype(f.applyRow(r)), tl::expected<ComputePipelineBundle, bng_errorobject>>;
 };
 
 
@@ -92,7 +105,7 @@ struct CreateShaderModule {
 		vk::ShaderModule shaderModule = createShaderModule(device, shaderCode);
 		
 		auto rWithShader = boost::hana::insert(r,boost::hana::make_pair(ShaderName, shaderModule));
-		tl::expected<PipelineBundle, bng_errorobject> applyResult = f.applyRow(rWithShader);
+		typename RowFunction::return_type applyResult = f.applyRow(rWithShader);
 		if (!applyResult.has_value()) {
 			device.destroyShaderModule(shaderModule);
 		}
@@ -162,6 +175,24 @@ struct CreateBasicRenderPass {
 	}
 };
 
+// The dynamic rendering replacement for CreateBasicRenderPass. Instead of a render pass the pipeline gets built
+// against the swapchain color format, and attachments are supplied later on at beginRendering.
+export
+struct CreateDynamicRenderingTarget {
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		std::shared_ptr<PresentationLayer> presentation = boost::hana::at_key(r, BOOST_HANA_STRING("presenterptr"));
+
+		auto rWithFormat = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("colorAttachmentFormat"), presentation->swapChainFormat_));
+		return f.applyRow(rWithFormat);
+	}
+};
+
 export
 struct CreateDefaultLayout {
 	using row_tag = RowType::RowWrapperTag;
@@ -225,6 +256,87 @@ struct CreateMVPDescriptorLayout {
 	}
 };
 
+// Like CreateMVPDescriptorLayout, but the UBO only holds view/projection and the model matrix and object ID
+// come in through push constants (see PerDrawConstants).
+export
+struct CreatePushConstantMVPLayout {
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+
+		auto layoutResult = createSimpleDescriptorSetLayout(device);
+		if (!layoutResult.has_value()) {
+			return tl::make_unexpected(layoutResult.error());
+		}
+		vk::DescriptorSetLayout layout = layoutResult.value();
+
+		vk::PushConstantRange pushConstantRange = perDrawPushConstantRange();
+		vk::PipelineLayoutCreateInfo pipelineLayoutInfo(
+			vk::PipelineLayoutCreateFlags(),
+			1, &layout, // SetLayouts
+			1, &pushConstantRange // push constants
+		);
+		vk::PipelineLayout pipelineLayout = device.createPipelineLayout(pipelineLayoutInfo);
+
+		auto rWithLayout = boost::hana::insert(
+			boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("layout"), pipelineLayout)),
+			boost::hana::make_pair(BOOST_HANA_STRING("descriptorLayout"), layout)
+		);
+		return f.applyRow(rWithLayout)
+			.or_else([&](bng_errorobject error) {
+				device.destroyDescriptorSetLayout(layout);
+				device.destroyPipelineLayout(pipelineLayout);
+			});
+	}
+};
+
+// Set 0 is the per-frame view/projection UBO and set 1 is the BindlessTable from "bindlessLayout". Per-draw data,
+// including the texture slot, comes in through push constants.
+export
+struct CreateBindlessLayout {
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+		vk::DescriptorSetLayout bindlessLayout = boost::hana::at_key(r, BOOST_HANA_STRING("bindlessLayout"));
+
+		auto layoutResult = createSimpleDescriptorSetLayout(device);
+		if (!layoutResult.has_value()) {
+			return tl::make_unexpected(layoutResult.error());
+		}
+		vk::DescriptorSetLayout layout = layoutResult.value();
+
+		std::array<vk::DescriptorSetLayout, 2> setLayouts{ layout, bindlessLayout };
+		vk::PushConstantRange pushConstantRange = perDrawPushConstantRange();
+		vk::PipelineLayoutCreateInfo pipelineLayoutInfo(
+			vk::PipelineLayoutCreateFlags(),
+			setLayouts, // SetLayouts
+			pushConstantRange // push constants
+		);
+		vk::PipelineLayout pipelineLayout = device.createPipelineLayout(pipelineLayoutInfo);
+
+		// only the UBO layout belongs to the pipeline; the table owns its own
+		auto rWithLayout = boost::hana::insert(
+			boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("layout"), pipelineLayout)),
+			boost::hana::make_pair(BOOST_HANA_STRING("descriptorLayout"), layout)
+		);
+		return f.applyRow(rWithLayout)
+			.or_else([&](bng_errorobject error) {
+				device.destroyDescriptorSetLayout(layout);
+				device.destroyPipelineLayout(pipelineLayout);
+			});
+	}
+};
+
 export
 struct CreateCombinedDescriptorLayout {
 	using row_tag = RowType::RowWrapperTag;
@@ -261,6 +373,11 @@ struct CreateCombinedDescriptorLayout {
 	}
 };
 
+// "vertexInput" holds either one binding and its attributes, or several bindings (from a split vertex layout) and
+// all of their attributes.
+std::vector<vk::VertexInputBindingDescription> vertexInputBindings(const vk::VertexInputBindingDescription& binding) { return { binding }; }
+std::vector<vk::VertexInputBindingDescription> vertexInputBindings(const std::vector<vk::VertexInputBindingDescription>& bindings) { return bindings; }
+
 export
 struct CreateNullVertexInfo {
 	using row_tag = RowType::RowWrapperTag;
@@ -295,6 +412,69 @@ struct CreateVTVertexInfo {
 };
 
 
+// Vertex input for VertexStruct split into streams by VertexStreamLayout. By default every stream gets a binding;
+// give a stream number to build a pipeline that only reads that one, such as the position stream for a depth pass.
+export
+template <typename VertexStruct, typename Split = PositionStreamSplit>
+struct CreateStreamVertexInfo {
+	CreateStreamVertexInfo(std::optional<uint32_t> onlyStream = std::nullopt) : onlyStream_(onlyStream) {}
+
+	std::optional<uint32_t> onlyStream_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		auto layout = reflectStreams<VertexStruct, Split>();
+		if (onlyStream_.has_value()) {
+			auto [binding, attributes] = layout.streamInput(onlyStream_.value());
+			auto vertexInfo = std::make_tuple(std::vector<vk::VertexInputBindingDescription>{ binding }, attributes);
+			return f.applyRow(boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("vertexInput"), vertexInfo)));
+		}
+		return f.applyRow(boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("vertexInput"), layout.vertexInput())));
+	}
+};
+
+// Adds an eInstance-rate binding for InstanceStruct after the per-vertex input, with its attributes deduced by
+// reflectInstanceInput. Goes after whichever stage adds "vertexInput". Without an explicit binding number it takes
+// the first one past the vertex bindings, so it works after a split stream layout as well as a single binding.
+export
+template <typename InstanceStruct>
+struct CreateInstanceInfo {
+	CreateInstanceInfo(std::optional<uint32_t> binding = std::nullopt) : binding_(binding) {}
+
+	std::optional<uint32_t> binding_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		const auto& vertexInput = boost::hana::at_key(r, BOOST_HANA_STRING("vertexInput"));
+
+		// instance attributes start at the first location the vertex attributes don't use
+		uint32_t firstLocation = 0;
+		for (auto& attribute : std::get<1>(vertexInput)) {
+			firstLocation = std::max(firstLocation, attribute.location + 1);
+		}
+
+		uint32_t firstFreeBinding = 0;
+		for (auto& binding : vertexInputBindings(std::get<0>(vertexInput))) {
+			firstFreeBinding = std::max(firstFreeBinding, binding.binding + 1);
+		}
+
+		auto instanceInfo = reflectInstanceInput<InstanceStruct>(binding_.value_or(firstFreeBinding), firstLocation);
+		auto rWithInstanceInput = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("instanceInput"), instanceInfo));
+		return f.applyRow(rWithInstanceInput);
+	}
+};
+
+
 export
 struct CreateTexVertexInfo {
 	using row_tag = RowType::RowWrapperTag;
@@ -327,18 +507,26 @@ struct CreateSimplePipeline {
 	template <typename RowFunction, typename Row>
 	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
 		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
-		vk::RenderPass renderPass = boost::hana::at_key(r, BOOST_HANA_STRING("renderPass"));
 		vk::PipelineLayout pipelineLayout = boost::hana::at_key(r, BOOST_HANA_STRING("layout"));
 		vk::ShaderModule vertexShaderModule = boost::hana::at_key(r, BOOST_HANA_STRING("vertexShader"));
 		vk::ShaderModule fragmentShaderModule = boost::hana::at_key(r, BOOST_HANA_STRING("fragmentShader"));
-		std::tuple<vk::VertexInputBindingDescription, std::vector<vk::VertexInputAttributeDescription>> vertexInput = boost::hana::at_key(r, BOOST_HANA_STRING("vertexInput"));
+		const auto& vertexInput = boost::hana::at_key(r, BOOST_HANA_STRING("vertexInput"));
 
 		vk::PipelineShaderStageCreateInfo shaderStagesInfo[] = {
 			vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, vertexShaderModule, "main"),
 			vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, fragmentShaderModule, "main")
 		};
 		
-		vk::PipelineVertexInputStateCreateInfo vertexInputInfo({},	std::get<0>(vertexInput), std::get<1>(vertexInput));
+		// per-instance data, if there is any, goes in a second binding after the per-vertex one
+		std::vector<vk::VertexInputBindingDescription> vertexBindings = vertexInputBindings(std::get<0>(vertexInput));
+		std::vector<vk::VertexInputAttributeDescription> vertexAttributes = std::get<1>(vertexInput);
+		if constexpr (boost::hana::contains(r, BOOST_HANA_STRING("instanceInput"))) {
+			std::tuple<vk::VertexInputBindingDescription, std::vector<vk::VertexInputAttributeDescription>> instanceInput = boost::hana::at_key(r, BOOST_HANA_STRING("instanceInput"));
+			vertexBindings.push_back(std::get<0>(instanceInput));
+			vertexAttributes.insert(vertexAttributes.end(), std::get<1>(instanceInput).begin(), std::get<1>(instanceInput).end());
+		}
+
+		vk::PipelineVertexInputStateCreateInfo vertexInputInfo({}, vertexBindings, vertexAttributes);
 		
 		vk::PipelineInputAssemblyStateCreateInfo inputAssemblyInfo( {}, vk::PrimitiveTopology::eTriangleList, false /* no restart */);
 
@@ -381,6 +569,18 @@ struct CreateSimplePipeline {
 		vk::DynamicState dynamicStates[] = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
 		vk::PipelineDynamicStateCreateInfo dynamicStateInfo(vk::PipelineDynamicStateCreateFlags(), dynamicStates);
 
+		// either a render pass, or the attachment formats for dynamic rendering
+		vk::RenderPass renderPass;
+		vk::Format colorAttachmentFormat = vk::Format::eUndefined;
+		vk::PipelineRenderingCreateInfoKHR renderingInfo;
+		if constexpr (boost::hana::contains(r, BOOST_HANA_STRING("colorAttachmentFormat"))) {
+			colorAttachmentFormat = boost::hana::at_key(r, BOOST_HANA_STRING("colorAttachmentFormat"));
+			renderingInfo.setColorAttachmentFormats(colorAttachmentFormat);
+		}
+		else {
+			renderPass = boost::hana::at_key(r, BOOST_HANA_STRING("renderPass"));
+		}
+
 		vk::GraphicsPipelineCreateInfo pipelineInfo(
 			vk::PipelineCreateFlags(),
 			shaderStagesInfo,
@@ -398,7 +598,7 @@ struct CreateSimplePipeline {
 			0, // subpass
 			VK_NULL_HANDLE,
 			-1,
-			nullptr
+			renderPass ? nullptr : &renderingInfo
 		);
 		vk::GraphicsPipelineCreateInfo pipelines[] = { pipelineInfo };
 		auto [result, graphicsPipelines] = device.createGraphicsPipelines(VK_NULL_HANDLE, pipelines);
@@ -419,6 +619,64 @@ struct CreateSimplePipeline {
 	}
 };
 
+// The compute counterpart of CreateSimplePipeline: one pipeline from "computeShader" and "layout".
+export
+struct CreateComputePipeline {
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+		vk::PipelineLayout pipelineLayout = boost::hana::at_key(r, BOOST_HANA_STRING("layout"));
+		vk::ShaderModule computeShaderModule = boost::hana::at_key(r, BOOST_HANA_STRING("computeShader"));
+
+		vk::ComputePipelineCreateInfo pipelineInfo(
+			vk::PipelineCreateFlags(),
+			vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, computeShaderModule, "main"),
+			pipelineLayout
+		);
+		vk::ComputePipelineCreateInfo pipelines[] = { pipelineInfo };
+		auto [result, computePipelines] = device.createComputePipelines(VK_NULL_HANDLE, pipelines);
+
+		if (result != vk::Result::eSuccess)
+		{
+			bainangua::bng_errorobject errorMessage;
+			std::format_to(std::back_inserter(errorMessage), "Failure creating compute pipeline: {}", vkResultToString(static_cast<VkResult>(result)));
+			return tl::make_unexpected(errorMessage);
+		}
+
+		auto rWithPipeline = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("pipelines"), computePipelines));
+		bng_expected<ComputePipelineBundle> applyResult = f.applyRow(rWithPipeline);
+		if (!applyResult.has_value()) {
+			std::ranges::for_each(computePipelines, [&](vk::Pipeline p) {device.destroyPipeline(p); });
+		}
+		return applyResult;
+	}
+};
+
+export
+struct AssembleComputePipelineBundle {
+	using row_tag = RowType::RowFunctionTag;
+	using return_type = tl::expected<ComputePipelineBundle, bng_errorobject>;
+
+	template<typename Row>
+	constexpr bng_expected<ComputePipelineBundle> applyRow(Row r) {
+		std::vector<vk::Pipeline> pipelines = boost::hana::at_key(r, BOOST_HANA_STRING("pipelines"));
+		vk::PipelineLayout pipelineLayout = boost::hana::at_key(r, BOOST_HANA_STRING("layout"));
+		vk::ShaderModule computeShaderModule = boost::hana::at_key(r, BOOST_HANA_STRING("computeShader"));
+
+		std::optional<vk::DescriptorSetLayout> descriptorSetLayout;
+		if constexpr (boost::hana::contains(r, BOOST_HANA_STRING("descriptorLayout"))) {
+			descriptorSetLayout = boost::hana::at_key(r, BOOST_HANA_STRING("descriptorLayout"));
+		}
+
+		return ComputePipelineBundle{ pipelines[0], pipelineLayout, computeShaderModule, descriptorSetLayout };
+	}
+};
+
 export
 struct AssemblePipelineBundle {
 	using row_tag = RowType::RowFunctionTag;
@@ -427,7 +685,10 @@ struct AssemblePipelineBundle {
 	template<typename Row>
 	constexpr bng_expected<PipelineBundle> applyRow(Row r) {
 		std::vector<vk::Pipeline> pipelines = boost::hana::at_key(r, BOOST_HANA_STRING("pipelines"));
-		vk::RenderPass renderPass = boost::hana::at_key(r, BOOST_HANA_STRING("renderPass"));
+		vk::RenderPass renderPass; // null for dynamic rendering
+		if constexpr (boost::hana::contains(r, BOOST_HANA_STRING("renderPass"))) {
+			renderPass = boost::hana::at_key(r, BOOST_HANA_STRING("renderPass"));
+		}
 		vk::PipelineLayout pipelineLayout = boost::hana::at_key(r, BOOST_HANA_STRING("layout"));
 		vk::ShaderModule vertexShaderModule = boost::hana::at_key(r, BOOST_HANA_STRING("vertexShader"));
 		vk::ShaderModule fragmentShaderModule = boost::hana::at_key(r, BOOST_HANA_STRING("fragmentShader"));
@@ -495,6 +756,60 @@ struct NoVertexPipelineStage {
 };
 
 
+export
+bng_expected<PipelineBundle> createDynamicNoVertexPipeline(std::shared_ptr<PresentationLayer> presentation, std::filesystem::path vertexShaderFile, std::filesystem::path fragmentShaderFile)
+{
+	vk::Device device = presentation->device_;
+
+	auto pipeRow = boost::hana::make_map(
+		boost::hana::make_pair(BOOST_HANA_STRING("device"), device),
+		boost::hana::make_pair(BOOST_HANA_STRING("presenterptr"), presentation)
+	);
+	auto pipelineChain =
+		CreateShaderModule<BOOST_HANA_STRING("vertexShader")>(vertexShaderFile)
+		| CreateShaderModule<BOOST_HANA_STRING("fragmentShader")>(fragmentShaderFile)
+		| CreateNullVertexInfo()
+		| CreateDynamicRenderingTarget()
+		| CreateDefaultLayout()
+		| CreateSimplePipeline(vk::FrontFace::eClockwise)
+		| AssemblePipelineBundle();
+
+	return pipelineChain.applyRow(pipeRow);
+}
+
+// Same as NoVertexPipelineStage but for dynamic rendering, so the presentation layer never builds framebuffers.
+// Requires VulkanContextConfig::useDynamicRendering and the DynamicRendering frame stage.
+export
+struct DynamicNoVertexPipelineStage {
+	DynamicNoVertexPipelineStage(std::filesystem::path shaderPath) : shaderPath_(shaderPath) {}
+
+	std::filesystem::path shaderPath_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+		std::shared_ptr<bainangua::PresentationLayer> presenterptr = boost::hana::at_key(r, BOOST_HANA_STRING("presenterptr"));
+
+		bng_expected<bainangua::PipelineBundle> pipelineResult(bainangua::createDynamicNoVertexPipeline(presenterptr, (shaderPath_ / "Basic.vert_spv"), (shaderPath_ / "Basic.frag_spv")));
+		if (!pipelineResult.has_value()) {
+			return tl::make_unexpected(pipelineResult.error());
+		}
+		bainangua::PipelineBundle pipeline = pipelineResult.value();
+
+		auto rWithPipeline = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("pipelineBundle"), pipeline));
+		auto result = f.applyRow(rWithPipeline);
+
+		destroyPipeline(device, pipeline);
+		return result;
+	}
+};
+
+
 export
 tl::expected<PipelineBundle, bng_errorobject> createVTVertexPipeline(std::shared_ptr<PresentationLayer> presentation, std::filesystem::path vertexShaderFile, std::filesystem::path fragmentShaderFile)
 {
@@ -576,7 +891,9 @@ void destroyPipeline(vk::Device device, PipelineBundle& pipeline)
 {
 	std::ranges::for_each(pipeline.graphicsPipelines, [&](vk::Pipeline p) {device.destroyPipeline(p); });
 
-	device.destroyRenderPass(pipeline.renderPass);
+	if (pipeline.renderPass) {
+		device.destroyRenderPass(pipeline.renderPass);
+	}
 	device.destroyPipelineLayout(pipeline.pipelineLayout);
 	if (pipeline.descriptorLayout.has_value()) {
 		device.destroyDescriptorSetLayout(pipeline.descriptorLayout.value());
@@ -585,6 +902,17 @@ void destroyPipeline(vk::Device device, PipelineBundle& pipeline)
 	device.destroyShaderModule(pipeline.fragmentShaderModule);
 }
 
+export
+void destroyComputePipeline(vk::Device device, ComputePipelineBundle& pipeline)
+{
+	device.destroyPipeline(pipeline.computePipeline);
+	device.destroyPipelineLayout(pipeline.pipelineLayout);
+	if (pipeline.descriptorLayout.has_value()) {
+		device.destroyDescriptorSetLayout(pipeline.descriptorLayout.value());
+	}
+	device.destroyShaderModule(pipeline.computeShaderModule);
+}
+
 export
 struct MVPPipelineStage {
 	MVPPipelineStage(std::filesystem::path shaderPath) : shaderPath_(shaderPath) {}
@@ -617,6 +945,118 @@ struct MVPPipelineStage {
 	}
 };
 
+export
+tl::expected<PipelineBundle, bng_errorobject> createPushMVPVertexPipeline(std::shared_ptr<PresentationLayer> presentation, std::filesystem::path vertexShaderFile, std::filesystem::path fragmentShaderFile)
+{
+	vk::Device device = presentation->device_;
+
+	auto pipeRow = boost::hana::make_map(
+		boost::hana::make_pair(BOOST_HANA_STRING("device"), device),
+		boost::hana::make_pair(BOOST_HANA_STRING("presenterptr"), presentation)
+	);
+	auto pipelineChain =
+		CreateShaderModule<BOOST_HANA_STRING("vertexShader")>(vertexShaderFile)
+		| CreateShaderModule<BOOST_HANA_STRING("fragmentShader")>(fragmentShaderFile)
+		| CreateVTVertexInfo()
+		| CreateBasicRenderPass()
+		| CreatePushConstantMVPLayout()
+		| CreateSimplePipeline(vk::FrontFace::eCounterClockwise)
+		| AssemblePipelineBundle();
+
+	return pipelineChain.applyRow(pipeRow);
+}
+
+// MVPPipelineStage with the model matrix moved into push constants. Fill the per-frame UBOs with
+// updateViewProjectionBuffer and call pushDrawConstants before each draw.
+export
+struct PushMVPPipelineStage {
+	PushMVPPipelineStage(std::filesystem::path shaderPath) : shaderPath_(shaderPath) {}
+
+	std::filesystem::path shaderPath_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+		std::shared_ptr<bainangua::PresentationLayer> presenterptr = boost::hana::at_key(r, BOOST_HANA_STRING("presenterptr"));
+
+		tl::expected<bainangua::PipelineBundle, std::string> pipelineResult(bainangua::createPushMVPVertexPipeline(presenterptr, (shaderPath_ / "PosColorPushMVP.vert_spv"), (shaderPath_ / "PosColor.frag_spv")));
+		if (!pipelineResult.has_value()) {
+			return tl::make_unexpected(pipelineResult.error());
+		}
+		bainangua::PipelineBundle pipeline = pipelineResult.value();
+
+		presenterptr->connectRenderPass(pipeline.renderPass);
+
+		auto rWithPipeline = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("pipelineBundle"), pipeline));
+		auto result = f.applyRow(rWithPipeline);
+
+		destroyPipeline(device, pipeline);
+		return result;
+	}
+};
+
+// VTVertex meshes drawn many times over, with an InstanceTransform per copy in binding 1. The UBOs hold a
+// ViewProjectionUBO; fill them with updateViewProjectionBuffer.
+export
+tl::expected<PipelineBundle, bng_errorobject> createInstancedVTVertexPipeline(std::shared_ptr<PresentationLayer> presentation, std::filesystem::path vertexShaderFile, std::filesystem::path fragmentShaderFile)
+{
+	vk::Device device = presentation->device_;
+
+	auto pipeRow = boost::hana::make_map(
+		boost::hana::make_pair(BOOST_HANA_STRING("device"), device),
+		boost::hana::make_pair(BOOST_HANA_STRING("presenterptr"), presentation)
+	);
+	auto pipelineChain =
+		CreateShaderModule<BOOST_HANA_STRING("vertexShader")>(vertexShaderFile)
+		| CreateShaderModule<BOOST_HANA_STRING("fragmentShader")>(fragmentShaderFile)
+		| CreateVTVertexInfo()
+		| CreateInstanceInfo<InstanceTransform>()
+		| CreateBasicRenderPass()
+		| CreateMVPDescriptorLayout()
+		| CreateSimplePipeline(vk::FrontFace::eCounterClockwise)
+		| AssemblePipelineBundle();
+
+	return pipelineChain.applyRow(pipeRow);
+}
+
+// Draw with an InstanceBuffer<InstanceTransform>: bind the mesh, then instanceBuffer->drawIndexed() draws every copy at once.
+export
+struct InstancedPipelineStage {
+	InstancedPipelineStage(std::filesystem::path shaderPath) : shaderPath_(shaderPath) {}
+
+	std::filesystem::path shaderPath_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+		std::shared_ptr<bainangua::PresentationLayer> presenterptr = boost::hana::at_key(r, BOOST_HANA_STRING("presenterptr"));
+
+		tl::expected<bainangua::PipelineBundle, std::string> pipelineResult(bainangua::createInstancedVTVertexPipeline(presenterptr, (shaderPath_ / "PosColorInstanced.vert_spv"), (shaderPath_ / "PosColor.frag_spv")));
+		if (!pipelineResult.has_value()) {
+			return tl::make_unexpected(pipelineResult.error());
+		}
+		bainangua::PipelineBundle pipeline = pipelineResult.value();
+
+		presenterptr->connectRenderPass(pipeline.renderPass);
+
+		auto rWithPipeline = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("pipelineBundle"), pipeline));
+		auto result = f.applyRow(rWithPipeline);
+
+		destroyPipeline(device, pipeline);
+		return result;
+	}
+};
+
 export
 tl::expected<PipelineBundle, bng_errorobject> createUBOVertexPipeline(std::shared_ptr<PresentationLayer> presentation, std::filesystem::path vertexShaderFile, std::filesystem::path fragmentShaderFile)
 {
@@ -697,6 +1137,63 @@ tl::expected<PipelineBundle, bng_errorobject> createTexVertexPipeline(std::share
 }
 
 
+export
+tl::expected<PipelineBundle, bng_errorobject> createBindlessTexVertexPipeline(std::shared_ptr<PresentationLayer> presentation, vk::DescriptorSetLayout bindlessLayout, std::filesystem::path vertexShaderFile, std::filesystem::path fragmentShaderFile)
+{
+	vk::Device device = presentation->device_;
+
+	auto pipeRow = boost::hana::make_map(
+		boost::hana::make_pair(BOOST_HANA_STRING("device"), device),
+		boost::hana::make_pair(BOOST_HANA_STRING("presenterptr"), presentation),
+		boost::hana::make_pair(BOOST_HANA_STRING("bindlessLayout"), bindlessLayout)
+	);
+	auto pipelineChain =
+		CreateShaderModule<BOOST_HANA_STRING("vertexShader")>(vertexShaderFile)
+		| CreateShaderModule<BOOST_HANA_STRING("fragmentShader")>(fragmentShaderFile)
+		| CreateTexVertexInfo()
+		| CreateBasicRenderPass()
+		| CreateBindlessLayout()
+		| CreateSimplePipeline(vk::FrontFace::eCounterClockwise)
+		| AssemblePipelineBundle();
+
+	return pipelineChain.applyRow(pipeRow);
+}
+
+// The bindless version of TexPipelineStage. Needs "bindlessTable" from BindlessTableStage; bind the table's set
+// as set 1 and pick each draw's texture with the textureIndex push constant.
+export
+struct BindlessTexPipelineStage {
+	BindlessTexPipelineStage(std::filesystem::path shaderPath) : shaderPath_(shaderPath) {}
+
+	std::filesystem::path shaderPath_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+		std::shared_ptr<bainangua::PresentationLayer> presenterptr = boost::hana::at_key(r, BOOST_HANA_STRING("presenterptr"));
+		std::shared_ptr<BindlessTable> bindlessTable = boost::hana::at_key(r, BOOST_HANA_STRING("bindlessTable"));
+
+		tl::expected<bainangua::PipelineBundle, std::string> pipelineResult(bainangua::createBindlessTexVertexPipeline(presenterptr, bindlessTable->layout(), (shaderPath_ / "TexturedBindless.vert_spv"), (shaderPath_ / "TexturedBindless.frag_spv")));
+		if (!pipelineResult.has_value()) {
+			return tl::make_unexpected(pipelineResult.error());
+		}
+		bainangua::PipelineBundle pipeline = pipelineResult.value();
+
+		presenterptr->connectRenderPass(pipeline.renderPass);
+
+		auto rWithPipeline = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("pipelineBundle"), pipeline));
+		auto result = f.applyRow(rWithPipeline);
+
+		destroyPipeline(device, pipeline);
+		return result;
+	}
+};
+
 export
 struct TexPipelineStage {
 	TexPipelineStage(std::filesystem::path shaderPath) : shaderPath_(shaderPath) {}
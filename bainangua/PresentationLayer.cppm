@@ -56,6 +56,18 @@ vk::Extent2D chooseSwapChainImageExtent(GLFWwindow *glfwWindow, const SwapChainP
 	}
 }
 
+// Picks the first mode in the preference list that the surface supports. FIFO is the only
+// mode guaranteed by the spec, so it is always the final fallback.
+vk::PresentModeKHR choosePresentMode(const SwapChainProperties& swapChainProperties, const std::vector<vk::PresentModeKHR>& preferredModes)
+{
+	for (vk::PresentModeKHR mode : preferredModes) {
+		if (std::find(swapChainProperties.presentModes.begin(), swapChainProperties.presentModes.end(), mode) != swapChainProperties.presentModes.end()) {
+			return mode;
+		}
+	}
+	return vk::PresentModeKHR::eFifo;
+}
+
 uint32_t chooseSwapChainImageCount(const SwapChainProperties& swapChainProperties)
 {
 	const uint32_t minImageCount = swapChainProperties.capabilities.minImageCount;
@@ -71,6 +83,20 @@ namespace bainangua {
 
 export constexpr uint32_t MultiFrameCount = 2;
 
+// Present mode preferences, in order. Whatever is picked falls back to FIFO if none of these are supported.
+export const std::vector<vk::PresentModeKHR> VSyncPresentModes{ vk::PresentModeKHR::eFifo };
+export const std::vector<vk::PresentModeKHR> LowLatencyPresentModes{ vk::PresentModeKHR::eMailbox, vk::PresentModeKHR::eImmediate, vk::PresentModeKHR::eFifoRelaxed };
+
+// A swapchain that has been replaced by a rebuild. Frames already in flight may still be rendering into
+// its framebuffers, so it sticks around until every frame slot has waited on its fence once more.
+export struct RetiredSwapChain
+{
+	vk::SwapchainKHR swapChain;
+	bng_array<vk::ImageView> imageViews;
+	bng_array<vk::Framebuffer> framebuffers;
+	uint32_t pendingFrameSlots; //< bit N set means frame slot N may still reference this swapchain
+};
+
 export struct PresentationLayer
 {
 	PresentationLayer(
@@ -82,6 +108,8 @@ export struct PresentationLayer
 		vk::Format swapChainFormat,
 		vk::Extent2D swapChainExtent2D,
 		unsigned int swapChainImageCount,
+		vk::PresentModeKHR presentMode,
+		std::vector<vk::PresentModeKHR> preferredPresentModes,
 		bng_array<vk::Semaphore> imageAvailableSemaphores,
 		bng_array<vk::Semaphore> renderFinishedSemaphores,
 		bng_array<vk::Fence> inFlightFences,
@@ -91,7 +119,7 @@ export struct PresentationLayer
 		bng_array<vk::Framebuffer> swapChainFramebuffers
 		) : device_(device), physicalDevice_(physicalDevice), surface_(surface), glfwWindow_(window),
 		    swapChain_(swapChain), swapChainFormat_(swapChainFormat), swapChainExtent2D_(swapChainExtent2D),
-	        swapChainImageCount_(swapChainImageCount), imageAvailableSemaphores_(imageAvailableSemaphores), renderFinishedSemaphores_(renderFinishedSemaphores),
+	        swapChainImageCount_(swapChainImageCount), presentMode_(presentMode), preferredPresentModes_(preferredPresentModes), imageAvailableSemaphores_(imageAvailableSemaphores), renderFinishedSemaphores_(renderFinishedSemaphores),
 		    inFlightFences_(inFlightFences), swapChainImages_(swapChainImages), swapChainImageViews_(swapChainImageViews), swapChainFramebuffers_(swapChainFramebuffers)
 			{}
 	~PresentationLayer() { teardown(); }
@@ -101,8 +129,15 @@ export struct PresentationLayer
 
 	void connectRenderPass(const vk::RenderPass& renderPass);
 
+	// Builds a new swapchain using this one as oldSwapchain. The per-frame sync objects move over to the new
+	// layer and this swapchain is retired; this layer is left empty.
 	std::shared_ptr<PresentationLayer> rebuildSwapChain();
 
+	// Call once the fence for a frame slot has been waited on. Retired swapchains that no frame slot
+	// references any more are destroyed.
+	void frameSlotCompleted(size_t multiFrameIndex);
+	void destroyRetired(const RetiredSwapChain& retired);
+
 	// we need all this to rebuild the swapchain
 	vk::Device device_;
 	vk::PhysicalDevice physicalDevice_;
@@ -115,6 +150,10 @@ export struct PresentationLayer
 	vk::Extent2D swapChainExtent2D_;
 	unsigned int swapChainImageCount_;
 
+	// the mode actually in use, and the preferences it was picked from (reused when rebuilding)
+	vk::PresentModeKHR presentMode_;
+	std::vector<vk::PresentModeKHR> preferredPresentModes_;
+
 	bng_array<vk::Semaphore> imageAvailableSemaphores_;
 	bng_array<vk::Semaphore> renderFinishedSemaphores_;
 	bng_array<vk::Fence> inFlightFences_;
@@ -122,19 +161,50 @@ export struct PresentationLayer
 	bng_array<vk::Image> swapChainImages_;
 	bng_array<vk::ImageView> swapChainImageViews_;
 	bng_array<vk::Framebuffer> swapChainFramebuffers_;
+
+	// Goes up whenever the images, views or framebuffers above are replaced, so command buffers recorded
+	// against the old ones can tell they're stale.
+	uint64_t generation_{ 0 };
+
+	std::vector<RetiredSwapChain> retiredSwapChains_;
 };
 
+std::shared_ptr<PresentationLayer> createPresentationLayer(
+	vk::Device device,
+	vk::PhysicalDevice physicalDevice,
+	vk::SurfaceKHR surface,
+	GLFWwindow* glfwWindow,
+	const std::vector<vk::PresentModeKHR>& preferredPresentModes,
+	vk::SwapchainKHR oldSwapChain,
+	bng_array<vk::Semaphore> imageAvailableSemaphores,
+	bng_array<vk::Semaphore> renderFinishedSemaphores,
+	bng_array<vk::Fence> inFlightFences);
 
-export std::shared_ptr<PresentationLayer> buildPresentationLayer(vk::Device device, vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface, GLFWwindow *glfwWindow)
+
+export std::shared_ptr<PresentationLayer> buildPresentationLayer(vk::Device device, vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface, GLFWwindow *glfwWindow, const std::vector<vk::PresentModeKHR>& preferredPresentModes = VSyncPresentModes)
+{
+	return createPresentationLayer(device, physicalDevice, surface, glfwWindow, preferredPresentModes, VK_NULL_HANDLE, {}, {}, {});
+}
+
+// Empty sync object arrays are created here; a rebuild passes in the ones it already has.
+std::shared_ptr<PresentationLayer> createPresentationLayer(
+	vk::Device device,
+	vk::PhysicalDevice physicalDevice,
+	vk::SurfaceKHR surface,
+	GLFWwindow* glfwWindow,
+	const std::vector<vk::PresentModeKHR>& preferredPresentModes,
+	vk::SwapchainKHR oldSwapChain,
+	bng_array<vk::Semaphore> imageAvailableSemaphores,
+	bng_array<vk::Semaphore> renderFinishedSemaphores,
+	bng_array<vk::Fence> inFlightFences)
 {
 	SwapChainProperties swapChainInfo = querySwapChainProperties(physicalDevice, surface);
 	auto useableFormat = std::find_if(swapChainInfo.formats.begin(), swapChainInfo.formats.end(), [](vk::SurfaceFormatKHR s) { return s.format == vk::Format::eB8G8R8A8Srgb && s.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear; });
-	auto useableModes = std::find_if(swapChainInfo.presentModes.begin(), swapChainInfo.presentModes.end(), [](vk::PresentModeKHR s) { return s == vk::PresentModeKHR::eFifo; });
 	
 	assert(useableFormat != swapChainInfo.formats.end());
-	assert(useableModes  != swapChainInfo.presentModes.end());
 
 	vk::SurfaceFormatKHR swapChainFormat = *useableFormat;
+	vk::PresentModeKHR presentMode = choosePresentMode(swapChainInfo, preferredPresentModes);
 
 	uint32_t swapChainImageCount = chooseSwapChainImageCount(swapChainInfo);
 	vk::Extent2D swapChainExtent2D = chooseSwapChainImageExtent(glfwWindow, swapChainInfo);
@@ -153,8 +223,9 @@ export std::shared_ptr<PresentationLayer> buildPresentationLayer(vk::Device devi
 		queueFamilies,
 		swapChainInfo.capabilities.currentTransform,
 		vk::CompositeAlphaFlagBitsKHR::eOpaque,
-		vk::PresentModeKHR::eFifo,
-		true);
+		presentMode,
+		true,
+		oldSwapChain);
 	VkDevice swapChainVkDevice = static_cast<VkDevice>(device);
 	auto swapChain = device.createSwapchainKHR(createInfo);
 
@@ -184,11 +255,7 @@ export std::shared_ptr<PresentationLayer> buildPresentationLayer(vk::Device devi
 				return vs.push_back(iv);
 			});
 
-	immer::array<vk::Semaphore, bainangua_memory_policy> imageAvailableSemaphores;
-	immer::array<vk::Semaphore, bainangua_memory_policy> renderFinishedSemaphores;
-	immer::array<vk::Fence, bainangua_memory_policy> inFlightFences;
-
-	for (size_t index = 0; index < MultiFrameCount; index++) {
+	for (size_t index = inFlightFences.size(); index < MultiFrameCount; index++) {
 		imageAvailableSemaphores = imageAvailableSemaphores.push_back(device.createSemaphore({}));
 		renderFinishedSemaphores = renderFinishedSemaphores.push_back(device.createSemaphore({}));
 
@@ -208,6 +275,9 @@ export std::shared_ptr<PresentationLayer> buildPresentationLayer(vk::Device devi
 
 		swapChainImageCount,
 
+		presentMode,
+		preferredPresentModes,
+
 		imageAvailableSemaphores,
 		renderFinishedSemaphores,
 		inFlightFences,
@@ -221,6 +291,7 @@ export std::shared_ptr<PresentationLayer> buildPresentationLayer(vk::Device devi
 void PresentationLayer::connectRenderPass(const vk::RenderPass& renderPass)
 {
 	teardownFramebuffers();
+	generation_++;
 	swapChainFramebuffers_ = std::accumulate(
 			swapChainImageViews_.begin(), 
 			swapChainImageViews_.end(), 
@@ -243,15 +314,61 @@ void PresentationLayer::teardownFramebuffers()
 
 std::shared_ptr<PresentationLayer> PresentationLayer::rebuildSwapChain()
 {
-	device_.waitIdle();
+	std::shared_ptr<PresentationLayer> rebuilt = createPresentationLayer(
+		device_, physicalDevice_, surface_, glfwWindow_, preferredPresentModes_,
+		swapChain_,
+		imageAvailableSemaphores_, renderFinishedSemaphores_, inFlightFences_);
+	if (!rebuilt) {
+		return rebuilt;
+	}
+
+	// the sync objects now belong to the new layer
+	imageAvailableSemaphores_ = bng_array<vk::Semaphore>();
+	renderFinishedSemaphores_ = bng_array<vk::Semaphore>();
+	inFlightFences_ = bng_array<vk::Fence>();
+
+	rebuilt->generation_ = generation_ + 1;
+	rebuilt->retiredSwapChains_ = std::move(retiredSwapChains_);
+	retiredSwapChains_.clear();
+	rebuilt->retiredSwapChains_.push_back(RetiredSwapChain{
+		swapChain_,
+		swapChainImageViews_,
+		swapChainFramebuffers_,
+		(1u << MultiFrameCount) - 1
+	});
+	swapChain_ = VK_NULL_HANDLE;
+	swapChainImageViews_ = bng_array<vk::ImageView>();
+	swapChainFramebuffers_ = bng_array<vk::Framebuffer>();
+
+	return rebuilt;
+}
 
-	teardown();
+void PresentationLayer::frameSlotCompleted(size_t multiFrameIndex)
+{
+	const uint32_t slotBit = 1u << multiFrameIndex;
+	std::erase_if(retiredSwapChains_, [&](RetiredSwapChain& retired) {
+		retired.pendingFrameSlots &= ~slotBit;
+		if (retired.pendingFrameSlots != 0) {
+			return false;
+		}
+		destroyRetired(retired);
+		return true;
+	});
+}
 
-	return buildPresentationLayer(device_, physicalDevice_, surface_, glfwWindow_);
+void PresentationLayer::destroyRetired(const RetiredSwapChain& retired)
+{
+	std::ranges::for_each(retired.framebuffers, [&](vk::Framebuffer f) { device_.destroyFramebuffer(f); });
+	std::ranges::for_each(retired.imageViews, [&](vk::ImageView iv) { device_.destroyImageView(iv); });
+	device_.destroySwapchainKHR(retired.swapChain);
 }
 
 void PresentationLayer::teardown()
 {
+	// teardown happens after the device has gone idle, so nothing can still be using these
+	std::ranges::for_each(retiredSwapChains_, [&](const RetiredSwapChain& retired) { destroyRetired(retired); });
+	retiredSwapChains_.clear();
+
 	if (device_ && swapChain_)
 	{
 		std::ranges::for_each(imageAvailableSemaphores_, [&](auto s) { device_.destroySemaphore(s); });
@@ -276,6 +393,11 @@ void PresentationLayer::teardown()
 
 
 export struct PresentationLayerStage {
+	PresentationLayerStage() = default;
+	PresentationLayerStage(std::vector<vk::PresentModeKHR> preferredPresentModes) : preferredPresentModes_(preferredPresentModes) {}
+
+	std::vector<vk::PresentModeKHR> preferredPresentModes_{ VSyncPresentModes };
+
 	using row_tag = RowType::RowWrapperTag;
 
 	template <typename WrappedReturnType>
@@ -288,7 +410,7 @@ export struct PresentationLayerStage {
 		vk::SurfaceKHR surface = boost::hana::at_key(r, BOOST_HANA_STRING("surface"));
 		GLFWwindow* glfwWindow = boost::hana::at_key(r, BOOST_HANA_STRING("glfwWindow"));
 
-		std::shared_ptr<PresentationLayer> presenterptr(buildPresentationLayer(device, physicalDevice, surface, glfwWindow));
+		std::shared_ptr<PresentationLayer> presenterptr(buildPresentationLayer(device, physicalDevice, surface, glfwWindow, preferredPresentModes_));
 
 		auto rWithPresenter = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("presenterptr"), presenterptr));
 		auto result = f.applyRow(rWithPresenter);
@@ -1,5 +1,6 @@
 //
-// This file only exists to instantiate the compilation unit data of "vk_mem_alloc.h" and "vk_result_to_string.h"
+// This file only exists to instantiate the compilation unit data of "vk_mem_alloc.h", "vk_result_to_string.h",
+// "stb_image.h" and "cgltf.h"
 //
 
 #define VMA_IMPLEMENTATION
@@ -11,6 +12,9 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#define CGLTF_IMPLEMENTATION
+#include <cgltf.h>
+
 #include "bainangua.hpp"
 #include "expected.hpp"
 
@@ -2,17 +2,23 @@ module;
 
 #include "bainangua.hpp"
 #include "RowType.hpp"
+#include "ParallelStages.hpp"
 
 #define STBI_WINDOWS_UTF8
 #include "stb_image.h"
 #include "vk_mem_alloc.h"
 
+#include <boost/container_hash/hash.hpp>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 export module TextureImage;
 
 import VulkanContext;
 import Commands;
+import DescriptorSets;
 
 namespace bainangua {
 
@@ -159,43 +165,56 @@ auto destroyTextureImage(vk::Device device, VmaAllocator vmaAllocator, ImageBund
 	vmaDestroyImage(vmaAllocator, image.image, image.allocation);
 }
 
+// A split stage, so it can be set up in parallel with other split stages using &. It records into "commandPool" and
+// submits to "graphicsQueue", so its siblings mustn't use either.
 export struct FromFileTextureImageStage {
 	FromFileTextureImageStage(std::filesystem::path path) : path_(path) {}
 
 	std::filesystem::path path_;
 
+	// kept from acquire() for release()
+	vk::Device device_;
+	VmaAllocator vmaAllocator_{ nullptr };
+
 	using row_tag = RowType::RowWrapperTag;
 
 	template <typename WrappedReturnType>
 	using return_type_transformer = WrappedReturnType;
 
-	template <typename RowFunction, typename Row>
-	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
-		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
-		VmaAllocator vmaAllocator = boost::hana::at_key(r, BOOST_HANA_STRING("vmaAllocator"));
+	template <typename Row>
+		requires   RowType::has_named_field<Row, BOOST_HANA_STRING("device"), vk::Device>
+				&& RowType::has_named_field<Row, BOOST_HANA_STRING("vmaAllocator"), VmaAllocator>
+				&& RowType::has_named_field<Row, BOOST_HANA_STRING("graphicsQueue"), vk::Queue>
+				&& RowType::has_named_field<Row, BOOST_HANA_STRING("commandPool"), vk::CommandPool>
+	auto acquire(const Row& r) {
+		device_ = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+		vmaAllocator_ = boost::hana::at_key(r, BOOST_HANA_STRING("vmaAllocator"));
 		vk::Queue graphicsQueue = boost::hana::at_key(r, BOOST_HANA_STRING("graphicsQueue"));
 		vk::CommandPool commandPool = boost::hana::at_key(r, BOOST_HANA_STRING("commandPool"));
 
-		auto loadResult = createTextureImage(device, graphicsQueue, vmaAllocator,commandPool, path_);
-		if (!loadResult.has_value()) {
-			return tl::make_unexpected(loadResult.error());
-		}
-
-		ImageBundle textureImage = loadResult.value();
-		auto rWithTextureImage = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("textureImage"), textureImage));
-		auto result = f.applyRow(rWithTextureImage);
+		return createTextureImage(device_, graphicsQueue, vmaAllocator_, commandPool, path_)
+			.map([](ImageBundle textureImage) {
+				return boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("textureImage"), textureImage));
+			});
+	}
 
-		bainangua::destroyTextureImage(device, vmaAllocator, textureImage);
+	template <typename Fields>
+	void release(const Fields& fields) {
+		bainangua::destroyTextureImage(device_, vmaAllocator_, boost::hana::at_key(fields, BOOST_HANA_STRING("textureImage")));
+	}
 
-		return result;
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		return RowType::wrapSplitStage(*this, f, std::move(r));
 	}
 };
 
-export auto createTextureSampler(vk::Device device, vk::PhysicalDevice physicalDevice) -> bng_expected<vk::Sampler> {
+// Linear filtering, repeat addressing and as much anisotropy as the device allows.
+export auto defaultTextureSamplerInfo(vk::PhysicalDevice physicalDevice) -> vk::SamplerCreateInfo {
 	vk::PhysicalDeviceProperties physicalProperties;
 	physicalDevice.getProperties(&physicalProperties);
 
-	vk::SamplerCreateInfo samplerCreateInfo(
+	return vk::SamplerCreateInfo(
 		{},
 		vk::Filter::eLinear,
 		vk::Filter::eLinear,
@@ -213,6 +232,10 @@ export auto createTextureSampler(vk::Device device, vk::PhysicalDevice physicalD
 		vk::BorderColor::eIntOpaqueBlack,
 		false
 	);
+}
+
+export auto createTextureSampler(vk::Device device, vk::PhysicalDevice physicalDevice) -> bng_expected<vk::Sampler> {
+	vk::SamplerCreateInfo samplerCreateInfo = defaultTextureSamplerInfo(physicalDevice);
 
 	vk::Sampler sampler;
 	vk::Result createResult = device.createSampler(&samplerCreateInfo, nullptr, &sampler);
@@ -223,6 +246,117 @@ export auto createTextureSampler(vk::Device device, vk::PhysicalDevice physicalD
 	return sampler;
 }
 
+// A sampler handed out by a SamplerCache. The sampler is destroyed when the last copy goes away.
+export using SharedSampler = std::shared_ptr<const vk::Sampler>;
+
+// Hands out one sampler per distinct SamplerCreateInfo, so textures with the same settings share a sampler
+// instead of each making their own. Drivers cap how many samplers can exist (maxSamplerAllocationCount, as low
+// as 4000), and creating duplicates costs memory and startup time. Samplers are refcounted: the cache only keeps
+// a weak reference, so a sampler is destroyed once nobody uses it, and its entry is dropped the next time the
+// cache has to create one.
+//
+// Create infos with a pNext chain aren't supported, since there's no way to compare the chains. Safe to use
+// from several loader threads at once.
+export class SamplerCache {
+public:
+	SamplerCache(vk::Device device) : device_(device) {}
+
+	SamplerCache(const SamplerCache&) = delete;
+	SamplerCache& operator=(const SamplerCache&) = delete;
+
+	auto getSampler(const vk::SamplerCreateInfo& info) -> bng_expected<SharedSampler> {
+		if (info.pNext != nullptr) {
+			return tl::make_unexpected("SamplerCache: sampler create infos with a pNext chain can't be cached");
+		}
+
+		std::scoped_lock lock(mutex_);
+		auto found = samplers_.find(info);
+		if (found != samplers_.end()) {
+			if (SharedSampler existing = found->second.lock()) {
+				return existing;
+			}
+		}
+
+		// misses are rare and about to create a sampler anyway, so that's when dead entries get cleared out
+		std::erase_if(samplers_, [](const auto& entry) { return entry.second.expired(); });
+
+		vk::Sampler sampler;
+		vk::Result createResult = device_.createSampler(&info, nullptr, &sampler);
+		if (createResult != vk::Result::eSuccess) {
+			return bainangua::formatVkResultError("SamplerCache", createResult);
+		}
+		createCount_++;
+
+		vk::Device device = device_;
+		SharedSampler shared(new vk::Sampler(sampler), [device](const vk::Sampler* s) {
+			device.destroySampler(*s);
+			delete s;
+		});
+		samplers_.insert_or_assign(info, shared);
+		return shared;
+	}
+
+	// how many samplers actually got created, as opposed to handed out again
+	size_t createCount() const {
+		std::scoped_lock lock(mutex_);
+		return createCount_;
+	}
+
+	// how many entries the cache holds, including ones whose sampler is gone but that haven't been cleared out yet
+	size_t entryCount() const {
+		std::scoped_lock lock(mutex_);
+		return samplers_.size();
+	}
+
+private:
+	struct InfoHash {
+		size_t operator()(const vk::SamplerCreateInfo& info) const {
+			size_t seed = 0;
+			boost::hash_combine(seed, static_cast<uint32_t>(info.flags));
+			boost::hash_combine(seed, static_cast<int>(info.magFilter));
+			boost::hash_combine(seed, static_cast<int>(info.minFilter));
+			boost::hash_combine(seed, static_cast<int>(info.mipmapMode));
+			boost::hash_combine(seed, static_cast<int>(info.addressModeU));
+			boost::hash_combine(seed, static_cast<int>(info.addressModeV));
+			boost::hash_combine(seed, static_cast<int>(info.addressModeW));
+			boost::hash_combine(seed, info.mipLodBias);
+			boost::hash_combine(seed, info.anisotropyEnable);
+			boost::hash_combine(seed, info.maxAnisotropy);
+			boost::hash_combine(seed, info.compareEnable);
+			boost::hash_combine(seed, static_cast<int>(info.compareOp));
+			boost::hash_combine(seed, info.minLod);
+			boost::hash_combine(seed, info.maxLod);
+			boost::hash_combine(seed, static_cast<int>(info.borderColor));
+			boost::hash_combine(seed, info.unnormalizedCoordinates);
+			return seed;
+		}
+	};
+
+	vk::Device device_;
+	mutable std::mutex mutex_;
+	std::unordered_map<vk::SamplerCreateInfo, std::weak_ptr<const vk::Sampler>, InfoHash> samplers_;
+	size_t createCount_{ 0 };
+};
+
+// Adds a SamplerCache as "samplerCache". Basic2DSamplerStage gets its sampler from it when it's there, and so do
+// glTF textures when this comes before the ResourceLoaderStage.
+export struct SamplerCacheStage {
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	requires RowType::has_named_field<Row, BOOST_HANA_STRING("device"), vk::Device>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+
+		auto cache = std::make_shared<SamplerCache>(device);
+		auto rWithCache = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("samplerCache"), cache));
+		return f.applyRow(rWithCache);
+	}
+};
+
 export auto linkImageToDescriptorSets(vk::Device device, ImageBundle image, vk::Sampler sampler, std::vector<vk::DescriptorSet> descriptors) -> bng_expected<void> {
 	for (auto descriptor : descriptors) {
 		vk::DescriptorImageInfo imageInfo(sampler, image.imageView, vk::ImageLayout::eShaderReadOnlyOptimal);
@@ -244,15 +378,26 @@ export struct Basic2DSamplerStage {
 		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
 		vk::PhysicalDevice physicalDevice = boost::hana::at_key(r, BOOST_HANA_STRING("physicalDevice"));
 
-		return createTextureSampler(device, physicalDevice)
-			.and_then([&](vk::Sampler sampler) {
-				auto rWithSampler = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("imageSampler"), sampler));
-				auto result = f.applyRow(rWithSampler);
+		if constexpr (boost::hana::contains(r, BOOST_HANA_STRING("samplerCache"))) {
+			const std::shared_ptr<SamplerCache>& samplerCache = boost::hana::at_key(r, BOOST_HANA_STRING("samplerCache"));
+			return samplerCache->getSampler(defaultTextureSamplerInfo(physicalDevice))
+				.and_then([&](SharedSampler sampler) {
+					// sampler keeps the cached sampler alive until the rest of the program is done
+					auto rWithSampler = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("imageSampler"), *sampler));
+					return f.applyRow(rWithSampler);
+				});
+		}
+		else {
+			return createTextureSampler(device, physicalDevice)
+				.and_then([&](vk::Sampler sampler) {
+					auto rWithSampler = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("imageSampler"), sampler));
+					auto result = f.applyRow(rWithSampler);
 
-				device.destroySampler(sampler);
+					device.destroySampler(sampler);
 
-				return result;
-			});
+					return result;
+				});
+		}
 	}
 };
 
@@ -278,6 +423,31 @@ export struct LinkImageToDescriptorsStage {
 	}
 };
 
+// Bindless counterpart to LinkImageToDescriptorsStage: puts "textureImage" with "imageSampler" into the row's
+// BindlessTable and adds its slot as "textureIndex". The slot is given back once the rest of the program is done.
+export struct BindlessTextureStage {
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		std::shared_ptr<BindlessTable> bindlessTable = boost::hana::at_key(r, BOOST_HANA_STRING("bindlessTable"));
+		const ImageBundle image = boost::hana::at_key(r, BOOST_HANA_STRING("textureImage"));
+		vk::Sampler sampler = boost::hana::at_key(r, BOOST_HANA_STRING("imageSampler"));
+
+		auto indexResult = bindlessTable->addTexture(image.imageView, sampler);
+		if (!indexResult) {
+			return tl::make_unexpected(indexResult.error());
+		}
+
+		auto rWithIndex = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("textureIndex"), indexResult.value()));
+		auto result = f.applyRow(rWithIndex);
 
+		bindlessTable->removeTexture(indexResult.value());
+		return result;
+	}
+};
 
-}
\ No newline at end of file
+}
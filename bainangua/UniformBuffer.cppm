@@ -27,6 +27,21 @@ export struct BasicUBO {
 	glm::mat4 projection;
 };
 
+// The per-frame half of BasicUBO, for pipelines that get the model matrix from push constants instead.
+export struct ViewProjectionUBO {
+	glm::mat4 view;
+	glm::mat4 projection;
+};
+
+// Per-draw data that goes in push constants, so drawing another object doesn't need a descriptor set or a
+// dynamic offset of its own. 72 bytes, well under the 128 bytes every implementation guarantees. textureIndex is
+// a BindlessTable slot, for shaders that use one.
+export struct PerDrawConstants {
+	glm::mat4 model;
+	uint32_t objectId;
+	uint32_t textureIndex;
+};
+
 namespace bainangua {
 
 export struct UniformBufferBundle {
@@ -101,6 +116,34 @@ export auto updateUniformBuffer(vk::Extent2D viewportExtent, const UniformBuffer
 	memcpy(UBOBundle.mappedMemory, &ubo, sizeof(ubo));
 }
 
+// The camera updateViewProjectionBuffer sets up, for anything that has to agree with it, like a culling frustum.
+export auto defaultViewProjection(vk::Extent2D viewportExtent) -> ViewProjectionUBO {
+	ViewProjectionUBO ubo{};
+	ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	float aspectRatio = viewportExtent.width / (float)viewportExtent.height;
+	ubo.projection = glm::perspective(glm::radians(45.0f), aspectRatio, 0.1f, 10.0f);
+	ubo.projection[1][1] *= -1;
+	return ubo;
+}
+
+// Fills in a ViewProjectionUBO. The buffers from createUniformBuffers are sized for a BasicUBO, which is bigger.
+export auto updateViewProjectionBuffer(vk::Extent2D viewportExtent, const UniformBufferBundle& UBOBundle) -> void {
+	ViewProjectionUBO ubo = defaultViewProjection(viewportExtent);
+
+	memcpy(UBOBundle.mappedMemory, &ubo, sizeof(ubo));
+}
+
+// Sets the per-draw constants for the next draw. The pipeline layout needs the range from perDrawPushConstantRange().
+export auto pushDrawConstants(vk::CommandBuffer buffer, vk::PipelineLayout layout, const glm::mat4& model, uint32_t objectId, uint32_t textureIndex = 0) -> void {
+	PerDrawConstants constants{ model, objectId, textureIndex };
+	buffer.pushConstants(layout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, sizeof(PerDrawConstants), &constants);
+}
+
+// Visible to the fragment stage too, so bindless fragment shaders can read textureIndex.
+export auto perDrawPushConstantRange() -> vk::PushConstantRange {
+	return vk::PushConstantRange(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, sizeof(PerDrawConstants));
+}
+
 export auto destroyUniformBuffer(VmaAllocator allocator, UniformBufferBundle UBOBundle) -> void {
 	vmaDestroyBuffer(allocator, UBOBundle.ubo, UBOBundle.allocation);
 }
@@ -8,10 +8,19 @@ module;
 #include <glm/glm.hpp>
 #include <reflect>
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
 export module VertBuffer;
 
 import VulkanContext;
 import Commands;
+import PresentationLayer; // for MultiFrameCount
+import VertexBuffer;
 
 namespace bainangua {
 
@@ -315,6 +324,83 @@ struct GPUIndexedVertexBufferStage {
 	}
 };
 
+export
+void destroyVertexStreams(VmaAllocator allocator, const std::vector<std::tuple<vk::Buffer, VmaAllocation>>& streamBuffers) {
+	for (auto& [buffer, allocation] : streamBuffers) {
+		if (buffer) {
+			vmaDestroyBuffer(allocator, buffer, allocation);
+		}
+	}
+}
+
+// One GPU vertex buffer per stream of a split vertex layout (see VertexStreamLayout), indexed by stream number.
+// Empty streams get a null buffer.
+export
+template <typename V, typename Split>
+auto createGPUVertexStreams(vk::Device device, vk::Queue graphicsQueue, VmaAllocator allocator, vk::CommandPool pool, const std::vector<V>& vertexData, const VertexStreamLayout<V, Split>& layout) -> tl::expected<std::vector<std::tuple<vk::Buffer, VmaAllocation>>, bainangua::bng_errorobject> {
+	std::vector<std::tuple<vk::Buffer, VmaAllocation>> streamBuffers;
+	for (const std::vector<std::byte>& streamData : splitVertexStreams(vertexData, layout)) {
+		if (streamData.empty()) {
+			streamBuffers.emplace_back(vk::Buffer{}, VmaAllocation{ VK_NULL_HANDLE });
+			continue;
+		}
+		auto streamResult = createGPUVertexBuffer(device, graphicsQueue, allocator, pool, streamData);
+		if (!streamResult.has_value()) {
+			destroyVertexStreams(allocator, streamBuffers);
+			return tl::make_unexpected("createGPUVertexStreams: " + streamResult.error());
+		}
+		streamBuffers.push_back(streamResult.value());
+	}
+	return streamBuffers;
+}
+
+// Binds a range of streams, each to the binding with its stream number. A position-only pass binds just stream 0.
+export
+void bindVertexStreams(vk::CommandBuffer buffer, const std::vector<std::tuple<vk::Buffer, VmaAllocation>>& streamBuffers, uint32_t firstStream = 0, uint32_t streamCount = UINT32_MAX) {
+	for (uint32_t i = 0; i < streamCount && firstStream + i < streamBuffers.size(); i++) {
+		uint32_t stream = firstStream + i;
+		vk::Buffer streamBuffer = std::get<0>(streamBuffers[stream]);
+		if (streamBuffer) {
+			vk::DeviceSize offset = 0;
+			buffer.bindVertexBuffers(stream, 1, &streamBuffer, &offset);
+		}
+	}
+}
+
+export
+template <typename V, typename Split = PositionStreamSplit>
+struct GPUVertexStreamsStage {
+	GPUVertexStreamsStage(const std::vector<V>& v) : vertices_(v) {}
+
+	std::vector<V> vertices_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+		vk::Queue graphicsQueue = boost::hana::at_key(r, BOOST_HANA_STRING("graphicsQueue"));
+		VmaAllocator vmaAllocator = boost::hana::at_key(r, BOOST_HANA_STRING("vmaAllocator"));
+		vk::CommandPool commandPool = boost::hana::at_key(r, BOOST_HANA_STRING("commandPool"));
+
+		auto streamsResult = bainangua::createGPUVertexStreams(device, graphicsQueue, vmaAllocator, commandPool, vertices_, reflectStreams<V, Split>());
+		if (!streamsResult.has_value()) {
+			return tl::make_unexpected(streamsResult.error());
+		}
+
+		auto streams = streamsResult.value();
+		auto rWithStreams = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("vertexStreams"), streams));
+		auto result = f.applyRow(rWithStreams);
+
+		bainangua::destroyVertexStreams(vmaAllocator, streams);
+
+		return result;
+	}
+};
+
 export struct GPUIndexBufferStage {
 	using row_tag = RowType::RowWrapperTag;
 
@@ -343,4 +429,125 @@ export struct GPUIndexBufferStage {
 	}
 };
 
-}
\ No newline at end of file
+
+// Per-instance data for instanced draws, rewritten every frame. Each frame in flight gets its own host-visible
+// buffer, so filling in this frame's instances never touches a buffer the GPU might still be reading.
+export
+template <typename InstanceStruct>
+class InstanceBuffer {
+public:
+	static auto create(VmaAllocator allocator, uint32_t capacity) -> bng_expected<std::shared_ptr<InstanceBuffer>> {
+		std::shared_ptr<InstanceBuffer> instanceBuffer(new InstanceBuffer(allocator, capacity));
+
+		VkBufferCreateInfo bufferCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size = sizeof(InstanceStruct) * capacity,
+			.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE
+		};
+		VmaAllocationCreateInfo vmaAllocateInfo{
+			.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+			.usage = VMA_MEMORY_USAGE_AUTO,
+			.requiredFlags = 0,
+			.preferredFlags = 0,
+			.memoryTypeBits = 0,
+			.pool = VK_NULL_HANDLE,
+			.pUserData = nullptr,
+			.priority = 0.0f
+		};
+
+		for (auto& frame : instanceBuffer->frames_) {
+			VkBuffer buffer;
+			VmaAllocationInfo allocationInfo;
+			auto vkResult = vmaCreateBuffer(allocator, &bufferCreateInfo, &vmaAllocateInfo, &buffer, &frame.allocation, &allocationInfo);
+			if (vkResult != VK_SUCCESS) {
+				// the destructor cleans up whichever buffers did get made
+				return tl::make_unexpected("InstanceBuffer: vmaCreateBuffer failed");
+			}
+			frame.buffer = buffer;
+			frame.mapped = static_cast<InstanceStruct*>(allocationInfo.pMappedData);
+		}
+		return instanceBuffer;
+	}
+
+	~InstanceBuffer() {
+		for (auto& frame : frames_) {
+			if (frame.buffer) {
+				vmaDestroyBuffer(allocator_, frame.buffer, frame.allocation);
+			}
+		}
+	}
+
+	InstanceBuffer(const InstanceBuffer&) = delete;
+	InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+	// Copies in this frame's instances and returns how many were kept; anything past capacity is dropped.
+	uint32_t write(size_t multiFrameIndex, std::span<const InstanceStruct> instances) {
+		Frame& frame = frames_[multiFrameIndex];
+		frame.count = static_cast<uint32_t>(std::min<size_t>(instances.size(), capacity_));
+		std::copy_n(instances.begin(), frame.count, frame.mapped);
+		vmaFlushAllocation(allocator_, frame.allocation, 0, sizeof(InstanceStruct) * frame.count);
+		return frame.count;
+	}
+
+	void bind(vk::CommandBuffer buffer, size_t multiFrameIndex, uint32_t binding = 1) const {
+		vk::Buffer instanceBuffer = frames_[multiFrameIndex].buffer;
+		vk::DeviceSize offset = 0;
+		buffer.bindVertexBuffers(binding, 1, &instanceBuffer, &offset);
+	}
+
+	// Binds this frame's instances and draws all of them with one call. The mesh's own vertex and index buffers
+	// should already be bound.
+	void drawIndexed(vk::CommandBuffer buffer, size_t multiFrameIndex, uint32_t indexCount, uint32_t firstIndex = 0, int32_t vertexOffset = 0, uint32_t binding = 1) const {
+		if (frames_[multiFrameIndex].count == 0) {
+			return;
+		}
+		bind(buffer, multiFrameIndex, binding);
+		buffer.drawIndexed(indexCount, frames_[multiFrameIndex].count, firstIndex, vertexOffset, 0);
+	}
+
+	uint32_t count(size_t multiFrameIndex) const { return frames_[multiFrameIndex].count; }
+	uint32_t capacity() const { return capacity_; }
+
+private:
+	InstanceBuffer(VmaAllocator allocator, uint32_t capacity) : allocator_(allocator), capacity_(capacity) {}
+
+	struct Frame {
+		vk::Buffer buffer;
+		VmaAllocation allocation{ VK_NULL_HANDLE };
+		InstanceStruct* mapped{ nullptr };
+		uint32_t count{ 0 };
+	};
+
+	VmaAllocator allocator_;
+	uint32_t capacity_;
+	std::array<Frame, MultiFrameCount> frames_;
+};
+
+export
+template <typename InstanceStruct>
+struct InstanceBufferStage {
+	InstanceBufferStage(uint32_t capacity) : capacity_(capacity) {}
+
+	uint32_t capacity_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		VmaAllocator vmaAllocator = boost::hana::at_key(r, BOOST_HANA_STRING("vmaAllocator"));
+
+		auto instanceResult = InstanceBuffer<InstanceStruct>::create(vmaAllocator, capacity_);
+		if (!instanceResult.has_value()) {
+			return tl::make_unexpected(instanceResult.error());
+		}
+
+		auto rWithInstances = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("instanceBuffer"), instanceResult.value()));
+		return f.applyRow(rWithInstances);
+	}
+};
+
+}
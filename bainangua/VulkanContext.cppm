@@ -43,6 +43,20 @@ struct VulkanContextConfig {
 
     bool verboseInit;
     bool useValidation;
+
+    // Enables VK_KHR_dynamic_rendering on the device, so pipelines and frames can skip render passes and framebuffers.
+    bool useDynamicRendering{ false };
+
+    // Enables the descriptor indexing features BindlessTable needs: update-after-bind, partially bound and
+    // non-uniformly indexed arrays of sampled images and storage buffers.
+    bool useBindless{ false };
+
+    // Enables the drawIndirectCount feature, so vkCmdDrawIndexedIndirectCount can take its draw count from a
+    // buffer written on the GPU. GpuCuller needs this.
+    bool useIndirectCount{ false };
+
+    // Enables timeline semaphores, so DeletionQueue entries can wait on a semaphore value instead of a frame.
+    bool useTimelineSemaphores{ false };
 };
 
 
@@ -273,12 +287,104 @@ struct StandardDevice {
         std::vector<const char*> extensions{ VK_KHR_SWAPCHAIN_EXTENSION_NAME };
         vk::PhysicalDeviceFeatures features;
         features.setSamplerAnisotropy(true);
+
+        vk::PhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures(true);
+        if (config.useDynamicRendering) {
+            std::vector<vk::ExtensionProperties> deviceExtensions = physicalDevice.enumerateDeviceExtensionProperties();
+            bool supportsDynamicRendering =
+                (std::ranges::find_if(deviceExtensions,
+                    [](vk::ExtensionProperties p) {
+                        std::string e = p.extensionName;
+                        return e == std::string(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+                    }) != deviceExtensions.end());
+            if (!supportsDynamicRendering) {
+                return bng_unexpected("Physical device does not support VK_KHR_dynamic_rendering");
+            }
+            extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+        }
+
+        // Bindless, indirect count and timeline semaphores are all Vulkan 1.2 core features, queried and enabled
+        // through 1.2 feature structs, so an older device can't offer them at all.
+        if (config.useBindless || config.useIndirectCount || config.useTimelineSemaphores) {
+            uint32_t apiVersion = physicalDevice.getProperties().apiVersion;
+            if (apiVersion < VK_API_VERSION_1_2) {
+                return bng_unexpected(std::format("Physical device supports Vulkan {}.{}, but bindless descriptors, indirect count and timeline semaphores need 1.2",
+                    VK_API_VERSION_MAJOR(apiVersion), VK_API_VERSION_MINOR(apiVersion)));
+            }
+        }
+
+        // core in Vulkan 1.2, so there's no extension to enable, just the features
+        vk::PhysicalDeviceDescriptorIndexingFeatures descriptorIndexingFeatures;
+        if (config.useBindless) {
+            vk::PhysicalDeviceDescriptorIndexingFeatures supported;
+            vk::PhysicalDeviceFeatures2 supportedFeatures2({}, &supported);
+            physicalDevice.getFeatures2(&supportedFeatures2);
+            if (!supported.runtimeDescriptorArray || !supported.descriptorBindingPartiallyBound
+                || !supported.descriptorBindingSampledImageUpdateAfterBind || !supported.descriptorBindingStorageBufferUpdateAfterBind
+                || !supported.shaderSampledImageArrayNonUniformIndexing) {
+                return bng_unexpected("Physical device does not support the descriptor indexing features needed for bindless descriptors");
+            }
+            descriptorIndexingFeatures
+                .setRuntimeDescriptorArray(true)
+                .setDescriptorBindingPartiallyBound(true)
+                .setDescriptorBindingSampledImageUpdateAfterBind(true)
+                .setDescriptorBindingStorageBufferUpdateAfterBind(true)
+                .setShaderSampledImageArrayNonUniformIndexing(true)
+                .setShaderStorageBufferArrayNonUniformIndexing(supported.shaderStorageBufferArrayNonUniformIndexing);
+        }
+
+        // drawIndirectCount and timelineSemaphore go in the Vulkan 1.2 feature struct, and that can't share a chain
+        // with the descriptor indexing struct, so when both are on the indexing features get copied across
+        vk::PhysicalDeviceVulkan12Features vulkan12Features;
+        bool useVulkan12Features = config.useIndirectCount || config.useTimelineSemaphores;
+        if (useVulkan12Features) {
+            vk::PhysicalDeviceVulkan12Features supported;
+            vk::PhysicalDeviceFeatures2 supportedFeatures2({}, &supported);
+            physicalDevice.getFeatures2(&supportedFeatures2);
+            if (config.useIndirectCount) {
+                if (!supported.drawIndirectCount) {
+                    return bng_unexpected("Physical device does not support drawIndirectCount");
+                }
+                vulkan12Features.setDrawIndirectCount(true);
+            }
+            if (config.useTimelineSemaphores) {
+                if (!supported.timelineSemaphore) {
+                    return bng_unexpected("Physical device does not support timeline semaphores");
+                }
+                vulkan12Features.setTimelineSemaphore(true);
+            }
+            if (config.useBindless) {
+                vulkan12Features
+                    .setRuntimeDescriptorArray(descriptorIndexingFeatures.runtimeDescriptorArray)
+                    .setDescriptorBindingPartiallyBound(descriptorIndexingFeatures.descriptorBindingPartiallyBound)
+                    .setDescriptorBindingSampledImageUpdateAfterBind(descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind)
+                    .setDescriptorBindingStorageBufferUpdateAfterBind(descriptorIndexingFeatures.descriptorBindingStorageBufferUpdateAfterBind)
+                    .setShaderSampledImageArrayNonUniformIndexing(descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing)
+                    .setShaderStorageBufferArrayNonUniformIndexing(descriptorIndexingFeatures.shaderStorageBufferArrayNonUniformIndexing);
+            }
+        }
+
+        void* featureChain = nullptr;
+        if (useVulkan12Features) {
+            vulkan12Features.pNext = featureChain;
+            featureChain = &vulkan12Features;
+        }
+        else if (config.useBindless) {
+            descriptorIndexingFeatures.pNext = featureChain;
+            featureChain = &descriptorIndexingFeatures;
+        }
+        if (config.useDynamicRendering) {
+            dynamicRenderingFeatures.pNext = featureChain;
+            featureChain = &dynamicRenderingFeatures;
+        }
+
         vk::DeviceCreateInfo deviceInfo(
             vk::DeviceCreateFlags(),
             queues,
             layers,
             extensions,
-            &features
+            &features,
+            featureChain
         );
         vk::Device device = physicalDevice.createDevice(deviceInfo);
 
@@ -0,0 +1,62 @@
+#pragma once
+
+//
+// Runtime checks for the x86 instruction set extensions the SIMD kernels use, so the library can be built for a
+// baseline x64 target and still pick the wider kernels on machines that have them.
+//
+// BNG_SIMD_X86 is defined when SSE2 can be assumed. BNG_TARGET("avx") in front of a function lets that one function
+// use the extension's intrinsics without enabling it for the whole build; only call such a function after the
+// matching check below says yes. MSVC allows every intrinsic anywhere, so there it expands to nothing.
+//
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#define BNG_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define BNG_TARGET(features)
+#else
+#define BNG_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+
+namespace bainangua {
+
+#if defined(BNG_SIMD_X86) && defined(_MSC_VER) && !defined(__clang__)
+	// ecx of cpuid leaf 1
+	inline int cpuidFeatureBits() {
+		int info[4];
+		__cpuid(info, 1);
+		return info[2];
+	}
+
+	// AVX and F16C use the ymm state, which the OS has to have turned on as well
+	inline bool osSavesAvxState() {
+		constexpr int osxsave = 1 << 27;
+		return (cpuidFeatureBits() & osxsave) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+	}
+#endif
+
+	inline bool cpuSupportsAvx() {
+#if defined(BNG_SIMD_X86) && defined(_MSC_VER) && !defined(__clang__)
+		static const bool supported = (cpuidFeatureBits() & (1 << 28)) != 0 && osSavesAvxState();
+		return supported;
+#elif defined(BNG_SIMD_X86)
+		return __builtin_cpu_supports("avx");
+#else
+		return false;
+#endif
+	}
+
+	inline bool cpuSupportsF16c() {
+#if defined(BNG_SIMD_X86) && defined(_MSC_VER) && !defined(__clang__)
+		static const bool supported = (cpuidFeatureBits() & (1 << 29)) != 0 && osSavesAvxState();
+		return supported;
+#elif defined(BNG_SIMD_X86)
+		return __builtin_cpu_supports("f16c");
+#else
+		return false;
+#endif
+	}
+
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+//
+// A second row backend. A FlatRow is a plain aggregate with one base class per field, so looking up a field is a
+// derived-to-base conversion picked by the key type. There is no hashing of keys and no recursion over the fields,
+// which is where most of the compile time of deep wrapper chains over boost::hana::map goes.
+//
+// FlatRow plugs into hana's Searchable and Foldable concepts plus insert/erase_key, so at_key, contains, find,
+// insert, fold_left, the has_named_field concepts, extendRow and operator| composition all work on it unchanged.
+// Start a program with RowType::makeFlatRow(...) instead of boost::hana::make_map(...) to use it.
+//
+
+#include <boost/hana/any_of.hpp>
+#include <boost/hana/at_key.hpp>
+#include <boost/hana/bool.hpp>
+#include <boost/hana/core/make.hpp>
+#include <boost/hana/erase_key.hpp>
+#include <boost/hana/find.hpp>
+#include <boost/hana/find_if.hpp>
+#include <boost/hana/first.hpp>
+#include <boost/hana/flatten.hpp>
+#include <boost/hana/insert.hpp>
+#include <boost/hana/optional.hpp>
+#include <boost/hana/pair.hpp>
+#include <boost/hana/second.hpp>
+#include <boost/hana/tuple.hpp>
+#include <boost/hana/unpack.hpp>
+#include <boost/hana/value.hpp>
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "RowType.hpp"
+
+namespace RowType {
+
+	struct FlatRowTag {};
+
+	template <typename Key, typename Value>
+	struct FlatField {
+		Value value;
+	};
+
+	// Value is deduced from the row's unique FlatField<Key, ...> base. A row without that key doesn't match.
+	template <typename Key, typename Value>
+	constexpr Value& flatField(FlatField<Key, Value>& f) { return f.value; }
+
+	template <typename Key, typename Value>
+	constexpr const Value& flatField(const FlatField<Key, Value>& f) { return f.value; }
+
+	template <typename Key, typename Value>
+	constexpr Value&& flatField(FlatField<Key, Value>&& f) { return static_cast<Value&&>(f.value); }
+
+	template <typename... Fields>
+	struct FlatRow;
+
+	template <typename... Pairs>
+	constexpr auto makeFlatRow(Pairs&&... pairs) {
+		return FlatRow<FlatField<std::decay_t<decltype(boost::hana::first(pairs))>, std::decay_t<decltype(boost::hana::second(std::forward<Pairs>(pairs)))>>...>{
+			FlatField<std::decay_t<decltype(boost::hana::first(pairs))>, std::decay_t<decltype(boost::hana::second(std::forward<Pairs>(pairs)))>>{ boost::hana::second(std::forward<Pairs>(pairs)) }...
+		};
+	}
+
+	template <typename ErasedKey, typename Key, typename Value>
+	constexpr auto keepUnlessErased(Value&& v) {
+		if constexpr (std::is_same_v<ErasedKey, Key>) {
+			return boost::hana::make_tuple();
+		}
+		else {
+			return boost::hana::make_tuple(boost::hana::make_pair(Key{}, std::forward<Value>(v)));
+		}
+	}
+
+	template <typename... Keys, typename... Values>
+	struct FlatRow<FlatField<Keys, Values>...> : FlatField<Keys, Values>... {
+		using hana_tag = FlatRowTag;
+
+		static constexpr std::size_t size = sizeof...(Keys);
+
+		// Position of a field in the row, or size if the row doesn't have it.
+		template <typename Key>
+		static constexpr std::size_t indexOf() {
+			constexpr bool matches[] = { std::is_same_v<Key, Keys>..., false };
+			std::size_t index = 0;
+			while (index < size && !matches[index]) { index++; }
+			return index;
+		}
+
+		template <typename Key>
+		static constexpr bool hasKey = indexOf<Key>() < size;
+
+		template <typename Pred>
+		static constexpr auto anyKey(Pred&& pred) {
+			return boost::hana::bool_c<(boost::hana::value<decltype(pred(Keys{}))>() || ...)>;
+		}
+
+		template <typename Self, typename Pred>
+		static constexpr auto findField(Self&& self, Pred&& pred) {
+			constexpr bool matches[] = { boost::hana::value<decltype(pred(Keys{}))>()..., false };
+			constexpr std::size_t index = [&]() {
+				std::size_t i = 0;
+				while (i < size && !matches[i]) { i++; }
+				return i;
+			}();
+			if constexpr (index == size) {
+				return boost::hana::nothing;
+			}
+			else {
+				using Key = std::tuple_element_t<index, std::tuple<Keys...>>;
+				return boost::hana::just(flatField<Key>(static_cast<Self&&>(self)));
+			}
+		}
+
+		template <typename Self, typename F>
+		static constexpr decltype(auto) unpackFields(Self&& self, F&& f) {
+			return static_cast<F&&>(f)(boost::hana::make_pair(Keys{}, flatField<Keys>(static_cast<Self&&>(self)))...);
+		}
+
+		// Like hana::insert on a map, inserting a key that's already there leaves the row as it is.
+		template <typename Self, typename Pair>
+		static constexpr auto insertField(Self&& self, Pair&& pair) {
+			using NewKey = std::decay_t<decltype(boost::hana::first(pair))>;
+			if constexpr (hasKey<NewKey>) {
+				return FlatRow(static_cast<Self&&>(self));
+			}
+			else {
+				using NewValue = std::decay_t<decltype(boost::hana::second(static_cast<Pair&&>(pair)))>;
+				return FlatRow<FlatField<Keys, Values>..., FlatField<NewKey, NewValue>>{
+					FlatField<Keys, Values>{ flatField<Keys>(static_cast<Self&&>(self)) }...,
+					FlatField<NewKey, NewValue>{ boost::hana::second(static_cast<Pair&&>(pair)) }
+				};
+			}
+		}
+
+		template <typename Self, typename Key>
+		static constexpr auto eraseField(Self&& self, const Key&) {
+			return boost::hana::unpack(
+				boost::hana::flatten(boost::hana::make_tuple(keepUnlessErased<Key, Keys>(flatField<Keys>(static_cast<Self&&>(self)))...)),
+				[](auto&&... pairs) { return makeFlatRow(std::forward<decltype(pairs)>(pairs)...); });
+		}
+	};
+
+}
+
+namespace boost::hana {
+
+	template <>
+	struct make_impl<RowType::FlatRowTag> {
+		template <typename... Pairs>
+		static constexpr auto apply(Pairs&&... pairs) {
+			return RowType::makeFlatRow(static_cast<Pairs&&>(pairs)...);
+		}
+	};
+
+	// at_key goes straight to the field instead of through find_if
+	template <>
+	struct at_key_impl<RowType::FlatRowTag> {
+		template <typename Row, typename Key>
+		static constexpr decltype(auto) apply(Row&& r, const Key&) {
+			return RowType::flatField<Key>(static_cast<Row&&>(r));
+		}
+	};
+
+	template <>
+	struct any_of_impl<RowType::FlatRowTag> {
+		template <typename Row, typename Pred>
+		static constexpr auto apply(Row&&, Pred&& pred) {
+			return std::remove_cvref_t<Row>::anyKey(static_cast<Pred&&>(pred));
+		}
+	};
+
+	template <>
+	struct find_if_impl<RowType::FlatRowTag> {
+		template <typename Row, typename Pred>
+		static constexpr auto apply(Row&& r, Pred&& pred) {
+			return std::remove_cvref_t<Row>::findField(static_cast<Row&&>(r), static_cast<Pred&&>(pred));
+		}
+	};
+
+	// unpacks to (key, value) pairs, the same as a hana::map
+	template <>
+	struct unpack_impl<RowType::FlatRowTag> {
+		template <typename Row, typename F>
+		static constexpr decltype(auto) apply(Row&& r, F&& f) {
+			return std::remove_cvref_t<Row>::unpackFields(static_cast<Row&&>(r), static_cast<F&&>(f));
+		}
+	};
+
+	template <>
+	struct insert_impl<RowType::FlatRowTag> {
+		template <typename Row, typename Pair>
+		static constexpr auto apply(Row&& r, Pair&& pair) {
+			return std::remove_cvref_t<Row>::insertField(static_cast<Row&&>(r), static_cast<Pair&&>(pair));
+		}
+	};
+
+	template <>
+	struct erase_key_impl<RowType::FlatRowTag> {
+		template <typename Row, typename Key>
+		static constexpr auto apply(Row&& r, const Key& key) {
+			return std::remove_cvref_t<Row>::eraseField(static_cast<Row&&>(r), key);
+		}
+	};
+
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+//
+// Parallel composition of row stages. `StageA() & StageB()` sets up both stages at the same time on a thread pool,
+// hands the rest of the program one row with both stages' fields, and tears them down in reverse order afterwards.
+// So (A & B & C) | D costs max(A, B, C) + D at startup instead of A + B + C + D.
+//
+// An ordinary row wrapper can't be run this way. It does its setup, calls the rest of the program from inside its
+// own stack frame, and does its teardown when that call returns; the row it hands on only exists inside that call.
+// There's no point where the rows of two wrappers running side by side could be merged into one. Stages that can
+// run in parallel instead expose their setup and teardown separately ("split stages"):
+//
+//   acquire(const Row& r)          creates the stage's resources and returns a hana::map of the fields it adds,
+//                                  either directly or as a bng_expected<> if setup can fail.
+//   release(const Fields& fields)  destroys them. fields holds at least the fields acquire() returned.
+//
+// wrapSplitStage() turns a split stage back into an ordinary wrapper, so split stages still compose with |.
+//
+// Both sides of & set up from the same input row. A stage that needs a field its sibling adds doesn't compile
+// (its acquire() constraints aren't met), and neither do two siblings that add the same field. Siblings run on
+// different threads, so they shouldn't share a command pool or submit to a queue without going through a funnel.
+//
+
+#include "bainangua.hpp"
+#include "RowType.hpp"
+
+#include <boost/hana/at_key.hpp>
+#include <boost/hana/fold_left.hpp>
+#include <boost/hana/insert.hpp>
+#include <boost/hana/keys.hpp>
+#include <boost/hana/map.hpp>
+#include <boost/hana/unpack.hpp>
+#include <coro/coro.hpp>
+
+#include <algorithm>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace RowType {
+
+	template <typename T>
+	struct isExpected : std::false_type {};
+
+	template <typename V, typename E>
+	struct isExpected<tl::expected<V, E>> : std::true_type {};
+
+	// Setup that can't fail returns its fields directly; this puts both kinds in a bng_expected.
+	template <typename Acquired>
+	auto asExpectedFields(Acquired&& acquired) {
+		if constexpr (isExpected<std::remove_cvref_t<Acquired>>::value) {
+			return std::remove_cvref_t<Acquired>(std::forward<Acquired>(acquired));
+		}
+		else {
+			return bainangua::bng_expected<std::remove_cvref_t<Acquired>>(std::forward<Acquired>(acquired));
+		}
+	}
+
+	template <typename Stage, typename Row>
+	concept isSplitStageFor = requires (Stage s, const Row& r) {
+		s.acquire(r);
+	};
+
+	template <typename Row, typename Fields>
+	constexpr auto addFields(Row&& r, const Fields& fields) {
+		return boost::hana::fold_left(fields, std::forward<Row>(r), boost::hana::insert);
+	}
+
+	template <typename Fields1, typename Fields2>
+	constexpr bool sharesFields() {
+		using Keys = decltype(boost::hana::keys(std::declval<const Fields1&>()));
+		return boost::hana::unpack(Keys{}, [](auto... keys) { return (false || ... || has_field<Fields2>(keys)); });
+	}
+
+	template <typename Stage, typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapSplitStage(Stage& stage, RowFunction& f, Row&& r) {
+		if constexpr (isExpected<std::remove_cvref_t<decltype(stage.acquire(std::as_const(r)))>>::value) {
+			auto acquired = stage.acquire(std::as_const(r));
+			if (!acquired) {
+				return tl::make_unexpected(acquired.error());
+			}
+			auto result = f.applyRow(addFields(std::forward<Row>(r), acquired.value()));
+			stage.release(acquired.value());
+			return result;
+		}
+		else {
+			auto fields = stage.acquire(std::as_const(r));
+			auto result = f.applyRow(addFields(std::forward<Row>(r), fields));
+			stage.release(fields);
+			return result;
+		}
+	}
+
+	// Parallel stages only run at startup, so they all share one pool.
+	inline coro::thread_pool& parallelStagePool() {
+		static coro::thread_pool pool(coro::thread_pool::options{ .thread_count = std::max(2u, std::thread::hardware_concurrency()) });
+		return pool;
+	}
+
+	// Nested parallel stages hand back their own task, so they don't park a pool thread waiting on their children.
+	template <typename Stage, typename Row>
+	auto acquireOnPool(coro::thread_pool& pool, Stage& stage, const Row& r) {
+		if constexpr (requires { stage.acquireAsync(pool, r); }) {
+			return stage.acquireAsync(pool, r);
+		}
+		else {
+			return [](coro::thread_pool& pool, Stage& stage, const Row& r) -> coro::task<decltype(asExpectedFields(stage.acquire(r)))> {
+				co_await pool.schedule();
+				co_return asExpectedFields(stage.acquire(r));
+			}(pool, stage, r);
+		}
+	}
+
+	template <typename Stage1, typename Stage2>
+	struct ParallelRowWrappers {
+		ParallelRowWrappers(Stage1 s1, Stage2 s2) : s1_(s1), s2_(s2) {}
+
+		Stage1 s1_;
+		Stage2 s2_;
+
+		using row_tag = RowWrapperTag;
+
+		template <typename WrappedReturnType>
+		using return_type_transformer = WrappedReturnType;
+
+		template <typename Row>
+		auto acquireAsync(coro::thread_pool& pool, const Row& r) {
+			static_assert(isSplitStageFor<Stage1, Row>, "a parallel stage can't set up from the input row; if it needs a field its sibling adds, compose them with | instead");
+			static_assert(isSplitStageFor<Stage2, Row>, "a parallel stage can't set up from the input row; if it needs a field its sibling adds, compose them with | instead");
+
+			using Fields1 = typename decltype(asExpectedFields(s1_.acquire(r)))::value_type;
+			using Fields2 = typename decltype(asExpectedFields(s2_.acquire(r)))::value_type;
+			static_assert(!sharesFields<Fields1, Fields2>(), "parallel stages can't add the same field");
+
+			using MergedFields = decltype(addFields(std::declval<Fields1>(), std::declval<const Fields2&>()));
+
+			return [](ParallelRowWrappers* self, coro::thread_pool& pool, const Row& r) -> coro::task<bainangua::bng_expected<MergedFields>> {
+				auto [result1, result2] = co_await coro::when_all(acquireOnPool(pool, self->s1_, r), acquireOnPool(pool, self->s2_, r));
+				auto acquired1 = std::move(result1.return_value());
+				auto acquired2 = std::move(result2.return_value());
+
+				if (!acquired1 || !acquired2) {
+					// give back whichever side did get set up
+					if (acquired2) { self->s2_.release(acquired2.value()); }
+					if (acquired1) { self->s1_.release(acquired1.value()); }
+					co_return tl::make_unexpected(!acquired1 ? acquired1.error() : acquired2.error());
+				}
+
+				co_return addFields(std::move(acquired1.value()), acquired2.value());
+			}(this, pool, r);
+		}
+
+		template <typename Row>
+		auto acquire(const Row& r) {
+			return coro::sync_wait(acquireAsync(parallelStagePool(), r));
+		}
+
+		template <typename Fields>
+		void release(const Fields& fields) {
+			s2_.release(fields);
+			s1_.release(fields);
+		}
+
+		template <typename RowFunction, typename Row>
+		constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row&& r) {
+			return wrapSplitStage(*this, f, std::forward<Row>(r));
+		}
+	};
+
+}
+
+// Like |, & is global. It binds tighter than |, so A | B & C | D sets up B and C together.
+
+template <typename Stage1, typename Stage2>
+	requires RowType::isRowWrapperCompose<Stage1, Stage2>
+constexpr auto operator & (Stage1 s1, Stage2 s2) { return RowType::ParallelRowWrappers<Stage1, Stage2>(s1, s2); };
@@ -2,15 +2,23 @@
 
 #include <boost/hana/assert.hpp>
 #include <boost/hana/contains.hpp>
+#include <boost/hana/core/make.hpp>
+#include <boost/hana/core/tag_of.hpp>
 #include <boost/hana/integral_constant.hpp>
 #include <boost/hana/set.hpp>
 #include <boost/hana/at_key.hpp>
 #include <boost/hana/map.hpp>
 #include <boost/hana/tuple.hpp>
 #include <boost/hana/type.hpp>
+#include <boost/hana/unpack.hpp>
 #include <boost/hana/string.hpp>
 
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "Tracing.hpp"
 
 namespace RowType {
 
@@ -86,7 +94,23 @@ namespace RowType {
 		return boost::hana::at_key(s, FieldName);
 	}
 
-		
+	// True if the row has a field with this name. Unlike boost::hana::contains(r, ...) this is still a constant
+	// expression when r is a reference parameter, so use it in `if constexpr` inside wrappers that take Row&&.
+	template <typename Row, typename FieldName>
+	constexpr bool has_field(FieldName) {
+		return decltype(boost::hana::contains(std::declval<const std::remove_cvref_t<Row>&>(), std::declval<FieldName>()))::value;
+	}
+
+	// Adds fields to a row without copying the ones already there, as long as the row is passed in as an rvalue.
+	// Unlike boost::hana::insert the new keys must not already be in the row. The result uses the same row backend
+	// (hana::map or FlatRow) as the row passed in.
+	template <typename Row, typename... Pairs>
+	constexpr auto extendRow(Row&& r, Pairs&&... newFields) {
+		return boost::hana::unpack(std::forward<Row>(r), [&](auto&&... fields) {
+			return boost::hana::make<boost::hana::tag_of_t<Row>>(std::forward<decltype(fields)>(fields)..., std::forward<Pairs>(newFields)...);
+		});
+	}
+
 	struct RowWrapperTag {};
 	struct RowFunctionTag {};
 
@@ -100,6 +124,21 @@ namespace RowType {
 		std::is_same_v<typename RowWrapper1::row_tag, RowWrapperTag>&&
 		std::is_same_v<typename RowWrapper2::row_tag, RowWrapperTag>;
 
+	template <typename RowWrapper1, typename RowWrapper2>
+	struct ComposedRowWrappers;
+
+	// Trace scopes are named after the wrapper type. A composed chain just forwards to its parts (which get
+	// their own scopes), so it gets a short name instead of its enormous type.
+	template <typename RowWrapper>
+	struct WrapperTraceName {
+		static constexpr std::string_view value = bainangua::tracing::typeName<RowWrapper>();
+	};
+
+	template <typename RowWrapper1, typename RowWrapper2>
+	struct WrapperTraceName<ComposedRowWrappers<RowWrapper1, RowWrapper2>> {
+		static constexpr std::string_view value = "RowType::ComposedRowWrappers";
+	};
+
 	template <typename RowWrapper, typename RowFunction>
 	struct ComposedRowFunction {
 		ComposedRowFunction(RowWrapper w, RowFunction f) : w_(w), f_(f) {}
@@ -110,8 +149,26 @@ namespace RowType {
 		using row_tag = RowWrapperTag;
 		using return_type = RowWrapper::template return_type_transformer<RowFunction::return_type>;
 
+		// Rows are forwarded, not copied. A wrapper that takes its row as Row&& (or const Row&) reads the caller's
+		// row in place, while one that takes Row by value gets a move when the caller hands over an rvalue.
 		template <typename Row>
-		constexpr return_type applyRow(Row r) { return w_.wrapRowFunction(f_, r); }
+		constexpr return_type applyRow(Row&& r) {
+#if BAINANGUA_TRACING
+			if (!std::is_constant_evaluated()) {
+				return tracedApplyRow(std::forward<Row>(r));
+			}
+#endif
+			return w_.wrapRowFunction(f_, std::forward<Row>(r));
+		}
+
+#if BAINANGUA_TRACING
+		// A TraceScope isn't a literal type, so it can't be declared inside the constexpr applyRow.
+		template <typename Row>
+		return_type tracedApplyRow(Row&& r) {
+			BNG_TRACE_SCOPE(WrapperTraceName<RowWrapper>::value);
+			return w_.wrapRowFunction(f_, std::forward<Row>(r));
+		}
+#endif
 	};
 
 	template <typename RowWrapper1, typename RowWrapper2>
@@ -127,8 +184,8 @@ namespace RowType {
 		using return_type_transformer = RowWrapper1::template return_type_transformer<RowWrapper2::template return_type_transformer<WrappedReturnType>>;
 
 		template <typename RowFunction, typename Row>
-		constexpr return_type_transformer<typename RowFunction::return_type> wrapRowFunction(RowFunction f, Row r) {
-			return w1_.wrapRowFunction(ComposedRowFunction<RowWrapper2, RowFunction>(w2_, f), r);
+		constexpr return_type_transformer<typename RowFunction::return_type> wrapRowFunction(RowFunction f, Row&& r) {
+			return w1_.wrapRowFunction(ComposedRowFunction<RowWrapper2, RowFunction>(w2_, f), std::forward<Row>(r));
 		}
 	};
 	
@@ -142,8 +199,8 @@ namespace RowType {
 		using return_type = RetType;
 
 		template <typename Row>
-		constexpr RetType applyRow(Row r) {
-			return l_(r);
+		constexpr RetType applyRow(Row&& r) {
+			return l_(std::forward<Row>(r));
 		}
 	};
 
@@ -0,0 +1,208 @@
+#pragma once
+
+//
+// Lightweight CPU tracing. Each thread writes complete (begin + duration) events into its own fixed-size ring
+// buffer with no locking; the buffers are only gathered up when a trace is exported. Events are recorded when a
+// scope ends, so a scope that spans a co_await and resumes on another thread still shows up as one event.
+//
+// Tracing is compiled in only when BAINANGUA_TRACING is defined to a nonzero value (see the BAINANGUA_TRACING
+// CMake option). Otherwise the BNG_TRACE_* macros expand to nothing.
+//
+
+#include <string>
+#include <string_view>
+
+namespace bainangua::tracing {
+
+	// Escapes a name for use inside a JSON string. Type names and hand-written scope names can hold quotes or
+	// backslashes, which would otherwise break the trace file.
+	inline std::string jsonEscaped(std::string_view text) {
+		std::string escaped;
+		escaped.reserve(text.size());
+		for (char c : text) {
+			switch (c) {
+			case '"': escaped += "\\\""; break;
+			case '\\': escaped += "\\\\"; break;
+			case '\n': escaped += "\\n"; break;
+			case '\t': escaped += "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20) {
+					constexpr std::string_view hexDigits = "0123456789abcdef";
+					escaped += "\\u00";
+					escaped += hexDigits[(c >> 4) & 0xf];
+					escaped += hexDigits[c & 0xf];
+				}
+				else {
+					escaped += c;
+				}
+			}
+		}
+		return escaped;
+	}
+
+	// Pulls a readable type name out of the compiler's pretty function signature.
+	template <typename T>
+	constexpr std::string_view typeName() {
+#if defined(_MSC_VER) && !defined(__clang__)
+		constexpr std::string_view signature = __FUNCSIG__;
+		constexpr std::string_view prefix = "typeName<";
+		constexpr std::string_view suffix = ">(void)";
+		constexpr size_t start = signature.find(prefix) + prefix.size();
+		constexpr size_t end = signature.rfind(suffix);
+		std::string_view name = signature.substr(start, end - start);
+		for (std::string_view keyword : { std::string_view("struct "), std::string_view("class ") }) {
+			if (name.starts_with(keyword)) { name.remove_prefix(keyword.size()); }
+		}
+		return name;
+#else
+		constexpr std::string_view signature = __PRETTY_FUNCTION__;
+		constexpr std::string_view prefix = "T = ";
+		constexpr size_t start = signature.find(prefix) + prefix.size();
+		constexpr size_t end = signature.find_first_of(";]", start);
+		return signature.substr(start, end - start);
+#endif
+	}
+
+}
+
+#if BAINANGUA_TRACING
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bainangua::tracing {
+
+	struct TraceEvent {
+		std::string_view name; // always points at static storage, either a literal or a typeName<>()
+		uint64_t beginNs;
+		uint64_t durationNs;
+	};
+
+	inline uint64_t nowNs() {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	// Single producer (the owning thread), read only on export. Old events get overwritten once the buffer wraps.
+	struct ThreadBuffer {
+		static constexpr size_t Capacity = size_t(1) << 16;
+
+		explicit ThreadBuffer(uint32_t threadId) : threadId_(threadId), events_(Capacity) {}
+
+		void push(const TraceEvent& e) {
+			uint64_t index = writeIndex_.load(std::memory_order_relaxed);
+			events_[index & (Capacity - 1)] = e;
+			writeIndex_.store(index + 1, std::memory_order_release);
+		}
+
+		uint32_t threadId_;
+		std::vector<TraceEvent> events_;
+		std::atomic<uint64_t> writeIndex_{ 0 };
+	};
+
+	struct TraceRegistry {
+		std::mutex mutex_; // only taken when a thread first traces something, and on export
+		std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+		uint32_t nextThreadId_{ 1 };
+	};
+
+	inline TraceRegistry& registry() {
+		static TraceRegistry r;
+		return r;
+	}
+
+	inline ThreadBuffer& threadBuffer() {
+		// the registry holds a reference too, so events survive the thread exiting
+		thread_local std::shared_ptr<ThreadBuffer> buffer = []() {
+			TraceRegistry& r = registry();
+			std::scoped_lock lock(r.mutex_);
+			auto b = std::make_shared<ThreadBuffer>(r.nextThreadId_++);
+			r.buffers_.push_back(b);
+			return b;
+		}();
+		return *buffer;
+	}
+
+	class TraceScope {
+	public:
+		explicit TraceScope(std::string_view name) : name_(name), beginNs_(nowNs()) {}
+		~TraceScope() { threadBuffer().push(TraceEvent{ name_, beginNs_, nowNs() - beginNs_ }); }
+
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+
+	private:
+		std::string_view name_;
+		uint64_t beginNs_;
+	};
+
+	// Writes every buffered event in the Chrome trace-event format, which Perfetto also reads. Best done while the
+	// traced threads are quiet, since a buffer that wraps during export can produce a garbled event or two.
+	inline bool writeChromeTrace(std::filesystem::path tracePath) {
+		std::ofstream out(tracePath, std::ios_base::out | std::ios_base::trunc);
+		if (!out) {
+			return false;
+		}
+
+		TraceRegistry& r = registry();
+		std::scoped_lock lock(r.mutex_);
+
+		out << "{\"traceEvents\":[";
+		bool first = true;
+		for (const auto& buffer : r.buffers_) {
+			uint64_t written = buffer->writeIndex_.load(std::memory_order_acquire);
+			uint64_t start = (written > ThreadBuffer::Capacity) ? written - ThreadBuffer::Capacity : 0;
+			for (uint64_t index = start; index < written; index++) {
+				const TraceEvent& e = buffer->events_[index & (ThreadBuffer::Capacity - 1)];
+				out << std::format("{}{{\"name\":\"{}\",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":0,\"tid\":{}}}",
+					first ? "" : ",\n", jsonEscaped(e.name), static_cast<double>(e.beginNs) / 1000.0, static_cast<double>(e.durationNs) / 1000.0, buffer->threadId_);
+				first = false;
+			}
+		}
+		out << "],\"displayTimeUnit\":\"ms\"}\n";
+		return true;
+	}
+
+	// Drops everything recorded so far.
+	inline void clearTrace() {
+		TraceRegistry& r = registry();
+		std::scoped_lock lock(r.mutex_);
+		for (const auto& buffer : r.buffers_) {
+			buffer->writeIndex_.store(0, std::memory_order_release);
+		}
+	}
+
+}
+
+#define BNG_TRACE_CONCAT_INNER(a, b) a##b
+#define BNG_TRACE_CONCAT(a, b) BNG_TRACE_CONCAT_INNER(a, b)
+
+// Times the enclosing scope. The name has to outlive the program's tracing, so use a string literal.
+#define BNG_TRACE_SCOPE(name) ::bainangua::tracing::TraceScope BNG_TRACE_CONCAT(bngTraceScope_, __COUNTER__)(name)
+
+// Times the enclosing scope, named after a type. Variadic so template types with commas work.
+#define BNG_TRACE_TYPE_SCOPE(...) ::bainangua::tracing::TraceScope BNG_TRACE_CONCAT(bngTraceScope_, __COUNTER__)(::bainangua::tracing::typeName<__VA_ARGS__>())
+
+#else
+
+#include <filesystem>
+
+namespace bainangua::tracing {
+
+	// tracing is compiled out, so there's never anything to write
+	inline bool writeChromeTrace(std::filesystem::path) { return false; }
+	inline void clearTrace() {}
+
+}
+
+#define BNG_TRACE_SCOPE(name)
+#define BNG_TRACE_TYPE_SCOPE(...)
+
+#endif
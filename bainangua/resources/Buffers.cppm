@@ -19,6 +19,7 @@ export module Buffers;
 
 import VulkanContext;
 import CommandQueue;
+import GPUProfiler;
 
 namespace bainangua {
 
@@ -145,7 +146,7 @@ export
 }
 
 export
-[[nodiscard]] auto allocateStaticGPUBuffer(VmaAllocator allocator, VkBufferUsageFlags usage, void* data, std::size_t dataSize, generic_buffer stagingBuffer, vk::CommandBuffer cmd, std::shared_ptr<CommandQueueFunnel> queue, coro::thread_pool &threads) -> coro::task<bng_expected<generic_buffer>>
+[[nodiscard]] auto allocateStaticGPUBuffer(VmaAllocator allocator, VkBufferUsageFlags usage, void* data, std::size_t dataSize, generic_buffer stagingBuffer, vk::CommandBuffer cmd, std::shared_ptr<CommandQueueFunnel> queue, coro::thread_pool &threads, UploadProfiling profiling = {}) -> coro::task<bng_expected<generic_buffer>>
 {
     VkBufferCreateInfo bufferCreateInfo{
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -199,12 +200,15 @@ export
         vmaDestroyBuffer(allocator, buffer, allocation);
         co_return bng_unexpected("allocateStaticGPUBuffer: failed to start command buffer");
     }
+    uint32_t profileScope = profiling.beginScope(cmd, "allocateStaticGPUBuffer");
     vk::BufferCopy copyRegion(0, 0, dataSize);
     cmd.copyBuffer(stagingBuffer.buffer_handle_, buffer, 1, &copyRegion);
+    profiling.endScope(cmd, profileScope);
     cmd.end();
 
     vk::SubmitInfo submitInfo(0, nullptr, nullptr, 1, &cmd, 0, nullptr);
     co_await queue->awaitCommand(submitInfo, threads);
+    profiling.finish(cmd);
 
     co_return generic_buffer{ buffer, allocation, allocator };
 }
@@ -6,6 +6,8 @@ module;
 
 #include "bainangua.hpp"
 #include "RowType.hpp"
+#include "ParallelStages.hpp"
+#include "Tracing.hpp"
 #include "vk_result_to_string.h"
 
 #include <boost/container_hash/hash.hpp>
@@ -50,6 +52,7 @@ public:
 	// Note that after co_await-ing on this coro::event your coroutine will be on the fence_reactor thread,
 	// so it's a good idea to immediately requeue onto whatever thread_pool your coroutine was originally on.
 	auto asyncCommand(const vk::SubmitInfo& b) -> bng_expected<std::shared_ptr<coro::event>> {
+		BNG_TRACE_SCOPE("CommandQueueFunnel::asyncCommand");
 		std::scoped_lock accessLock(access_mutex_);
 
 		bng_expected<vk::Fence> awaitingFence = acquireFence();
@@ -69,6 +72,8 @@ public:
 	// on the GPU (detected using a vkFence). Since this will cause thread jumping
 	// you need to also submit a thread_pool where the coroutine will get scheduled once the command buffer is finished.
 	auto awaitCommand(const vk::SubmitInfo& b, coro::thread_pool &resume_on) -> coro::task<bng_expected<void>> {
+		// covers the submit, the GPU work and getting rescheduled afterwards
+		BNG_TRACE_SCOPE("CommandQueueFunnel::awaitCommand");
 
 		auto result = asyncCommand(b);
 		if (result) {
@@ -159,7 +164,8 @@ private:
 };
 
 /**
-* Creates two CommandQueueFunnels, 'graphicsFunnel' and 'presentFunnel'
+* Creates two CommandQueueFunnels, 'graphicsFunnel' and 'presentFunnel'. This is a split stage, so it can be set
+* up in parallel with other split stages using &.
 */
 export
 struct CreateQueueFunnels {
@@ -169,13 +175,13 @@ struct CreateQueueFunnels {
     template <typename WrappedReturnType>
     using return_type_transformer = WrappedReturnType;
 
-    template <typename RowFunction, typename Row>
+    template <typename Row>
 	requires   RowType::has_named_field<Row, BOOST_HANA_STRING("instance"), vk::Instance>
 	        && RowType::has_named_field<Row, BOOST_HANA_STRING("physicalDevice"), vk::PhysicalDevice>
 			&& RowType::has_named_field<Row, BOOST_HANA_STRING("device"), vk::Device>
 			&& RowType::has_named_field<Row, BOOST_HANA_STRING("graphicsQueue"), vk::Queue>
 			&& RowType::has_named_field<Row, BOOST_HANA_STRING("presentQueue"), vk::Queue>
-	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+	auto acquire(const Row& r) {
 		vk::Instance instance = boost::hana::at_key(r, BOOST_HANA_STRING("instance"));
 		vk::PhysicalDevice physicalDevice = boost::hana::at_key(r, BOOST_HANA_STRING("physicalDevice"));
 		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
@@ -188,10 +194,18 @@ struct CreateQueueFunnels {
 			graphicsFunnel :
 			std::make_shared<CommandQueueFunnel>(device, presentQueue);
 
-		auto rWithFunnels = boost::hana::insert(boost::hana::insert(r,
-			boost::hana::make_pair(BOOST_HANA_STRING("graphicsFunnel"), graphicsFunnel)),
+		return boost::hana::make_map(
+			boost::hana::make_pair(BOOST_HANA_STRING("graphicsFunnel"), graphicsFunnel),
 			boost::hana::make_pair(BOOST_HANA_STRING("presentFunnel"), presentFunnel));
-        return f.applyRow(rWithFunnels);
+    }
+
+	// the funnels shut themselves down when the last reference goes away
+	template <typename Fields>
+	void release(const Fields&) {}
+
+    template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		return RowType::wrapSplitStage(*this, f, std::move(r));
     }
 };
 
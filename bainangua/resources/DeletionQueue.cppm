@@ -0,0 +1,190 @@
+/**
+* A device-wide queue of destroy functions that run once the GPU is done with whatever they destroy. Each entry is
+* tagged with either the frame it was enqueued in or a point on a timeline semaphore. The queue gets drained a bit
+* at a time at the end of every frame, so releasing resources mid-session doesn't need a device.waitIdle().
+*/
+module;
+
+#include "bainangua.hpp"
+#include "RowType.hpp"
+
+#include <coroutine>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+export module DeletionQueue;
+
+namespace bainangua {
+
+export
+class DeletionQueue
+{
+public:
+	// framesInFlight is how many frames can be submitted but not yet finished. The standard loop uses MultiFrameCount.
+	DeletionQueue(vk::Device device, uint64_t framesInFlight) : device_(device), framesInFlight_(framesInFlight) {}
+	~DeletionQueue() { flush(); }
+
+	DeletionQueue(const DeletionQueue&) = delete;
+	DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+	// Runs destroyFunction once every frame that might have been recorded before now has completed.
+	void enqueue(std::function<void()> destroyFunction) {
+		std::scoped_lock lock(access_mutex_);
+		frameEntries_.push_back(FrameEntry{ currentFrame_, std::move(destroyFunction) });
+	}
+
+	// Runs destroyFunction once the timeline semaphore reaches waitValue. Timeline semaphores need a device created
+	// with VulkanContextConfig::useTimelineSemaphores.
+	void enqueue(vk::Semaphore timeline, uint64_t waitValue, std::function<void()> destroyFunction) {
+		std::scoped_lock lock(access_mutex_);
+		timelineEntries_.push_back(TimelineEntry{ timeline, waitValue, std::move(destroyFunction) });
+	}
+
+	// Call at the end of every frame, after it has been submitted. Runs whatever is now safe to destroy.
+	void endFrame() {
+		std::vector<std::function<void()>> ready;
+		{
+			std::scoped_lock lock(access_mutex_);
+			currentFrame_++;
+			collectReady(ready);
+		}
+		// run these outside the lock, so destroy functions can enqueue more work
+		for (auto& destroyFunction : ready) { destroyFunction(); }
+	}
+
+	// Runs everything still queued, ready or not. Only call this once the device is idle.
+	void flush() {
+		std::vector<std::function<void()>> remaining;
+		{
+			std::scoped_lock lock(access_mutex_);
+			for (auto& e : frameEntries_) { remaining.push_back(std::move(e.destroyFunction)); }
+			for (auto& e : timelineEntries_) { remaining.push_back(std::move(e.destroyFunction)); }
+			frameEntries_.clear();
+			timelineEntries_.clear();
+		}
+		for (auto& destroyFunction : remaining) { destroyFunction(); }
+	}
+
+	uint64_t currentFrame() const {
+		std::scoped_lock lock(access_mutex_);
+		return currentFrame_;
+	}
+
+	size_t pendingCount() const {
+		std::scoped_lock lock(access_mutex_);
+		return frameEntries_.size() + timelineEntries_.size();
+	}
+
+private:
+	struct FrameEntry {
+		uint64_t frame;
+		std::function<void()> destroyFunction;
+	};
+
+	struct TimelineEntry {
+		vk::Semaphore timeline;
+		uint64_t waitValue;
+		std::function<void()> destroyFunction;
+	};
+
+	void collectReady(std::vector<std::function<void()>>& ready) {
+		// Frame N is finished once the loop has waited on its fence, which happens when frame N + framesInFlight starts.
+		// Entries are pushed in frame order, so the ready ones are always at the front.
+		auto frameIt = frameEntries_.begin();
+		while (frameIt != frameEntries_.end() && frameIt->frame + framesInFlight_ < currentFrame_) {
+			ready.push_back(std::move(frameIt->destroyFunction));
+			++frameIt;
+		}
+		frameEntries_.erase(frameEntries_.begin(), frameIt);
+
+		if (!timelineEntries_.empty()) {
+			std::erase_if(timelineEntries_, [&](TimelineEntry& e) {
+				if (device_.getSemaphoreCounterValue(e.timeline) < e.waitValue) {
+					return false;
+				}
+				ready.push_back(std::move(e.destroyFunction));
+				return true;
+			});
+		}
+	}
+
+	vk::Device device_;
+	uint64_t framesInFlight_;
+	uint64_t currentFrame_{ 0 };
+
+	mutable std::mutex access_mutex_;
+
+	std::vector<FrameEntry> frameEntries_;
+	std::vector<TimelineEntry> timelineEntries_;
+};
+
+
+struct DeletionQueueFrameHook {
+	struct promise_type {
+		DeletionQueueFrameHook get_return_object() {
+			return { .h_ = std::coroutine_handle<promise_type>::from_promise(*this) };
+		}
+		std::suspend_never initial_suspend() { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void unhandled_exception() {}
+		void return_void() {}
+	};
+
+	std::coroutine_handle<promise_type> h_;
+	operator std::coroutine_handle<>() const { return h_; }
+};
+
+// Drains the deletion queue, then passes the end-of-frame on to whatever callback was there before.
+DeletionQueueFrameHook drainAtEndOfFrame(DeletionQueue* deletionQueue, std::coroutine_handle<> innerCallback)
+{
+	for (;;) {
+		co_await std::suspend_always();
+		deletionQueue->endFrame();
+		innerCallback();
+	}
+}
+
+/**
+* Creates a DeletionQueue and hooks it into the end-of-frame callback. Put this after whatever provides
+* "endOfFrameCallback" and before the frame loop.
+*/
+export
+struct DeletionQueueStage {
+	DeletionQueueStage(uint64_t framesInFlight) : framesInFlight_(framesInFlight) {}
+
+	uint64_t framesInFlight_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+		requires   RowType::has_named_field<Row, BOOST_HANA_STRING("device"), vk::Device>
+				&& RowType::has_named_field<Row, BOOST_HANA_STRING("endOfFrameCallback"), std::coroutine_handle<>>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+		std::coroutine_handle<> innerCallback = boost::hana::at_key(r, BOOST_HANA_STRING("endOfFrameCallback"));
+
+		std::shared_ptr<DeletionQueue> deletionQueue = std::make_shared<DeletionQueue>(device, framesInFlight_);
+		std::coroutine_handle<> frameCallback(drainAtEndOfFrame(deletionQueue.get(), innerCallback));
+
+		auto rWithDeletionQueue = boost::hana::insert(
+			boost::hana::erase_key(r, BOOST_HANA_STRING("endOfFrameCallback")),
+			boost::hana::make_pair(BOOST_HANA_STRING("endOfFrameCallback"), frameCallback)
+		);
+		auto rWithBoth = boost::hana::insert(rWithDeletionQueue,
+			boost::hana::make_pair(BOOST_HANA_STRING("deletionQueue"), deletionQueue)
+		);
+		auto result = f.applyRow(rWithBoth);
+
+		device.waitIdle();
+		deletionQueue->flush();
+		frameCallback.destroy();
+
+		return result;
+	}
+};
+
+}
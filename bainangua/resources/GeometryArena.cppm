@@ -0,0 +1,482 @@
+/**
+* A geometry arena: one large device-local vertex buffer and one large index buffer that many meshes are packed into.
+* Space in each buffer is handed out by a VMA virtual block (a TLSF allocator that only does the bookkeeping), so
+* adding or removing a mesh never creates or destroys a Vulkan buffer.
+*
+* Every mesh in an arena shares the same vertex layout and index type. The virtual blocks count in vertices and
+* indices rather than bytes, so a mesh's offsets go straight into drawIndexed() as firstIndex/vertexOffset, and all
+* the meshes in an arena can be drawn after a single bind().
+*
+* A mesh can also carry several levels of detail: the LODs share the mesh's vertices and only differ in which
+* slice of its index range they draw. LodSelector picks one per instance from how big the instance is on screen.
+*/
+module;
+
+#include "bainangua.hpp"
+#include "RowType.hpp"
+#include "vk_result_to_string.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+#include <coro/coro.hpp>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+
+export module GeometryArena;
+
+import VulkanContext;
+import CommandQueue;
+import Buffers;
+import MeshProcessing;
+import DeletionQueue;
+import GPUProfiler;
+
+namespace bainangua {
+
+export
+struct MeshHandle {
+	VmaVirtualAllocation vertexAllocation_{ VK_NULL_HANDLE };
+	VmaVirtualAllocation indexAllocation_{ VK_NULL_HANDLE };
+
+	uint32_t vertexCount{ 0 };
+	uint32_t indexCount{ 0 };
+
+	// pass these to drawIndexed()
+	uint32_t firstIndex{ 0 };
+	int32_t vertexOffset{ 0 };
+};
+
+export
+struct MeshLod {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float error; // object-space error, from generateLods
+};
+
+export
+struct LodMeshHandle {
+	MeshHandle mesh;
+	std::vector<MeshLod> lods; // finest first
+	BoundingSphere bounds;
+};
+
+export
+class GeometryArena : public std::enable_shared_from_this<GeometryArena>
+{
+public:
+	// Creates the two backing buffers. vertexStride is the size of one vertex in bytes.
+	static auto create(VmaAllocator allocator, uint32_t vertexStride, uint32_t maxVertices, uint32_t maxIndices, vk::IndexType indexType = vk::IndexType::eUint32) -> bng_expected<std::shared_ptr<GeometryArena>> {
+		if (indexType != vk::IndexType::eUint16 && indexType != vk::IndexType::eUint32) {
+			return bng_unexpected("GeometryArena: index type must be eUint16 or eUint32");
+		}
+		uint32_t indexSize = (indexType == vk::IndexType::eUint16) ? 2 : 4;
+
+		auto vertexBuffer = allocateArenaBuffer(allocator, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, static_cast<VkDeviceSize>(vertexStride) * maxVertices);
+		if (!vertexBuffer) {
+			return bng_unexpected("GeometryArena: could not create vertex buffer: " + vertexBuffer.error());
+		}
+		auto indexBuffer = allocateArenaBuffer(allocator, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, static_cast<VkDeviceSize>(indexSize) * maxIndices);
+		if (!indexBuffer) {
+			vertexBuffer.value().release();
+			return bng_unexpected("GeometryArena: could not create index buffer: " + indexBuffer.error());
+		}
+
+		VmaVirtualBlock vertexBlock;
+		VmaVirtualBlockCreateInfo vertexBlockInfo{ .size = maxVertices };
+		VkResult vertexBlockResult = vmaCreateVirtualBlock(&vertexBlockInfo, &vertexBlock);
+		if (vertexBlockResult != VK_SUCCESS) {
+			vertexBuffer.value().release();
+			indexBuffer.value().release();
+			return formatVkResultError("GeometryArena: could not create vertex block", vk::Result(vertexBlockResult));
+		}
+		VmaVirtualBlock indexBlock;
+		VmaVirtualBlockCreateInfo indexBlockInfo{ .size = maxIndices };
+		VkResult indexBlockResult = vmaCreateVirtualBlock(&indexBlockInfo, &indexBlock);
+		if (indexBlockResult != VK_SUCCESS) {
+			vmaDestroyVirtualBlock(vertexBlock);
+			vertexBuffer.value().release();
+			indexBuffer.value().release();
+			return formatVkResultError("GeometryArena: could not create index block", vk::Result(indexBlockResult));
+		}
+
+		return std::shared_ptr<GeometryArena>(new GeometryArena(allocator, vertexStride, indexType, indexSize, vertexBuffer.value(), indexBuffer.value(), vertexBlock, indexBlock));
+	}
+
+	~GeometryArena() {
+		// any meshes still in the arena go along with it
+		vmaClearVirtualBlock(vertexBlock_);
+		vmaClearVirtualBlock(indexBlock_);
+		vmaDestroyVirtualBlock(vertexBlock_);
+		vmaDestroyVirtualBlock(indexBlock_);
+		vertexBuffer_.release();
+		indexBuffer_.release();
+	}
+
+	GeometryArena(const GeometryArena&) = delete;
+	GeometryArena& operator=(const GeometryArena&) = delete;
+
+	// Copies a mesh into the arena using cmd, and resumes on threads once the copy has finished on the GPU.
+	// sizeof(V) must match the arena's vertex stride and sizeof(Index) its index type.
+	template <typename V, typename Index>
+	auto uploadMesh(const std::vector<V>& vertices, const std::vector<Index>& indices, vk::CommandBuffer cmd, std::shared_ptr<CommandQueueFunnel> queue, coro::thread_pool& threads) -> coro::task<bng_expected<MeshHandle>> {
+		if (sizeof(V) != vertexStride_) {
+			co_return bng_unexpected("GeometryArena::uploadMesh: vertex size does not match the arena's vertex stride");
+		}
+		if (sizeof(Index) != indexSize_) {
+			co_return bng_unexpected("GeometryArena::uploadMesh: index size does not match the arena's index type");
+		}
+		if (indexSize_ == 2 && vertices.size() > MaxVertices16) {
+			co_return bng_unexpected("GeometryArena::uploadMesh: mesh has too many vertices for 16-bit indices");
+		}
+		co_return co_await uploadMeshData(vertices.data(), static_cast<uint32_t>(vertices.size()), indices.data(), static_cast<uint32_t>(indices.size()), cmd, queue, threads);
+	}
+
+	// Uploads the vertices once and every LOD's indices back to back in one index range. V needs a glm::vec3 pos3
+	// member, for the bounding sphere.
+	template <typename V>
+	auto uploadMeshLods(const std::vector<V>& vertices, const std::vector<MeshLodIndices>& lods, vk::CommandBuffer cmd, std::shared_ptr<CommandQueueFunnel> queue, coro::thread_pool& threads) -> coro::task<bng_expected<LodMeshHandle>> {
+		std::vector<uint32_t> indices;
+		std::vector<MeshLod> ranges;
+		for (const MeshLodIndices& lod : lods) {
+			ranges.push_back(MeshLod{ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lod.indices.size()), lod.error });
+			indices.insert(indices.end(), lod.indices.begin(), lod.indices.end());
+		}
+
+		bng_expected<MeshHandle> mesh;
+		if (indexType_ == vk::IndexType::eUint16) {
+			if (vertices.size() > MaxVertices16 || std::ranges::any_of(indices, [](uint32_t index) { return index > 0xffff; })) {
+				co_return bng_unexpected("GeometryArena::uploadMeshLods: mesh is too big for 16-bit indices");
+			}
+			std::vector<uint16_t> indices16(indices.begin(), indices.end());
+			mesh = co_await uploadMesh(vertices, indices16, cmd, queue, threads);
+		}
+		else {
+			mesh = co_await uploadMesh(vertices, indices, cmd, queue, threads);
+		}
+		if (!mesh) {
+			co_return bng_unexpected(mesh.error());
+		}
+		for (MeshLod& range : ranges) {
+			range.firstIndex += mesh.value().firstIndex;
+		}
+
+		std::vector<glm::vec3> positions(vertices.size());
+		for (size_t v = 0; v < vertices.size(); v++) {
+			positions[v] = vertices[v].pos3;
+		}
+		co_return LodMeshHandle{ mesh.value(), std::move(ranges), boundingSphere(positions) };
+	}
+
+	// Hands the mesh's space back to the arena right away. The GPU must be done with any draws of it; meshes that
+	// might still be in flight go through one of the DeletionQueue overloads below instead.
+	void free(MeshHandle& mesh) {
+		std::scoped_lock lock(access_mutex_);
+		freeAllocations(mesh.vertexAllocation_, mesh.indexAllocation_);
+		mesh = MeshHandle{};
+	}
+
+	void free(LodMeshHandle& mesh) {
+		free(mesh.mesh);
+		mesh.lods.clear();
+	}
+
+	// Clears the handle now but keeps the mesh's space allocated until the frames that might draw it are finished.
+	// The queue holds a reference to the arena until then.
+	void free(MeshHandle& mesh, DeletionQueue& deletionQueue) {
+		deletionQueue.enqueue(deferredFree(mesh));
+		mesh = MeshHandle{};
+	}
+
+	// As above, but the space comes back once the timeline semaphore reaches waitValue.
+	void free(MeshHandle& mesh, DeletionQueue& deletionQueue, vk::Semaphore timeline, uint64_t waitValue) {
+		deletionQueue.enqueue(timeline, waitValue, deferredFree(mesh));
+		mesh = MeshHandle{};
+	}
+
+	void free(LodMeshHandle& mesh, DeletionQueue& deletionQueue) {
+		free(mesh.mesh, deletionQueue);
+		mesh.lods.clear();
+	}
+
+	// Binds the arena's vertex buffer (at binding 0) and index buffer. Any mesh in the arena can be drawn after this.
+	void bind(vk::CommandBuffer buffer) const {
+		vk::Buffer vertexBuffer = vertexBuffer_.buffer_handle_;
+		vk::DeviceSize offset = 0;
+		buffer.bindVertexBuffers(0, 1, &vertexBuffer, &offset);
+		buffer.bindIndexBuffer(indexBuffer_.buffer_handle_, 0, indexType_);
+	}
+
+	void draw(vk::CommandBuffer buffer, const MeshHandle& mesh, uint32_t instanceCount = 1, uint32_t firstInstance = 0) const {
+		buffer.drawIndexed(mesh.indexCount, instanceCount, mesh.firstIndex, mesh.vertexOffset, firstInstance);
+	}
+
+	void draw(vk::CommandBuffer buffer, const LodMeshHandle& mesh, size_t lod, uint32_t instanceCount = 1, uint32_t firstInstance = 0) const {
+		const MeshLod& range = mesh.lods[std::min(lod, mesh.lods.size() - 1)];
+		buffer.drawIndexed(range.indexCount, instanceCount, range.firstIndex, mesh.mesh.vertexOffset, firstInstance);
+	}
+
+	// Indices are local to their mesh, so with 16-bit indices this limits each mesh, not the arena.
+	static constexpr size_t MaxVertices16 = 0x10000;
+
+	vk::Buffer vertexBuffer() const { return vertexBuffer_.buffer_handle_; }
+	vk::Buffer indexBuffer() const { return indexBuffer_.buffer_handle_; }
+	vk::IndexType indexType() const { return indexType_; }
+	uint32_t vertexStride() const { return vertexStride_; }
+
+	// Times every upload into the arena from now on. Set it before any uploads start.
+	void setUploadProfiling(UploadProfiling profiling) { profiling_ = profiling; }
+
+	// number of vertices and indices currently handed out
+	uint64_t usedVertices() const {
+		std::scoped_lock lock(access_mutex_);
+		return usedCount(vertexBlock_);
+	}
+	uint64_t usedIndices() const {
+		std::scoped_lock lock(access_mutex_);
+		return usedCount(indexBlock_);
+	}
+
+private:
+	GeometryArena(VmaAllocator allocator, uint32_t vertexStride, vk::IndexType indexType, uint32_t indexSize, generic_buffer vertexBuffer, generic_buffer indexBuffer, VmaVirtualBlock vertexBlock, VmaVirtualBlock indexBlock)
+		: allocator_(allocator), vertexStride_(vertexStride), indexType_(indexType), indexSize_(indexSize),
+		  vertexBuffer_(vertexBuffer), indexBuffer_(indexBuffer), vertexBlock_(vertexBlock), indexBlock_(indexBlock) {}
+
+	void freeAllocations(VmaVirtualAllocation vertexAllocation, VmaVirtualAllocation indexAllocation) {
+		if (vertexAllocation != VK_NULL_HANDLE) {
+			vmaVirtualFree(vertexBlock_, vertexAllocation);
+		}
+		if (indexAllocation != VK_NULL_HANDLE) {
+			vmaVirtualFree(indexBlock_, indexAllocation);
+		}
+	}
+
+	auto deferredFree(const MeshHandle& mesh) -> std::function<void()> {
+		return [arena = shared_from_this(), vertexAllocation = mesh.vertexAllocation_, indexAllocation = mesh.indexAllocation_]() {
+			std::scoped_lock lock(arena->access_mutex_);
+			arena->freeAllocations(vertexAllocation, indexAllocation);
+		};
+	}
+
+	static auto allocateArenaBuffer(VmaAllocator allocator, VkBufferUsageFlags usage, VkDeviceSize size) -> bng_expected<generic_buffer> {
+		VkBufferCreateInfo bufferCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size = size,
+			.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE
+		};
+		VmaAllocationCreateInfo vmaAllocateInfo{
+			.flags = 0,
+			.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+			.requiredFlags = 0,
+			.preferredFlags = 0,
+			.memoryTypeBits = 0,
+			.pool = VK_NULL_HANDLE,
+			.pUserData = nullptr,
+			.priority = 0.0f
+		};
+		VkBuffer buffer;
+		VmaAllocation allocation;
+		auto vkResult = vmaCreateBuffer(allocator, &bufferCreateInfo, &vmaAllocateInfo, &buffer, &allocation, nullptr);
+		if (vkResult != VK_SUCCESS) {
+			return formatVkResultError("vmaCreateBuffer failed", vk::Result(vkResult));
+		}
+		return generic_buffer{ buffer, allocation, allocator };
+	}
+
+	static uint64_t usedCount(VmaVirtualBlock block) {
+		VmaStatistics stats;
+		vmaGetVirtualBlockStatistics(block, &stats);
+		return stats.allocationBytes;
+	}
+
+	auto uploadMeshData(const void* vertexData, uint32_t vertexCount, const void* indexData, uint32_t indexCount, vk::CommandBuffer cmd, std::shared_ptr<CommandQueueFunnel> queue, coro::thread_pool& threads) -> coro::task<bng_expected<MeshHandle>> {
+		// VMA doesn't allow zero-sized allocations
+		if (vertexCount == 0 || indexCount == 0) {
+			co_return bng_unexpected("GeometryArena::uploadMesh: mesh has no vertices or no indices");
+		}
+
+		MeshHandle mesh{ .vertexCount = vertexCount, .indexCount = indexCount };
+
+		{
+			std::scoped_lock lock(access_mutex_);
+
+			VkDeviceSize vertexStart;
+			VmaVirtualAllocationCreateInfo vertexInfo{ .size = vertexCount };
+			if (vmaVirtualAllocate(vertexBlock_, &vertexInfo, &mesh.vertexAllocation_, &vertexStart) != VK_SUCCESS) {
+				co_return bng_unexpected("GeometryArena::uploadMesh: out of vertex space");
+			}
+			VkDeviceSize indexStart;
+			VmaVirtualAllocationCreateInfo indexInfo{ .size = indexCount };
+			if (vmaVirtualAllocate(indexBlock_, &indexInfo, &mesh.indexAllocation_, &indexStart) != VK_SUCCESS) {
+				vmaVirtualFree(vertexBlock_, mesh.vertexAllocation_);
+				co_return bng_unexpected("GeometryArena::uploadMesh: out of index space");
+			}
+
+			mesh.vertexOffset = static_cast<int32_t>(vertexStart);
+			mesh.firstIndex = static_cast<uint32_t>(indexStart);
+		}
+
+		auto result = co_await copyIntoArena(mesh, vertexData, indexData, cmd, queue, threads);
+		if (!result) {
+			free(mesh);
+			co_return bng_unexpected(result.error());
+		}
+		co_return mesh;
+	}
+
+	// both halves of the mesh go through one staging buffer and one submit
+	auto copyIntoArena(const MeshHandle& mesh, const void* vertexData, const void* indexData, vk::CommandBuffer cmd, std::shared_ptr<CommandQueueFunnel> queue, coro::thread_pool& threads) -> coro::task<bng_expected<void>> {
+		size_t vertexBytes = static_cast<size_t>(mesh.vertexCount) * vertexStride_;
+		size_t indexBytes = static_cast<size_t>(mesh.indexCount) * indexSize_;
+
+		auto stagingResult = allocateStagingBuffer(allocator_, 0, vertexBytes + indexBytes);
+		if (!stagingResult) {
+			co_return bng_unexpected("GeometryArena::uploadMesh: could not create staging buffer: " + stagingResult.error());
+		}
+		generic_buffer staging = stagingResult.value();
+
+		void* stagingMemory;
+		if (vmaMapMemory(allocator_, staging.allocation_, &stagingMemory) != VK_SUCCESS) {
+			staging.release();
+			co_return bng_unexpected("GeometryArena::uploadMesh: vmaMapMemory failed");
+		}
+		memcpy(stagingMemory, vertexData, vertexBytes);
+		memcpy(static_cast<std::byte*>(stagingMemory) + vertexBytes, indexData, indexBytes);
+		vmaUnmapMemory(allocator_, staging.allocation_);
+
+		vk::CommandBufferBeginInfo beginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+		vk::Result commandBeginResult = cmd.begin(&beginInfo);
+		if (commandBeginResult != vk::Result::eSuccess) {
+			staging.release();
+			co_return formatVkResultError("GeometryArena::uploadMesh: failed to start command buffer", commandBeginResult);
+		}
+		uint32_t profileScope = profiling_.beginScope(cmd, "GeometryArena upload");
+		vk::BufferCopy vertexRegion(0, static_cast<vk::DeviceSize>(mesh.vertexOffset) * vertexStride_, vertexBytes);
+		cmd.copyBuffer(staging.buffer_handle_, vertexBuffer_.buffer_handle_, 1, &vertexRegion);
+		vk::BufferCopy indexRegion(vertexBytes, static_cast<vk::DeviceSize>(mesh.firstIndex) * indexSize_, indexBytes);
+		cmd.copyBuffer(staging.buffer_handle_, indexBuffer_.buffer_handle_, 1, &indexRegion);
+		profiling_.endScope(cmd, profileScope);
+		cmd.end();
+
+		vk::SubmitInfo submitInfo(0, nullptr, nullptr, 1, &cmd, 0, nullptr);
+		auto submitResult = co_await queue->awaitCommand(submitInfo, threads);
+		profiling_.finish(cmd);
+
+		staging.release();
+		co_return submitResult;
+	}
+
+	VmaAllocator allocator_;
+	uint32_t vertexStride_;
+	vk::IndexType indexType_;
+	uint32_t indexSize_;
+
+	generic_buffer vertexBuffer_;
+	generic_buffer indexBuffer_;
+	UploadProfiling profiling_;
+
+	// virtual blocks aren't thread-safe, and meshes get loaded from several threads
+	mutable std::mutex access_mutex_;
+	VmaVirtualBlock vertexBlock_;
+	VmaVirtualBlock indexBlock_;
+};
+
+
+/**
+* Picks a LOD per instance from how big it is on screen. The coarsest LOD whose error, projected to the screen at
+* the instance's distance, stays under pixelError pixels wins, so a mesh covering a few pixels draws its last LOD.
+*/
+export
+struct LodSelector {
+	glm::vec3 eye;
+	float projectionScale; // viewportHeight / (2 tan(fovY / 2)): pixels per world unit at distance 1
+	float pixelError;
+
+	static LodSelector fromCamera(glm::vec3 eye, float fovY, float viewportHeight, float pixelError = 1.0f) {
+		return LodSelector{ eye, viewportHeight / (2.0f * std::tan(fovY * 0.5f)), pixelError };
+	}
+
+	// Assumes uniform scale; with non-uniform scale the largest axis is used, which errs on the side of detail.
+	size_t select(const LodMeshHandle& mesh, const glm::mat4& transform) const {
+		float scale = std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])) });
+		glm::vec3 center(transform * glm::vec4(mesh.bounds.center, 1.0f));
+
+		// measured to the near side of the bounding sphere; inside it, always full detail
+		float distance = glm::length(center - eye) - mesh.bounds.radius * scale;
+		if (distance <= 0.0f) {
+			return 0;
+		}
+		float pixelsPerUnit = projectionScale * scale / distance;
+		for (size_t lod = mesh.lods.size(); lod-- > 1;) {
+			if (mesh.lods[lod].error * pixelsPerUnit <= pixelError) {
+				return lod;
+			}
+		}
+		return 0;
+	}
+
+	void select(const LodMeshHandle& mesh, std::span<const glm::mat4> transforms, std::span<uint32_t> lods) const {
+		for (size_t i = 0; i < transforms.size(); i++) {
+			lods[i] = static_cast<uint32_t>(select(mesh, transforms[i]));
+		}
+	}
+};
+
+
+/**
+* Creates a GeometryArena and adds it to the row as "geometryArena". This is a split stage, so it can be set up in
+* parallel with other split stages using &. With a "gpuProfiler" in the row, uploads are timed, assuming they go to
+* the graphics queue.
+*/
+export
+struct CreateGeometryArena {
+	CreateGeometryArena(uint32_t vertexStride, uint32_t maxVertices = 1 << 20, uint32_t maxIndices = 1 << 22, vk::IndexType indexType = vk::IndexType::eUint32)
+		: vertexStride_(vertexStride), maxVertices_(maxVertices), maxIndices_(maxIndices), indexType_(indexType) {}
+
+	uint32_t vertexStride_;
+	uint32_t maxVertices_;
+	uint32_t maxIndices_;
+	vk::IndexType indexType_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename Row>
+		requires RowType::has_named_field<Row, BOOST_HANA_STRING("vmaAllocator"), VmaAllocator>
+	auto acquire(const Row& r) -> bng_expected<decltype(boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("geometryArena"), std::shared_ptr<GeometryArena>())))> {
+		VmaAllocator allocator = boost::hana::at_key(r, BOOST_HANA_STRING("vmaAllocator"));
+
+		auto arena = GeometryArena::create(allocator, vertexStride_, maxVertices_, maxIndices_, indexType_);
+		if constexpr (RowType::has_field<Row>(BOOST_HANA_STRING("gpuProfiler")) && RowType::has_field<Row>(BOOST_HANA_STRING("graphicsQueueFamilyIndex"))) {
+			if (arena) {
+				std::shared_ptr<GPUProfiler> profiler = boost::hana::at_key(r, BOOST_HANA_STRING("gpuProfiler"));
+				uint32_t graphicsQueueFamilyIndex = boost::hana::at_key(r, BOOST_HANA_STRING("graphicsQueueFamilyIndex"));
+				arena.value()->setUploadProfiling(UploadProfiling{ profiler, graphicsQueueFamilyIndex });
+			}
+		}
+		return arena.map([](std::shared_ptr<GeometryArena> created) {
+			return boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("geometryArena"), created));
+		});
+	}
+
+	// the arena is destroyed along with the last reference to it
+	template <typename Fields>
+	void release(const Fields&) {}
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		return RowType::wrapSplitStage(*this, f, std::move(r));
+	}
+};
+
+}
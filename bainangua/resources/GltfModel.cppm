@@ -0,0 +1,792 @@
+//
+// glTF 2.0 models loaded via the ResourceLoader, parsed with cgltf. Both .gltf (JSON with .bin and image files
+// alongside) and .glb work. There are three resources, so loads share work and run in parallel:
+//
+//   - GltfDocumentKey: the parsed document with its buffers in memory. Only held while models/textures load.
+//   - GltfTextureKey: one image of a document, decoded and uploaded to a sampled image, with its sampler.
+//   - GltfModelKey: meshes in device-local vertex/index buffers, plus materials and the node hierarchy.
+//
+// Loading runs on the loader's threads and uploads are awaited on the graphics CommandQueueFunnel, so the frame
+// loop only waits if it co_awaits the result. The texture and model loaders need "vmaAllocator" and
+// "graphicsFunnel" in the row given to the ResourceLoaderStage; a stage without them doesn't compile. With a
+// "samplerCache" in the row, textures also get a sampler matching the glTF sampler that uses them, and with a
+// "bindlessTable" as well they're added to the table and know their slot. A "gpuProfiler" times the uploads.
+//
+
+module;
+
+#include "bainangua.hpp"
+#include "expected.hpp"
+
+#define STBI_WINDOWS_UTF8
+#include "stb_image.h"
+#include "vk_mem_alloc.h"
+#include <cgltf.h>
+
+#include <boost/hana/pair.hpp>
+#include <boost/hana/type.hpp>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+#include <coro/coro.hpp>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+export module GltfModel;
+
+import VulkanContext;
+import ResourceLoader;
+import CommandQueue;
+import Buffers;
+import TextureImage;
+import MeshProcessing;
+import GPUProfiler;
+
+namespace bainangua {
+
+export
+struct GltfDocument {
+	std::filesystem::path path;
+	std::shared_ptr<cgltf_data> data;
+};
+
+export
+struct GltfVertex {
+	glm::vec3 pos3;
+	glm::vec3 normal3;
+	glm::vec2 uv;
+};
+
+export
+struct GltfPrimitive {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	int32_t vertexOffset;
+	int32_t material; // -1 for the default material
+};
+
+export
+struct GltfMesh {
+	std::string name;
+	std::vector<GltfPrimitive> primitives;
+};
+
+export
+struct GltfMaterial {
+	std::string name;
+	glm::vec4 baseColorFactor{ 1.0f };
+	float metallicFactor = 1.0f;
+	float roughnessFactor = 1.0f;
+	int32_t baseColorTexture = -1; // index into GltfModel::textures
+};
+
+export
+struct GltfNode {
+	std::string name;
+	int32_t mesh = -1;
+	int32_t parent = -1;
+	std::vector<uint32_t> children;
+	glm::mat4 localTransform{ 1.0f };
+	glm::mat4 worldTransform{ 1.0f };
+};
+
+export
+struct GltfTexture {
+	ImageBundle image;
+	SharedSampler sampler; // only there when the ResourceLoader's row has a "samplerCache"
+	std::optional<uint32_t> textureIndex; // slot in the row's "bindlessTable", when there is one
+};
+
+/**
+* All primitives of all meshes share one vertex buffer and one index buffer. Indices are local to their primitive
+* (offset by vertexOffset when drawn), which keeps them 16-bit whenever no single primitive is too big.
+*/
+export
+struct GltfModel {
+	std::vector<GltfMesh> meshes;
+	std::vector<GltfMaterial> materials;
+	std::vector<GltfNode> nodes;
+	std::vector<uint32_t> rootNodes;
+	std::vector<GltfTexture> textures; // one per image in the document
+
+	generic_buffer vertexBuffer{};
+	generic_buffer indexBuffer{};
+	vk::IndexType indexType = vk::IndexType::eUint16;
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+
+	void bind(vk::CommandBuffer cmd) const {
+		vk::DeviceSize offset = 0;
+		cmd.bindVertexBuffers(0, 1, &vertexBuffer.buffer_handle_, &offset);
+		cmd.bindIndexBuffer(indexBuffer.buffer_handle_, 0, indexType);
+	}
+
+	void draw(vk::CommandBuffer cmd, const GltfPrimitive& primitive, uint32_t instanceCount = 1, uint32_t firstInstance = 0) const {
+		cmd.drawIndexed(primitive.indexCount, instanceCount, primitive.firstIndex, primitive.vertexOffset, firstInstance);
+	}
+};
+
+export using GltfDocumentKey = SingleResourceKey<std::filesystem::path, std::shared_ptr<const GltfDocument>>;
+export using GltfTextureKey = SingleResourceKey<std::pair<std::filesystem::path, size_t>, GltfTexture>;
+export using GltfModelKey = SingleResourceKey<std::filesystem::path, std::shared_ptr<const GltfModel>>;
+
+template <> constexpr bool loader_uploads_to_gpu<GltfTextureKey> = true;
+template <> constexpr bool loader_uploads_to_gpu<GltfModelKey> = true;
+
+
+auto parseGltf(const std::filesystem::path& path) -> bng_expected<std::shared_ptr<const GltfDocument>> {
+	std::u8string utf8Path = path.u8string();
+	const char* cPath = reinterpret_cast<const char*>(utf8Path.c_str());
+
+	cgltf_options options{};
+	cgltf_data* data = nullptr;
+	cgltf_result result = cgltf_parse_file(&options, cPath, &data);
+	if (result != cgltf_result_success) {
+		return bng_unexpected(std::format("parseGltf: failed to parse {} (cgltf error {})", reinterpret_cast<const char*>(utf8Path.c_str()), static_cast<int>(result)));
+	}
+	std::shared_ptr<cgltf_data> owned(data, cgltf_free);
+
+	result = cgltf_load_buffers(&options, data, cPath);
+	if (result != cgltf_result_success) {
+		return bng_unexpected(std::format("parseGltf: failed to load buffers for {} (cgltf error {})", reinterpret_cast<const char*>(utf8Path.c_str()), static_cast<int>(result)));
+	}
+	result = cgltf_validate(data);
+	if (result != cgltf_result_success) {
+		return bng_unexpected(std::format("parseGltf: {} is not valid glTF (cgltf error {})", reinterpret_cast<const char*>(utf8Path.c_str()), static_cast<int>(result)));
+	}
+
+	return std::make_shared<const GltfDocument>(GltfDocument{ path, owned });
+}
+
+// the cgltf data goes away with the last reference, so no unloader
+export auto gltfDocumentLoader = boost::hana::make_pair(
+	boost::hana::type_c<GltfDocumentKey>,
+	[]<typename Resources, typename Storage>(ResourceLoader<Resources, Storage>&, GltfDocumentKey key) -> LoaderRoutine<std::shared_ptr<const GltfDocument>> {
+		bng_expected<std::shared_ptr<const GltfDocument>> document = parseGltf(key.key);
+		if (!document) {
+			co_return bng_unexpected(document.error());
+		}
+		co_return LoaderResults<std::shared_ptr<const GltfDocument>>{ document.value(), std::nullopt };
+	}
+);
+
+
+//
+// uploads
+//
+
+struct UploadContext {
+	vk::Device device;
+	VmaAllocator allocator;
+	uint32_t queueFamilyIndex;
+	std::shared_ptr<CommandQueueFunnel> queue;
+	coro::thread_pool* threads;
+	UploadProfiling profiling;
+};
+
+template <typename Resources, typename Storage>
+auto uploadContext(ResourceLoader<Resources, Storage>& loader) -> bng_expected<UploadContext> {
+	if (loader.allocator_ == VK_NULL_HANDLE || !loader.graphicsFunnel_) {
+		return bng_unexpected("glTF loading needs \"vmaAllocator\" and \"graphicsFunnel\" in the ResourceLoader's row");
+	}
+	return UploadContext{ loader.device_, loader.allocator_, loader.graphicsQueueFamilyIndex_, loader.graphicsFunnel_, &loader.threadPool(),
+		UploadProfiling{ loader.gpuProfiler_, loader.graphicsQueueFamilyIndex_ } };
+}
+
+// Each load records into its own transient pool, since a pool can't be used from two threads at once.
+auto createUploadCommands(const UploadContext& context, uint32_t count) -> bng_expected<std::pair<vk::CommandPool, std::vector<vk::CommandBuffer>>> {
+	vk::CommandPoolCreateInfo poolInfo(vk::CommandPoolCreateFlagBits::eTransient, context.queueFamilyIndex);
+	vk::CommandPool pool;
+	vk::Result poolResult = context.device.createCommandPool(&poolInfo, nullptr, &pool);
+	if (poolResult != vk::Result::eSuccess) {
+		return formatVkResultError("createUploadCommands: createCommandPool", poolResult);
+	}
+
+	std::vector<vk::CommandBuffer> cmds(count);
+	vk::CommandBufferAllocateInfo allocInfo(pool, vk::CommandBufferLevel::ePrimary, count);
+	vk::Result allocResult = context.device.allocateCommandBuffers(&allocInfo, cmds.data());
+	if (allocResult != vk::Result::eSuccess) {
+		context.device.destroyCommandPool(pool);
+		return formatVkResultError("createUploadCommands: allocateCommandBuffers", allocResult);
+	}
+	return std::make_pair(pool, cmds);
+}
+
+auto uploadTexture(UploadContext context, const stbi_uc* pixels, uint32_t width, uint32_t height, uint32_t channels, vk::Format format) -> coro::task<bng_expected<ImageBundle>> {
+	size_t imageSize = static_cast<size_t>(width) * height * 4;
+
+	auto staging = allocateStaticHostBuffer(context.allocator, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, const_cast<stbi_uc*>(pixels), imageSize);
+	if (!staging) {
+		co_return bng_unexpected("uploadTexture: staging buffer failed: " + staging.error());
+	}
+
+	VkImageCreateInfo imageCreateInfo{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.flags = 0,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = static_cast<VkFormat>(format),
+		.extent = VkExtent3D{width, height, 1},
+		.mipLevels = 1,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+	};
+	VmaAllocationCreateInfo imageVmaAllocateInfo{
+		.flags = 0,
+		.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE
+	};
+	VkImage image;
+	VmaAllocation allocation;
+	if (vmaCreateImage(context.allocator, &imageCreateInfo, &imageVmaAllocateInfo, &image, &allocation, nullptr) != VK_SUCCESS) {
+		staging.value().release();
+		co_return bng_unexpected("uploadTexture: vmaCreateImage failed");
+	}
+
+	auto commands = createUploadCommands(context, 1);
+	if (!commands) {
+		vmaDestroyImage(context.allocator, image, allocation);
+		staging.value().release();
+		co_return bng_unexpected("uploadTexture: " + commands.error());
+	}
+	auto [pool, cmds] = commands.value();
+	vk::CommandBuffer cmd = cmds[0];
+	cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	uint32_t profileScope = context.profiling.beginScope(cmd, "glTF texture upload");
+
+	vk::ImageMemoryBarrier copyBarrier(
+		{},
+		vk::AccessFlagBits::eTransferWrite,
+		vk::ImageLayout::eUndefined,
+		vk::ImageLayout::eTransferDstOptimal,
+		VK_QUEUE_FAMILY_IGNORED,
+		VK_QUEUE_FAMILY_IGNORED,
+		image,
+		VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+	);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, 0, nullptr, 0, nullptr, 1, &copyBarrier);
+
+	vk::BufferImageCopy copyRegion(0, 0, 0, vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1), vk::Offset3D(0, 0, 0), vk::Extent3D(width, height, 1));
+	cmd.copyBufferToImage(staging.value().buffer_handle_, image, vk::ImageLayout::eTransferDstOptimal, 1, &copyRegion);
+
+	vk::ImageMemoryBarrier finalBarrier(
+		vk::AccessFlagBits::eTransferWrite,
+		vk::AccessFlagBits::eShaderRead,
+		vk::ImageLayout::eTransferDstOptimal,
+		vk::ImageLayout::eShaderReadOnlyOptimal,
+		VK_QUEUE_FAMILY_IGNORED,
+		VK_QUEUE_FAMILY_IGNORED,
+		image,
+		VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+	);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, 0, nullptr, 0, nullptr, 1, &finalBarrier);
+	context.profiling.endScope(cmd, profileScope);
+	cmd.end();
+
+	vk::SubmitInfo submitInfo(0, nullptr, nullptr, 1, &cmd, 0, nullptr);
+	bng_expected<void> submitResult = co_await context.queue->awaitCommand(submitInfo, *context.threads);
+	context.profiling.finish(cmd);
+
+	context.device.destroyCommandPool(pool);
+	staging.value().release();
+
+	if (!submitResult) {
+		vmaDestroyImage(context.allocator, image, allocation);
+		co_return bng_unexpected("uploadTexture: copy failed: " + submitResult.error());
+	}
+
+	vk::ImageViewCreateInfo viewInfo({}, image, vk::ImageViewType::e2D, format, vk::ComponentMapping(), vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1), nullptr);
+	vk::ImageView imageView;
+	vk::Result viewResult = context.device.createImageView(&viewInfo, nullptr, &imageView);
+	if (viewResult != vk::Result::eSuccess) {
+		vmaDestroyImage(context.allocator, image, allocation);
+		co_return formatVkResultError("uploadTexture: createImageView", viewResult);
+	}
+
+	co_return ImageBundle{
+		.width = width,
+		.height = height,
+		.channels = channels,
+		.image = image,
+		.imageView = imageView,
+		.allocation = allocation
+	};
+}
+
+// Uploads through a staging buffer with allocateStaticGPUBuffer; the staging buffer is only needed until it returns.
+auto uploadBuffer(UploadContext context, VkBufferUsageFlags usage, void* data, size_t dataSize, vk::CommandBuffer cmd) -> coro::task<bng_expected<generic_buffer>> {
+	auto staging = allocateStagingBuffer(context.allocator, usage, dataSize);
+	if (!staging) {
+		co_return bng_unexpected(staging.error());
+	}
+	bng_expected<generic_buffer> result = co_await allocateStaticGPUBuffer(context.allocator, usage, data, dataSize, staging.value(), cmd, context.queue, *context.threads, context.profiling);
+	staging.value().release();
+	co_return result;
+}
+
+
+//
+// textures
+//
+
+// Base color and emissive images hold colors and are stored as sRGB. Everything else (normals, metallic/roughness,
+// occlusion) is linear data that the sampler mustn't convert.
+export
+auto gltfImageFormat(const GltfDocument& document, size_t imageIndex) -> vk::Format {
+	const cgltf_data& data = *document.data;
+	auto refersTo = [&](const cgltf_texture_view& view) {
+		return view.texture && view.texture->image && static_cast<size_t>(view.texture->image - data.images) == imageIndex;
+	};
+	for (size_t i = 0; i < data.materials_count; i++) {
+		const cgltf_material& material = data.materials[i];
+		if ((material.has_pbr_metallic_roughness && refersTo(material.pbr_metallic_roughness.base_color_texture)) || refersTo(material.emissive_texture)) {
+			return vk::Format::eR8G8B8A8Srgb;
+		}
+	}
+	return vk::Format::eR8G8B8A8Unorm;
+}
+
+// glTF stores samplers as OpenGL enums
+constexpr int GlNearest = 9728;
+constexpr int GlLinear = 9729;
+constexpr int GlNearestMipmapNearest = 9984;
+constexpr int GlLinearMipmapNearest = 9985;
+constexpr int GlNearestMipmapLinear = 9986;
+constexpr int GlLinearMipmapLinear = 9987;
+constexpr int GlClampToEdge = 33071;
+constexpr int GlMirroredRepeat = 33648;
+constexpr int GlRepeat = 10497;
+
+auto gltfAddressMode(int wrap) -> vk::SamplerAddressMode {
+	switch (wrap) {
+	case GlClampToEdge: return vk::SamplerAddressMode::eClampToEdge;
+	case GlMirroredRepeat: return vk::SamplerAddressMode::eMirroredRepeat;
+	default: return vk::SamplerAddressMode::eRepeat;
+	}
+}
+
+// Applies the filters and wrap modes of the sampler used with an image on top of defaults, which supply whatever
+// glTF doesn't specify (anisotropy, LOD range). Samplers belong to textures rather than images, so if several
+// textures share an image with different samplers, the first one wins.
+export
+auto gltfSamplerInfo(const GltfDocument& document, size_t imageIndex, vk::SamplerCreateInfo defaults) -> vk::SamplerCreateInfo {
+	const cgltf_data& data = *document.data;
+	const cgltf_sampler* sampler = nullptr;
+	for (size_t i = 0; i < data.textures_count; i++) {
+		const cgltf_texture& texture = data.textures[i];
+		if (texture.image && static_cast<size_t>(texture.image - data.images) == imageIndex) {
+			sampler = texture.sampler;
+			break;
+		}
+	}
+	if (!sampler) {
+		return defaults;
+	}
+
+	vk::SamplerCreateInfo info = defaults;
+	switch (static_cast<int>(sampler->mag_filter)) {
+	case GlNearest: info.magFilter = vk::Filter::eNearest; break;
+	case GlLinear: info.magFilter = vk::Filter::eLinear; break;
+	default: break; // unset
+	}
+	switch (static_cast<int>(sampler->min_filter)) {
+	case GlNearest:
+	case GlNearestMipmapNearest: info.minFilter = vk::Filter::eNearest; info.mipmapMode = vk::SamplerMipmapMode::eNearest; break;
+	case GlLinear:
+	case GlLinearMipmapNearest: info.minFilter = vk::Filter::eLinear; info.mipmapMode = vk::SamplerMipmapMode::eNearest; break;
+	case GlNearestMipmapLinear: info.minFilter = vk::Filter::eNearest; info.mipmapMode = vk::SamplerMipmapMode::eLinear; break;
+	case GlLinearMipmapLinear: info.minFilter = vk::Filter::eLinear; info.mipmapMode = vk::SamplerMipmapMode::eLinear; break;
+	default: break; // unset
+	}
+	info.addressModeU = gltfAddressMode(static_cast<int>(sampler->wrap_s));
+	info.addressModeV = gltfAddressMode(static_cast<int>(sampler->wrap_t));
+	return info;
+}
+
+auto decodeGltfImage(const GltfDocument& document, size_t imageIndex) -> bng_expected<std::tuple<stbi_uc*, int, int, int>> {
+	if (imageIndex >= document.data->images_count) {
+		return bng_unexpected(std::format("decodeGltfImage: image {} out of range", imageIndex));
+	}
+	const cgltf_image& image = document.data->images[imageIndex];
+
+	int width, height, channels;
+	stbi_uc* pixels = nullptr;
+	if (image.buffer_view) {
+		// embedded, usually in a .glb: decode straight out of the loaded buffer
+		const stbi_uc* bytes = cgltf_buffer_view_data(image.buffer_view);
+		pixels = stbi_load_from_memory(bytes, static_cast<int>(image.buffer_view->size), &width, &height, &channels, STBI_rgb_alpha);
+	}
+	else if (image.uri && std::strncmp(image.uri, "data:", 5) != 0) {
+		std::string uri(image.uri);
+		cgltf_decode_uri(uri.data());
+		uri.resize(std::strlen(uri.c_str()));
+		std::u8string imagePath = (document.path.parent_path() / std::filesystem::path(reinterpret_cast<const char8_t*>(uri.c_str()))).u8string();
+		pixels = stbi_load(reinterpret_cast<const char*>(imagePath.c_str()), &width, &height, &channels, STBI_rgb_alpha);
+	}
+	else {
+		return bng_unexpected(std::format("decodeGltfImage: image {} uses a data: URI, which isn't supported", imageIndex));
+	}
+
+	if (!pixels) {
+		return bng_unexpected(std::format("decodeGltfImage: failed to decode image {}: {}", imageIndex, stbi_failure_reason()));
+	}
+	return std::make_tuple(pixels, width, height, channels);
+}
+
+export auto gltfTextureLoader = boost::hana::make_pair(
+	boost::hana::type_c<GltfTextureKey>,
+	[]<typename Resources, typename Storage>(ResourceLoader<Resources, Storage>& loader, GltfTextureKey key) -> LoaderRoutine<GltfTexture> {
+		auto context = uploadContext(loader);
+		if (!context) {
+			co_return bng_unexpected(context.error());
+		}
+
+		GltfDocumentKey documentKey{ key.key.first };
+		bng_expected<std::shared_ptr<const GltfDocument>> document = co_await loader.loadResource(documentKey);
+		auto decoded = document.and_then([&](auto d) { return decodeGltfImage(*d, key.key.second); });
+		vk::Format format = document ? gltfImageFormat(*document.value(), key.key.second) : vk::Format::eR8G8B8A8Unorm;
+		vk::SamplerCreateInfo samplerInfo = loader.physicalDevice_ ? defaultTextureSamplerInfo(loader.physicalDevice_) : vk::SamplerCreateInfo();
+		if (document) {
+			samplerInfo = gltfSamplerInfo(*document.value(), key.key.second, samplerInfo);
+		}
+		co_await loader.unloadResource(documentKey);
+		if (!decoded) {
+			co_return bng_unexpected(decoded.error());
+		}
+
+		SharedSampler sampler;
+		if (loader.samplerCache_) {
+			bng_expected<SharedSampler> cached = loader.samplerCache_->getSampler(samplerInfo);
+			if (!cached) {
+				stbi_image_free(std::get<0>(decoded.value()));
+				co_return bng_unexpected(cached.error());
+			}
+			sampler = cached.value();
+		}
+		if (loader.bindlessTable_ && !sampler) {
+			stbi_image_free(std::get<0>(decoded.value()));
+			co_return bng_unexpected("gltfTextureLoader: textures can only go into the \"bindlessTable\" with a \"samplerCache\" in the row");
+		}
+
+		auto [pixels, width, height, channels] = decoded.value();
+		bng_expected<ImageBundle> image = co_await uploadTexture(context.value(), pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), static_cast<uint32_t>(channels), format);
+		stbi_image_free(pixels);
+		if (!image) {
+			co_return bng_unexpected(image.error());
+		}
+
+		GltfTexture texture{ image.value(), sampler };
+		if (loader.bindlessTable_) {
+			bng_expected<uint32_t> slot = loader.bindlessTable_->addTexture(image.value().imageView, *sampler);
+			if (!slot) {
+				destroyTextureImage(loader.device_, context.value().allocator, image.value());
+				co_return bng_unexpected(slot.error());
+			}
+			texture.textureIndex = slot.value();
+		}
+
+		co_return LoaderResults<GltfTexture>{
+			.resource_ = texture,
+			.unloader_ = [](ResourceLoader<Resources, Storage>& loader, VmaAllocator allocator, GltfTexture texture) -> coro::task<bng_expected<void>> {
+				// the sampler and the bindless slot are held until the image goes, since draws in flight may still use all three
+				loader.destroyWhenUnused([device = loader.device_, allocator, texture, bindlessTable = loader.bindlessTable_]() {
+					if (texture.textureIndex) { bindlessTable->removeTexture(texture.textureIndex.value()); }
+					destroyTextureImage(device, allocator, texture.image);
+				});
+				co_return{};
+			}(loader, context.value().allocator, texture)
+		};
+	}
+);
+
+
+//
+// models
+//
+
+// Float accessors are read straight out of the loaded buffer; anything quantized goes through cgltf's converter.
+template <int N>
+void readAttribute(const cgltf_accessor* accessor, std::vector<GltfVertex>& vertices, glm::vec<N, float> GltfVertex::* field) {
+	size_t count = std::min(vertices.size(), accessor->count);
+	if (accessor->component_type == cgltf_component_type_r_32f && !accessor->normalized && !accessor->is_sparse && accessor->buffer_view) {
+		const uint8_t* base = cgltf_buffer_view_data(accessor->buffer_view) + accessor->offset;
+		for (size_t i = 0; i < count; i++) {
+			std::memcpy(glm::value_ptr(vertices[i].*field), base + i * accessor->stride, sizeof(float) * N);
+		}
+	}
+	else {
+		for (size_t i = 0; i < count; i++) {
+			cgltf_accessor_read_float(accessor, i, glm::value_ptr(vertices[i].*field), N);
+		}
+	}
+}
+
+void readIndices(const cgltf_accessor* accessor, std::vector<uint32_t>& indices) {
+	indices.resize(accessor->count);
+	if (!accessor->is_sparse && accessor->buffer_view) {
+		const uint8_t* base = cgltf_buffer_view_data(accessor->buffer_view) + accessor->offset;
+		switch (accessor->component_type) {
+		case cgltf_component_type_r_16u:
+			for (size_t i = 0; i < indices.size(); i++) {
+				uint16_t index;
+				std::memcpy(&index, base + i * accessor->stride, sizeof(index));
+				indices[i] = index;
+			}
+			return;
+		case cgltf_component_type_r_32u:
+			for (size_t i = 0; i < indices.size(); i++) {
+				std::memcpy(&indices[i], base + i * accessor->stride, sizeof(uint32_t));
+			}
+			return;
+		default:
+			break;
+		}
+	}
+	for (size_t i = 0; i < indices.size(); i++) {
+		indices[i] = static_cast<uint32_t>(cgltf_accessor_read_index(accessor, i));
+	}
+}
+
+struct PrimitiveSource {
+	size_t mesh;
+	int32_t material;
+	std::vector<GltfVertex> vertices;
+	std::vector<uint32_t> indices;
+};
+
+// Only triangle lists are kept: points and lines don't go through this vertex format.
+auto extractPrimitives(const cgltf_data& data) -> bng_expected<std::vector<PrimitiveSource>> {
+	std::vector<PrimitiveSource> sources;
+	for (size_t m = 0; m < data.meshes_count; m++) {
+		const cgltf_mesh& mesh = data.meshes[m];
+		for (size_t p = 0; p < mesh.primitives_count; p++) {
+			const cgltf_primitive& primitive = mesh.primitives[p];
+			if (primitive.type != cgltf_primitive_type_triangles) {
+				continue;
+			}
+
+			const cgltf_accessor* position = cgltf_find_accessor(&primitive, cgltf_attribute_type_position, 0);
+			if (!position) {
+				return bng_unexpected(std::format("extractPrimitives: mesh {} primitive {} has no positions", m, p));
+			}
+			const cgltf_accessor* normal = cgltf_find_accessor(&primitive, cgltf_attribute_type_normal, 0);
+			const cgltf_accessor* uv = cgltf_find_accessor(&primitive, cgltf_attribute_type_texcoord, 0);
+
+			PrimitiveSource source{
+				.mesh = m,
+				.material = primitive.material ? static_cast<int32_t>(primitive.material - data.materials) : -1,
+				.vertices = std::vector<GltfVertex>(position->count, GltfVertex{ glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(0.0f) }),
+				.indices = {}
+			};
+			readAttribute(position, source.vertices, &GltfVertex::pos3);
+			if (normal) { readAttribute(normal, source.vertices, &GltfVertex::normal3); }
+			if (uv) { readAttribute(uv, source.vertices, &GltfVertex::uv); }
+
+			if (primitive.indices) {
+				readIndices(primitive.indices, source.indices);
+			}
+			else {
+				source.indices.resize(position->count);
+				for (uint32_t i = 0; i < source.indices.size(); i++) { source.indices[i] = i; }
+			}
+			sources.push_back(std::move(source));
+		}
+	}
+	return sources;
+}
+
+void readSceneGraph(const cgltf_data& data, GltfModel& model) {
+	model.meshes.resize(data.meshes_count);
+	for (size_t m = 0; m < data.meshes_count; m++) {
+		model.meshes[m].name = data.meshes[m].name ? data.meshes[m].name : "";
+	}
+
+	for (size_t i = 0; i < data.materials_count; i++) {
+		const cgltf_material& source = data.materials[i];
+		GltfMaterial material{ .name = source.name ? source.name : "" };
+		if (source.has_pbr_metallic_roughness) {
+			const cgltf_pbr_metallic_roughness& pbr = source.pbr_metallic_roughness;
+			material.baseColorFactor = glm::make_vec4(pbr.base_color_factor);
+			material.metallicFactor = pbr.metallic_factor;
+			material.roughnessFactor = pbr.roughness_factor;
+			if (pbr.base_color_texture.texture && pbr.base_color_texture.texture->image) {
+				material.baseColorTexture = static_cast<int32_t>(pbr.base_color_texture.texture->image - data.images);
+			}
+		}
+		model.materials.push_back(material);
+	}
+
+	for (size_t i = 0; i < data.nodes_count; i++) {
+		const cgltf_node& source = data.nodes[i];
+		GltfNode node{ .name = source.name ? source.name : "" };
+		node.mesh = source.mesh ? static_cast<int32_t>(source.mesh - data.meshes) : -1;
+		node.parent = source.parent ? static_cast<int32_t>(source.parent - data.nodes) : -1;
+		for (size_t c = 0; c < source.children_count; c++) {
+			node.children.push_back(static_cast<uint32_t>(source.children[c] - data.nodes));
+		}
+		cgltf_node_transform_local(&source, glm::value_ptr(node.localTransform));
+		cgltf_node_transform_world(&source, glm::value_ptr(node.worldTransform));
+		model.nodes.push_back(std::move(node));
+	}
+
+	const cgltf_scene* scene = data.scene ? data.scene : (data.scenes_count > 0 ? &data.scenes[0] : nullptr);
+	if (scene) {
+		for (size_t n = 0; n < scene->nodes_count; n++) {
+			model.rootNodes.push_back(static_cast<uint32_t>(scene->nodes[n] - data.nodes));
+		}
+	}
+	else {
+		for (uint32_t n = 0; n < model.nodes.size(); n++) {
+			if (model.nodes[n].parent < 0) { model.rootNodes.push_back(n); }
+		}
+	}
+}
+
+template <typename Index>
+void appendIndices(std::vector<Index>& all, const IndexData& indices) {
+	std::visit([&](const auto& source) { all.insert(all.end(), source.begin(), source.end()); }, indices);
+}
+
+// Packs the processed primitives into one vertex and one index list, and fills in each primitive's ranges.
+template <typename Index>
+std::vector<Index> packPrimitives(const std::vector<PrimitiveSource>& sources, const std::vector<ProcessedMesh<GltfVertex>>& processed, GltfModel& model, std::vector<GltfVertex>& vertices) {
+	std::vector<Index> indices;
+	for (size_t i = 0; i < processed.size(); i++) {
+		GltfPrimitive primitive{
+			.firstIndex = static_cast<uint32_t>(indices.size()),
+			.indexCount = static_cast<uint32_t>(indexCount(processed[i].indices)),
+			.vertexOffset = static_cast<int32_t>(vertices.size()),
+			.material = sources[i].material
+		};
+		model.meshes[sources[i].mesh].primitives.push_back(primitive);
+		vertices.insert(vertices.end(), processed[i].vertices.begin(), processed[i].vertices.end());
+		appendIndices(indices, processed[i].indices);
+	}
+	return indices;
+}
+
+template <typename Resources, typename Storage>
+auto unloadGltfTextures(ResourceLoader<Resources, Storage>& loader, std::filesystem::path path, size_t count) -> coro::task<void> {
+	for (size_t i = 0; i < count; i++) {
+		co_await loader.unloadResource(GltfTextureKey{ {path, i} });
+	}
+}
+
+export auto gltfModelLoader = boost::hana::make_pair(
+	boost::hana::type_c<GltfModelKey>,
+	[]<typename Resources, typename Storage>(ResourceLoader<Resources, Storage>& loader, GltfModelKey key) -> LoaderRoutine<std::shared_ptr<const GltfModel>> {
+		auto context = uploadContext(loader);
+		if (!context) {
+			co_return bng_unexpected(context.error());
+		}
+
+		GltfDocumentKey documentKey{ key.key };
+		bng_expected<std::shared_ptr<const GltfDocument>> documentResult = co_await loader.loadResource(documentKey);
+		if (!documentResult) {
+			co_await loader.unloadResource(documentKey);
+			co_return bng_unexpected(documentResult.error());
+		}
+		std::shared_ptr<const GltfDocument> document = documentResult.value();
+		const cgltf_data& data = *document->data;
+
+		auto model = std::make_shared<GltfModel>();
+		readSceneGraph(data, *model);
+
+		auto sources = extractPrimitives(data);
+		size_t imageCount = data.images_count;
+		if (!sources) {
+			co_await loader.unloadResource(documentKey);
+			co_return bng_unexpected(sources.error());
+		}
+
+		// textures load as their own resources while the geometry gets optimized on the loader's threads
+		std::vector<coro::task<bng_expected<GltfTexture>>> textureLoads;
+		for (size_t i = 0; i < imageCount; i++) {
+			textureLoads.push_back(loader.loadResource(GltfTextureKey{ {key.key, i} }));
+		}
+		std::vector<coro::task<ProcessedMesh<GltfVertex>>> geometry;
+		for (const PrimitiveSource& source : sources.value()) {
+			geometry.push_back(processMeshAsync(loader.threadPool(), source.vertices, source.indices));
+		}
+		auto [textureResults, geometryResults] = co_await coro::when_all(coro::when_all(std::move(textureLoads)), coro::when_all(std::move(geometry)));
+
+		// held until the texture loads are done with it, or each of them would parse the file again
+		co_await loader.unloadResource(documentKey);
+
+		for (auto& texture : textureResults.return_value()) {
+			if (!texture.return_value()) {
+				co_await unloadGltfTextures(loader, key.key, imageCount);
+				co_return bng_unexpected(texture.return_value().error());
+			}
+			model->textures.push_back(texture.return_value().value());
+		}
+
+		std::vector<ProcessedMesh<GltfVertex>> processed;
+		bool all16Bit = true;
+		for (auto& result : geometryResults.return_value()) {
+			processed.push_back(std::move(result.return_value()));
+			all16Bit = all16Bit && indexType(processed.back().indices) == vk::IndexType::eUint16;
+		}
+
+		std::vector<GltfVertex> vertices;
+		std::variant<std::vector<uint16_t>, std::vector<uint32_t>> indices;
+		if (all16Bit) {
+			indices = packPrimitives<uint16_t>(sources.value(), processed, *model, vertices);
+			model->indexType = vk::IndexType::eUint16;
+		}
+		else {
+			indices = packPrimitives<uint32_t>(sources.value(), processed, *model, vertices);
+			model->indexType = vk::IndexType::eUint32;
+		}
+		model->vertexCount = vertices.size();
+		model->indexCount = std::visit([](const auto& i) { return i.size(); }, indices);
+
+		if (!vertices.empty()) {
+			auto commands = createUploadCommands(context.value(), 2);
+			if (!commands) {
+				co_await unloadGltfTextures(loader, key.key, imageCount);
+				co_return bng_unexpected("gltfModelLoader: " + commands.error());
+			}
+			auto [pool, cmds] = commands.value();
+			auto vertexBuffer = co_await uploadBuffer(context.value(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertices.data(), vertices.size() * sizeof(GltfVertex), cmds[0]);
+			auto indexBuffer = co_await std::visit([&](auto& i) {
+				return uploadBuffer(context.value(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, i.data(), i.size() * sizeof(i[0]), cmds[1]);
+			}, indices);
+			context.value().device.destroyCommandPool(pool);
+
+			if (!vertexBuffer || !indexBuffer) {
+				if (vertexBuffer) { vertexBuffer.value().release(); }
+				if (indexBuffer) { indexBuffer.value().release(); }
+				co_await unloadGltfTextures(loader, key.key, imageCount);
+				co_return bng_unexpected("gltfModelLoader: geometry upload failed: " + (vertexBuffer ? indexBuffer.error() : vertexBuffer.error()));
+			}
+			model->vertexBuffer = vertexBuffer.value();
+			model->indexBuffer = indexBuffer.value();
+		}
+
+		std::shared_ptr<const GltfModel> result = model;
+		co_return LoaderResults<std::shared_ptr<const GltfModel>>{
+			.resource_ = result,
+			.unloader_ = [](ResourceLoader<Resources, Storage>& loader, std::shared_ptr<GltfModel> model, std::filesystem::path path) -> coro::task<bng_expected<void>> {
+				loader.destroyWhenUnused([vertexBuffer = model->vertexBuffer, indexBuffer = model->indexBuffer]() mutable {
+					if (vertexBuffer.buffer_handle_) { vertexBuffer.release(); }
+					if (indexBuffer.buffer_handle_) { indexBuffer.release(); }
+				});
+				co_await unloadGltfTextures(loader, path, model->textures.size());
+				co_return{};
+			}(loader, model, key.key)
+		};
+	}
+);
+
+}
@@ -0,0 +1,420 @@
+/**
+* Culling on the GPU, feeding indirect draws. Each frame the CPU writes a flat list of objects (a world-space bounding
+* sphere plus the index range to draw) and records two things:
+*
+*   - cull(): a compute dispatch of Cull.comp, which frustum tests every object and appends a VkDrawIndexedIndirectCommand
+*     for each one that survives, counting them in a separate buffer,
+*   - drawIndexedIndirect(): one vkCmdDrawIndexedIndirectCount that draws however many commands the dispatch wrote.
+*
+* The CPU never looks at individual objects once they're written, so the cost of recording a frame doesn't depend
+* on how many objects there are. Each draw gets the object's firstInstance, which shaders see as gl_InstanceIndex
+* and can use to look up per-object data.
+*
+* In a frame loop, GpuCullPrePass records cull() as the pre-pass of BasicRendering or DynamicRendering, and the draw
+* function inside the pass calls drawIndexedIndirect().
+*
+* Needs the pipeline from createGpuCullPipeline and a device created with VulkanContextConfig::useIndirectCount.
+*/
+module;
+
+#include "bainangua.hpp"
+#include "RowType.hpp"
+#include "vk_result_to_string.h"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+export module GpuCulling;
+
+import PresentationLayer; // for MultiFrameCount
+import Pipeline;
+import MeshProcessing;
+import GeometryArena;
+import SceneCulling;
+
+namespace bainangua {
+
+// matches CullObject in Cull.comp
+export
+struct GpuCullObject {
+	glm::vec4 sphere; // world space center in xyz, radius in w
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t firstInstance;
+};
+static_assert(sizeof(GpuCullObject) == 32);
+
+export
+GpuCullObject makeGpuCullObject(const MeshHandle& mesh, const BoundingSphere& worldBounds, uint32_t firstInstance) {
+	return GpuCullObject{ glm::vec4(worldBounds.center, worldBounds.radius), mesh.indexCount, mesh.firstIndex, mesh.vertexOffset, firstInstance };
+}
+
+// matches CullConstants in Cull.comp
+export
+struct GpuCullConstants {
+	std::array<glm::vec4, 6> planes;
+	uint32_t objectCount;
+	uint32_t maxDraws;
+};
+
+export
+vk::PushConstantRange gpuCullPushConstantRange() {
+	return vk::PushConstantRange(vk::ShaderStageFlagBits::eCompute, 0, sizeof(GpuCullConstants));
+}
+
+// binding 0 holds the objects, binding 1 the draw commands and binding 2 the draw count
+export
+auto createGpuCullDescriptorSetLayout(vk::Device device) -> bng_expected<vk::DescriptorSetLayout> {
+	std::array<vk::DescriptorSetLayoutBinding, 3> bindings{
+		vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute, nullptr),
+		vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute, nullptr),
+		vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute, nullptr)
+	};
+	vk::DescriptorSetLayoutCreateInfo layoutInfo({}, bindings);
+
+	vk::DescriptorSetLayout layout;
+	vk::Result layoutResult = device.createDescriptorSetLayout(&layoutInfo, nullptr, &layout);
+	if (layoutResult != vk::Result::eSuccess) {
+		return formatVkResultError("createGpuCullDescriptorSetLayout: could not create descriptor set layout", layoutResult);
+	}
+	return layout;
+}
+
+export
+class GpuCuller {
+public:
+	static constexpr uint32_t WorkgroupSize = 64; // local_size_x in Cull.comp
+
+	// With readback set the draw commands and count live in host-visible memory so readDraws() can look at them.
+	// That's slow for the GPU, so it's only meant for tests and debugging.
+	static auto create(vk::Device device, VmaAllocator allocator, vk::DescriptorSetLayout layout, uint32_t capacity, bool readback = false) -> bng_expected<std::shared_ptr<GpuCuller>> {
+		std::shared_ptr<GpuCuller> culler(new GpuCuller(device, allocator, capacity, readback));
+
+		std::array<vk::DescriptorPoolSize, 1> poolSizes{
+			vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 3 * MultiFrameCount)
+		};
+		vk::DescriptorPoolCreateInfo poolInfo({}, MultiFrameCount, poolSizes);
+		vk::Result poolResult = device.createDescriptorPool(&poolInfo, nullptr, &culler->pool_);
+		if (poolResult != vk::Result::eSuccess) {
+			return formatVkResultError("GpuCuller: could not create descriptor pool", poolResult);
+		}
+
+		VmaAllocationCreateFlags outputFlags = readback ? (VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT) : 0;
+		for (Frame& frame : culler->frames_) {
+			// the destructor cleans up whichever buffers did get made
+			auto objectResult = culler->allocate(frame.objects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(GpuCullObject) * capacity,
+				VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
+			if (!objectResult) {
+				return bng_unexpected(objectResult.error());
+			}
+			auto drawResult = culler->allocate(frame.draws, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				sizeof(vk::DrawIndexedIndirectCommand) * capacity, outputFlags);
+			if (!drawResult) {
+				return bng_unexpected(drawResult.error());
+			}
+			auto countResult = culler->allocate(frame.count, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				sizeof(uint32_t), outputFlags);
+			if (!countResult) {
+				return bng_unexpected(countResult.error());
+			}
+
+			vk::DescriptorSetAllocateInfo allocInfo(culler->pool_, 1, &layout);
+			vk::Result allocResult = device.allocateDescriptorSets(&allocInfo, &frame.set);
+			if (allocResult != vk::Result::eSuccess) {
+				return formatVkResultError("GpuCuller: could not allocate descriptor set", allocResult);
+			}
+
+			std::array<vk::DescriptorBufferInfo, 3> bufferInfos{
+				vk::DescriptorBufferInfo(frame.objects.buffer, 0, VK_WHOLE_SIZE),
+				vk::DescriptorBufferInfo(frame.draws.buffer, 0, VK_WHOLE_SIZE),
+				vk::DescriptorBufferInfo(frame.count.buffer, 0, VK_WHOLE_SIZE)
+			};
+			std::array<vk::WriteDescriptorSet, 3> writes;
+			for (uint32_t binding = 0; binding < 3; binding++) {
+				writes[binding] = vk::WriteDescriptorSet(frame.set, binding, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bufferInfos[binding], nullptr);
+			}
+			device.updateDescriptorSets(writes, nullptr);
+		}
+		return culler;
+	}
+
+	~GpuCuller() {
+		for (Frame& frame : frames_) {
+			for (Buffer* buffer : { &frame.objects, &frame.draws, &frame.count }) {
+				if (buffer->buffer) {
+					vmaDestroyBuffer(allocator_, buffer->buffer, buffer->allocation);
+				}
+			}
+		}
+		if (pool_) {
+			device_.destroyDescriptorPool(pool_);
+		}
+	}
+
+	GpuCuller(const GpuCuller&) = delete;
+	GpuCuller& operator=(const GpuCuller&) = delete;
+
+	// Copies in this frame's objects and returns how many were kept; anything past capacity is dropped.
+	uint32_t write(size_t multiFrameIndex, std::span<const GpuCullObject> objects) {
+		Frame& frame = frames_[multiFrameIndex];
+		frame.objectCount = static_cast<uint32_t>(std::min<size_t>(objects.size(), capacity_));
+		std::copy_n(objects.begin(), frame.objectCount, static_cast<GpuCullObject*>(frame.objects.mapped));
+		vmaFlushAllocation(allocator_, frame.objects.allocation, 0, sizeof(GpuCullObject) * frame.objectCount);
+		return frame.objectCount;
+	}
+
+	// Records the culling dispatch. Has to go outside of any render pass, before the drawIndexedIndirect() that uses it.
+	void cull(vk::CommandBuffer cmd, size_t multiFrameIndex, vk::Pipeline pipeline, vk::PipelineLayout layout, const Frustum& frustum) const {
+		const Frame& frame = frames_[multiFrameIndex];
+
+		cmd.fillBuffer(frame.count.buffer, 0, sizeof(uint32_t), 0);
+		vk::BufferMemoryBarrier clearBarrier(
+			vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+			VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, frame.count.buffer, 0, VK_WHOLE_SIZE);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, clearBarrier, nullptr);
+
+		GpuCullConstants constants{ frustum.planes, frame.objectCount, capacity_ };
+		cmd.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, layout, 0, frame.set, nullptr);
+		cmd.pushConstants(layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(GpuCullConstants), &constants);
+		cmd.dispatch((frame.objectCount + WorkgroupSize - 1) / WorkgroupSize, 1, 1);
+
+		vk::AccessFlags readAccess = vk::AccessFlagBits::eIndirectCommandRead;
+		vk::PipelineStageFlags readStages = vk::PipelineStageFlagBits::eDrawIndirect;
+		if (readback_) {
+			readAccess |= vk::AccessFlagBits::eHostRead;
+			readStages |= vk::PipelineStageFlagBits::eHost;
+		}
+		std::array<vk::BufferMemoryBarrier, 2> outputBarriers{
+			vk::BufferMemoryBarrier(vk::AccessFlagBits::eShaderWrite, readAccess, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, frame.draws.buffer, 0, VK_WHOLE_SIZE),
+			vk::BufferMemoryBarrier(vk::AccessFlagBits::eShaderWrite, readAccess, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, frame.count.buffer, 0, VK_WHOLE_SIZE)
+		};
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, readStages, {}, nullptr, outputBarriers, nullptr);
+	}
+
+	// Draws every object that cull() kept. The vertex and index buffers they draw from should already be bound.
+	void drawIndexedIndirect(vk::CommandBuffer cmd, size_t multiFrameIndex) const {
+		const Frame& frame = frames_[multiFrameIndex];
+		cmd.drawIndexedIndirectCount(frame.draws.buffer, 0, frame.count.buffer, 0, capacity_, sizeof(vk::DrawIndexedIndirectCommand));
+	}
+
+	// The draws the last cull() for this frame wrote, once its command buffer has finished. Only with readback.
+	auto readDraws(size_t multiFrameIndex) const -> bng_expected<std::vector<vk::DrawIndexedIndirectCommand>> {
+		if (!readback_) {
+			return bng_unexpected("GpuCuller: readDraws needs a culler created with readback");
+		}
+		const Frame& frame = frames_[multiFrameIndex];
+		vmaInvalidateAllocation(allocator_, frame.count.allocation, 0, VK_WHOLE_SIZE);
+		uint32_t count = std::min(*static_cast<const uint32_t*>(frame.count.mapped), capacity_);
+		vmaInvalidateAllocation(allocator_, frame.draws.allocation, 0, VK_WHOLE_SIZE);
+		const auto* draws = static_cast<const vk::DrawIndexedIndirectCommand*>(frame.draws.mapped);
+		return std::vector<vk::DrawIndexedIndirectCommand>(draws, draws + count);
+	}
+
+	uint32_t objectCount(size_t multiFrameIndex) const { return frames_[multiFrameIndex].objectCount; }
+	uint32_t capacity() const { return capacity_; }
+
+private:
+	GpuCuller(vk::Device device, VmaAllocator allocator, uint32_t capacity, bool readback) : device_(device), allocator_(allocator), capacity_(capacity), readback_(readback) {}
+
+	struct Buffer {
+		VkBuffer buffer{ VK_NULL_HANDLE };
+		VmaAllocation allocation{ VK_NULL_HANDLE };
+		void* mapped{ nullptr };
+	};
+
+	struct Frame {
+		Buffer objects;
+		Buffer draws;
+		Buffer count;
+		vk::DescriptorSet set;
+		uint32_t objectCount{ 0 };
+	};
+
+	auto allocate(Buffer& buffer, VkBufferUsageFlags usage, VkDeviceSize size, VmaAllocationCreateFlags flags) -> bng_expected<void> {
+		VkBufferCreateInfo bufferCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size = size,
+			.usage = usage,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE
+		};
+		VmaAllocationCreateInfo vmaAllocateInfo{
+			.flags = flags,
+			.usage = VMA_MEMORY_USAGE_AUTO,
+			.requiredFlags = 0,
+			.preferredFlags = 0,
+			.memoryTypeBits = 0,
+			.pool = VK_NULL_HANDLE,
+			.pUserData = nullptr,
+			.priority = 0.0f
+		};
+		VmaAllocationInfo allocationInfo;
+		auto vkResult = vmaCreateBuffer(allocator_, &bufferCreateInfo, &vmaAllocateInfo, &buffer.buffer, &buffer.allocation, &allocationInfo);
+		if (vkResult != VK_SUCCESS) {
+			return formatVkResultError("GpuCuller: vmaCreateBuffer failed", vk::Result(vkResult));
+		}
+		buffer.mapped = allocationInfo.pMappedData;
+		return {};
+	}
+
+	vk::Device device_;
+	VmaAllocator allocator_;
+	uint32_t capacity_;
+	bool readback_;
+	vk::DescriptorPool pool_;
+	std::array<Frame, MultiFrameCount> frames_;
+};
+
+// The object, draw and count buffers of a GpuCuller in set 0, and GpuCullConstants in push constants.
+export
+struct CreateGpuCullLayout {
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+
+		auto layoutResult = createGpuCullDescriptorSetLayout(device);
+		if (!layoutResult.has_value()) {
+			return tl::make_unexpected(layoutResult.error());
+		}
+		vk::DescriptorSetLayout layout = layoutResult.value();
+
+		vk::PushConstantRange pushConstantRange = gpuCullPushConstantRange();
+		vk::PipelineLayoutCreateInfo pipelineLayoutInfo(
+			vk::PipelineLayoutCreateFlags(),
+			1, &layout, // SetLayouts
+			1, &pushConstantRange // push constants
+		);
+		vk::PipelineLayout pipelineLayout = device.createPipelineLayout(pipelineLayoutInfo);
+
+		auto rWithLayout = boost::hana::insert(
+			boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("layout"), pipelineLayout)),
+			boost::hana::make_pair(BOOST_HANA_STRING("descriptorLayout"), layout)
+		);
+		return f.applyRow(rWithLayout)
+			.or_else([&](bng_errorobject error) {
+				device.destroyDescriptorSetLayout(layout);
+				device.destroyPipelineLayout(pipelineLayout);
+			});
+	}
+};
+
+// The culling dispatch for GpuCuller::cull().
+export
+bng_expected<ComputePipelineBundle> createGpuCullPipeline(vk::Device device, std::filesystem::path computeShaderFile)
+{
+	auto pipeRow = boost::hana::make_map(
+		boost::hana::make_pair(BOOST_HANA_STRING("device"), device)
+	);
+	auto pipelineChain =
+		CreateShaderModule<BOOST_HANA_STRING("computeShader")>(computeShaderFile)
+		| CreateGpuCullLayout()
+		| CreateComputePipeline()
+		| AssembleComputePipelineBundle();
+
+	return pipelineChain.applyRow(pipeRow);
+}
+
+// Adds the culling pipeline as "cullPipelineBundle"; follow with GpuCullerStage to get something to run it on.
+export
+struct GpuCullPipelineStage {
+	GpuCullPipelineStage(std::filesystem::path shaderPath) : shaderPath_(shaderPath) {}
+
+	std::filesystem::path shaderPath_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+
+		bng_expected<ComputePipelineBundle> pipelineResult = createGpuCullPipeline(device, shaderPath_ / "Cull.comp_spv");
+		if (!pipelineResult.has_value()) {
+			return tl::make_unexpected(pipelineResult.error());
+		}
+		ComputePipelineBundle pipeline = pipelineResult.value();
+
+		auto rWithPipeline = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("cullPipelineBundle"), pipeline));
+		auto result = f.applyRow(rWithPipeline);
+
+		destroyComputePipeline(device, pipeline);
+		return result;
+	}
+};
+
+// Adds a GpuCuller as "gpuCuller", using the descriptor set layout of "cullPipelineBundle" from GpuCullPipelineStage.
+export
+struct GpuCullerStage {
+	GpuCullerStage(uint32_t capacity, bool readback = false) : capacity_(capacity), readback_(readback) {}
+
+	uint32_t capacity_;
+	bool readback_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename Row>
+		requires RowType::has_named_field<Row, BOOST_HANA_STRING("device"), vk::Device>
+			  && RowType::has_named_field<Row, BOOST_HANA_STRING("vmaAllocator"), VmaAllocator>
+			  && RowType::has_namedonly_field<Row, BOOST_HANA_STRING("cullPipelineBundle")>
+	auto acquire(const Row& r) -> bng_expected<decltype(boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("gpuCuller"), std::shared_ptr<GpuCuller>())))> {
+		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
+		VmaAllocator allocator = boost::hana::at_key(r, BOOST_HANA_STRING("vmaAllocator"));
+		vk::DescriptorSetLayout layout = boost::hana::at_key(r, BOOST_HANA_STRING("cullPipelineBundle")).descriptorLayout.value();
+
+		return GpuCuller::create(device, allocator, layout, capacity_, readback_)
+			.map([](std::shared_ptr<GpuCuller> culler) {
+				return boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("gpuCuller"), culler));
+			});
+	}
+
+	// the culler is destroyed along with the last reference to it
+	template <typename Fields>
+	void release(const Fields&) {}
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		return RowType::wrapSplitStage(*this, f, std::move(r));
+	}
+};
+
+// Records this frame's cull() with the row's "gpuCuller" and "cullPipelineBundle", for use as the prePass of
+// BasicRendering or DynamicRendering. frustumOf is called with the row and returns the frustum to cull against.
+export
+template <typename FrustumSource>
+struct GpuCullPrePass {
+	GpuCullPrePass(FrustumSource frustumOf) : frustumOf_(frustumOf) {}
+
+	FrustumSource frustumOf_;
+
+	template <typename Row>
+		requires RowType::has_named_field<Row, BOOST_HANA_STRING("gpuCuller"), std::shared_ptr<GpuCuller>>
+			  && RowType::has_named_field<Row, BOOST_HANA_STRING("cullPipelineBundle"), ComputePipelineBundle>
+			  && RowType::has_named_field<Row, BOOST_HANA_STRING("multiFrameIndex"), size_t>
+	void operator()(const Row& r, vk::CommandBuffer buffer) const {
+		const std::shared_ptr<GpuCuller>& culler = boost::hana::at_key(r, BOOST_HANA_STRING("gpuCuller"));
+		const ComputePipelineBundle& pipeline = boost::hana::at_key(r, BOOST_HANA_STRING("cullPipelineBundle"));
+		size_t multiFrameIndex = boost::hana::at_key(r, BOOST_HANA_STRING("multiFrameIndex"));
+
+		culler->cull(buffer, multiFrameIndex, pipeline.computePipeline, pipeline.pipelineLayout, frustumOf_(r));
+	}
+};
+
+}
@@ -0,0 +1,597 @@
+/**
+* CPU-side mesh optimization, run once when a mesh is loaded:
+*
+*   - deduplicateVertices merges byte-identical vertices, which mesh exporters love to emit.
+*   - optimizeVertexCache reorders triangles for the post-transform vertex cache, using Tipsify
+*     (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+*   - optimizeVertexFetch renumbers vertices in the order the triangles first use them, so vertex fetches walk
+*     through memory instead of jumping around.
+*   - compactIndices drops to 16-bit indices when the vertex count allows it.
+*   - simplifyMesh/generateLods build coarser index lists over the same vertices by quadric-error edge collapse
+*     (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics").
+*
+* ACMR (average cache miss ratio) is the number of vertex shader invocations per triangle with a FIFO cache of a
+* given size: 3.0 is the worst case, 0.5 is the best a large regular grid can do.
+*/
+module;
+
+#include "bainangua.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+#include <coro/coro.hpp>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+export module MeshProcessing;
+
+namespace bainangua {
+
+// Post-transform cache size assumed by the optimizer and the ACMR measurement.
+export constexpr uint32_t DefaultVertexCacheSize = 16;
+
+export
+[[nodiscard]] float computeACMR(std::span<const uint32_t> indices, size_t vertexCount, uint32_t cacheSize = DefaultVertexCacheSize) {
+	if (indices.size() < 3) {
+		return 0.0f;
+	}
+
+	// FIFO cache: a vertex is a hit if it went in fewer than cacheSize misses ago
+	std::vector<size_t> insertedAt(vertexCount, SIZE_MAX);
+	size_t misses = 0;
+	for (uint32_t index : indices) {
+		if (insertedAt[index] == SIZE_MAX || misses - insertedAt[index] >= cacheSize) {
+			insertedAt[index] = misses;
+			misses++;
+		}
+	}
+	return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
+
+/**
+* Merges vertices whose bytes are identical and rewrites the indices to match. Returns the new vertex count.
+* V has to be trivially copyable, and any padding in it should be zeroed (value-initialized vertices are).
+*/
+export
+template <typename V>
+size_t deduplicateVertices(std::vector<V>& vertices, std::vector<uint32_t>& indices) {
+	static_assert(std::is_trivially_copyable_v<V>, "deduplicateVertices compares vertices byte by byte");
+
+	auto hashVertex = [&](uint32_t v) {
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertices[v]);
+		size_t hash = 14695981039346656037ull; // FNV-1a
+		for (size_t i = 0; i < sizeof(V); i++) {
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		}
+		return hash;
+	};
+	auto sameVertex = [&](uint32_t a, uint32_t b) {
+		return std::memcmp(&vertices[a], &vertices[b], sizeof(V)) == 0;
+	};
+	std::unordered_map<uint32_t, uint32_t, decltype(hashVertex), decltype(sameVertex)> firstCopy(vertices.size(), hashVertex, sameVertex);
+
+	std::vector<uint32_t> remap(vertices.size());
+	std::vector<V> unique;
+	unique.reserve(vertices.size());
+	for (uint32_t v = 0; v < vertices.size(); v++) {
+		auto [it, inserted] = firstCopy.try_emplace(v, static_cast<uint32_t>(unique.size()));
+		if (inserted) {
+			unique.push_back(vertices[v]);
+		}
+		remap[v] = it->second;
+	}
+
+	for (uint32_t& index : indices) {
+		index = remap[index];
+	}
+	vertices = std::move(unique);
+	return vertices.size();
+}
+
+/**
+* Reorders triangles so that each one reuses vertices still in a post-transform cache of cacheSize entries.
+* Triangles keep their winding. Runs in time linear in the number of indices.
+*/
+export
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = DefaultVertexCacheSize) {
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// triangles using each vertex, as offsets into one flat array
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+	for (uint32_t index : indices) {
+		liveTriangles[index]++;
+	}
+	std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++) {
+		adjacencyStart[v + 1] = adjacencyStart[v] + liveTriangles[v];
+	}
+	std::vector<uint32_t> adjacency(indices.size());
+	{
+		std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++) {
+			for (size_t c = 0; c < 3; c++) {
+				adjacency[fill[indices[t * 3 + c]]++] = static_cast<uint32_t>(t);
+			}
+		}
+	}
+
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnds;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+
+	uint32_t timestamp = cacheSize + 1;
+	size_t cursor = 0;
+
+	auto skipDeadEnd = [&]() -> int64_t {
+		while (!deadEnds.empty()) {
+			uint32_t v = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[v] > 0) {
+				return v;
+			}
+		}
+		while (cursor < vertexCount) {
+			size_t v = cursor++;
+			if (liveTriangles[v] > 0) {
+				return static_cast<int64_t>(v);
+			}
+		}
+		return -1;
+	};
+
+	int64_t fan = skipDeadEnd();
+	while (fan >= 0) {
+		candidates.clear();
+
+		// emit every remaining triangle around the fanning vertex
+		for (uint32_t a = adjacencyStart[fan]; a < adjacencyStart[fan + 1]; a++) {
+			uint32_t t = adjacency[a];
+			if (emitted[t]) {
+				continue;
+			}
+			for (size_t c = 0; c < 3; c++) {
+				uint32_t v = indices[t * 3 + c];
+				output.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (timestamp - cacheTime[v] > cacheSize) {
+					cacheTime[v] = timestamp++;
+				}
+			}
+			emitted[t] = true;
+		}
+
+		// next fan: the candidate that will still be in the cache after its own triangles go through, preferring
+		// the one that's been there longest
+		int64_t best = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t v : candidates) {
+			if (liveTriangles[v] == 0) {
+				continue;
+			}
+			int64_t priority = 0;
+			if (timestamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+				priority = timestamp - cacheTime[v];
+			}
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				best = v;
+			}
+		}
+		fan = (best >= 0) ? best : skipDeadEnd();
+	}
+
+	indices = std::move(output);
+}
+
+/**
+* Renumbers vertices in the order the indices first reach them, and drops vertices no triangle uses. Run this
+* after optimizeVertexCache so the fetch order follows the final triangle order. Returns the new vertex count.
+*/
+export
+template <typename V>
+size_t optimizeVertexFetch(std::vector<V>& vertices, std::vector<uint32_t>& indices) {
+	std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+	std::vector<V> reordered;
+	reordered.reserve(vertices.size());
+
+	for (uint32_t& index : indices) {
+		if (remap[index] == UINT32_MAX) {
+			remap[index] = static_cast<uint32_t>(reordered.size());
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices = std::move(reordered);
+	return vertices.size();
+}
+
+
+export
+using IndexData = std::variant<std::vector<uint16_t>, std::vector<uint32_t>>;
+
+// 16-bit indices when every vertex fits, 32-bit otherwise
+export
+[[nodiscard]] IndexData compactIndices(const std::vector<uint32_t>& indices, size_t vertexCount) {
+	if (vertexCount <= 0x10000) {
+		return std::vector<uint16_t>(indices.begin(), indices.end());
+	}
+	return indices;
+}
+
+export
+[[nodiscard]] vk::IndexType indexType(const IndexData& indices) {
+	return std::holds_alternative<std::vector<uint16_t>>(indices) ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+}
+
+export
+[[nodiscard]] size_t indexCount(const IndexData& indices) {
+	return std::visit([](const auto& i) { return i.size(); }, indices);
+}
+
+
+export
+struct MeshOptimizationStats {
+	size_t verticesBefore;
+	size_t verticesAfter;
+	float acmrBefore;
+	float acmrAfter;
+};
+
+export
+template <typename V>
+struct ProcessedMesh {
+	std::vector<V> vertices;
+	IndexData indices;
+	MeshOptimizationStats stats;
+};
+
+/**
+* Runs the whole pipeline: deduplicate, reorder for the vertex cache, reorder for fetch, then pick an index width.
+*/
+export
+template <typename V>
+[[nodiscard]] ProcessedMesh<V> processMesh(std::vector<V> vertices, std::vector<uint32_t> indices, uint32_t cacheSize = DefaultVertexCacheSize) {
+	MeshOptimizationStats stats{
+		.verticesBefore = vertices.size(),
+		.verticesAfter = 0,
+		.acmrBefore = computeACMR(indices, vertices.size(), cacheSize),
+		.acmrAfter = 0.0f
+	};
+
+	deduplicateVertices(vertices, indices);
+	optimizeVertexCache(indices, vertices.size(), cacheSize);
+	optimizeVertexFetch(vertices, indices);
+
+	stats.verticesAfter = vertices.size();
+	stats.acmrAfter = computeACMR(indices, vertices.size(), cacheSize);
+
+	IndexData compact = compactIndices(indices, vertices.size());
+	return ProcessedMesh<V>{ std::move(vertices), std::move(compact), stats };
+}
+
+// The same, moved onto a thread pool (usually the ResourceLoader's) so loading a big mesh doesn't stall the caller.
+export
+template <typename V>
+auto processMeshAsync(coro::thread_pool& pool, std::vector<V> vertices, std::vector<uint32_t> indices, uint32_t cacheSize = DefaultVertexCacheSize) -> coro::task<ProcessedMesh<V>> {
+	co_await pool.schedule();
+	co_return processMesh(std::move(vertices), std::move(indices), cacheSize);
+}
+
+
+
+//
+// Level of detail
+//
+
+struct Quadric {
+	// the symmetric 4x4 matrix of summed plane equations, plus the summed weight so errors come out as distances
+	double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2, weight;
+
+	static Quadric fromPlane(glm::dvec3 n, double d, double w) {
+		return Quadric{
+			n.x * n.x * w, n.x * n.y * w, n.x * n.z * w, n.x * d * w,
+			n.y * n.y * w, n.y * n.z * w, n.y * d * w,
+			n.z * n.z * w, n.z * d * w,
+			d * d * w,
+			w
+		};
+	}
+
+	Quadric& operator+=(const Quadric& q) {
+		a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+		b2 += q.b2; bc += q.bc; bd += q.bd;
+		c2 += q.c2; cd += q.cd;
+		d2 += q.d2;
+		weight += q.weight;
+		return *this;
+	}
+
+	// mean squared distance from p to the accumulated planes
+	double error(glm::dvec3 p) const {
+		double e =
+			a2 * p.x * p.x + 2.0 * ab * p.x * p.y + 2.0 * ac * p.x * p.z + 2.0 * ad * p.x +
+			b2 * p.y * p.y + 2.0 * bc * p.y * p.z + 2.0 * bd * p.y +
+			c2 * p.z * p.z + 2.0 * cd * p.z +
+			d2;
+		return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+	}
+};
+
+export
+struct SimplifiedIndices {
+	std::vector<uint32_t> indices;
+	float error; // how far (in object space) the simplified surface may be from the input
+};
+
+/**
+* Collapses edges in order of quadric error until the index count drops to targetIndexCount or the next collapse
+* would move the surface further than maxError. Vertices are never moved or created: the result indexes the same
+* vertex buffer, so several levels of detail can share one copy of the vertices.
+*
+* Vertices on open borders, and vertices that share a position with another vertex (UV or normal seams), stay
+* put, which keeps outlines and seams intact. Collapses that would flip a triangle are skipped.
+*/
+export
+[[nodiscard]] SimplifiedIndices simplifyMesh(std::span<const glm::vec3> positions, std::span<const uint32_t> indices, size_t targetIndexCount, float maxError = std::numeric_limits<float>::max()) {
+	const size_t vertexCount = positions.size();
+	std::vector<uint32_t> current(indices.begin(), indices.end());
+
+	// vertices at the same position share a quadric
+	std::vector<uint32_t> canonical(vertexCount);
+	std::vector<bool> locked(vertexCount, false);
+	{
+		auto hashPosition = [&](uint32_t v) {
+			const glm::vec3& p = positions[v];
+			size_t hash = 14695981039346656037ull;
+			for (float f : { p.x, p.y, p.z }) {
+				uint32_t bits;
+				std::memcpy(&bits, &f, sizeof(bits));
+				hash = (hash ^ bits) * 1099511628211ull;
+			}
+			return hash;
+		};
+		auto samePosition = [&](uint32_t a, uint32_t b) { return positions[a] == positions[b]; };
+		std::unordered_map<uint32_t, uint32_t, decltype(hashPosition), decltype(samePosition)> firstAt(vertexCount, hashPosition, samePosition);
+		for (uint32_t v = 0; v < vertexCount; v++) {
+			auto [it, inserted] = firstAt.try_emplace(v, v);
+			canonical[v] = it->second;
+			if (!inserted) {
+				locked[v] = true;
+				locked[it->second] = true;
+			}
+		}
+	}
+
+	// open borders: edges (between positions) that only one triangle uses
+	{
+		std::unordered_map<uint64_t, int> edgeUses;
+		auto edgeKey = [&](uint32_t a, uint32_t b) {
+			uint64_t ca = canonical[a], cb = canonical[b];
+			return ca < cb ? (ca << 32) | cb : (cb << 32) | ca;
+		};
+		for (size_t t = 0; t + 2 < current.size(); t += 3) {
+			for (size_t e = 0; e < 3; e++) {
+				edgeUses[edgeKey(current[t + e], current[t + (e + 1) % 3])]++;
+			}
+		}
+		for (size_t t = 0; t + 2 < current.size(); t += 3) {
+			for (size_t e = 0; e < 3; e++) {
+				uint32_t a = current[t + e], b = current[t + (e + 1) % 3];
+				if (edgeUses[edgeKey(a, b)] == 1) {
+					locked[a] = true;
+					locked[b] = true;
+				}
+			}
+		}
+	}
+
+	std::vector<Quadric> quadrics(vertexCount, Quadric{});
+	for (size_t t = 0; t + 2 < current.size(); t += 3) {
+		glm::dvec3 p0(positions[current[t]]), p1(positions[current[t + 1]]), p2(positions[current[t + 2]]);
+		glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+		double area = glm::length(normal);
+		if (area == 0.0) {
+			continue;
+		}
+		normal /= area;
+		Quadric q = Quadric::fromPlane(normal, -glm::dot(normal, p0), area);
+		for (size_t c = 0; c < 3; c++) {
+			quadrics[canonical[current[t + c]]] += q;
+		}
+	}
+
+	struct Collapse {
+		uint32_t from;
+		uint32_t to;
+		double error;
+	};
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> adjacencyStart;
+	std::vector<uint32_t> adjacency;
+	std::vector<bool> touched;
+	const double maxSquaredError = static_cast<double>(maxError) * static_cast<double>(maxError);
+	double resultError = 0.0;
+
+	// each pass collapses a batch of cheap, non-overlapping edges, then rebuilds the index list
+	while (current.size() > targetIndexCount) {
+		const size_t triangleCount = current.size() / 3;
+
+		adjacencyStart.assign(vertexCount + 1, 0);
+		for (uint32_t index : current) {
+			adjacencyStart[index + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++) {
+			adjacencyStart[v + 1] += adjacencyStart[v];
+		}
+		adjacency.resize(current.size());
+		{
+			std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+			for (size_t i = 0; i < current.size(); i++) {
+				adjacency[fill[current[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		collapses.clear();
+		for (size_t t = 0; t < triangleCount; t++) {
+			for (size_t e = 0; e < 3; e++) {
+				uint32_t a = current[t * 3 + e], b = current[t * 3 + (e + 1) % 3];
+				for (auto [from, to] : { std::pair{ a, b }, std::pair{ b, a } }) {
+					if (locked[from] || from == to) {
+						continue;
+					}
+					Quadric q = quadrics[canonical[from]];
+					q += quadrics[canonical[to]];
+					collapses.push_back({ from, to, q.error(glm::dvec3(positions[to])) });
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.error < y.error; });
+
+		// each collapse removes about two triangles; don't overshoot the target by much in one pass
+		size_t trianglesToRemove = (current.size() - targetIndexCount) / 3;
+		size_t removed = 0;
+		std::vector<uint32_t> remap(vertexCount);
+		for (uint32_t v = 0; v < vertexCount; v++) { remap[v] = v; }
+		touched.assign(vertexCount, false);
+
+		for (const Collapse& c : collapses) {
+			if (removed >= trianglesToRemove || c.error > maxSquaredError) {
+				break;
+			}
+			if (touched[c.from] || touched[c.to]) {
+				continue;
+			}
+
+			// reject collapses that turn a triangle around the moved vertex upside down
+			bool flips = false;
+			size_t shared = 0;
+			glm::vec3 target = positions[c.to];
+			for (uint32_t a = adjacencyStart[c.from]; a < adjacencyStart[c.from + 1] && !flips; a++) {
+				const uint32_t* tri = &current[adjacency[a] * 3];
+				if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+					shared++;
+					continue;
+				}
+				glm::vec3 p[3], q[3];
+				for (size_t k = 0; k < 3; k++) {
+					p[k] = positions[tri[k]];
+					q[k] = (tri[k] == c.from) ? target : p[k];
+				}
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				flips = glm::dot(before, after) <= 0.0f;
+			}
+			if (flips) {
+				continue;
+			}
+
+			remap[c.from] = c.to;
+			quadrics[canonical[c.to]] += quadrics[canonical[c.from]];
+			for (uint32_t a = adjacencyStart[c.from]; a < adjacencyStart[c.from + 1]; a++) {
+				const uint32_t* tri = &current[adjacency[a] * 3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+			}
+			removed += shared;
+			resultError = std::max(resultError, c.error);
+		}
+
+		if (removed == 0) {
+			break;
+		}
+
+		size_t write = 0;
+		for (size_t t = 0; t < triangleCount; t++) {
+			uint32_t a = remap[current[t * 3]], b = remap[current[t * 3 + 1]], c = remap[current[t * 3 + 2]];
+			if (a != b && b != c && c != a) {
+				current[write++] = a;
+				current[write++] = b;
+				current[write++] = c;
+			}
+		}
+		current.resize(write);
+	}
+
+	return SimplifiedIndices{ std::move(current), static_cast<float>(std::sqrt(resultError)) };
+}
+
+export
+struct MeshLodIndices {
+	std::vector<uint32_t> indices;
+	float error; // object-space error relative to the full-detail mesh; 0 for LOD 0
+};
+
+/**
+* Builds up to maxLods levels of detail over one vertex list: LOD 0 is the input, and each LOD after it aims for
+* `reduction` times the previous index count. Stops early once simplification stops paying off. Every LOD is
+* reordered for the vertex cache. V needs a glm::vec3 pos3 member, as in the vertex formats in VertexBuffer.
+*/
+export
+template <typename V>
+[[nodiscard]] std::vector<MeshLodIndices> generateLods(const std::vector<V>& vertices, const std::vector<uint32_t>& indices, size_t maxLods = 4, float reduction = 0.5f, float maxError = std::numeric_limits<float>::max()) {
+	std::vector<glm::vec3> positions(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++) {
+		positions[v] = vertices[v].pos3;
+	}
+
+	std::vector<MeshLodIndices> lods;
+	lods.push_back({ indices, 0.0f });
+	while (lods.size() < maxLods) {
+		const MeshLodIndices& previous = lods.back();
+		size_t target = static_cast<size_t>(static_cast<float>(previous.indices.size() / 3) * reduction) * 3;
+
+		SimplifiedIndices simplified = simplifyMesh(positions, previous.indices, target, maxError);
+		if (simplified.indices.empty() || simplified.indices.size() > previous.indices.size() * 9 / 10) {
+			break;
+		}
+		// each LOD is simplified from the one before, so errors add up
+		float error = previous.error + simplified.error;
+		optimizeVertexCache(simplified.indices, vertices.size());
+		lods.push_back({ std::move(simplified.indices), error });
+	}
+	return lods;
+}
+
+export
+struct BoundingSphere {
+	glm::vec3 center;
+	float radius;
+};
+
+// Centered on the bounding box, so not the tightest sphere, but cheap and stable.
+export
+[[nodiscard]] BoundingSphere boundingSphere(std::span<const glm::vec3> positions) {
+	if (positions.empty()) {
+		return BoundingSphere{ glm::vec3(0.0f), 0.0f };
+	}
+	glm::vec3 low = positions[0], high = positions[0];
+	for (const glm::vec3& p : positions) {
+		low = glm::min(low, p);
+		high = glm::max(high, p);
+	}
+	glm::vec3 center = (low + high) * 0.5f;
+	float radius = 0.0f;
+	for (const glm::vec3& p : positions) {
+		radius = std::max(radius, glm::length(p - center));
+	}
+	return BoundingSphere{ center, radius };
+}
+
+}
@@ -6,6 +6,7 @@ module;
 
 #include "bainangua.hpp"
 #include "RowType.hpp"
+#include "ParallelStages.hpp"
 #include "vk_result_to_string.h"
 
 #include <boost/container_hash/hash.hpp>
@@ -100,7 +101,7 @@ private:
 
 
 /**
-* Creates a PerFramePool
+* Creates a PerFramePool. This is a split stage, so it can be set up in parallel with other split stages using &.
 */
 export
 struct CreatePerFramePool {
@@ -110,19 +111,27 @@ struct CreatePerFramePool {
 	template <typename WrappedReturnType>
 	using return_type_transformer = WrappedReturnType;
 
-	template <typename RowFunction, typename Row>
+	template <typename Row>
 		requires   RowType::has_named_field<Row, BOOST_HANA_STRING("device"), vk::Device>
 				&& RowType::has_named_field<Row, BOOST_HANA_STRING("graphicsQueueFamilyIndex"), uint32_t>
-	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+	auto acquire(const Row& r) {
 		vk::Device device = boost::hana::at_key(r, BOOST_HANA_STRING("device"));
 		uint32_t graphicsQueueIndex = boost::hana::at_key(r, BOOST_HANA_STRING("graphicsQueueFamilyIndex"));
 
 		std::shared_ptr<PerFramePool> pfp = std::make_shared<PerFramePool>(device, graphicsQueueIndex);
 
-		auto rWithPerFramePool = boost::hana::insert(r,
+		return boost::hana::make_map(
 			boost::hana::make_pair(BOOST_HANA_STRING("perFramePool"), pfp)
 		);
-		return f.applyRow(rWithPerFramePool);
+	}
+
+	// the pool is destroyed along with the last reference to it
+	template <typename Fields>
+	void release(const Fields&) {}
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		return RowType::wrapSplitStage(*this, f, std::move(r));
 	}
 };
 
@@ -2,17 +2,25 @@ module;
 
 #include "bainangua.hpp"
 #include "RowType.hpp"
+#include "Tracing.hpp"
+#include "ParallelStages.hpp"
 
 #include <boost/container_hash/hash.hpp>
+#include <boost/hana/any_of.hpp>
 #include <boost/hana/assert.hpp>
 #include <boost/hana/contains.hpp>
+#include <boost/hana/for_each.hpp>
+#include <boost/hana/keys.hpp>
 #include <boost/hana/at_key.hpp>
 #include <boost/hana/map.hpp>
 #include <boost/hana/tuple.hpp>
 #include <boost/hana/type.hpp>
 #include <boost/hana/string.hpp>
 #include <coro/coro.hpp>
+#include <functional>
 #include <mutex>
+#include <utility>
+#include <vector>
 #include <vk_mem_alloc.h>
 #include <vulkan/vulkan.hpp>
 
@@ -21,6 +29,11 @@ module;
 export module ResourceLoader;
 
 import VulkanContext;
+import CommandQueue;
+import DeletionQueue;
+import TextureImage;
+import DescriptorSets;
+import GPUProfiler;
 
 namespace bainangua {
 
@@ -131,7 +144,33 @@ public:
         loaders_(loaders),
         tp_(std::make_shared<coro::thread_pool>(coro::thread_pool::options{.thread_count = 4})),
         autoTasks_(tp_)
-    {}
+    {
+        // loaders that upload to the GPU need these; CPU-only loaders work without them
+        if constexpr (boost::hana::contains(r, BOOST_HANA_STRING("vmaAllocator"))) {
+            allocator_ = boost::hana::at_key(r, BOOST_HANA_STRING("vmaAllocator"));
+        }
+        if constexpr (boost::hana::contains(r, BOOST_HANA_STRING("graphicsQueueFamilyIndex"))) {
+            graphicsQueueFamilyIndex_ = boost::hana::at_key(r, BOOST_HANA_STRING("graphicsQueueFamilyIndex"));
+        }
+        if constexpr (boost::hana::contains(r, BOOST_HANA_STRING("graphicsFunnel"))) {
+            graphicsFunnel_ = boost::hana::at_key(r, BOOST_HANA_STRING("graphicsFunnel"));
+        }
+        if constexpr (boost::hana::contains(r, BOOST_HANA_STRING("physicalDevice"))) {
+            physicalDevice_ = boost::hana::at_key(r, BOOST_HANA_STRING("physicalDevice"));
+        }
+        if constexpr (boost::hana::contains(r, BOOST_HANA_STRING("samplerCache"))) {
+            samplerCache_ = boost::hana::at_key(r, BOOST_HANA_STRING("samplerCache"));
+        }
+        if constexpr (boost::hana::contains(r, BOOST_HANA_STRING("bindlessTable"))) {
+            bindlessTable_ = boost::hana::at_key(r, BOOST_HANA_STRING("bindlessTable"));
+        }
+        if constexpr (boost::hana::contains(r, BOOST_HANA_STRING("gpuProfiler"))) {
+            gpuProfiler_ = boost::hana::at_key(r, BOOST_HANA_STRING("gpuProfiler"));
+        }
+        if constexpr (boost::hana::contains(r, BOOST_HANA_STRING("deletionQueue"))) {
+            deletionQueue_ = boost::hana::at_key(r, BOOST_HANA_STRING("deletionQueue"));
+        }
+    }
 
     ResourceLoader(ResourceLoader const&) = delete;
     ResourceLoader(ResourceLoader&) = delete;
@@ -142,8 +181,33 @@ public:
     void operator=(ResourceLoader&&) = delete;
 
     ~ResourceLoader() {
-        // some unloads might still be queued, wait for them to finish
+        // some loads and unloads might still be queued, wait for them to finish
         coro::sync_wait(autoTasks_.garbage_collect_and_yield_until_empty());
+
+        // Then unload whatever is still loaded, no matter how many references are left. Unloaders can unload their
+        // dependencies, which changes the storage, so take the unloaders out first and repeat until there are none.
+        for (;;) {
+            std::vector<coro::task<bng_expected<void>>> unloaders;
+            boost::hana::for_each(boost::hana::keys(storage_), [&](auto lookupKey) {
+                for (auto& [key, resourceStore] : boost::hana::at_key(storage_, lookupKey)) {
+                    if (resourceStore->unloader_.has_value()) {
+                        unloaders.push_back(std::move(resourceStore->unloader_.value()));
+                        resourceStore->unloader_ = std::nullopt;
+                    }
+                }
+            });
+            if (unloaders.empty()) {
+                break;
+            }
+            for (auto& unloader : unloaders) {
+                (void)coro::sync_wait(unloader);
+            }
+            coro::sync_wait(autoTasks_.garbage_collect_and_yield_until_empty());
+        }
+        boost::hana::for_each(boost::hana::keys(storage_), [this](auto lookupKey) {
+            boost::hana::at_key(storage_, lookupKey).clear();
+        });
+
         tp_->shutdown();
     }
 
@@ -160,7 +224,30 @@ public:
         return totalSize;
     }
 
+    // loaders can push CPU-heavy work (decoding, mesh processing) onto the loader's own threads
+    coro::thread_pool& threadPool() { return *tp_; }
+
+    // Unloaders destroy GPU objects through this. With a "deletionQueue" in the row, destruction waits until every
+    // frame that might still be drawing with them has finished; without one it happens right away, so resources
+    // must only be unloaded while the GPU is idle.
+    void destroyWhenUnused(std::function<void()> destroyFunction) {
+        if (deletionQueue_) {
+            deletionQueue_->enqueue(std::move(destroyFunction));
+        }
+        else {
+            destroyFunction();
+        }
+    }
+
     vk::Device device_;
+    vk::PhysicalDevice physicalDevice_;
+    VmaAllocator allocator_ = VK_NULL_HANDLE;
+    uint32_t graphicsQueueFamilyIndex_ = 0;
+    std::shared_ptr<CommandQueueFunnel> graphicsFunnel_;
+    std::shared_ptr<DeletionQueue> deletionQueue_;
+    std::shared_ptr<SamplerCache> samplerCache_;
+    std::shared_ptr<BindlessTable> bindlessTable_;
+    std::shared_ptr<GPUProfiler> gpuProfiler_;
     LoaderDirectory loaders_;
     LoaderStorage storage_;
     
@@ -214,6 +301,7 @@ public:
     {
         // this is a coroutine, no lambda capture for me
         auto loadAndGo = [](ResourceLoader* self, LookupKey key, std::shared_ptr<SingleResourceStore<LookupKey::resource_type>> storePtr) -> coro::task<void> {
+            BNG_TRACE_TYPE_SCOPE(LookupKey);
             auto& loader = boost::hana::at_key(self->loaders_, boost::hana::type_c<LookupKey>);
             bng_expected<LoaderResults<LookupKey::resource_type>> result = co_await loader(*self, key);
 
@@ -266,6 +354,7 @@ public:
                         resourceStore->unloader_ = std::nullopt;
 
                         self->autoTasks_.start([](ResourceLoader* self, LookupKey key, std::shared_ptr<SingleResourceStore<LookupKey::resource_type>> resourceStore, auto t) -> coro::task<void> {
+                            BNG_TRACE_SCOPE("ResourceLoader::unload");
                             auto result = co_await t;
 
                             // the resource is fully unloaded.
@@ -320,6 +409,19 @@ auto createLoaderStorage(LoaderDirectoryType loaderDirectory) {
         );
 }
 
+// Keys whose loaders upload to the GPU specialize this to true. A ResourceLoaderStage with one of those loaders then
+// needs "vmaAllocator", "graphicsQueueFamilyIndex" and "graphicsFunnel" in its row, which means the stages that
+// provide them go before it with |, not beside it with &.
+export
+template <typename Key>
+constexpr bool loader_uploads_to_gpu = false;
+
+template <typename LoaderDirectory>
+constexpr bool directory_uploads_to_gpu = decltype(boost::hana::any_of(
+    boost::hana::keys(std::declval<LoaderDirectory>()),
+    [](auto key) { return boost::hana::bool_c<loader_uploads_to_gpu<typename decltype(key)::type>>; }
+))::value;
+
 export
 template <typename LoaderDirectory, typename LoaderStorage>
 struct ResourceLoaderStage {
@@ -332,15 +434,27 @@ struct ResourceLoaderStage {
     template <typename WrappedReturnType>
     using return_type_transformer = WrappedReturnType;
 
-    template <typename RowFunction, typename Row>
-    constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+    // This is a split stage, so it can be set up in parallel with other split stages using &.
+    template <typename Row>
+        requires   (!directory_uploads_to_gpu<LoaderDirectory>)
+                || (RowType::has_named_field<Row, BOOST_HANA_STRING("vmaAllocator"), VmaAllocator>
+                 && RowType::has_named_field<Row, BOOST_HANA_STRING("graphicsQueueFamilyIndex"), uint32_t>
+                 && RowType::has_named_field<Row, BOOST_HANA_STRING("graphicsFunnel"), std::shared_ptr<CommandQueueFunnel>>)
+    auto acquire(const Row& r) {
         using LoaderType = ResourceLoader<LoaderDirectory, LoaderStorage>;
 
         std::shared_ptr<LoaderType> loaderptr(std::make_shared<LoaderType>(r, directory_));
 
-        auto rWithResourceLoader = boost::hana::insert(r, boost::hana::make_pair(BOOST_HANA_STRING("resourceLoader"), loaderptr));
-        auto result = f.applyRow(rWithResourceLoader);
-        return result;
+        return boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("resourceLoader"), loaderptr));
+    }
+
+    // the loader unloads everything when the last reference to it goes away
+    template <typename Fields>
+    void release(const Fields&) {}
+
+    template <typename RowFunction, typename Row>
+    constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+        return RowType::wrapSplitStage(*this, f, std::move(r));
     }
 };
 
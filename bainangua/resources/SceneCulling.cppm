@@ -0,0 +1,489 @@
+/**
+* CPU frustum culling for large scenes. Objects are bounding spheres kept in structure-of-arrays form, sorted into
+* the leaf order of a bounding volume hierarchy so every subtree covers one contiguous run of objects:
+*
+*   - a node entirely outside the frustum drops its whole run,
+*   - a node entirely inside accepts its whole run without testing anything,
+*   - leaves that straddle a plane test their spheres 8 (AVX) or 4 (SSE) at a time. The AVX kernel is picked at
+*     runtime when the CPU has it, so the library doesn't have to be built for AVX.
+*
+* Moving objects only needs refit(), which recomputes node bounds in one pass; rebuild() re-sorts everything and is
+* worth doing when objects have moved far enough that the tree has gone baggy. Objects added since the last build
+* aren't in the tree yet and get tested with the SIMD kernel on their own.
+*
+* cull() produces a compact list of visible object ids for the recording stage. cullParallel() splits the tree into
+* jobs on a thread pool.
+*/
+module;
+
+#include "bainangua.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <coro/coro.hpp>
+
+#include "CpuFeatures.hpp"
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+export module SceneCulling;
+
+import MeshProcessing;
+
+namespace bainangua {
+
+export
+struct Frustum {
+	// xyz points into the frustum; a point p is inside a plane when dot(xyz, p) + w >= 0
+	std::array<glm::vec4, 6> planes;
+
+	// Gribb and Hartmann: the planes are sums and differences of the rows of the view-projection matrix
+	static Frustum fromViewProjection(const glm::mat4& m) {
+		auto row = [&](int i) { return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]); };
+		Frustum frustum{ {
+			row(3) + row(0),
+			row(3) - row(0),
+			row(3) + row(1),
+			row(3) - row(1),
+#if defined(GLM_FORCE_DEPTH_ZERO_TO_ONE)
+			row(2),
+#else
+			row(3) + row(2),
+#endif
+			row(3) - row(2)
+		} };
+		for (glm::vec4& plane : frustum.planes) {
+			plane /= glm::length(glm::vec3(plane));
+		}
+		return frustum;
+	}
+
+	bool contains(const BoundingSphere& sphere) const {
+		for (const glm::vec4& plane : planes) {
+			if (plane.x * sphere.center.x + plane.y * sphere.center.y + plane.z * sphere.center.z + plane.w < -sphere.radius) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+// How partially visible leaves get their spheres tested.
+export
+enum class CullKernel { Scalar, SSE, AVX };
+
+export
+CullKernel fastestCullKernel() {
+#if defined(BNG_SIMD_X86)
+	return cpuSupportsAvx() ? CullKernel::AVX : CullKernel::SSE;
+#else
+	return CullKernel::Scalar;
+#endif
+}
+
+export
+class SceneCulling
+{
+public:
+	static constexpr uint32_t LeafSize = 8;
+
+	// The kernel starts out as the fastest this CPU can run. Asking for a faster one than that gets the fastest.
+	void setKernel(CullKernel kernel) { kernel_ = std::min(kernel, fastestCullKernel()); }
+	CullKernel kernel() const { return kernel_; }
+
+	// Returns the object's id, which stays the same across rebuilds.
+	uint32_t add(const BoundingSphere& sphere) {
+		uint32_t id;
+		if (!freeIds_.empty()) {
+			id = freeIds_.back();
+			freeIds_.pop_back();
+		}
+		else {
+			id = static_cast<uint32_t>(slotOfId_.size());
+			slotOfId_.push_back(0);
+		}
+		uint32_t slot = static_cast<uint32_t>(x_.size());
+		x_.push_back(sphere.center.x);
+		y_.push_back(sphere.center.y);
+		z_.push_back(sphere.center.z);
+		r_.push_back(sphere.radius);
+		idOfSlot_.push_back(id);
+		slotOfId_[id] = slot;
+		liveCount_++;
+		return id;
+	}
+
+	// Call refit() (or rebuild()) after a batch of updates and before the next cull.
+	void update(uint32_t id, const BoundingSphere& sphere) {
+		uint32_t slot = slotOfId_[id];
+		x_[slot] = sphere.center.x;
+		y_[slot] = sphere.center.y;
+		z_[slot] = sphere.center.z;
+		r_[slot] = sphere.radius;
+		if (slot < treeObjects_) {
+			dirtyLeaves_.push_back(leafOfSlot_[slot]);
+		}
+	}
+
+	// The slot stays behind with a radius that no frustum test can pass, until the next rebuild drops it.
+	void remove(uint32_t id) {
+		update(id, BoundingSphere{ glm::vec3(0.0f), -std::numeric_limits<float>::infinity() });
+		freeIds_.push_back(id);
+		liveCount_--;
+	}
+
+	size_t size() const { return liveCount_; }
+
+	BoundingSphere bounds(uint32_t id) const {
+		uint32_t slot = slotOfId_[id];
+		return BoundingSphere{ glm::vec3(x_[slot], y_[slot], z_[slot]), r_[slot] };
+	}
+
+	// Builds the tree from scratch with median splits on the longest axis, and re-sorts the object arrays to match.
+	void rebuild() {
+		// drop removed objects, then sort the rest into leaf order
+		std::vector<uint32_t> order;
+		order.reserve(liveCount_);
+		for (uint32_t slot = 0; slot < x_.size(); slot++) {
+			if (r_[slot] >= 0.0f) {
+				order.push_back(slot);
+			}
+		}
+
+		nodes_.clear();
+		if (!order.empty()) {
+			buildNode(order, 0, static_cast<uint32_t>(order.size()));
+		}
+
+		std::vector<float> x(order.size()), y(order.size()), z(order.size()), r(order.size());
+		std::vector<uint32_t> ids(order.size());
+		for (uint32_t slot = 0; slot < order.size(); slot++) {
+			x[slot] = x_[order[slot]];
+			y[slot] = y_[order[slot]];
+			z[slot] = z_[order[slot]];
+			r[slot] = r_[order[slot]];
+			ids[slot] = idOfSlot_[order[slot]];
+			slotOfId_[ids[slot]] = slot;
+		}
+		x_ = std::move(x);
+		y_ = std::move(y);
+		z_ = std::move(z);
+		r_ = std::move(r);
+		idOfSlot_ = std::move(ids);
+		treeObjects_ = static_cast<uint32_t>(order.size());
+
+		leafOfSlot_.assign(treeObjects_, 0);
+		for (uint32_t n = 0; n < nodes_.size(); n++) {
+			if (nodes_[n].rightChild == 0) {
+				std::fill_n(leafOfSlot_.begin() + nodes_[n].start, nodes_[n].count, n);
+			}
+		}
+		dirtyLeaves_.clear();
+	}
+
+	// Recomputes the bounds of the leaves holding updated objects, then of every node above them.
+	void refit() {
+		if (dirtyLeaves_.empty()) {
+			return;
+		}
+		for (uint32_t leaf : dirtyLeaves_) {
+			Node& node = nodes_[leaf];
+			sphereBounds(node.start, node.count, node.min, node.max);
+		}
+		dirtyLeaves_.clear();
+
+		// children always come after their parent, so one backwards pass fixes up every ancestor
+		for (size_t n = nodes_.size(); n-- > 0;) {
+			Node& node = nodes_[n];
+			if (node.rightChild != 0) {
+				const Node& left = nodes_[n + 1];
+				const Node& right = nodes_[node.rightChild];
+				node.min = glm::min(left.min, right.min);
+				node.max = glm::max(left.max, right.max);
+			}
+		}
+	}
+
+	// Appends the ids of every object that might be visible.
+	void cull(const Frustum& frustum, std::vector<uint32_t>& visible) const {
+		if (!nodes_.empty()) {
+			cullSubtree(frustum, 0, visible);
+		}
+		cullSpheres(frustum, treeObjects_, static_cast<uint32_t>(x_.size()) - treeObjects_, visible);
+	}
+
+	std::vector<uint32_t> cull(const Frustum& frustum) const {
+		std::vector<uint32_t> visible;
+		cull(frustum, visible);
+		return visible;
+	}
+
+	// The same as cull(), split into subtree jobs on threads. The result lists objects in the same order cull() does.
+	auto cullParallel(const Frustum& frustum, coro::thread_pool& threads) const -> coro::task<std::vector<uint32_t>> {
+		std::vector<uint32_t> visible;
+		std::vector<coro::task<std::vector<uint32_t>>> jobs;
+
+		// walk down until subtrees are small enough to be one job each. Nodes found to be entirely inside or outside
+		// on the way are settled here; inside ones become their own (trivial) job to keep the output in order.
+		size_t jobSize = std::max<size_t>(4096, treeObjects_ / (threads.thread_count() * 4 + 1));
+		auto job = [](const SceneCulling* self, Frustum frustum, uint32_t node, bool inside, coro::thread_pool& threads) -> coro::task<std::vector<uint32_t>> {
+			co_await threads.schedule();
+			std::vector<uint32_t> visible;
+			if (inside) {
+				self->acceptRange(self->nodes_[node].start, self->nodes_[node].count, visible);
+			}
+			else {
+				self->cullSubtree(frustum, node, visible);
+			}
+			co_return visible;
+		};
+
+		std::vector<uint32_t> stack;
+		if (!nodes_.empty()) {
+			stack.push_back(0);
+		}
+		while (!stack.empty()) {
+			uint32_t n = stack.back();
+			stack.pop_back();
+			const Node& node = nodes_[n];
+
+			Containment containment = classify(frustum, node);
+			if (containment == Containment::Outside) {
+				continue;
+			}
+			if (containment == Containment::Inside || node.count <= jobSize || node.rightChild == 0) {
+				jobs.push_back(job(this, frustum, n, containment == Containment::Inside, threads));
+				continue;
+			}
+			stack.push_back(node.rightChild);
+			stack.push_back(n + 1);
+		}
+
+		auto results = co_await coro::when_all(std::move(jobs));
+		size_t total = 0;
+		for (auto& result : results) {
+			total += result.return_value().size();
+		}
+		visible.reserve(total + (x_.size() - treeObjects_));
+		for (auto& result : results) {
+			visible.insert(visible.end(), result.return_value().begin(), result.return_value().end());
+		}
+		cullSpheres(frustum, treeObjects_, static_cast<uint32_t>(x_.size()) - treeObjects_, visible);
+		co_return visible;
+	}
+
+private:
+	struct Node {
+		glm::vec3 min;
+		uint32_t start;      // first object slot in this subtree
+		glm::vec3 max;
+		uint32_t count;      // objects in this subtree
+		uint32_t rightChild; // the left child is the next node; 0 for a leaf
+	};
+
+	enum class Containment { Outside, Intersecting, Inside };
+
+	// bounds of the spheres in a run of slots, skipping removed objects
+	void sphereBounds(uint32_t start, uint32_t count, glm::vec3& low, glm::vec3& high) const {
+		low = glm::vec3(std::numeric_limits<float>::infinity());
+		high = glm::vec3(-std::numeric_limits<float>::infinity());
+		for (uint32_t slot = start; slot < start + count; slot++) {
+			if (r_[slot] < 0.0f) {
+				continue;
+			}
+			glm::vec3 center(x_[slot], y_[slot], z_[slot]);
+			low = glm::min(low, center - glm::vec3(r_[slot]));
+			high = glm::max(high, center + glm::vec3(r_[slot]));
+		}
+	}
+
+	uint32_t buildNode(std::vector<uint32_t>& order, uint32_t start, uint32_t count) {
+		uint32_t index = static_cast<uint32_t>(nodes_.size());
+		nodes_.push_back(Node{ glm::vec3(0.0f), start, glm::vec3(0.0f), count, 0 });
+
+		glm::vec3 low(std::numeric_limits<float>::infinity()), high(-std::numeric_limits<float>::infinity());
+		glm::vec3 centerLow = low, centerHigh = high;
+		for (uint32_t i = start; i < start + count; i++) {
+			uint32_t slot = order[i];
+			glm::vec3 center(x_[slot], y_[slot], z_[slot]);
+			low = glm::min(low, center - glm::vec3(r_[slot]));
+			high = glm::max(high, center + glm::vec3(r_[slot]));
+			centerLow = glm::min(centerLow, center);
+			centerHigh = glm::max(centerHigh, center);
+		}
+		nodes_[index].min = low;
+		nodes_[index].max = high;
+
+		if (count <= LeafSize) {
+			return index;
+		}
+
+		glm::vec3 extent = centerHigh - centerLow;
+		const std::vector<float>& axis = (extent.x >= extent.y && extent.x >= extent.z) ? x_ : (extent.y >= extent.z ? y_ : z_);
+		uint32_t half = count / 2;
+		std::nth_element(order.begin() + start, order.begin() + start + half, order.begin() + start + count,
+			[&](uint32_t a, uint32_t b) { return axis[a] < axis[b]; });
+
+		buildNode(order, start, half);
+		uint32_t right = buildNode(order, start + half, count - half);
+		nodes_[index].rightChild = right;
+		return index;
+	}
+
+	static Containment classify(const Frustum& frustum, const Node& node) {
+		bool inside = true;
+		for (const glm::vec4& plane : frustum.planes) {
+			// the box corner furthest along the plane normal, and the one furthest against it
+			glm::vec3 farCorner(plane.x >= 0.0f ? node.max.x : node.min.x, plane.y >= 0.0f ? node.max.y : node.min.y, plane.z >= 0.0f ? node.max.z : node.min.z);
+			glm::vec3 nearCorner(plane.x >= 0.0f ? node.min.x : node.max.x, plane.y >= 0.0f ? node.min.y : node.max.y, plane.z >= 0.0f ? node.min.z : node.max.z);
+			if (glm::dot(glm::vec3(plane), farCorner) + plane.w < 0.0f) {
+				return Containment::Outside;
+			}
+			if (glm::dot(glm::vec3(plane), nearCorner) + plane.w < 0.0f) {
+				inside = false;
+			}
+		}
+		return inside ? Containment::Inside : Containment::Intersecting;
+	}
+
+	void cullSubtree(const Frustum& frustum, uint32_t root, std::vector<uint32_t>& visible) const {
+		// median splits keep the tree balanced, so its depth is about log2(objects / LeafSize)
+		uint32_t stack[64];
+		uint32_t top = 0;
+		stack[top++] = root;
+		while (top > 0) {
+			uint32_t n = stack[--top];
+			const Node& node = nodes_[n];
+			switch (classify(frustum, node)) {
+			case Containment::Outside:
+				break;
+			case Containment::Inside:
+				acceptRange(node.start, node.count, visible);
+				break;
+			case Containment::Intersecting:
+				if (node.rightChild == 0) {
+					cullSpheres(frustum, node.start, node.count, visible);
+				}
+				else {
+					stack[top++] = node.rightChild;
+					stack[top++] = n + 1;
+				}
+				break;
+			}
+		}
+	}
+
+	void acceptRange(uint32_t start, uint32_t count, std::vector<uint32_t>& visible) const {
+		for (uint32_t slot = start; slot < start + count; slot++) {
+			if (r_[slot] >= 0.0f) {
+				visible.push_back(idOfSlot_[slot]);
+			}
+		}
+	}
+
+	// the SIMD kernel: tests a run of spheres against all six planes
+	void cullSpheres(const Frustum& frustum, uint32_t start, uint32_t count, std::vector<uint32_t>& visible) const {
+		size_t written = visible.size();
+		visible.resize(written + count);
+		uint32_t* out = visible.data() + written;
+
+		uint32_t slot = start;
+		const uint32_t end = start + count;
+
+#if defined(BNG_SIMD_X86)
+		if (kernel_ == CullKernel::AVX) {
+			out = cullSpheresAvx(frustum, slot, end, out);
+		}
+		if (kernel_ != CullKernel::Scalar) {
+			out = cullSpheresSse(frustum, slot, end, out);
+		}
+#endif
+		for (; slot < end; slot++) {
+			if (frustum.contains(BoundingSphere{ glm::vec3(x_[slot], y_[slot], z_[slot]), r_[slot] })) {
+				*out++ = idOfSlot_[slot];
+			}
+		}
+
+		visible.resize(static_cast<size_t>(out - visible.data()));
+	}
+
+#if defined(BNG_SIMD_X86)
+	// Both of these test whole groups of spheres from slot on, leaving slot at the first one they didn't get to.
+
+	BNG_TARGET("avx")
+	uint32_t* cullSpheresAvx(const Frustum& frustum, uint32_t& slot, uint32_t end, uint32_t* out) const {
+		__m256 planes[6][4];
+		for (size_t p = 0; p < 6; p++) {
+			for (int c = 0; c < 4; c++) {
+				planes[p][c] = _mm256_set1_ps(frustum.planes[p][c]);
+			}
+		}
+		for (; slot + 8 <= end; slot += 8) {
+			__m256 x = _mm256_loadu_ps(&x_[slot]);
+			__m256 y = _mm256_loadu_ps(&y_[slot]);
+			__m256 z = _mm256_loadu_ps(&z_[slot]);
+			__m256 negR = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&r_[slot]));
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (size_t p = 0; p < 6; p++) {
+				__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planes[p][0], x), _mm256_mul_ps(planes[p][1], y)), _mm256_mul_ps(planes[p][2], z)), planes[p][3]);
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negR, _CMP_GE_OQ));
+			}
+			for (unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(inside)); mask != 0; mask &= mask - 1) {
+				*out++ = idOfSlot_[slot + std::countr_zero(mask)];
+			}
+		}
+		return out;
+	}
+
+	uint32_t* cullSpheresSse(const Frustum& frustum, uint32_t& slot, uint32_t end, uint32_t* out) const {
+		__m128 planes[6][4];
+		for (size_t p = 0; p < 6; p++) {
+			for (int c = 0; c < 4; c++) {
+				planes[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+			}
+		}
+		for (; slot + 4 <= end; slot += 4) {
+			__m128 x = _mm_loadu_ps(&x_[slot]);
+			__m128 y = _mm_loadu_ps(&y_[slot]);
+			__m128 z = _mm_loadu_ps(&z_[slot]);
+			__m128 negR = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&r_[slot]));
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (size_t p = 0; p < 6; p++) {
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(planes[p][0], x), _mm_mul_ps(planes[p][1], y)), _mm_mul_ps(planes[p][2], z)), planes[p][3]);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+			}
+			for (unsigned mask = static_cast<unsigned>(_mm_movemask_ps(inside)); mask != 0; mask &= mask - 1) {
+				*out++ = idOfSlot_[slot + std::countr_zero(mask)];
+			}
+		}
+		return out;
+	}
+#endif
+
+	// objects, by slot
+	std::vector<float> x_;
+	std::vector<float> y_;
+	std::vector<float> z_;
+	std::vector<float> r_;
+	std::vector<uint32_t> idOfSlot_;
+
+	std::vector<uint32_t> slotOfId_;
+	std::vector<uint32_t> freeIds_;
+	size_t liveCount_ = 0;
+
+	// slots [0, treeObjects_) are in the tree; anything after was added since the last rebuild
+	std::vector<Node> nodes_;
+	uint32_t treeObjects_ = 0;
+	std::vector<uint32_t> leafOfSlot_;
+	std::vector<uint32_t> dirtyLeaves_;
+
+	CullKernel kernel_ = fastestCullKernel();
+};
+
+}
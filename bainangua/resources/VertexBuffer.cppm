@@ -4,10 +4,19 @@ module;
 #include "RowType.hpp"
 #include "vk_result_to_string.h"
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <span>
 #include <variant>
 #include <vector>
 #include <map>
 #include <string_view>
+#include <tuple>
+#include <utility>
 #include <coro/coro.hpp>
 #include <boost/hana/map.hpp>
 #include <boost/hana/hash.hpp>
@@ -20,6 +29,8 @@ module;
 
 #include <reflect.hpp>
 
+#include "CpuFeatures.hpp"
+
 export module VertexBuffer;
 
 namespace bainangua {
@@ -32,17 +43,36 @@ namespace bainangua {
 using namespace std::literals;
 
 // we map from member name to vertex format. Also includes the expected size of the data as an additional check.
+//
+// The packed formats below cut vertex bandwidth. Three-component 16-bit formats aren't widely supported for vertex
+// input, so half positions take four halves with w unused. The 10:10:10:2 formats are unorm, which every device
+// supports, so shaders decode normals and tangents with n * 2.0 - 1.0. Octahedral normals decode with octDecode().
+// Fill these fields with the pack...() functions further down.
+//
+// The last column is how many shader locations a field takes up. Matrices take one location per vec4 with the
+// listed format: transform is a glm::mat4, and transform3x4 is an affine transform stored as three vec4 rows.
 constexpr std::array vertexTypeMap{
-	std::make_tuple("pos3"sv, vk::Format::eR32G32B32Sfloat, (size_t)12),
-	std::make_tuple("pos4"sv, vk::Format::eR32G32B32A32Sfloat, (size_t)16),
-	std::make_tuple("normal3"sv, vk::Format::eR32G32B32Sfloat, (size_t)12),
-	std::make_tuple("uv"sv, vk::Format::eR32G32Sfloat, (size_t)8),
-	std::make_tuple("uvw"sv, vk::Format::eR32G32B32Sfloat, (size_t)12)
+	std::make_tuple("pos3"sv, vk::Format::eR32G32B32Sfloat, (size_t)12, 1u),
+	std::make_tuple("pos4"sv, vk::Format::eR32G32B32A32Sfloat, (size_t)16, 1u),
+	std::make_tuple("normal3"sv, vk::Format::eR32G32B32Sfloat, (size_t)12, 1u),
+	std::make_tuple("uv"sv, vk::Format::eR32G32Sfloat, (size_t)8, 1u),
+	std::make_tuple("uvw"sv, vk::Format::eR32G32B32Sfloat, (size_t)12, 1u),
+	std::make_tuple("pos3h"sv, vk::Format::eR16G16B16A16Sfloat, (size_t)8, 1u),
+	std::make_tuple("uvh"sv, vk::Format::eR16G16Sfloat, (size_t)4, 1u),
+	std::make_tuple("uv16"sv, vk::Format::eR16G16Unorm, (size_t)4, 1u),
+	std::make_tuple("normal3s"sv, vk::Format::eR8G8B8A8Snorm, (size_t)4, 1u),
+	std::make_tuple("normalOct"sv, vk::Format::eR16G16Snorm, (size_t)4, 1u),
+	std::make_tuple("normal10"sv, vk::Format::eA2B10G10R10UnormPack32, (size_t)4, 1u),
+	std::make_tuple("tangent10"sv, vk::Format::eA2B10G10R10UnormPack32, (size_t)4, 1u),
+	std::make_tuple("color8"sv, vk::Format::eR8G8B8A8Unorm, (size_t)4, 1u),
+	std::make_tuple("transform"sv, vk::Format::eR32G32B32A32Sfloat, (size_t)64, 4u),
+	std::make_tuple("transform3x4"sv, vk::Format::eR32G32B32A32Sfloat, (size_t)48, 3u),
+	std::make_tuple("colorIndex"sv, vk::Format::eR32Uint, (size_t)4, 1u)
 };
 	
-[[nodiscard]] constexpr auto lookupVertexType(const std::string_view identifier) -> std::tuple<std::string_view, vk::Format, size_t> {
+[[nodiscard]] constexpr auto lookupVertexType(const std::string_view identifier) -> std::tuple<std::string_view, vk::Format, size_t, uint32_t> {
 	for (auto const &vpair : vertexTypeMap) {
-		auto &[k, v, e] = vpair;
+		auto &[k, v, e, l] = vpair;
 		if (k == identifier) {
 			return vpair;
 		}
@@ -50,19 +80,37 @@ constexpr std::array vertexTypeMap{
 	throw std::range_error("vertex type not found");
 }
 
+template <typename VertexStruct, size_t... I>
+constexpr size_t countLocations(std::index_sequence<I...>) {
+	return (size_t{ 0 } + ... + std::get<3>(lookupVertexType(reflect::member_name<I, VertexStruct>())));
+}
+
+// number of shader locations the fields of VertexStruct take up
+export
+template <typename VertexStruct>
+constexpr size_t locationCount() {
+	return countLocations<VertexStruct>(std::make_index_sequence<reflect::size<VertexStruct>()>{});
+}
+
 
 template <typename VertexStruct, size_t ArraySize>
-constexpr auto attributes(const VertexStruct v) -> std::array<vk::VertexInputAttributeDescription, ArraySize>  {
+constexpr auto attributes(const VertexStruct v, uint32_t binding, uint32_t firstLocation) -> std::array<vk::VertexInputAttributeDescription, ArraySize>  {
 	std::array<vk::VertexInputAttributeDescription, ArraySize> attributes;
+	uint32_t location = firstLocation;
+	size_t attributeIndex = 0;
 
-	reflect::for_each([&attributes](auto I) {
+	reflect::for_each([&](auto I) {
 			std::string_view fieldName = reflect::member_name<I, VertexStruct>();
 			size_t actualSize = reflect::size_of<I, VertexStruct>();
 
-			auto [name, format, expectedSize] = lookupVertexType(fieldName);
+			auto [name, format, expectedSize, locations] = lookupVertexType(fieldName);
 			assert(expectedSize == actualSize);
 
-			attributes[I] = vk::VertexInputAttributeDescription(static_cast<uint32_t>(I), 0, format, static_cast<uint32_t>(reflect::offset_of<I, VertexStruct>()));
+			uint32_t offset = static_cast<uint32_t>(reflect::offset_of<I, VertexStruct>());
+			uint32_t columnSize = static_cast<uint32_t>(expectedSize / locations);
+			for (uint32_t column = 0; column < locations; column++) {
+				attributes[attributeIndex++] = vk::VertexInputAttributeDescription(location++, binding, format, offset + column * columnSize);
+			}
 		}, v);
 
 	return attributes;
@@ -75,8 +123,486 @@ constexpr auto attributes(const VertexStruct v) -> std::array<vk::VertexInputAtt
 export
 template <typename VertexStruct>
 constexpr auto reflectAttributes(const VertexStruct v = {}) {
-	return attributes<VertexStruct, reflect::size<VertexStruct>()>(v);
+	return attributes<VertexStruct, locationCount<VertexStruct>()>(v, 0, 0);
+}
+
+// The same, for a struct that goes in another binding. Its attributes start at firstLocation, which is usually the
+// locationCount() of the struct in binding 0.
+export
+template <typename VertexStruct>
+constexpr auto reflectAttributes(uint32_t binding, uint32_t firstLocation) {
+	return attributes<VertexStruct, locationCount<VertexStruct>()>(VertexStruct{}, binding, firstLocation);
+}
+
+/**
+* Binding and attributes for a struct of per-instance data, such as a transform or a color index. The result has the
+* same shape as the "vertexInput" row field; put it in the row as "instanceInput" and CreateSimplePipeline adds it
+* to the pipeline as an eInstance-rate binding.
+*/
+export
+template <typename InstanceStruct>
+auto reflectInstanceInput(uint32_t binding, uint32_t firstLocation) -> std::tuple<vk::VertexInputBindingDescription, std::vector<vk::VertexInputAttributeDescription>> {
+	auto instanceAttributes = reflectAttributes<InstanceStruct>(binding, firstLocation);
+	return {
+		vk::VertexInputBindingDescription(binding, sizeof(InstanceStruct), vk::VertexInputRate::eInstance),
+		std::vector<vk::VertexInputAttributeDescription>(instanceAttributes.begin(), instanceAttributes.end())
+	};
+}
+
+// per-instance data for drawing many copies of one mesh
+export
+struct InstanceTransform {
+	glm::mat4 transform;
+};
+
+
+/**
+* Split vertex layouts. Instead of one interleaved binding, the fields of a vertex struct get spread over several
+* bindings ("streams"), each tightly packed. A pass that only needs some of the fields binds only those streams; a
+* depth-only or shadow pass binds the position stream and fetches a fraction of the bytes.
+*
+* A split is a callable that picks a stream for each field name. Attribute locations are the same as the
+* interleaved layout from reflectAttributes, so the same shaders work with either.
+*/
+
+// positions in stream 0, everything else in stream 1
+export
+struct PositionStreamSplit {
+	static constexpr uint32_t streamCount = 2;
+
+	constexpr uint32_t operator()(std::string_view fieldName) const {
+		return fieldName.starts_with("pos") ? 0 : 1;
+	}
+};
+
+export
+template <typename VertexStruct, typename Split>
+struct VertexStreamLayout {
+	static constexpr size_t fieldCount = reflect::size<VertexStruct>();
+	static constexpr uint32_t streamCount = Split::streamCount;
+
+	struct Field {
+		std::string_view name;
+		vk::Format format;
+		uint32_t locations;
+		uint32_t firstLocation;
+		uint32_t size;
+		uint32_t sourceOffset; // in VertexStruct
+		uint32_t stream;
+		uint32_t streamOffset; // in one element of the stream
+	};
+
+	std::array<Field, fieldCount> fields;
+	std::array<uint32_t, streamCount> streamStrides{};
+
+	// The binding and attributes of a single stream, in the same shape as the "vertexInput" row field. The binding
+	// number is the stream number.
+	auto streamInput(uint32_t stream) const -> std::tuple<vk::VertexInputBindingDescription, std::vector<vk::VertexInputAttributeDescription>> {
+		std::vector<vk::VertexInputAttributeDescription> attributes;
+		for (const Field& field : fields) {
+			if (field.stream == stream) {
+				appendAttributes(field, attributes);
+			}
+		}
+		return { vk::VertexInputBindingDescription(stream, streamStrides[stream], vk::VertexInputRate::eVertex), attributes };
+	}
+
+	// Every non-empty stream, each in its own binding. Also usable as a "vertexInput" row field.
+	auto vertexInput() const -> std::tuple<std::vector<vk::VertexInputBindingDescription>, std::vector<vk::VertexInputAttributeDescription>> {
+		std::vector<vk::VertexInputBindingDescription> bindings;
+		std::vector<vk::VertexInputAttributeDescription> attributes;
+		for (uint32_t stream = 0; stream < streamCount; stream++) {
+			if (streamStrides[stream] > 0) {
+				bindings.emplace_back(stream, streamStrides[stream], vk::VertexInputRate::eVertex);
+			}
+		}
+		for (const Field& field : fields) {
+			appendAttributes(field, attributes);
+		}
+		return { bindings, attributes };
+	}
+
+private:
+	static void appendAttributes(const Field& field, std::vector<vk::VertexInputAttributeDescription>& attributes) {
+		uint32_t columnSize = field.size / field.locations;
+		for (uint32_t column = 0; column < field.locations; column++) {
+			attributes.emplace_back(field.firstLocation + column, field.stream, field.format, field.streamOffset + column * columnSize);
+		}
+	}
+};
+
+template <typename VertexStruct, typename Split, size_t... I>
+constexpr auto buildStreamLayout(Split split, std::index_sequence<I...>) -> VertexStreamLayout<VertexStruct, Split> {
+	VertexStreamLayout<VertexStruct, Split> layout{};
+	uint32_t location = 0;
+
+	auto addField = [&](auto index) {
+		constexpr size_t F = decltype(index)::value;
+		std::string_view name = reflect::member_name<F, VertexStruct>();
+		auto [key, format, expectedSize, locations] = lookupVertexType(name);
+		uint32_t stream = split(name);
+
+		layout.fields[F] = {
+			.name = name,
+			.format = format,
+			.locations = locations,
+			.firstLocation = location,
+			.size = static_cast<uint32_t>(reflect::size_of<F, VertexStruct>()),
+			.sourceOffset = static_cast<uint32_t>(reflect::offset_of<F, VertexStruct>()),
+			.stream = stream,
+			.streamOffset = layout.streamStrides[stream]
+		};
+		location += locations;
+		layout.streamStrides[stream] += layout.fields[F].size;
+	};
+	(addField(std::integral_constant<size_t, I>{}), ...);
+
+	return layout;
+}
+
+/**
+* Works out a split layout for VertexStruct, using the same field naming scheme as reflectAttributes.
+*/
+export
+template <typename VertexStruct, typename Split = PositionStreamSplit>
+constexpr auto reflectStreams(Split split = {}) -> VertexStreamLayout<VertexStruct, Split> {
+	return buildStreamLayout<VertexStruct>(split, std::make_index_sequence<reflect::size<VertexStruct>()>{});
+}
+
+/**
+* Rearranges interleaved vertices into one tightly packed byte array per stream, ready for the vertex buffer
+* builders. Empty streams come back empty.
+*/
+export
+template <typename VertexStruct, typename Split>
+auto splitVertexStreams(const std::vector<VertexStruct>& vertices, const VertexStreamLayout<VertexStruct, Split>& layout) -> std::vector<std::vector<std::byte>> {
+	std::vector<std::vector<std::byte>> streams(layout.streamCount);
+	for (uint32_t stream = 0; stream < layout.streamCount; stream++) {
+		streams[stream].resize(static_cast<size_t>(layout.streamStrides[stream]) * vertices.size());
+	}
+
+	for (size_t v = 0; v < vertices.size(); v++) {
+		const std::byte* source = reinterpret_cast<const std::byte*>(&vertices[v]);
+		for (const auto& field : layout.fields) {
+			std::byte* dest = streams[field.stream].data() + v * layout.streamStrides[field.stream] + field.streamOffset;
+			std::memcpy(dest, source + field.sourceOffset, field.size);
+		}
+	}
+	return streams;
+}
+
+
+
+//
+// Packed field types. They aren't aggregates, so reflect counts each one as a single field.
+//
+
+export struct PackedHalf2 { constexpr PackedHalf2() {} uint16_t v[2]{}; };
+export struct PackedHalf4 { constexpr PackedHalf4() {} uint16_t v[4]{}; };
+export struct PackedUnorm16x2 { constexpr PackedUnorm16x2() {} uint16_t v[2]{}; };
+export struct PackedSnorm16x2 { constexpr PackedSnorm16x2() {} int16_t v[2]{}; };
+export struct PackedSnorm8x4 { constexpr PackedSnorm8x4() {} int8_t v[4]{}; };
+export struct PackedUnorm8x4 { constexpr PackedUnorm8x4() {} uint8_t v[4]{}; };
+export struct Packed1010102 { constexpr Packed1010102() {} uint32_t v{}; };
+
+
+//
+// Float to packed conversion kernels. These convert count floats from src into dst, using SSE2 (and F16C for halves
+// when the CPU has it) on x64, with a scalar loop for the leftovers and for other targets.
+//
+
+export
+[[nodiscard]] inline uint16_t floatToHalf(float f) {
+	uint32_t bits = std::bit_cast<uint32_t>(f);
+	uint32_t sign = (bits >> 16) & 0x8000u;
+	uint32_t magnitude = bits & 0x7fffffffu;
+
+	if (magnitude >= 0x7f800000u) { // inf or nan
+		return static_cast<uint16_t>(sign | 0x7c00u | (magnitude > 0x7f800000u ? 0x200u : 0u));
+	}
+	if (magnitude >= 0x477ff000u) { // rounds up past the largest half
+		return static_cast<uint16_t>(sign | 0x7c00u);
+	}
+	if (magnitude < 0x38800000u) { // half denormal or zero; let the float adder do the rounding
+		float shifted = std::bit_cast<float>(magnitude) + 0.5f;
+		return static_cast<uint16_t>(sign | (std::bit_cast<uint32_t>(shifted) - 0x3f000000u));
+	}
+	// rebias the exponent and round to nearest even
+	uint32_t odd = (magnitude >> 13) & 1u;
+	magnitude += 0xc8000fffu + odd;
+	return static_cast<uint16_t>(sign | (magnitude >> 13));
+}
+
+export
+[[nodiscard]] inline float halfToFloat(uint16_t h) {
+	uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+	uint32_t exponent = (h >> 10) & 0x1fu;
+	uint32_t mantissa = h & 0x3ffu;
+
+	if (exponent == 0) {
+		float value = std::ldexp(static_cast<float>(mantissa), -24);
+		return sign ? -value : value;
+	}
+	if (exponent == 31) {
+		return std::bit_cast<float>(sign | 0x7f800000u | (mantissa << 13));
+	}
+	return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+#if defined(BNG_SIMD_X86)
+// Converts groups of four and returns how many it got through. Only call it when cpuSupportsF16c() says so.
+BNG_TARGET("f16c")
+size_t floatsToHalfF16c(const float* src, uint16_t* dst, size_t count) {
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i halves = _mm_cvtps_ph(_mm_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), halves);
+	}
+	return i;
+}
+#endif
+
+export
+void floatsToHalf(const float* src, uint16_t* dst, size_t count) {
+	size_t i = 0;
+#if defined(BNG_SIMD_X86)
+	if (cpuSupportsF16c()) {
+		i = floatsToHalfF16c(src, dst, count);
+	}
+#endif
+	for (; i < count; i++) {
+		dst[i] = floatToHalf(src[i]);
+	}
+}
+
+export
+void floatsToSnorm16(const float* src, int16_t* dst, size_t count) {
+	size_t i = 0;
+#if defined(BNG_SIMD_X86)
+	const __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f), scale = _mm_set1_ps(32767.0f);
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo), hi), scale));
+		__m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), lo), hi), scale));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(a, b));
+	}
+#endif
+	for (; i < count; i++) {
+		dst[i] = static_cast<int16_t>(std::nearbyint(std::clamp(src[i], -1.0f, 1.0f) * 32767.0f));
+	}
+}
+
+export
+void floatsToUnorm16(const float* src, uint16_t* dst, size_t count) {
+	size_t i = 0;
+#if defined(BNG_SIMD_X86)
+	// SSE2 only has a signed 32->16 pack, so shift into signed range, pack, and flip the top bit back
+	const __m128 lo = _mm_setzero_ps(), hi = _mm_set1_ps(1.0f), scale = _mm_set1_ps(65535.0f);
+	const __m128i bias = _mm_set1_epi32(32768);
+	const __m128i flip = _mm_set1_epi16(static_cast<short>(0x8000));
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_sub_epi32(_mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo), hi), scale)), bias);
+		__m128i b = _mm_sub_epi32(_mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), lo), hi), scale)), bias);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(_mm_packs_epi32(a, b), flip));
+	}
+#endif
+	for (; i < count; i++) {
+		dst[i] = static_cast<uint16_t>(std::nearbyint(std::clamp(src[i], 0.0f, 1.0f) * 65535.0f));
+	}
 }
 
+export
+void floatsToSnorm8(const float* src, int8_t* dst, size_t count) {
+	size_t i = 0;
+#if defined(BNG_SIMD_X86)
+	const __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f), scale = _mm_set1_ps(127.0f);
+	for (; i + 16 <= count; i += 16) {
+		__m128i q[4];
+		for (int j = 0; j < 4; j++) {
+			q[j] = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4 * j), lo), hi), scale));
+		}
+		__m128i packed = _mm_packs_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3]));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+	}
+#endif
+	for (; i < count; i++) {
+		dst[i] = static_cast<int8_t>(std::nearbyint(std::clamp(src[i], -1.0f, 1.0f) * 127.0f));
+	}
+}
+
+export
+void floatsToUnorm8(const float* src, uint8_t* dst, size_t count) {
+	size_t i = 0;
+#if defined(BNG_SIMD_X86)
+	const __m128 lo = _mm_setzero_ps(), hi = _mm_set1_ps(1.0f), scale = _mm_set1_ps(255.0f);
+	for (; i + 16 <= count; i += 16) {
+		__m128i q[4];
+		for (int j = 0; j < 4; j++) {
+			q[j] = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4 * j), lo), hi), scale));
+		}
+		__m128i packed = _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3]));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+	}
+#endif
+	for (; i < count; i++) {
+		dst[i] = static_cast<uint8_t>(std::nearbyint(std::clamp(src[i], 0.0f, 1.0f) * 255.0f));
+	}
+}
+
+// src holds groups of four floats in [0,1]; each group becomes one A2B10G10R10 value
+export
+void floatsToUnorm1010102(const float* src, uint32_t* dst, size_t groupCount) {
+	size_t i = 0;
+#if defined(BNG_SIMD_X86)
+	const __m128 lo = _mm_setzero_ps(), hi = _mm_set1_ps(1.0f);
+	const __m128 scale10 = _mm_set1_ps(1023.0f), scale2 = _mm_set1_ps(3.0f);
+	for (; i + 4 <= groupCount; i += 4) {
+		// transpose four xyzw groups so each register holds one component of four values
+		__m128 x = _mm_loadu_ps(src + 4 * i);
+		__m128 y = _mm_loadu_ps(src + 4 * i + 4);
+		__m128 z = _mm_loadu_ps(src + 4 * i + 8);
+		__m128 w = _mm_loadu_ps(src + 4 * i + 12);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		__m128i xi = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(x, lo), hi), scale10));
+		__m128i yi = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(y, lo), hi), scale10));
+		__m128i zi = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(z, lo), hi), scale10));
+		__m128i wi = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(w, lo), hi), scale2));
+
+		__m128i packed = _mm_or_si128(_mm_or_si128(xi, _mm_slli_epi32(yi, 10)), _mm_or_si128(_mm_slli_epi32(zi, 20), _mm_slli_epi32(wi, 30)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+	}
+#endif
+	for (; i < groupCount; i++) {
+		const float* g = src + 4 * i;
+		uint32_t x = static_cast<uint32_t>(std::nearbyint(std::clamp(g[0], 0.0f, 1.0f) * 1023.0f));
+		uint32_t y = static_cast<uint32_t>(std::nearbyint(std::clamp(g[1], 0.0f, 1.0f) * 1023.0f));
+		uint32_t z = static_cast<uint32_t>(std::nearbyint(std::clamp(g[2], 0.0f, 1.0f) * 1023.0f));
+		uint32_t w = static_cast<uint32_t>(std::nearbyint(std::clamp(g[3], 0.0f, 1.0f) * 3.0f));
+		dst[i] = x | (y << 10) | (z << 20) | (w << 30);
+	}
+}
 
-}
\ No newline at end of file
+// Octahedral normal encoding: folds the unit sphere onto the [-1,1] square.
+export
+[[nodiscard]] inline glm::vec2 octEncode(glm::vec3 n) {
+	n /= (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+	glm::vec2 p(n.x, n.y);
+	if (n.z < 0.0f) {
+		p = glm::vec2((1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+	}
+	return p;
+}
+
+export
+[[nodiscard]] inline glm::vec3 octDecode(glm::vec2 p) {
+	glm::vec3 n(p.x, p.y, 1.0f - std::abs(p.x) - std::abs(p.y));
+	float t = std::max(-n.z, 0.0f);
+	n.x += (n.x >= 0.0f) ? -t : t;
+	n.y += (n.y >= 0.0f) ? -t : t;
+	return glm::normalize(n);
+}
+
+
+//
+// Packers. Each one converts a float source stream into one packed field of an array of vertices. They work through
+// the stream in chunks: gather a chunk of floats, convert it with one of the kernels above, then copy the packed
+// values into the vertices.
+//
+
+template <size_t FloatsPerVertex, typename Packed, typename Vertex, typename Field, typename Gather, typename Convert>
+void packStream(size_t count, std::span<Vertex> vertices, Field Vertex::* field, Gather gather, Convert convert) {
+	constexpr size_t ChunkSize = 64;
+	constexpr size_t PackedPerVertex = sizeof(Field) / sizeof(Packed);
+	static_assert(sizeof(Field) % sizeof(Packed) == 0);
+
+	std::array<float, ChunkSize * FloatsPerVertex> floats;
+	std::array<Packed, ChunkSize * PackedPerVertex> packed;
+
+	size_t total = std::min(count, vertices.size());
+	for (size_t start = 0; start < total; start += ChunkSize) {
+		size_t chunk = std::min(ChunkSize, total - start);
+		for (size_t i = 0; i < chunk; i++) {
+			gather(start + i, &floats[i * FloatsPerVertex]);
+		}
+		convert(floats.data(), packed.data(), chunk);
+		for (size_t i = 0; i < chunk; i++) {
+			std::memcpy(&(vertices[start + i].*field), &packed[i * PackedPerVertex], sizeof(Field));
+		}
+	}
+}
+
+export
+template <typename Vertex, typename Field>
+void packPositionsHalf(std::span<const glm::vec3> positions, std::span<Vertex> vertices, Field Vertex::* field) {
+	static_assert(sizeof(Field) == 8, "half positions need an 8-byte field, such as PackedHalf4");
+	packStream<4, uint16_t>(positions.size(), vertices, field,
+		[&](size_t i, float* out) { out[0] = positions[i].x; out[1] = positions[i].y; out[2] = positions[i].z; out[3] = 1.0f; },
+		[](const float* src, uint16_t* dst, size_t n) { floatsToHalf(src, dst, n * 4); });
+}
+
+export
+template <typename Vertex, typename Field>
+void packUVsHalf(std::span<const glm::vec2> uvs, std::span<Vertex> vertices, Field Vertex::* field) {
+	static_assert(sizeof(Field) == 4, "half UVs need a 4-byte field, such as PackedHalf2");
+	packStream<2, uint16_t>(uvs.size(), vertices, field,
+		[&](size_t i, float* out) { out[0] = uvs[i].x; out[1] = uvs[i].y; },
+		[](const float* src, uint16_t* dst, size_t n) { floatsToHalf(src, dst, n * 2); });
+}
+
+// only for UVs that stay within [0,1]
+export
+template <typename Vertex, typename Field>
+void packUVsUnorm16(std::span<const glm::vec2> uvs, std::span<Vertex> vertices, Field Vertex::* field) {
+	static_assert(sizeof(Field) == 4, "unorm16 UVs need a 4-byte field, such as PackedUnorm16x2");
+	packStream<2, uint16_t>(uvs.size(), vertices, field,
+		[&](size_t i, float* out) { out[0] = uvs[i].x; out[1] = uvs[i].y; },
+		[](const float* src, uint16_t* dst, size_t n) { floatsToUnorm16(src, dst, n * 2); });
+}
+
+export
+template <typename Vertex, typename Field>
+void packNormalsSnorm8(std::span<const glm::vec3> normals, std::span<Vertex> vertices, Field Vertex::* field) {
+	static_assert(sizeof(Field) == 4, "snorm8 normals need a 4-byte field, such as PackedSnorm8x4");
+	packStream<4, int8_t>(normals.size(), vertices, field,
+		[&](size_t i, float* out) { out[0] = normals[i].x; out[1] = normals[i].y; out[2] = normals[i].z; out[3] = 0.0f; },
+		[](const float* src, int8_t* dst, size_t n) { floatsToSnorm8(src, dst, n * 4); });
+}
+
+export
+template <typename Vertex, typename Field>
+void packNormalsOctahedral(std::span<const glm::vec3> normals, std::span<Vertex> vertices, Field Vertex::* field) {
+	static_assert(sizeof(Field) == 4, "octahedral normals need a 4-byte field, such as PackedSnorm16x2");
+	packStream<2, int16_t>(normals.size(), vertices, field,
+		[&](size_t i, float* out) { glm::vec2 p = octEncode(normals[i]); out[0] = p.x; out[1] = p.y; },
+		[](const float* src, int16_t* dst, size_t n) { floatsToSnorm16(src, dst, n * 2); });
+}
+
+export
+template <typename Vertex, typename Field>
+void packNormals1010102(std::span<const glm::vec3> normals, std::span<Vertex> vertices, Field Vertex::* field) {
+	static_assert(sizeof(Field) == 4, "10:10:10:2 normals need a 4-byte field, such as Packed1010102");
+	packStream<4, uint32_t>(normals.size(), vertices, field,
+		[&](size_t i, float* out) { out[0] = normals[i].x * 0.5f + 0.5f; out[1] = normals[i].y * 0.5f + 0.5f; out[2] = normals[i].z * 0.5f + 0.5f; out[3] = 0.0f; },
+		[](const float* src, uint32_t* dst, size_t n) { floatsToUnorm1010102(src, dst, n); });
+}
+
+// w is the bitangent sign, +1 or -1. It lands in the two-bit channel as 3 or 0, which decodes back to +1 or -1.
+export
+template <typename Vertex, typename Field>
+void packTangents1010102(std::span<const glm::vec4> tangents, std::span<Vertex> vertices, Field Vertex::* field) {
+	static_assert(sizeof(Field) == 4, "10:10:10:2 tangents need a 4-byte field, such as Packed1010102");
+	packStream<4, uint32_t>(tangents.size(), vertices, field,
+		[&](size_t i, float* out) { for (int c = 0; c < 4; c++) { out[c] = tangents[i][c] * 0.5f + 0.5f; } },
+		[](const float* src, uint32_t* dst, size_t n) { floatsToUnorm1010102(src, dst, n); });
+}
+
+export
+template <typename Vertex, typename Field>
+void packColorsUnorm8(std::span<const glm::vec4> colors, std::span<Vertex> vertices, Field Vertex::* field) {
+	static_assert(sizeof(Field) == 4, "unorm8 colors need a 4-byte field, such as PackedUnorm8x4");
+	packStream<4, uint8_t>(colors.size(), vertices, field,
+		[&](size_t i, float* out) { for (int c = 0; c < 4; c++) { out[c] = colors[i][c]; } },
+		[](const float* src, uint8_t* dst, size_t n) { floatsToUnorm8(src, dst, n * 4); });
+}
+
+}
@@ -0,0 +1,19 @@
+#version 450
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+// per-instance, one location per matrix column
+layout(location = 2) in mat4 instanceTransform;
+
+layout(binding = 0) uniform ViewProjection {
+    mat4 view;
+    mat4 proj;
+} frame;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    gl_Position = frame.proj * frame.view * instanceTransform * vec4(inPosition, 0.0, 1.0);
+    fragColor = inColor;
+}
@@ -0,0 +1,21 @@
+#version 450
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout(binding = 0) uniform ViewProjection {
+    mat4 view;
+    mat4 proj;
+} frame;
+
+layout(push_constant) uniform PerDraw {
+    mat4 model;
+    uint objectId;
+} draw;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    gl_Position = frame.proj * frame.view * draw.model * vec4(inPosition, 0.0, 1.0);
+    fragColor = inColor;
+}
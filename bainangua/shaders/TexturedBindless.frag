@@ -0,0 +1,20 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+// the BindlessTable set
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+layout(push_constant) uniform PerDraw {
+    mat4 model;
+    uint objectId;
+    uint textureIndex;
+} draw;
+
+void main() {
+    outColor = texture(textures[nonuniformEXT(draw.textureIndex)], fragTexCoord);
+}
@@ -0,0 +1,25 @@
+#version 450
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+
+layout(set = 0, binding = 0) uniform ViewProjection {
+    mat4 view;
+    mat4 proj;
+} frame;
+
+layout(push_constant) uniform PerDraw {
+    mat4 model;
+    uint objectId;
+    uint textureIndex;
+} draw;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+void main() {
+    gl_Position = frame.proj * frame.view * draw.model * vec4(inPosition, 0.0, 1.0);
+    fragColor = inColor;
+    fragTexCoord = inTexCoord;
+}
@@ -17,6 +17,7 @@
 #include <boost/hana/hash.hpp>
 #include <boost/hana/define_struct.hpp>
 #include <coro/coro.hpp>
+#include "ParallelStages.hpp"
 #include <map>
 #include <utility>
 #include <vector>
@@ -110,12 +111,12 @@ struct DrawMVPIndexedGeometry {
 	using return_type = void;
 
 	template<typename Row>
-	constexpr void applyRow(Row r) {
+	constexpr void applyRow(Row&& r) {
 		vk::CommandBuffer buffer = boost::hana::at_key(r, BOOST_HANA_STRING("primaryCommandBuffer"));
-		bainangua::PipelineBundle pipeline = boost::hana::at_key(r, BOOST_HANA_STRING("pipelineBundle"));
+		const bainangua::PipelineBundle& pipeline = boost::hana::at_key(r, BOOST_HANA_STRING("pipelineBundle"));
 		auto [vertexBuffer, bufferMemory] = boost::hana::at_key(r, BOOST_HANA_STRING("indexedVertexBuffer"));
 		auto [indexBuffer, indexBufferMemory] = boost::hana::at_key(r, BOOST_HANA_STRING("indexBuffer"));
-		std::vector<vk::DescriptorSet> descriptorSets = boost::hana::at_key(r, BOOST_HANA_STRING("descriptorSets"));
+		const std::vector<vk::DescriptorSet>& descriptorSets = boost::hana::at_key(r, BOOST_HANA_STRING("descriptorSets"));
 		size_t multiFrameIndex = boost::hana::at_key(r, BOOST_HANA_STRING("multiFrameIndex"));
 
 		vk::Buffer vertexBuffers[] = { vertexBuffer };
@@ -137,14 +138,14 @@ struct UpdateUniformBuffer {
 	using return_type_transformer = WrappedReturnType;
 
 	template <typename RowFunction, typename Row>
-	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
-		std::vector<bainangua::UniformBufferBundle> uniformBuffers = boost::hana::at_key(r, BOOST_HANA_STRING("uniformBuffers"));
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row&& r) {
+		const std::vector<bainangua::UniformBufferBundle>& uniformBuffers = boost::hana::at_key(r, BOOST_HANA_STRING("uniformBuffers"));
 		size_t multiFrameIndex = boost::hana::at_key(r, BOOST_HANA_STRING("multiFrameIndex"));
 		vk::Extent2D viewportExtent = boost::hana::at_key(r, BOOST_HANA_STRING("viewportExtent"));
 
 		bainangua::updateUniformBuffer(viewportExtent, uniformBuffers[multiFrameIndex]);
 
-		return f.applyRow(r);
+		return f.applyRow(std::forward<Row>(r));
 	}
 };
 
@@ -164,7 +165,6 @@ auto renderLoop (Row r) -> bainangua::bng_expected<bool> {
 	bainangua::PipelineBundle pipeline = boost::hana::at_key(r, BOOST_HANA_STRING("pipelineBundle"));
 
 	vk::CommandPool commandPool = boost::hana::at_key(r, BOOST_HANA_STRING("commandPool"));
-	std::vector<vk::CommandBuffer> commandBuffers = boost::hana::at_key(r, BOOST_HANA_STRING("commandBuffers"));
 
 	auto [vertexBuffer, bufferMemory] = boost::hana::at_key(r, BOOST_HANA_STRING("vertexBuffer"));
 	auto [indexBuffer, indexBufferMemory] = boost::hana::at_key(r, BOOST_HANA_STRING("indexBuffer"));
@@ -174,14 +174,19 @@ auto renderLoop (Row r) -> bainangua::bng_expected<bool> {
 	std::vector<bainangua::UniformBufferBundle> uniformBuffers = boost::hana::at_key(r, BOOST_HANA_STRING("uniformBuffers"));
 
 
+	// the draw commands never change, so each (image, frame slot) only gets recorded again after a swapchain rebuild
+	bainangua::CommandBufferCache commandCache(device, commandPool);
+
 	size_t multiFrameIndex = 0;
 
 	while (!glfwWindowShouldClose(glfwWindow)) {
 
 		tl::expected<std::shared_ptr<bainangua::PresentationLayer>, vk::Result> result =
-			bainangua::drawOneFrame(device, graphicsQueue, presentQueue, presenterptr, pipeline, commandBuffers[multiFrameIndex], multiFrameIndex, [&](vk::CommandBuffer commandbuffer, vk::Framebuffer framebuffer) {
-				updateUniformBuffer(presenterptr->swapChainExtent2D_, uniformBuffers[multiFrameIndex]);
-				recordCommandBuffer(commandbuffer, framebuffer, presenterptr->swapChainExtent2D_, pipeline, vertexBuffer, indexBuffer, descriptorSets[multiFrameIndex]);
+			bainangua::drawOneFrameCached(device, graphicsQueue, presentQueue, presenterptr, pipeline, commandCache, multiFrameIndex, [&](vk::CommandBuffer commandbuffer, const bainangua::FrameTarget& target, bool recordCommands) {
+				updateUniformBuffer(target.extent, uniformBuffers[multiFrameIndex]);
+				if (recordCommands) {
+					recordCommandBuffer(commandbuffer, target.framebuffer, target.extent, pipeline, vertexBuffer, indexBuffer, descriptorSets[multiFrameIndex]);
+				}
 				})
 			.and_then([&](std::shared_ptr<bainangua::PresentationLayer> newPresenter) {
 				presenterptr = newPresenter;
@@ -286,9 +291,8 @@ int main()
 
 	auto program =
 		bainangua::QuickCreateContext()
+		| (bainangua::CreateQueueFunnels() & bainangua::CreatePerFramePool())
 		| bainangua::ResourceLoaderStage(loaderDirectory, loaderStorage)
-		| bainangua::CreateQueueFunnels()
-		| bainangua::CreatePerFramePool()
 		| RowType::RowWrapLambda<bainangua::bng_expected<bool>>([](auto row) {
 			vk::Device device = boost::hana::at_key(row, BOOST_HANA_STRING("device"));
 			std::shared_ptr<bainangua::PerFramePool> perFramePool = boost::hana::at_key(row, BOOST_HANA_STRING("perFramePool"));
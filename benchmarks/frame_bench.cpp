@@ -0,0 +1,91 @@
+//
+// Whole frames: wait, acquire, record, submit and present, using the same drawOneFrame the frame loops use.
+//
+
+#include "bainangua.hpp"
+
+#include <benchmark/benchmark.h>
+#include <array>
+
+#include "nangua_bench.hpp"
+
+import OneFrame;
+
+namespace FrameBench {
+
+static void recordTriangle(vk::CommandBuffer buffer, const bainangua::FrameTarget& target, const bainangua::PipelineBundle& pipeline) {
+	buffer.begin(vk::CommandBufferBeginInfo({}, {}));
+	std::array<vk::ClearValue, 1> clearColors{ vk::ClearValue() };
+	buffer.beginRenderPass(vk::RenderPassBeginInfo(pipeline.renderPass, target.framebuffer, vk::Rect2D({ 0,0 }, target.extent), clearColors), vk::SubpassContents::eInline);
+	buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.graphicsPipelines[0]);
+	vk::Viewport viewport(0.0f, 0.0f, static_cast<float>(target.extent.width), static_cast<float>(target.extent.height), 0.0f, 1.0f);
+	buffer.setViewport(0, 1, &viewport);
+	vk::Rect2D scissor({ 0,0 }, target.extent);
+	buffer.setScissor(0, 1, &scissor);
+	buffer.draw(3, 1, 0, 0);
+	buffer.endRenderPass();
+	buffer.end();
+}
+
+static void BM_FullFrame(benchmark::State& state) {
+	nangua_bench::BenchContext* context = nangua_bench::benchContext();
+	if (!context) { state.SkipWithError("no Vulkan device"); return; }
+
+	const bainangua::PipelineBundle& pipeline = context->pipeline;
+	size_t multiFrameIndex = 0;
+
+	for (auto _ : state) {
+		auto result = bainangua::drawOneFrame(
+			context->device, context->graphicsQueue, context->presentQueue,
+			context->presenterptr, pipeline,
+			context->commandBuffers[multiFrameIndex], multiFrameIndex,
+			[&](vk::CommandBuffer buffer, const bainangua::FrameTarget& target) {
+				recordTriangle(buffer, target, pipeline);
+			});
+		if (!result) {
+			state.SkipWithError("drawOneFrame failed");
+			break;
+		}
+		context->presenterptr = result.value();
+		multiFrameIndex = (multiFrameIndex + 1) % bainangua::MultiFrameCount;
+	}
+
+	context->device.waitIdle();
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FullFrame)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+// Same frame, but the commands are recorded once per (image, frame slot) and resubmitted after that.
+static void BM_FullFrameCached(benchmark::State& state) {
+	nangua_bench::BenchContext* context = nangua_bench::benchContext();
+	if (!context) { state.SkipWithError("no Vulkan device"); return; }
+
+	const bainangua::PipelineBundle& pipeline = context->pipeline;
+	bainangua::CommandBufferCache cache(context->device, context->commandPool);
+	size_t multiFrameIndex = 0;
+
+	for (auto _ : state) {
+		auto result = bainangua::drawOneFrameCached(
+			context->device, context->graphicsQueue, context->presentQueue,
+			context->presenterptr, pipeline,
+			cache, multiFrameIndex,
+			[&](vk::CommandBuffer buffer, const bainangua::FrameTarget& target, bool recordCommands) {
+				if (recordCommands) {
+					recordTriangle(buffer, target, pipeline);
+				}
+			});
+		if (!result) {
+			state.SkipWithError("drawOneFrameCached failed");
+			break;
+		}
+		context->presenterptr = result.value();
+		multiFrameIndex = (multiFrameIndex + 1) % bainangua::MultiFrameCount;
+	}
+
+	context->device.waitIdle();
+	state.SetItemsProcessed(state.iterations());
+	state.counters["recorded"] = static_cast<double>(cache.recordCount());
+}
+BENCHMARK(BM_FullFrameCached)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+}
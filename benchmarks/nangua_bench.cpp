@@ -0,0 +1,94 @@
+//
+// Entry point for nangua_bench. The CPU-only benchmarks can always run; the device benchmarks run inside a
+// single Vulkan context that is built once, here, using the usual row stages.
+//
+
+#include "bainangua.hpp"
+#include "RowType.hpp"
+
+#include <benchmark/benchmark.h>
+#include <boost/hana/map.hpp>
+#include <filesystem>
+#include <iostream>
+
+#include "nangua_bench.hpp"
+
+import Commands;
+
+namespace nangua_bench {
+
+BenchContext* currentContext = nullptr;
+
+BenchContext* benchContext() { return currentContext; }
+
+auto benchConfig() {
+	return boost::hana::make_map(
+		boost::hana::make_pair(
+			BOOST_HANA_STRING("config"),
+			bainangua::VulkanContextConfig{
+				.AppName = std::string("nangua_bench"),
+				.requiredExtensions = {
+						VK_KHR_EXTERNAL_FENCE_CAPABILITIES_EXTENSION_NAME,
+						VK_KHR_EXTERNAL_SEMAPHORE_CAPABILITIES_EXTENSION_NAME,
+						VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME
+				},
+				.verboseInit = false,
+				// validation would dominate the timings
+				.useValidation = false
+			}
+		)
+	);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+		return 1;
+	}
+
+	std::filesystem::path shaderPath = SHADER_DIR;
+
+	auto program =
+		bainangua::QuickCreateContext()
+		| bainangua::CreateQueueFunnels()
+		| bainangua::CreatePerFramePool()
+		// with FIFO every frame would wait for vsync, and the frame benchmarks would just measure the refresh rate
+		| bainangua::PresentationLayerStage(bainangua::LowLatencyPresentModes)
+		| bainangua::NoVertexPipelineStage(shaderPath)
+		| bainangua::SimpleGraphicsCommandPoolStage()
+		| bainangua::PrimaryGraphicsCommandBuffersStage(bainangua::MultiFrameCount)
+		| RowType::RowWrapLambda<bainangua::bng_expected<bool>>([](auto row) {
+				nangua_bench::BenchContext context{
+					.device = boost::hana::at_key(row, BOOST_HANA_STRING("device")),
+					.vmaAllocator = boost::hana::at_key(row, BOOST_HANA_STRING("vmaAllocator")),
+					.graphicsQueue = boost::hana::at_key(row, BOOST_HANA_STRING("graphicsQueue")),
+					.presentQueue = boost::hana::at_key(row, BOOST_HANA_STRING("presentQueue")),
+					.graphicsFunnel = boost::hana::at_key(row, BOOST_HANA_STRING("graphicsFunnel")),
+					.perFramePool = boost::hana::at_key(row, BOOST_HANA_STRING("perFramePool")),
+					.presenterptr = boost::hana::at_key(row, BOOST_HANA_STRING("presenterptr")),
+					.pipeline = boost::hana::at_key(row, BOOST_HANA_STRING("pipelineBundle")),
+					.commandPool = boost::hana::at_key(row, BOOST_HANA_STRING("commandPool")),
+					.commandBuffers = boost::hana::at_key(row, BOOST_HANA_STRING("commandBuffers"))
+				};
+				nangua_bench::currentContext = &context;
+
+				benchmark::RunSpecifiedBenchmarks();
+
+				context.device.waitIdle();
+				nangua_bench::currentContext = nullptr;
+				return true;
+			});
+
+	bainangua::bng_expected<bool> result = program.applyRow(nangua_bench::benchConfig());
+	if (!result) {
+		// no device, but the CPU-only benchmarks are still worth running
+		std::cerr << "Vulkan context failed (" << result.error() << "), running without device benchmarks\n";
+		benchmark::RunSpecifiedBenchmarks();
+	}
+
+	benchmark::Shutdown();
+	return 0;
+}
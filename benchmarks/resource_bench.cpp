@@ -0,0 +1,146 @@
+//
+// Benchmarks for the resource subsystems: ResourceLoader, StagingBufferPool, CommandQueueFunnel and PerFramePool.
+//
+
+#include "bainangua.hpp"
+#include "RowType.hpp"
+
+#include <benchmark/benchmark.h>
+#include <boost/hana/map.hpp>
+#include <boost/hana/at_key.hpp>
+#include <coro/coro.hpp>
+
+#include <atomic>
+#include <memory>
+
+#include "nangua_bench.hpp"
+
+import ResourceLoader;
+import StagingBuffer;
+
+namespace ResourceBench {
+
+using IdentityKey = bainangua::SingleResourceKey<int, int>;
+
+constexpr auto benchLoaderLookup = boost::hana::make_map(
+	boost::hana::make_pair(
+		boost::hana::type_c<IdentityKey>,
+		[](auto&, IdentityKey key) -> bainangua::LoaderRoutine<int> {
+			co_return bainangua::LoaderResults<int>{ key.key, std::nullopt };
+		}
+	)
+);
+
+auto benchLoaderStorage = bainangua::createLoaderStorage(benchLoaderLookup);
+
+using BenchResourceLoader = bainangua::ResourceLoader<decltype(benchLoaderLookup), decltype(benchLoaderStorage)>;
+
+// The identity loader never touches the device, so these don't need a Vulkan context.
+std::unique_ptr<BenchResourceLoader> makeLoader() {
+	auto row = boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("device"), vk::Device()));
+	return std::make_unique<BenchResourceLoader>(row, benchLoaderLookup);
+}
+
+// Loading a resource that is already loaded: the common case once a scene is up.
+static void BM_ResourceLoaderHit(benchmark::State& state) {
+	auto loader = makeLoader();
+	(void)coro::sync_wait(loader->loadResource(IdentityKey{ 1 })); // hold one reference so it never unloads
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(coro::sync_wait(loader->loadResource(IdentityKey{ 1 })));
+		coro::sync_wait(loader->unloadResource(IdentityKey{ 1 }));
+	}
+
+	coro::sync_wait(loader->unloadResource(IdentityKey{ 1 }));
+}
+BENCHMARK(BM_ResourceLoaderHit);
+
+// Loading something new each time, which goes through the loader thread pool, then unloading it.
+static void BM_ResourceLoaderMiss(benchmark::State& state) {
+	auto loader = makeLoader();
+	int key = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(coro::sync_wait(loader->loadResource(IdentityKey{ key })));
+		coro::sync_wait(loader->unloadResource(IdentityKey{ key }));
+		key++;
+	}
+}
+BENCHMARK(BM_ResourceLoaderMiss);
+
+// Several threads hitting the same resource at once, contending on the storage and resource mutexes.
+std::unique_ptr<BenchResourceLoader> sharedLoader;
+
+static void BM_ResourceLoaderContention(benchmark::State& state) {
+	if (state.thread_index() == 0) {
+		sharedLoader = makeLoader();
+		(void)coro::sync_wait(sharedLoader->loadResource(IdentityKey{ 1 }));
+	}
+	// benchmark synchronizes all threads before the first iteration
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(coro::sync_wait(sharedLoader->loadResource(IdentityKey{ 1 })));
+		coro::sync_wait(sharedLoader->unloadResource(IdentityKey{ 1 }));
+	}
+	if (state.thread_index() == 0) {
+		coro::sync_wait(sharedLoader->unloadResource(IdentityKey{ 1 }));
+		sharedLoader.reset();
+	}
+}
+BENCHMARK(BM_ResourceLoaderContention)->Threads(2)->Threads(4)->Threads(8)->UseRealTime();
+
+
+static void BM_StagingBufferAcquireRelease(benchmark::State& state) {
+	nangua_bench::BenchContext* context = nangua_bench::benchContext();
+	if (!context) { state.SkipWithError("no Vulkan device"); return; }
+
+	bainangua::StagingBufferPool<VK_BUFFER_USAGE_VERTEX_BUFFER_BIT> pool(context->vmaAllocator, 4, 65536);
+	size_t requestSize = static_cast<size_t>(state.range(0));
+	for (auto _ : state) {
+		auto buffer = coro::sync_wait(pool.acquireStagingBufferTask(requestSize));
+		if (!buffer) { state.SkipWithError(buffer.error().c_str()); break; }
+		coro::sync_wait(pool.releaseStagingBufferTask(buffer.value()));
+	}
+}
+BENCHMARK(BM_StagingBufferAcquireRelease)->Arg(1024)->Arg(65536);
+
+
+// Time from submitting an empty command buffer to the waiting coroutine being resumed on its thread pool.
+static void BM_FunnelSubmitToWake(benchmark::State& state) {
+	nangua_bench::BenchContext* context = nangua_bench::benchContext();
+	if (!context) { state.SkipWithError("no Vulkan device"); return; }
+
+	vk::CommandBuffer cmd = context->commandBuffers[0];
+	cmd.reset();
+	cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eSimultaneousUse, {}));
+	cmd.end();
+	vk::SubmitInfo submit(0, nullptr, {}, 1, &cmd, 0, nullptr, nullptr);
+
+	coro::thread_pool resumeThread{ coro::thread_pool::options{1} };
+	for (auto _ : state) {
+		auto result = coro::sync_wait(context->graphicsFunnel->awaitCommand(submit, resumeThread));
+		if (!result) { state.SkipWithError(result.error().c_str()); break; }
+	}
+	context->device.waitIdle();
+}
+BENCHMARK(BM_FunnelSubmitToWake)->UseRealTime();
+
+
+static void BM_PerFramePoolAcquireRelease(benchmark::State& state) {
+	nangua_bench::BenchContext* context = nangua_bench::benchContext();
+	if (!context) { state.SkipWithError("no Vulkan device"); return; }
+
+	auto frame = [](std::shared_ptr<bainangua::PerFramePool> pool) -> coro::task<bainangua::bng_expected<void>> {
+		auto pfd = co_await pool->acquirePerFrameData();
+		if (!pfd) { co_return bainangua::bng_unexpected(pfd.error()); }
+		auto cmd = co_await pfd.value()->acquireCommandBuffer();
+		if (!cmd) { co_return bainangua::bng_unexpected(cmd.error()); }
+		co_return co_await pool->releasePerFrameData(pfd.value());
+	};
+
+	for (auto _ : state) {
+		auto result = coro::sync_wait(frame(context->perFramePool));
+		if (!result) { state.SkipWithError(result.error().c_str()); break; }
+	}
+}
+BENCHMARK(BM_PerFramePoolAcquireRelease);
+
+}
@@ -0,0 +1,156 @@
+//
+// Overhead of building programs out of row wrappers, compared to calling the same code directly, for both row
+// backends (boost::hana::map and FlatRow). The compile-time side of the comparison is rowtype_compile.cpp.
+//
+
+#include "RowType.hpp"
+#include "FlatRow.hpp"
+
+#include <benchmark/benchmark.h>
+#include <boost/hana/map.hpp>
+#include <boost/hana/string.hpp>
+#include <boost/hana/pair.hpp>
+#include <boost/hana/at_key.hpp>
+#include <boost/hana/integral_constant.hpp>
+#include <boost/hana/second.hpp>
+#include <boost/hana/unpack.hpp>
+
+#include <type_traits>
+#include <vector>
+
+namespace RowTypeBench {
+
+// Passes the row through untouched.
+struct PassThrough {
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		return f.applyRow(r);
+	}
+};
+
+// Adds one int field to the row, like most of the real stages do.
+template <int N>
+struct AddField {
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+		return f.applyRow(boost::hana::insert(r, boost::hana::make_pair(boost::hana::int_c<N>, N)));
+	}
+};
+
+template <typename V>
+int fieldSize(const V& v) {
+	if constexpr (std::is_same_v<V, int>) { return v; }
+	else { return static_cast<int>(v.size()); }
+}
+
+auto sumFields = RowType::RowWrapLambda<int>([](const auto& r) {
+	return boost::hana::unpack(r, [](const auto&... fields) {
+		return (0 + ... + fieldSize(boost::hana::second(fields)));
+	});
+});
+
+auto baseRow() {
+	// a vector field, to show what copying a heap-owning field costs on each stage
+	return boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("commandBuffers"), std::vector<int>(8, 1)));
+}
+
+auto flatBaseRow() {
+	return RowType::makeFlatRow(boost::hana::make_pair(BOOST_HANA_STRING("commandBuffers"), std::vector<int>(8, 1)));
+}
+
+template <typename Make>
+auto eightIntRow(Make make) {
+	return make(
+		boost::hana::make_pair(BOOST_HANA_STRING("a"), 1), boost::hana::make_pair(BOOST_HANA_STRING("b"), 2),
+		boost::hana::make_pair(BOOST_HANA_STRING("c"), 3), boost::hana::make_pair(BOOST_HANA_STRING("d"), 4),
+		boost::hana::make_pair(BOOST_HANA_STRING("e"), 5), boost::hana::make_pair(BOOST_HANA_STRING("f"), 6),
+		boost::hana::make_pair(BOOST_HANA_STRING("g"), 7), boost::hana::make_pair(BOOST_HANA_STRING("h"), 8)
+	);
+}
+
+template <typename Row>
+int readEightInts(const Row& row) {
+	// backwards, so a backend that searched its fields in order would pay for it
+	return boost::hana::at_key(row, BOOST_HANA_STRING("h")) + boost::hana::at_key(row, BOOST_HANA_STRING("g"))
+		+ boost::hana::at_key(row, BOOST_HANA_STRING("f")) + boost::hana::at_key(row, BOOST_HANA_STRING("e"))
+		+ boost::hana::at_key(row, BOOST_HANA_STRING("d")) + boost::hana::at_key(row, BOOST_HANA_STRING("c"))
+		+ boost::hana::at_key(row, BOOST_HANA_STRING("b")) + boost::hana::at_key(row, BOOST_HANA_STRING("a"));
+}
+
+static void BM_HanaRowFieldAccess(benchmark::State& state) {
+	auto row = eightIntRow([](auto... pairs) { return boost::hana::make_map(pairs...); });
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(row);
+		benchmark::DoNotOptimize(readEightInts(row));
+	}
+}
+BENCHMARK(BM_HanaRowFieldAccess);
+
+static void BM_FlatRowFieldAccess(benchmark::State& state) {
+	auto row = eightIntRow([](auto... pairs) { return RowType::makeFlatRow(pairs...); });
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(row);
+		benchmark::DoNotOptimize(readEightInts(row));
+	}
+}
+BENCHMARK(BM_FlatRowFieldAccess);
+
+static void BM_RowDirectCall(benchmark::State& state) {
+	auto row = baseRow();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(sumFields.applyRow(row));
+	}
+}
+BENCHMARK(BM_RowDirectCall);
+
+static void BM_RowPassThrough4(benchmark::State& state) {
+	auto program = PassThrough() | PassThrough() | PassThrough() | PassThrough() | sumFields;
+	auto row = baseRow();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(program.applyRow(row));
+	}
+}
+BENCHMARK(BM_RowPassThrough4);
+
+static void BM_RowAddFields4(benchmark::State& state) {
+	auto program = AddField<1>() | AddField<2>() | AddField<3>() | AddField<4>() | sumFields;
+	auto row = baseRow();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(program.applyRow(row));
+	}
+}
+BENCHMARK(BM_RowAddFields4);
+
+static void BM_RowAddFields8(benchmark::State& state) {
+	auto program = AddField<1>() | AddField<2>() | AddField<3>() | AddField<4>()
+		| AddField<5>() | AddField<6>() | AddField<7>() | AddField<8>()
+		| sumFields;
+	auto row = baseRow();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(program.applyRow(row));
+	}
+}
+BENCHMARK(BM_RowAddFields8);
+
+static void BM_FlatRowAddFields8(benchmark::State& state) {
+	auto program = AddField<1>() | AddField<2>() | AddField<3>() | AddField<4>()
+		| AddField<5>() | AddField<6>() | AddField<7>() | AddField<8>()
+		| sumFields;
+	auto row = flatBaseRow();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(program.applyRow(row));
+	}
+}
+BENCHMARK(BM_FlatRowAddFields8);
+
+}
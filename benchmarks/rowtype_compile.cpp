@@ -0,0 +1,64 @@
+//
+// Compile-time benchmark for the two row backends. This file is built twice, once with BNG_FLAT_ROW=0
+// (boost::hana::map rows) and once with BNG_FLAT_ROW=1 (FlatRow), and each build is timed. It builds a chain of
+// wrappers about as deep as a full program's, each adding a field and reading back some of the earlier ones.
+// Nothing here needs to run.
+//
+
+#include "RowType.hpp"
+#include "FlatRow.hpp"
+
+#include <boost/hana/at_key.hpp>
+#include <boost/hana/insert.hpp>
+#include <boost/hana/integral_constant.hpp>
+#include <boost/hana/map.hpp>
+#include <boost/hana/pair.hpp>
+
+#include <string>
+#include <vector>
+
+namespace RowTypeCompileBench {
+
+template <int N>
+struct AddAndReadField {
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row&& r) {
+		int previous = 0;
+		if constexpr (N > 1) {
+			previous = boost::hana::at_key(r, boost::hana::int_c<N - 1>) + boost::hana::at_key(r, boost::hana::int_c<N / 2>);
+		}
+		return f.applyRow(boost::hana::insert(std::forward<Row>(r), boost::hana::make_pair(boost::hana::int_c<N>, previous + N)));
+	}
+};
+
+template <int... N>
+auto makeProgram(std::integer_sequence<int, N...>) {
+	auto readLast = RowType::RowWrapLambda<int>([](auto&& r) {
+		return boost::hana::at_key(r, boost::hana::int_c<sizeof...(N)>) + static_cast<int>(boost::hana::at_key(r, BOOST_HANA_STRING("name")).size());
+	});
+	return (... | AddAndReadField<N + 1>()) | readLast;
+}
+
+int run()
+{
+#if BNG_FLAT_ROW
+	auto row = RowType::makeFlatRow(
+#else
+	auto row = boost::hana::make_map(
+#endif
+		boost::hana::make_pair(BOOST_HANA_STRING("name"), std::string("compile bench")),
+		boost::hana::make_pair(BOOST_HANA_STRING("commandBuffers"), std::vector<int>(2))
+	);
+
+	auto program = makeProgram(std::make_integer_sequence<int, 40>());
+	return program.applyRow(std::move(row));
+}
+
+}
+
+int rowTypeCompileBench() { return RowTypeCompileBench::run(); }
@@ -0,0 +1,196 @@
+#include "bainangua.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <span>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+import DrawList;
+
+
+namespace DrawListTests {
+
+// stand-in handles; they're only ever compared
+template <typename Handle>
+Handle fakeHandle(uintptr_t value) {
+	return Handle(reinterpret_cast<typename Handle::CType>(value));
+}
+
+// records what would have gone into a command buffer
+struct MockCommandBuffer {
+	struct Draw {
+		vk::Pipeline pipeline;
+		std::vector<vk::DescriptorSet> sets;
+		vk::Buffer vertexBuffer;
+		vk::Buffer indexBuffer;
+		uint32_t firstIndex;
+		uint32_t pushed;
+	};
+
+	std::vector<Draw>* draws;
+
+	// the state as the GPU would see it
+	vk::Pipeline pipeline{};
+	std::vector<vk::DescriptorSet> sets = std::vector<vk::DescriptorSet>(4);
+	vk::Buffer vertexBuffer{};
+	vk::Buffer indexBuffer{};
+	uint32_t pushed = 0;
+
+	void bindPipeline(vk::PipelineBindPoint, vk::Pipeline p) { pipeline = p; }
+	void bindDescriptorSets(vk::PipelineBindPoint, vk::PipelineLayout, uint32_t firstSet, uint32_t count, const vk::DescriptorSet* s, uint32_t, const uint32_t*) {
+		std::copy_n(s, count, sets.begin() + firstSet);
+	}
+	void bindVertexBuffers(uint32_t first, uint32_t count, const vk::Buffer* buffers, const vk::DeviceSize*) {
+		if (first == 0 && count > 0) { vertexBuffer = buffers[0]; }
+	}
+	void bindIndexBuffer(vk::Buffer buffer, vk::DeviceSize, vk::IndexType) { indexBuffer = buffer; }
+	void pushConstants(vk::PipelineLayout, vk::ShaderStageFlags, uint32_t, uint32_t size, const void* data) {
+		REQUIRE(size == sizeof(uint32_t));
+		std::memcpy(&pushed, data, size);
+	}
+	void drawIndexed(uint32_t, uint32_t, uint32_t firstIndex, int32_t, uint32_t) {
+		draws->push_back(Draw{ pipeline, { sets[0], sets[1] }, vertexBuffer, indexBuffer, firstIndex, pushed });
+	}
+};
+
+// containers go through the byte span overload, not the one that copies a single struct
+template <typename PushConstants>
+concept AddsAsStruct = requires(bainangua::DrawList list, bainangua::DrawPacket packet, PushConstants pushConstants) {
+	list.template add<PushConstants>(packet, pushConstants);
+};
+static_assert(AddsAsStruct<uint32_t>);
+static_assert(!AddsAsStruct<std::vector<uint32_t>>);
+static_assert(!AddsAsStruct<std::span<const std::byte>>);
+
+TEST_CASE("Draw sort keys", "[DrawList]")
+{
+	using bainangua::makeSortKey;
+
+	// each field outranks everything below it
+	REQUIRE(makeSortKey(0, 5, 5, 100.0f) < makeSortKey(1, 0, 0, 0.0f));
+	REQUIRE(makeSortKey(0, 0, 9, 100.0f) < makeSortKey(0, 1, 0, 0.0f));
+	REQUIRE(makeSortKey(0, 0, 0, 100.0f) < makeSortKey(0, 0, 1, 0.0f));
+
+	REQUIRE(makeSortKey(0, 0, 0, 1.0f) < makeSortKey(0, 0, 0, 2.0f));
+	REQUIRE(makeSortKey(0, 0, 0, 2.0f, bainangua::DepthOrder::BackToFront) < makeSortKey(0, 0, 0, 1.0f, bainangua::DepthOrder::BackToFront));
+	REQUIRE(makeSortKey(0, 0, 0, -3.0f) == makeSortKey(0, 0, 0, 0.0f));
+}
+
+TEST_CASE("Draw key radix sort", "[DrawList]")
+{
+	std::mt19937_64 random(5);
+	std::vector<bainangua::DrawSortEntry> entries;
+	for (uint32_t i = 0; i < 5000; i++) {
+		// few distinct keys, so the sort has to be stable to match
+		entries.push_back({ random() & 0x0f0000ff000000ffull, i });
+	}
+	auto expected = entries;
+	std::ranges::stable_sort(expected, {}, &bainangua::DrawSortEntry::key);
+
+	std::vector<bainangua::DrawSortEntry> scratch;
+	bainangua::radixSortDrawKeys(entries, scratch);
+	REQUIRE(std::ranges::equal(entries, expected, [](const auto& a, const auto& b) { return a.key == b.key && a.index == b.index; }));
+}
+
+TEST_CASE("Draw list recording", "[DrawList]")
+{
+	// 3 pipelines x 4 materials, each material with its own mesh buffers, added in a shuffled order
+	const vk::DescriptorSet frameSet = fakeHandle<vk::DescriptorSet>(0x100);
+	std::vector<bainangua::DrawPacket> packets;
+	for (uint32_t pipeline = 0; pipeline < 3; pipeline++) {
+		for (uint32_t material = 0; material < 4; material++) {
+			for (uint32_t draw = 0; draw < 50; draw++) {
+				bainangua::DrawPacket packet{
+					.sortKey = bainangua::makeSortKey(0, pipeline, material, float(draw)),
+					.pipeline = fakeHandle<vk::Pipeline>(0x10 + pipeline),
+					.layout = fakeHandle<vk::PipelineLayout>(0x20),
+					.descriptorSets = { frameSet, fakeHandle<vk::DescriptorSet>(0x200 + material) },
+					.descriptorSetCount = 2,
+					.vertexBuffers = { fakeHandle<vk::Buffer>(0x300 + material) },
+					.vertexBufferCount = 1,
+					.indexBuffer = fakeHandle<vk::Buffer>(0x400 + material),
+					.indexCount = 3,
+					.firstIndex = pipeline * 1000 + material * 100 + draw,
+					.pushConstantStages = vk::ShaderStageFlagBits::eVertex
+				};
+				packets.push_back(packet);
+			}
+		}
+	}
+	std::shuffle(packets.begin(), packets.end(), std::mt19937(17));
+
+	bainangua::DrawList drawList;
+	for (const auto& packet : packets) {
+		drawList.add(packet, packet.firstIndex);
+	}
+
+	std::vector<MockCommandBuffer::Draw> draws;
+	auto stats = drawList.record(MockCommandBuffer{ &draws });
+
+	REQUIRE(stats.draws == 600);
+	REQUIRE(stats.pipelineBinds == 3);
+	// the frame set gets bound once; after that only the material set changes
+	REQUIRE(stats.descriptorSetBinds == 12);
+	REQUIRE(stats.vertexBufferBinds == 12);
+	REQUIRE(stats.indexBufferBinds == 12);
+	REQUIRE(stats.pushConstantUpdates == 600);
+	REQUIRE(stats.skippedBinds == 600 * 4 - 3 - 12 * 3);
+	REQUIRE(drawList.lastStats().draws == 600);
+
+	// the draws come out in key order, each with its own state in place
+	REQUIRE(std::ranges::is_sorted(draws, {}, &MockCommandBuffer::Draw::firstIndex));
+	for (const auto& draw : draws) {
+		uint32_t pipeline = draw.firstIndex / 1000;
+		uint32_t material = (draw.firstIndex / 100) % 10;
+		REQUIRE(draw.pipeline == fakeHandle<vk::Pipeline>(0x10 + pipeline));
+		REQUIRE(draw.sets[0] == frameSet);
+		REQUIRE(draw.sets[1] == fakeHandle<vk::DescriptorSet>(0x200 + material));
+		REQUIRE(draw.vertexBuffer == fakeHandle<vk::Buffer>(0x300 + material));
+		REQUIRE(draw.indexBuffer == fakeHandle<vk::Buffer>(0x400 + material));
+		REQUIRE(draw.pushed == draw.firstIndex);
+	}
+
+	SECTION("a new layout rebinds every set") {
+		bainangua::DrawPacket other = packets[0];
+		other.sortKey = bainangua::makeSortKey(1, 0, 0, 0.0f);
+		other.layout = fakeHandle<vk::PipelineLayout>(0x21);
+		drawList.add(other);
+
+		draws.clear();
+		stats = drawList.record(MockCommandBuffer{ &draws });
+		REQUIRE(stats.draws == 601);
+		REQUIRE(stats.descriptorSetBinds == 13);
+		REQUIRE(draws.back().sets[0] == frameSet);
+	}
+
+	drawList.clear();
+	REQUIRE(drawList.size() == 0);
+	REQUIRE(drawList.record(MockCommandBuffer{ &draws }).draws == 0);
+}
+
+#ifdef NDEBUG // skip benchmarks in debug builds
+TEST_CASE("Draw list benchmarks", "[DrawList][!benchmark]")
+{
+	std::mt19937_64 random(11);
+	std::vector<bainangua::DrawSortEntry> entries;
+	for (uint32_t i = 0; i < 100000; i++) {
+		entries.push_back({ bainangua::makeSortKey(0, random() % 16, random() % 256, float(random() % 10000)), i });
+	}
+	std::vector<bainangua::DrawSortEntry> sorting, scratch;
+
+	BENCHMARK_ADVANCED("radix sort 100k draw keys")(Catch::Benchmark::Chronometer meter) {
+		meter.measure([&] { sorting = entries; bainangua::radixSortDrawKeys(sorting, scratch); return sorting[0].key; });
+	};
+
+	BENCHMARK_ADVANCED("std::sort 100k draw keys")(Catch::Benchmark::Chronometer meter) {
+		meter.measure([&] { sorting = entries; std::ranges::sort(sorting, {}, &bainangua::DrawSortEntry::key); return sorting[0].key; });
+	};
+}
+#endif
+
+}
@@ -0,0 +1,138 @@
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <boost/hana/map.hpp>
+#include <boost/hana/string.hpp>
+#include <boost/hana/pair.hpp>
+#include <boost/hana/at_key.hpp>
+#include <boost/hana/integral_constant.hpp>
+
+#include <chrono>
+#include <format>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <coro/coro.hpp>
+
+#include "include/RowType.hpp"
+#include "include/ParallelStages.hpp"
+
+namespace ParallelStagesTests {
+
+	using namespace std::chrono_literals;
+
+	struct StageLog {
+		using Span = std::pair<std::chrono::steady_clock::time_point, std::chrono::steady_clock::time_point>;
+
+		std::mutex mutex_;
+		std::vector<std::string> entries_;
+		std::map<int, Span> setupSpans_; //< when each stage's acquire started and finished
+
+		void add(std::string entry) {
+			std::scoped_lock lock(mutex_);
+			entries_.push_back(entry);
+		}
+
+		void addSpan(int stage, Span span) {
+			std::scoped_lock lock(mutex_);
+			setupSpans_[stage] = span;
+		}
+
+		bool overlapped(int a, int b) const {
+			const Span& spanA = setupSpans_.at(a);
+			const Span& spanB = setupSpans_.at(b);
+			return spanA.first < spanB.second && spanB.first < spanA.second;
+		}
+	};
+
+	// A split stage that takes a while to set up and adds the field N, with value N.
+	template <int N>
+	struct SlowStage {
+		SlowStage(std::shared_ptr<StageLog> log, bool fail = false) : log_(log), fail_(fail) {}
+
+		std::shared_ptr<StageLog> log_;
+		bool fail_;
+
+		using row_tag = RowType::RowWrapperTag;
+
+		template <typename WrappedReturnType>
+		using return_type_transformer = WrappedReturnType;
+
+		template <typename Row>
+			requires RowType::has_named_field<Row, BOOST_HANA_STRING("base"), int>
+		auto acquire(const Row&) -> bainangua::bng_expected<decltype(boost::hana::make_map(boost::hana::make_pair(boost::hana::int_c<N>, N)))> {
+			auto start = std::chrono::steady_clock::now();
+			std::this_thread::sleep_for(200ms);
+			log_->addSpan(N, { start, std::chrono::steady_clock::now() });
+			if (fail_) {
+				return bainangua::bng_unexpected(std::format("stage {} failed", N));
+			}
+			log_->add(std::format("acquire {}", N));
+			return boost::hana::make_map(boost::hana::make_pair(boost::hana::int_c<N>, N));
+		}
+
+		template <typename Fields>
+		void release(const Fields& fields) {
+			log_->add(std::format("release {}", static_cast<int>(boost::hana::at_key(fields, boost::hana::int_c<N>))));
+		}
+
+		template <typename RowFunction, typename Row>
+		constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+			return RowType::wrapSplitStage(*this, f, std::move(r));
+		}
+	};
+
+	auto sumFields = RowType::RowWrapLambda<bainangua::bng_expected<int>>([](auto row) {
+		return boost::hana::at_key(row, BOOST_HANA_STRING("base")) + boost::hana::at_key(row, boost::hana::int_c<1>) + boost::hana::at_key(row, boost::hana::int_c<2>) + boost::hana::at_key(row, boost::hana::int_c<3>);
+	});
+
+	auto baseRow() {
+		return boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("base"), 100));
+	}
+
+	TEST_CASE("ParallelStages", "[Basic][RowType]")
+	{
+		auto log = std::make_shared<StageLog>();
+
+		auto program = (SlowStage<1>(log) & SlowStage<2>(log) & SlowStage<3>(log)) | sumFields;
+
+		auto result = program.applyRow(baseRow());
+
+		REQUIRE(result == bainangua::bng_expected<int>(106));
+
+		// Set up side by side, so the setups overlap rather than running one after another. The pool has at least
+		// two threads; only with three or more can all three stages be in their setup at once.
+		REQUIRE(log->setupSpans_.size() == 3);
+		int overlappingPairs = int(log->overlapped(1, 2)) + int(log->overlapped(1, 3)) + int(log->overlapped(2, 3));
+		REQUIRE(overlappingPairs >= 1);
+		if (RowType::parallelStagePool().thread_count() >= 3) {
+			REQUIRE(overlappingPairs == 3);
+		}
+
+		// torn down in reverse
+		REQUIRE(log->entries_.size() == 6);
+		REQUIRE(log->entries_[3] == "release 3");
+		REQUIRE(log->entries_[4] == "release 2");
+		REQUIRE(log->entries_[5] == "release 1");
+	}
+
+	TEST_CASE("ParallelStages failure", "[Basic][RowType]")
+	{
+		auto log = std::make_shared<StageLog>();
+
+		auto program = (SlowStage<1>(log) & SlowStage<2>(log, true)) | SlowStage<3>(log) | sumFields;
+
+		auto result = program.applyRow(baseRow());
+		REQUIRE(!result.has_value());
+		REQUIRE(result.error() == "stage 2 failed");
+
+		// the stage that did set up gets released, and nothing after the failure runs
+		REQUIRE(log->entries_ == std::vector<std::string>{ "acquire 1", "release 1" });
+	}
+
+}
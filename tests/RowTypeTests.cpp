@@ -10,6 +10,7 @@
 #include <boost/hana/at_key.hpp>
 
 #include "include/RowType.hpp"
+#include "include/FlatRow.hpp"
 
 using namespace RowType;
 
@@ -83,6 +84,37 @@ namespace RowTypeTests {
 	};
 
 
+	// counts copies, so the forwarding tests can check that a row was never copied
+	struct CopyCounter {
+		CopyCounter(int* copies) : copies_(copies) {}
+		CopyCounter(const CopyCounter& other) : copies_(other.copies_) { (*copies_)++; }
+		CopyCounter(CopyCounter&& other) noexcept = default;
+
+		int* copies_;
+	};
+
+	struct ForwardingRowWrapper {
+		using row_tag = RowWrapperTag;
+
+		template <typename WrappedReturnType>
+		using return_type_transformer = WrappedReturnType;
+
+		template <typename RowFunction, typename Row>
+		constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row&& r) {
+			return f.applyRow(std::forward<Row>(r));
+		}
+	};
+
+	struct HasCounterFunction {
+		using row_tag = RowFunctionTag;
+		using return_type = bool;
+
+		template <typename Row>
+		constexpr bool applyRow(Row&&) {
+			return RowType::has_field<Row>(BOOST_HANA_STRING("counter"));
+		}
+	};
+
 	TEST_CASE("Basic RowType Tests", "[Basic][RowType]")
 	{
 		auto simpleRow = boost::hana::make_map(
@@ -210,4 +242,71 @@ namespace RowTypeTests {
 		REQUIRE(onlyStringFn.applyRow(doubleRow) == std::string("argh"));
 
 	}
-}
\ No newline at end of file
+
+	TEST_CASE("RowType Forwarding", "[Basic][RowType]")
+	{
+		int copies = 0;
+		auto row = boost::hana::make_map(
+			boost::hana::make_pair(BOOST_HANA_STRING("counter"), CopyCounter(&copies))
+		);
+
+		auto rowFn =
+			ForwardingRowWrapper()
+			| ForwardingRowWrapper()
+			| HasCounterFunction();
+
+		REQUIRE(rowFn.applyRow(row) == true);
+		REQUIRE(copies == 0);
+
+		auto extendedRow = extendRow(std::move(row), boost::hana::make_pair(BOOST_HANA_STRING("x"), 1));
+		REQUIRE(copies == 0);
+		REQUIRE(boost::hana::at_key(extendedRow, BOOST_HANA_STRING("x")) == 1);
+		REQUIRE(has_field<decltype(extendedRow)>(BOOST_HANA_STRING("counter")));
+		REQUIRE(!has_field<decltype(extendedRow)>(BOOST_HANA_STRING("y")));
+
+		// extending an lvalue row leaves it intact, so its fields get copied
+		auto copiedRow = extendRow(extendedRow, boost::hana::make_pair(BOOST_HANA_STRING("y"), 2));
+		REQUIRE(copies == 1);
+		REQUIRE(boost::hana::at_key(copiedRow, BOOST_HANA_STRING("y")) == 2);
+	}
+
+	template <typename Row>
+		requires has_named_field<Row, BOOST_HANA_STRING("name"), std::string>
+	std::string nameOf(const Row& r) { return boost::hana::at_key(r, BOOST_HANA_STRING("name")); }
+
+	TEST_CASE("FlatRow", "[Basic][RowType]")
+	{
+		auto singleRow = makeFlatRow(
+			boost::hana::make_pair(BOOST_HANA_STRING("a"), std::string("blargh"))
+		);
+		auto doubleRow = makeFlatRow(
+			boost::hana::make_pair(BOOST_HANA_STRING("name"), std::string("blargh")),
+			boost::hana::make_pair(boost::hana::int_c<4>, 3.0f)
+		);
+
+		// the same wrapper chain as the hana::map rows above
+		auto rowFn =
+			AddOneRowWrapper()
+			| IdRowWrapper()
+			| AddFieldWrapper()
+			| PullFromMapFunction<float>();
+
+		REQUIRE(rowFn.applyRow(singleRow) == 9.0f);
+		REQUIRE(rowFn.applyRow(doubleRow) == 4.0f);
+
+		REQUIRE(nameOf(doubleRow) == std::string("blargh"));
+		REQUIRE(getRowField<"name"_field>(doubleRow) == std::string("blargh"));
+		STATIC_REQUIRE(decltype(doubleRow)::indexOf<boost::hana::int_<4>>() == 1);
+		STATIC_REQUIRE(boost::hana::contains(doubleRow, BOOST_HANA_STRING("name")));
+		STATIC_REQUIRE(!boost::hana::contains(singleRow, BOOST_HANA_STRING("name")));
+
+		auto erased = boost::hana::erase_key(doubleRow, BOOST_HANA_STRING("name"));
+		STATIC_REQUIRE(decltype(erased)::size == 1);
+
+		auto extended = extendRow(std::move(doubleRow), boost::hana::make_pair(BOOST_HANA_STRING("x"), 1));
+		STATIC_REQUIRE(decltype(extended)::size == 3);
+		boost::hana::at_key(extended, BOOST_HANA_STRING("x")) = 5;
+		REQUIRE(boost::hana::at_key(extended, BOOST_HANA_STRING("x")) == 5);
+		REQUIRE(boost::hana::find(extended, BOOST_HANA_STRING("x")).value() == 5);
+	}
+}
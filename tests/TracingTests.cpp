@@ -0,0 +1,68 @@
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <boost/hana/map.hpp>
+#include <boost/hana/string.hpp>
+#include <boost/hana/pair.hpp>
+#include <boost/hana/at_key.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "include/RowType.hpp"
+#include "include/Tracing.hpp"
+
+namespace TracingTests {
+	struct TracedWrapper {
+		using row_tag = RowType::RowWrapperTag;
+
+		template <typename WrappedReturnType>
+		using return_type_transformer = WrappedReturnType;
+
+		template <typename RowFunction, typename Row>
+		constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
+			return f.applyRow(r);
+		}
+	};
+
+	TEST_CASE("TraceTypeNames", "[Tracing]")
+	{
+		REQUIRE(bainangua::tracing::typeName<TracingTests::TracedWrapper>() == "TracingTests::TracedWrapper");
+		REQUIRE(RowType::WrapperTraceName<RowType::ComposedRowWrappers<TracedWrapper, TracedWrapper>>::value == "RowType::ComposedRowWrappers");
+	}
+
+	TEST_CASE("TraceNameEscaping", "[Tracing]")
+	{
+		REQUIRE(bainangua::tracing::jsonEscaped("plain::Name<int>") == "plain::Name<int>");
+		REQUIRE(bainangua::tracing::jsonEscaped("say \"hi\"") == "say \\\"hi\\\"");
+		REQUIRE(bainangua::tracing::jsonEscaped("C:\\shaders") == "C:\\\\shaders");
+		REQUIRE(bainangua::tracing::jsonEscaped("a\nb\x01") == "a\\nb\\u0001");
+	}
+
+#if BAINANGUA_TRACING
+	TEST_CASE("TraceExport", "[Tracing]")
+	{
+		bainangua::tracing::clearTrace();
+
+		{
+			BNG_TRACE_SCOPE("load \"quoted\" path");
+		}
+
+		auto program = TracedWrapper()
+			| TracedWrapper()
+			| RowType::RowWrapLambda<int>([](auto r) { return boost::hana::at_key(r, BOOST_HANA_STRING("a")); });
+		auto row = boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("a"), 3));
+		REQUIRE(program.applyRow(row) == 3);
+
+		std::filesystem::path tracePath = std::filesystem::temp_directory_path() / "bainangua_cpu_trace.json";
+		REQUIRE(bainangua::tracing::writeChromeTrace(tracePath));
+
+		std::ifstream in(tracePath);
+		std::stringstream contents;
+		contents << in.rdbuf();
+		REQUIRE(contents.str().find("TracingTests::TracedWrapper") != std::string::npos);
+		REQUIRE(contents.str().find("load \\\"quoted\\\" path") != std::string::npos);
+	}
+#endif
+}
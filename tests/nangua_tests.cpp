@@ -5,18 +5,32 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/benchmark/catch_benchmark.hpp>
 
+#include <algorithm>
 #include <coroutine>
 #include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 
 import Commands;
 import DescriptorSets;
+import GPUProfiler;
+import GpuCulling;
 import OneFrame;
 import Pipeline;
 import PresentationLayer;
+import SceneCulling;
 import TextureImage;
 import UniformBuffer;
 import VertBuffer;
+import VertexBuffer;
 import VulkanContext;
 
 
@@ -81,6 +95,254 @@ TEST_CASE("OneFrame", "[Basic][Rendering]")
 	REQUIRE(program.applyRow(testConfig2) == (bainangua::bng_expected<bool>(true)));
 }
 
+TEST_CASE("LowLatencyFrames", "[Basic][Rendering]")
+{
+	vk::PresentModeKHR chosenMode = vk::PresentModeKHR::eFifo;
+	vk::PresentModeKHR expectedMode = vk::PresentModeKHR::eFifo;
+
+	auto program =
+		bainangua::QuickCreateContext()
+		| bainangua::PresentationLayerStage(bainangua::LowLatencyPresentModes)
+		| bainangua::NoVertexPipelineStage(ShaderPath)
+		| bainangua::SimpleGraphicsCommandPoolStage()
+		| bainangua::PrimaryGraphicsCommandBuffersStage(bainangua::MultiFrameCount)
+		| bainangua::StandardMultiFrameLoop(10, bainangua::FramePacing::LowLatency)
+		| bainangua::BasicRendering()
+		| RowType::RowWrapLambda<bainangua::bng_expected<bool>>([&](auto row) {
+				vk::CommandBuffer buffer = boost::hana::at_key(row, BOOST_HANA_STRING("primaryCommandBuffer"));
+				vk::PhysicalDevice physicalDevice = boost::hana::at_key(row, BOOST_HANA_STRING("physicalDevice"));
+				vk::SurfaceKHR surface = boost::hana::at_key(row, BOOST_HANA_STRING("surface"));
+				std::shared_ptr<bainangua::PresentationLayer> presenter = boost::hana::at_key(row, BOOST_HANA_STRING("presenterptr"));
+
+				// the first low latency mode the surface has, or FIFO when it has none of them
+				auto available = physicalDevice.getSurfacePresentModesKHR(surface);
+				auto preferred = std::ranges::find_if(bainangua::LowLatencyPresentModes, [&](vk::PresentModeKHR mode) { return std::ranges::find(available, mode) != available.end(); });
+				expectedMode = (preferred != bainangua::LowLatencyPresentModes.end()) ? *preferred : vk::PresentModeKHR::eFifo;
+				chosenMode = presenter->presentMode_;
+
+				buffer.draw(3, 1, 0, 0);
+				return true;
+			});
+
+	// no vertex input buffer here either, so turn off validation
+	bainangua::VulkanContextConfig newConfig = boost::hana::at_key(testConfig(), BOOST_HANA_STRING("config"));
+	newConfig.useValidation = false;
+
+	auto testConfig2 = boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("config"), newConfig));
+
+	REQUIRE(program.applyRow(testConfig2) == (bainangua::bng_expected<bool>(true)));
+	REQUIRE(chosenMode == expectedMode);
+
+	// Drive the frames by hand to see where input gets sampled: after the fence wait and image acquire (the fence
+	// is only reset once both are done) and before any recording.
+	std::vector<std::string> events;
+
+	auto orderProgram =
+		bainangua::QuickCreateContext()
+		| bainangua::PresentationLayerStage(bainangua::LowLatencyPresentModes)
+		| bainangua::NoVertexPipelineStage(ShaderPath)
+		| bainangua::SimpleGraphicsCommandPoolStage()
+		| bainangua::PrimaryGraphicsCommandBuffersStage(bainangua::MultiFrameCount)
+		| RowType::RowWrapLambda<bainangua::bng_expected<bool>>([&events](auto row) -> bainangua::bng_expected<bool> {
+				vk::Device device = boost::hana::at_key(row, BOOST_HANA_STRING("device"));
+				vk::Queue graphicsQueue = boost::hana::at_key(row, BOOST_HANA_STRING("graphicsQueue"));
+				vk::Queue presentQueue = boost::hana::at_key(row, BOOST_HANA_STRING("presentQueue"));
+				std::shared_ptr<bainangua::PresentationLayer> presenter = boost::hana::at_key(row, BOOST_HANA_STRING("presenterptr"));
+				bainangua::PipelineBundle pipeline = boost::hana::at_key(row, BOOST_HANA_STRING("pipelineBundle"));
+				std::vector<vk::CommandBuffer> commandBuffers = boost::hana::at_key(row, BOOST_HANA_STRING("commandBuffers"));
+
+				auto drawTriangle = bainangua::BasicRendering()
+					| RowType::RowWrapLambda<bool>([](auto frameRow) {
+						vk::CommandBuffer buffer = boost::hana::at_key(frameRow, BOOST_HANA_STRING("primaryCommandBuffer"));
+						buffer.draw(3, 1, 0, 0);
+						return true;
+					});
+
+				for (size_t frame = 0; frame < 6; frame++) {
+					size_t multiFrameIndex = frame % bainangua::MultiFrameCount;
+					auto sampleInput = [&]() {
+						bool fenceReset = device.getFenceStatus(presenter->inFlightFences_[multiFrameIndex]) == vk::Result::eNotReady;
+						events.push_back(fenceReset ? "input" : "input before fence wait");
+					};
+					auto result = bainangua::drawOneFrame(device, graphicsQueue, presentQueue, presenter, pipeline, commandBuffers[multiFrameIndex], multiFrameIndex,
+						[&](vk::CommandBuffer buffer, const bainangua::FrameTarget& target) {
+							events.push_back("record");
+							auto frameRow = boost::hana::make_map(
+								boost::hana::make_pair(BOOST_HANA_STRING("primaryCommandBuffer"), buffer),
+								boost::hana::make_pair(BOOST_HANA_STRING("targetFrameBuffer"), target.framebuffer),
+								boost::hana::make_pair(BOOST_HANA_STRING("pipelineBundle"), pipeline),
+								boost::hana::make_pair(BOOST_HANA_STRING("viewportExtent"), target.extent)
+							);
+							drawTriangle.applyRow(frameRow);
+						},
+						sampleInput);
+					if (!result) {
+						device.waitIdle();
+						return bainangua::bng_unexpected(std::format("drawOneFrame failed: {}", vk::to_string(result.error())));
+					}
+					presenter = result.value();
+				}
+
+				device.waitIdle();
+				return true;
+			});
+
+	REQUIRE(orderProgram.applyRow(testConfig2) == (bainangua::bng_expected<bool>(true)));
+	REQUIRE(events.size() == 12);
+	for (size_t frame = 0; frame < 6; frame++) {
+		INFO(frame);
+		REQUIRE(events[frame * 2] == "input");
+		REQUIRE(events[frame * 2 + 1] == "record");
+	}
+}
+
+TEST_CASE("DynamicRenderingFrames", "[Basic][Rendering]")
+{
+	auto program =
+		bainangua::QuickCreateContext()
+		| bainangua::PresentationLayerStage()
+		| bainangua::DynamicNoVertexPipelineStage(ShaderPath)
+		| bainangua::SimpleGraphicsCommandPoolStage()
+		| bainangua::PrimaryGraphicsCommandBuffersStage(bainangua::MultiFrameCount)
+		| bainangua::StandardMultiFrameLoop(10)
+		| bainangua::DynamicRendering()
+		| RowType::RowWrapLambda<bainangua::bng_expected<bool>>([](auto row) {
+				vk::CommandBuffer buffer = boost::hana::at_key(row, BOOST_HANA_STRING("primaryCommandBuffer"));
+
+				buffer.draw(3, 1, 0, 0);
+				return true;
+			});
+
+	bainangua::VulkanContextConfig newConfig = boost::hana::at_key(testConfig(), BOOST_HANA_STRING("config"));
+	newConfig.useValidation = false;
+	newConfig.useDynamicRendering = true;
+
+	auto testConfig2 = boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("config"), newConfig));
+
+	REQUIRE(program.applyRow(testConfig2) == (bainangua::bng_expected<bool>(true)));
+}
+
+TEST_CASE("GPUProfiler", "[Basic][Rendering]")
+{
+	std::filesystem::path tracePath = std::filesystem::temp_directory_path() / "bainangua_gpu_trace.json";
+	std::filesystem::remove(tracePath);
+
+	std::shared_ptr<bainangua::GPUProfiler> profiler;
+
+	auto program =
+		bainangua::QuickCreateContext()
+		| bainangua::PresentationLayerStage()
+		| bainangua::GPUProfilerStage(bainangua::MultiFrameCount, tracePath)
+		| bainangua::NoVertexPipelineStage(ShaderPath)
+		| bainangua::SimpleGraphicsCommandPoolStage()
+		| bainangua::PrimaryGraphicsCommandBuffersStage(bainangua::MultiFrameCount)
+		| bainangua::StandardMultiFrameLoop(10)
+		| bainangua::BasicRendering()
+		| RowType::RowWrapLambda<bainangua::bng_expected<bool>>([&profiler](auto row) {
+				vk::CommandBuffer buffer = boost::hana::at_key(row, BOOST_HANA_STRING("primaryCommandBuffer"));
+				profiler = boost::hana::at_key(row, BOOST_HANA_STRING("gpuProfiler"));
+
+				uint32_t scope = bainangua::beginProfileScope(row, buffer, "triangle");
+				buffer.draw(3, 1, 0, 0);
+				bainangua::endProfileScope(row, buffer, scope);
+				return true;
+			});
+
+	bainangua::VulkanContextConfig newConfig = boost::hana::at_key(testConfig(), BOOST_HANA_STRING("config"));
+	newConfig.useValidation = false;
+
+	auto testConfig2 = boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("config"), newConfig));
+
+	REQUIRE(program.applyRow(testConfig2) == (bainangua::bng_expected<bool>(true)));
+	REQUIRE(std::filesystem::exists(tracePath));
+
+	// without timestamp support there's nothing to time, and the trace is empty
+	REQUIRE(profiler);
+	if (profiler->enabled()) {
+		// the last frame slots never get collected, but every earlier frame does
+		auto statistics = profiler->statistics();
+		for (std::string name : { "BasicRendering", "triangle" }) {
+			INFO(name);
+			REQUIRE(statistics.contains(name));
+			REQUIRE(statistics[name].sampleCount > 0);
+			REQUIRE(statistics[name].maxMs > 0.0);
+		}
+
+		std::ifstream traceFile(tracePath);
+		std::string trace((std::istreambuf_iterator<char>(traceFile)), std::istreambuf_iterator<char>());
+		REQUIRE(trace.find("\"name\":\"BasicRendering\"") != std::string::npos);
+		REQUIRE(trace.find("\"name\":\"triangle\"") != std::string::npos);
+	}
+}
+
+// counts every frame, whether or not its commands get recorded
+struct CountFrames {
+	CountFrames(size_t* frameCount, size_t* imageCount) : frameCount_(frameCount), imageCount_(imageCount) {}
+
+	size_t* frameCount_;
+	size_t* imageCount_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row&& r) {
+		const std::shared_ptr<bainangua::PresentationLayer>& presenterptr = boost::hana::at_key(r, BOOST_HANA_STRING("presenterptr"));
+		(*frameCount_)++;
+		*imageCount_ = presenterptr->swapChainImageCount_;
+		return f.applyRow(std::forward<Row>(r));
+	}
+};
+
+TEST_CASE("CachedFrames", "[Basic][Rendering]")
+{
+	size_t frameCount = 0;
+	size_t imageCount = 0;
+	size_t recordCount = 0;
+	std::shared_ptr<bainangua::GPUProfiler> profiler;
+
+	auto program =
+		bainangua::QuickCreateContext()
+		| bainangua::PresentationLayerStage()
+		| bainangua::GPUProfilerStage(bainangua::MultiFrameCount)
+		| bainangua::NoVertexPipelineStage(ShaderPath)
+		| bainangua::SimpleGraphicsCommandPoolStage()
+		| bainangua::PrimaryGraphicsCommandBuffersStage(bainangua::MultiFrameCount)
+		| bainangua::CommandBufferCacheStage()
+		| bainangua::StandardMultiFrameLoop(40)
+		| CountFrames(&frameCount, &imageCount)
+		| bainangua::BasicRendering()
+		| RowType::RowWrapLambda<bainangua::bng_expected<bool>>([&](auto row) {
+				vk::CommandBuffer buffer = boost::hana::at_key(row, BOOST_HANA_STRING("primaryCommandBuffer"));
+				profiler = boost::hana::at_key(row, BOOST_HANA_STRING("gpuProfiler"));
+
+				recordCount++;
+				buffer.draw(3, 1, 0, 0);
+				return true;
+			});
+
+	bainangua::VulkanContextConfig newConfig = boost::hana::at_key(testConfig(), BOOST_HANA_STRING("config"));
+	newConfig.useValidation = false;
+
+	auto testConfig2 = boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("config"), newConfig));
+
+	REQUIRE(program.applyRow(testConfig2) == (bainangua::bng_expected<bool>(true)));
+
+	// every frame still runs the wrappers outside BasicRendering, but each (image, frame slot) pair only
+	// gets recorded once
+	REQUIRE(frameCount == 40);
+	REQUIRE(recordCount > 0);
+	REQUIRE(recordCount <= imageCount * bainangua::MultiFrameCount);
+
+	// replayed frames still report their timings
+	REQUIRE(profiler);
+	if (profiler->enabled()) {
+		REQUIRE(profiler->statistics()["BasicRendering"].sampleCount > recordCount);
+	}
+}
+
 TEST_CASE("VertexBuffer","[Rendering]")
 {
 	auto program =
@@ -149,12 +411,12 @@ struct DrawMVPIndexedGeometry {
 	using return_type = void;
 
 	template<typename Row>
-	constexpr void applyRow(Row r) {
+	constexpr void applyRow(Row&& r) {
 		vk::CommandBuffer buffer = boost::hana::at_key(r, BOOST_HANA_STRING("primaryCommandBuffer"));
-		bainangua::PipelineBundle pipeline = boost::hana::at_key(r, BOOST_HANA_STRING("pipelineBundle"));
+		const bainangua::PipelineBundle& pipeline = boost::hana::at_key(r, BOOST_HANA_STRING("pipelineBundle"));
 		auto [vertexBuffer, bufferMemory] = boost::hana::at_key(r, BOOST_HANA_STRING("indexedVertexBuffer"));
 		auto [indexBuffer, indexBufferMemory] = boost::hana::at_key(r, BOOST_HANA_STRING("indexBuffer"));
-		std::vector<vk::DescriptorSet> descriptorSets = boost::hana::at_key(r, BOOST_HANA_STRING("descriptorSets"));
+		const std::vector<vk::DescriptorSet>& descriptorSets = boost::hana::at_key(r, BOOST_HANA_STRING("descriptorSets"));
 		size_t multiFrameIndex = boost::hana::at_key(r, BOOST_HANA_STRING("multiFrameIndex"));
 
 		vk::Buffer vertexBuffers[] = { vertexBuffer };
@@ -176,14 +438,14 @@ struct UpdateUniformBuffer {
 	using return_type_transformer = WrappedReturnType;
 
 	template <typename RowFunction, typename Row>
-	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row r) {
-		std::vector<bainangua::UniformBufferBundle> uniformBuffers = boost::hana::at_key(r, BOOST_HANA_STRING("uniformBuffers"));
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row&& r) {
+		const std::vector<bainangua::UniformBufferBundle>& uniformBuffers = boost::hana::at_key(r, BOOST_HANA_STRING("uniformBuffers"));
 		size_t multiFrameIndex = boost::hana::at_key(r, BOOST_HANA_STRING("multiFrameIndex"));
 		vk::Extent2D viewportExtent = boost::hana::at_key(r, BOOST_HANA_STRING("viewportExtent"));
 
 		bainangua::updateUniformBuffer(viewportExtent, uniformBuffers[multiFrameIndex]);
 
-		return f.applyRow(r);
+		return f.applyRow(std::forward<Row>(r));
 	}
 };
 
@@ -211,6 +473,459 @@ TEST_CASE("Uniform Buffer Object", "[Rendering]")
 	REQUIRE(program.applyRow(testConfig()) == bainangua::bng_expected<bool>(true));
 }
 
+struct UpdateViewProjection {
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row&& r) {
+		const std::vector<bainangua::UniformBufferBundle>& uniformBuffers = boost::hana::at_key(r, BOOST_HANA_STRING("uniformBuffers"));
+		size_t multiFrameIndex = boost::hana::at_key(r, BOOST_HANA_STRING("multiFrameIndex"));
+		vk::Extent2D viewportExtent = boost::hana::at_key(r, BOOST_HANA_STRING("viewportExtent"));
+
+		bainangua::updateViewProjectionBuffer(viewportExtent, uniformBuffers[multiFrameIndex]);
+
+		return f.applyRow(std::forward<Row>(r));
+	}
+};
+
+// A grid of copies of the same geometry. The descriptor set is bound once; each copy only pushes its own constants.
+struct DrawPushConstantGrid {
+	using row_tag = RowType::RowFunctionTag;
+	using return_type = void;
+
+	template<typename Row>
+	constexpr void applyRow(Row&& r) {
+		vk::CommandBuffer buffer = boost::hana::at_key(r, BOOST_HANA_STRING("primaryCommandBuffer"));
+		const bainangua::PipelineBundle& pipeline = boost::hana::at_key(r, BOOST_HANA_STRING("pipelineBundle"));
+		auto [vertexBuffer, bufferMemory] = boost::hana::at_key(r, BOOST_HANA_STRING("indexedVertexBuffer"));
+		auto [indexBuffer, indexBufferMemory] = boost::hana::at_key(r, BOOST_HANA_STRING("indexBuffer"));
+		const std::vector<vk::DescriptorSet>& descriptorSets = boost::hana::at_key(r, BOOST_HANA_STRING("descriptorSets"));
+		size_t multiFrameIndex = boost::hana::at_key(r, BOOST_HANA_STRING("multiFrameIndex"));
+
+		vk::Buffer vertexBuffers[] = { vertexBuffer };
+		vk::DeviceSize offsets[] = { 0 };
+		buffer.bindVertexBuffers(0, 1, vertexBuffers, offsets);
+		buffer.bindIndexBuffer(indexBuffer, 0, vk::IndexType::eUint16);
+		buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline.pipelineLayout, 0, 1, &(descriptorSets[multiFrameIndex]), 0, nullptr);
+
+		uint32_t objectId = 0;
+		for (int y = -2; y <= 2; y++) {
+			for (int x = -2; x <= 2; x++) {
+				glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x * 0.5f, y * 0.5f, 0.0f)), glm::vec3(0.2f));
+				bainangua::pushDrawConstants(buffer, pipeline.pipelineLayout, model, objectId++);
+				buffer.drawIndexed(static_cast<uint32_t>(bainangua::staticIndices.size()), 1, 0, 0, 0);
+			}
+		}
+	}
+};
+
+TEST_CASE("Push Constants", "[Rendering]")
+{
+	auto program =
+		bainangua::QuickCreateContext()
+		| bainangua::PresentationLayerStage()
+		| bainangua::PushMVPPipelineStage(SHADER_DIR)
+		| bainangua::SimpleGraphicsCommandPoolStage()
+		| bainangua::GPUIndexedVertexBufferStage(bainangua::indexedStaticVertices)
+		| bainangua::GPUIndexBufferStage()
+		| bainangua::CreateSimpleDescriptorPoolStage(vk::DescriptorType::eUniformBuffer, bainangua::MultiFrameCount)
+		| bainangua::CreateSimpleDescriptorSetsStage(vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eVertex, bainangua::MultiFrameCount)
+		| bainangua::CreateAndLinkUniformBuffersStage()
+		| bainangua::PrimaryGraphicsCommandBuffersStage(bainangua::MultiFrameCount)
+		| bainangua::StandardMultiFrameLoop(40)
+		| UpdateViewProjection()
+		| bainangua::BasicRendering()
+		| DrawPushConstantGrid();
+
+	REQUIRE(program.applyRow(testConfig()) == bainangua::bng_expected<bool>(true));
+}
+
+// 10,000 copies of the quad, all in one draw call. The instance transforms are rewritten every frame.
+struct DrawInstancedGrid {
+	using row_tag = RowType::RowFunctionTag;
+	using return_type = void;
+
+	template<typename Row>
+	constexpr void applyRow(Row&& r) {
+		vk::CommandBuffer buffer = boost::hana::at_key(r, BOOST_HANA_STRING("primaryCommandBuffer"));
+		const bainangua::PipelineBundle& pipeline = boost::hana::at_key(r, BOOST_HANA_STRING("pipelineBundle"));
+		auto [vertexBuffer, bufferMemory] = boost::hana::at_key(r, BOOST_HANA_STRING("indexedVertexBuffer"));
+		auto [indexBuffer, indexBufferMemory] = boost::hana::at_key(r, BOOST_HANA_STRING("indexBuffer"));
+		const std::vector<vk::DescriptorSet>& descriptorSets = boost::hana::at_key(r, BOOST_HANA_STRING("descriptorSets"));
+		const std::shared_ptr<bainangua::InstanceBuffer<bainangua::InstanceTransform>>& instanceBuffer = boost::hana::at_key(r, BOOST_HANA_STRING("instanceBuffer"));
+		size_t multiFrameIndex = boost::hana::at_key(r, BOOST_HANA_STRING("multiFrameIndex"));
+
+		const int gridSize = 100;
+		std::vector<bainangua::InstanceTransform> instances;
+		instances.reserve(gridSize * gridSize);
+		for (int y = 0; y < gridSize; y++) {
+			for (int x = 0; x < gridSize; x++) {
+				glm::vec3 position((x - gridSize / 2) * 0.02f, (y - gridSize / 2) * 0.02f, 0.0f);
+				instances.push_back({ glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(0.015f)) });
+			}
+		}
+		instanceBuffer->write(multiFrameIndex, instances);
+
+		vk::Buffer vertexBuffers[] = { vertexBuffer };
+		vk::DeviceSize offsets[] = { 0 };
+		buffer.bindVertexBuffers(0, 1, vertexBuffers, offsets);
+		buffer.bindIndexBuffer(indexBuffer, 0, vk::IndexType::eUint16);
+		buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline.pipelineLayout, 0, 1, &(descriptorSets[multiFrameIndex]), 0, nullptr);
+
+		instanceBuffer->drawIndexed(buffer, multiFrameIndex, static_cast<uint32_t>(bainangua::staticIndices.size()));
+	}
+};
+
+TEST_CASE("Instanced Draw", "[Rendering]")
+{
+	auto program =
+		bainangua::QuickCreateContext()
+		| bainangua::PresentationLayerStage()
+		| bainangua::InstancedPipelineStage(SHADER_DIR)
+		| bainangua::SimpleGraphicsCommandPoolStage()
+		| bainangua::GPUIndexedVertexBufferStage(bainangua::indexedStaticVertices)
+		| bainangua::GPUIndexBufferStage()
+		| bainangua::InstanceBufferStage<bainangua::InstanceTransform>(10000)
+		| bainangua::CreateSimpleDescriptorPoolStage(vk::DescriptorType::eUniformBuffer, bainangua::MultiFrameCount)
+		| bainangua::CreateSimpleDescriptorSetsStage(vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eVertex, bainangua::MultiFrameCount)
+		| bainangua::CreateAndLinkUniformBuffersStage()
+		| bainangua::PrimaryGraphicsCommandBuffersStage(bainangua::MultiFrameCount)
+		| bainangua::StandardMultiFrameLoop(40)
+		| UpdateViewProjection()
+		| bainangua::BasicRendering()
+		| DrawInstancedGrid();
+
+	REQUIRE(program.applyRow(testConfig()) == bainangua::bng_expected<bool>(true));
+}
+
+// A grid on the z = 0 plane that runs off every edge of the view and behind the camera. Each frame writes the
+// instances and a bounding sphere per object, with the object's instance as its firstInstance.
+struct WriteCulledGrid {
+	static constexpr uint32_t GridSize = 12;
+	static constexpr uint32_t ObjectCount = GridSize * GridSize;
+	static constexpr float Scale = 0.3f;
+
+	static glm::vec3 position(uint32_t object) {
+		return glm::vec3((int(object % GridSize) - int(GridSize / 2)) * 0.8f, (int(object / GridSize) - int(GridSize / 2)) * 0.8f, 0.0f);
+	}
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row&& r) {
+		const std::shared_ptr<bainangua::InstanceBuffer<bainangua::InstanceTransform>>& instanceBuffer = boost::hana::at_key(r, BOOST_HANA_STRING("instanceBuffer"));
+		const std::shared_ptr<bainangua::GpuCuller>& culler = boost::hana::at_key(r, BOOST_HANA_STRING("gpuCuller"));
+		size_t multiFrameIndex = boost::hana::at_key(r, BOOST_HANA_STRING("multiFrameIndex"));
+
+		std::vector<bainangua::InstanceTransform> instances;
+		std::vector<bainangua::GpuCullObject> objects;
+		for (uint32_t object = 0; object < ObjectCount; object++) {
+			// the quad's corners are half a unit out, so a radius of one scale covers it
+			objects.push_back({ glm::vec4(position(object), Scale), static_cast<uint32_t>(bainangua::staticIndices.size()), 0, 0, object });
+			instances.push_back({ glm::scale(glm::translate(glm::mat4(1.0f), position(object)), glm::vec3(Scale)) });
+		}
+		instanceBuffer->write(multiFrameIndex, instances);
+		culler->write(multiFrameIndex, objects);
+
+		return f.applyRow(std::forward<Row>(r));
+	}
+};
+
+// Everything the cull kept, in one indirect draw.
+struct DrawCulledGrid {
+	using row_tag = RowType::RowFunctionTag;
+	using return_type = void;
+
+	template<typename Row>
+	constexpr void applyRow(Row&& r) {
+		vk::CommandBuffer buffer = boost::hana::at_key(r, BOOST_HANA_STRING("primaryCommandBuffer"));
+		const bainangua::PipelineBundle& pipeline = boost::hana::at_key(r, BOOST_HANA_STRING("pipelineBundle"));
+		auto [vertexBuffer, bufferMemory] = boost::hana::at_key(r, BOOST_HANA_STRING("indexedVertexBuffer"));
+		auto [indexBuffer, indexBufferMemory] = boost::hana::at_key(r, BOOST_HANA_STRING("indexBuffer"));
+		const std::vector<vk::DescriptorSet>& descriptorSets = boost::hana::at_key(r, BOOST_HANA_STRING("descriptorSets"));
+		const std::shared_ptr<bainangua::InstanceBuffer<bainangua::InstanceTransform>>& instanceBuffer = boost::hana::at_key(r, BOOST_HANA_STRING("instanceBuffer"));
+		const std::shared_ptr<bainangua::GpuCuller>& culler = boost::hana::at_key(r, BOOST_HANA_STRING("gpuCuller"));
+		size_t multiFrameIndex = boost::hana::at_key(r, BOOST_HANA_STRING("multiFrameIndex"));
+
+		vk::Buffer vertexBuffers[] = { vertexBuffer };
+		vk::DeviceSize offsets[] = { 0 };
+		buffer.bindVertexBuffers(0, 1, vertexBuffers, offsets);
+		buffer.bindIndexBuffer(indexBuffer, 0, vk::IndexType::eUint16);
+		buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline.pipelineLayout, 0, 1, &(descriptorSets[multiFrameIndex]), 0, nullptr);
+		instanceBuffer->bind(buffer, multiFrameIndex);
+
+		culler->drawIndexedIndirect(buffer, multiFrameIndex);
+	}
+};
+
+// the frustum the last frame culled against, and which frame slot it used
+struct LastCull {
+	size_t multiFrameIndex{ 0 };
+	bainangua::Frustum frustum{};
+};
+
+// After the loop, the last frame should have drawn exactly the objects its frustum could see.
+struct CheckCulledDraws {
+	CheckCulledDraws(const LastCull* last) : last_(last) {}
+
+	const LastCull* last_;
+
+	using row_tag = RowType::RowWrapperTag;
+
+	template <typename WrappedReturnType>
+	using return_type_transformer = WrappedReturnType;
+
+	template <typename RowFunction, typename Row>
+	constexpr RowFunction::return_type wrapRowFunction(RowFunction f, Row&& r) {
+		std::shared_ptr<bainangua::GpuCuller> culler = boost::hana::at_key(r, BOOST_HANA_STRING("gpuCuller"));
+
+		auto result = f.applyRow(std::forward<Row>(r));
+		if (!result) {
+			return result;
+		}
+
+		// the loop waits for the device before it returns
+		auto drawsResult = culler->readDraws(last_->multiFrameIndex);
+		if (!drawsResult) {
+			return bainangua::bng_unexpected(drawsResult.error());
+		}
+		std::vector<vk::DrawIndexedIndirectCommand> draws = drawsResult.value();
+		std::ranges::sort(draws, {}, &vk::DrawIndexedIndirectCommand::firstInstance);
+
+		std::vector<uint32_t> expected;
+		for (uint32_t object = 0; object < WriteCulledGrid::ObjectCount; object++) {
+			if (last_->frustum.contains(bainangua::BoundingSphere{ WriteCulledGrid::position(object), WriteCulledGrid::Scale })) {
+				expected.push_back(object);
+			}
+		}
+		if (expected.empty() || expected.size() == WriteCulledGrid::ObjectCount) {
+			return bainangua::bng_unexpected("the view should see some but not all of the grid");
+		}
+		if (!std::ranges::equal(draws, expected, {}, &vk::DrawIndexedIndirectCommand::firstInstance)) {
+			return bainangua::bng_unexpected(std::format("expected {} culled draws, got {}", expected.size(), draws.size()));
+		}
+		return result;
+	}
+};
+
+TEST_CASE("GPU Culled Draw", "[Rendering][GpuCulling]")
+{
+	LastCull last;
+
+	// cull against the same camera UpdateViewProjection puts in the UBO
+	auto frustumOf = [&last](const auto& row) {
+		vk::Extent2D viewportExtent = boost::hana::at_key(row, BOOST_HANA_STRING("viewportExtent"));
+		bainangua::ViewProjectionUBO viewProjection = bainangua::defaultViewProjection(viewportExtent);
+		last.multiFrameIndex = boost::hana::at_key(row, BOOST_HANA_STRING("multiFrameIndex"));
+		last.frustum = bainangua::Frustum::fromViewProjection(viewProjection.projection * viewProjection.view);
+		return last.frustum;
+	};
+
+	auto program =
+		bainangua::QuickCreateContext()
+		| bainangua::PresentationLayerStage()
+		| bainangua::InstancedPipelineStage(SHADER_DIR)
+		| bainangua::SimpleGraphicsCommandPoolStage()
+		| bainangua::GPUIndexedVertexBufferStage(bainangua::indexedStaticVertices)
+		| bainangua::GPUIndexBufferStage()
+		| bainangua::InstanceBufferStage<bainangua::InstanceTransform>(WriteCulledGrid::ObjectCount)
+		| bainangua::CreateSimpleDescriptorPoolStage(vk::DescriptorType::eUniformBuffer, bainangua::MultiFrameCount)
+		| bainangua::CreateSimpleDescriptorSetsStage(vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eVertex, bainangua::MultiFrameCount)
+		| bainangua::CreateAndLinkUniformBuffersStage()
+		| bainangua::PrimaryGraphicsCommandBuffersStage(bainangua::MultiFrameCount)
+		| bainangua::GpuCullPipelineStage(SHADER_DIR)
+		| bainangua::GpuCullerStage(WriteCulledGrid::ObjectCount, true)
+		| CheckCulledDraws(&last)
+		| bainangua::StandardMultiFrameLoop(10)
+		| UpdateViewProjection()
+		| WriteCulledGrid()
+		| bainangua::BasicRendering(bainangua::GpuCullPrePass(frustumOf))
+		| DrawCulledGrid();
+
+	bainangua::VulkanContextConfig newConfig = boost::hana::at_key(testConfig(), BOOST_HANA_STRING("config"));
+	newConfig.useIndirectCount = true;
+
+	auto testConfig2 = boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("config"), newConfig));
+
+	REQUIRE(program.applyRow(testConfig2) == bainangua::bng_expected<bool>(true));
+}
+
+// The table and UBO sets get bound once; each copy just pushes its transform and texture slot.
+struct DrawBindlessGrid {
+	using row_tag = RowType::RowFunctionTag;
+	using return_type = void;
+
+	template<typename Row>
+	constexpr void applyRow(Row&& r) {
+		vk::CommandBuffer buffer = boost::hana::at_key(r, BOOST_HANA_STRING("primaryCommandBuffer"));
+		const bainangua::PipelineBundle& pipeline = boost::hana::at_key(r, BOOST_HANA_STRING("pipelineBundle"));
+		auto [vertexBuffer, bufferMemory] = boost::hana::at_key(r, BOOST_HANA_STRING("indexedVertexBuffer"));
+		auto [indexBuffer, indexBufferMemory] = boost::hana::at_key(r, BOOST_HANA_STRING("indexBuffer"));
+		const std::vector<vk::DescriptorSet>& descriptorSets = boost::hana::at_key(r, BOOST_HANA_STRING("descriptorSets"));
+		const std::shared_ptr<bainangua::BindlessTable>& bindlessTable = boost::hana::at_key(r, BOOST_HANA_STRING("bindlessTable"));
+		uint32_t textureIndex = boost::hana::at_key(r, BOOST_HANA_STRING("textureIndex"));
+		size_t multiFrameIndex = boost::hana::at_key(r, BOOST_HANA_STRING("multiFrameIndex"));
+
+		vk::Buffer vertexBuffers[] = { vertexBuffer };
+		vk::DeviceSize offsets[] = { 0 };
+		buffer.bindVertexBuffers(0, 1, vertexBuffers, offsets);
+		buffer.bindIndexBuffer(indexBuffer, 0, vk::IndexType::eUint16);
+
+		std::array<vk::DescriptorSet, 2> sets{ descriptorSets[multiFrameIndex], bindlessTable->set() };
+		buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline.pipelineLayout, 0, sets, {});
+
+		uint32_t objectId = 0;
+		for (int y = -1; y <= 1; y++) {
+			for (int x = -1; x <= 1; x++) {
+				glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x * 0.7f, y * 0.7f, 0.0f)), glm::vec3(0.3f));
+				bainangua::pushDrawConstants(buffer, pipeline.pipelineLayout, model, objectId++, textureIndex);
+				buffer.drawIndexed(static_cast<uint32_t>(bainangua::staticIndices.size()), 1, 0, 0, 0);
+			}
+		}
+	}
+};
+
+TEST_CASE("Bindless Textures", "[Rendering]")
+{
+	auto program =
+		bainangua::QuickCreateContext()
+		| bainangua::PresentationLayerStage()
+		| bainangua::BindlessTableStage()
+		| bainangua::BindlessTexPipelineStage(SHADER_DIR)
+		| bainangua::SimpleGraphicsCommandPoolStage()
+		| bainangua::GPUIndexedVertexBufferStage(bainangua::indexedStaticTexVertices)
+		| bainangua::GPUIndexBufferStage()
+		| bainangua::CreateSimpleDescriptorPoolStage(vk::DescriptorType::eUniformBuffer, bainangua::MultiFrameCount)
+		| bainangua::CreateSimpleDescriptorSetsStage(vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eVertex, bainangua::MultiFrameCount)
+		| bainangua::CreateAndLinkUniformBuffersStage()
+		| bainangua::FromFileTextureImageStage(TEXTURES_DIR / std::filesystem::path("default.jpg"))
+		| bainangua::SamplerCacheStage()
+		| bainangua::Basic2DSamplerStage()
+		| bainangua::BindlessTextureStage()
+		| bainangua::PrimaryGraphicsCommandBuffersStage(bainangua::MultiFrameCount)
+		| bainangua::StandardMultiFrameLoop(40)
+		| UpdateViewProjection()
+		| bainangua::BasicRendering()
+		| DrawBindlessGrid();
+
+	bainangua::VulkanContextConfig newConfig = boost::hana::at_key(testConfig(), BOOST_HANA_STRING("config"));
+	newConfig.useBindless = true;
+
+	auto testConfig2 = boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("config"), newConfig));
+
+	REQUIRE(program.applyRow(testConfig2) == bainangua::bng_expected<bool>(true));
+}
+
+TEST_CASE("DescriptorAllocator", "[Basic]")
+{
+	auto program =
+		bainangua::QuickCreateContext()
+		| bainangua::DescriptorAllocatorStage()
+		| RowType::RowWrapLambda<bainangua::bng_expected<bool>>([](auto row) -> bainangua::bng_expected<bool> {
+				vk::Device device = boost::hana::at_key(row, BOOST_HANA_STRING("device"));
+				VmaAllocator vmaAllocator = boost::hana::at_key(row, BOOST_HANA_STRING("vmaAllocator"));
+				std::shared_ptr<bainangua::DescriptorAllocator> allocator = boost::hana::at_key(row, BOOST_HANA_STRING("descriptorAllocator"));
+
+				auto layoutResult = bainangua::createSimpleDescriptorSetLayout(device);
+				REQUIRE(layoutResult.has_value());
+				vk::DescriptorSetLayout layout = layoutResult.value();
+				auto ubosResult = bainangua::createUniformBuffers(vmaAllocator);
+				REQUIRE(ubosResult.has_value());
+				std::vector<bainangua::UniformBufferBundle> ubos = ubosResult.value();
+
+				std::array<bainangua::DescriptorBinding, 1> bindings0{ bainangua::DescriptorBinding{ 0, vk::DescriptorType::eUniformBuffer, vk::DescriptorBufferInfo(ubos[0].ubo, 0, sizeof(BasicUBO)), {} } };
+				std::array<bainangua::DescriptorBinding, 1> bindings1{ bainangua::DescriptorBinding{ 0, vk::DescriptorType::eUniformBuffer, vk::DescriptorBufferInfo(ubos[1].ubo, 0, sizeof(BasicUBO)), {} } };
+
+				// far more sets per frame than the first pool holds, so the frame pools have to grow
+				for (size_t frame = 0; frame < 4; frame++) {
+					size_t multiFrameIndex = frame % bainangua::MultiFrameCount;
+					allocator->beginFrame(multiFrameIndex);
+					for (int draw = 0; draw < 1000; draw++) {
+						REQUIRE(allocator->allocateFrameSet(multiFrameIndex, layout, bindings0).has_value());
+					}
+				}
+
+				// the same bindings give back the same set
+				auto cached0 = allocator->cachedSet(layout, bindings0);
+				auto cached1 = allocator->cachedSet(layout, bindings1);
+				REQUIRE(cached0.has_value());
+				REQUIRE(cached1.has_value());
+				REQUIRE(cached0.value() != cached1.value());
+				REQUIRE(allocator->cachedSet(layout, bindings0) == cached0);
+				REQUIRE(allocator->cachedSetCount() == 2);
+
+				// destroying a buffer drops the sets that use it, and nothing else
+				REQUIRE(allocator->invalidate(ubos[0].ubo) == 1);
+				REQUIRE(allocator->cachedSetCount() == 1);
+				REQUIRE(allocator->generation() == 1);
+				REQUIRE(allocator->invalidate(ubos[0].ubo) == 0);
+				REQUIRE(allocator->generation() == 1);
+				REQUIRE(allocator->cachedSet(layout, bindings1) == cached1);
+
+				// the dropped set only comes back once every frame in flight has finished with it
+				std::array<bainangua::DescriptorBinding, 1> bindings2{ bainangua::DescriptorBinding{ 0, vk::DescriptorType::eUniformBuffer, vk::DescriptorBufferInfo(ubos[1].ubo, 0, sizeof(BasicUBO) / 2), {} } };
+				auto cached2 = allocator->cachedSet(layout, bindings2);
+				REQUIRE(cached2.has_value());
+				REQUIRE(cached2.value() != cached0.value());
+				for (size_t frame = 0; frame < bainangua::MultiFrameCount; frame++) {
+					allocator->beginFrame(frame);
+				}
+				REQUIRE(allocator->invalidate(ubos[1].ubo) == 2);
+				REQUIRE(allocator->cachedSet(layout, bindings0) == cached0);
+
+				bainangua::destroyUniformBuffers(vmaAllocator, ubos);
+				device.destroyDescriptorSetLayout(layout);
+				return true;
+			});
+
+	REQUIRE(program.applyRow(testConfig()) == bainangua::bng_expected<bool>(true));
+}
+
+TEST_CASE("SamplerCache", "[Basic]")
+{
+	auto program =
+		bainangua::QuickCreateContext()
+		| bainangua::SamplerCacheStage()
+		| RowType::RowWrapLambda<bainangua::bng_expected<bool>>([](auto row) -> bainangua::bng_expected<bool> {
+				vk::PhysicalDevice physicalDevice = boost::hana::at_key(row, BOOST_HANA_STRING("physicalDevice"));
+				std::shared_ptr<bainangua::SamplerCache> cache = boost::hana::at_key(row, BOOST_HANA_STRING("samplerCache"));
+
+				vk::SamplerCreateInfo linearInfo = bainangua::defaultTextureSamplerInfo(physicalDevice);
+				vk::SamplerCreateInfo nearestInfo = linearInfo;
+				nearestInfo.setMagFilter(vk::Filter::eNearest).setMinFilter(vk::Filter::eNearest);
+
+				{
+					auto a = cache->getSampler(linearInfo);
+					auto b = cache->getSampler(linearInfo);
+					auto c = cache->getSampler(nearestInfo);
+					REQUIRE(a.has_value());
+					REQUIRE(b.has_value());
+					REQUIRE(c.has_value());
+
+					// identical settings share one sampler
+					REQUIRE(*a.value() == *b.value());
+					REQUIRE(*a.value() != *c.value());
+					REQUIRE(cache->createCount() == 2);
+				}
+
+				// all the users are gone, so the next request makes a new one, and the dead entries get cleared out
+				REQUIRE(cache->entryCount() == 2);
+				auto d = cache->getSampler(linearInfo);
+				REQUIRE(d.has_value());
+				REQUIRE(cache->createCount() == 3);
+				REQUIRE(cache->entryCount() == 1);
+				return true;
+			});
+
+	REQUIRE(program.applyRow(testConfig()) == bainangua::bng_expected<bool>(true));
+}
+
 TEST_CASE("Textures", "[Rendering]")
 {
 	auto program =
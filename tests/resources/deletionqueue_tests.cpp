@@ -0,0 +1,115 @@
+#include "expected.hpp" // using tl::expected since this is C++20
+#include "RowType.hpp"
+
+#include <coroutine>
+#include <format>
+#include <memory>
+#include <boost/hana/map.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "nangua_tests.hpp"
+
+import VulkanContext;
+import DeletionQueue;
+
+namespace DeletionQueueTests {
+
+TEST_CASE("DeletionQueueFrames", "[DeletionQueue]")
+{
+	// frame-tagged entries never touch the device, so no context is needed here
+	bainangua::DeletionQueue queue(vk::Device(), 2);
+
+	std::vector<int> destroyed;
+	queue.enqueue([&]() { destroyed.push_back(0); });
+	queue.endFrame(); // end of frame 0
+	queue.enqueue([&]() { destroyed.push_back(1); });
+	REQUIRE(queue.pendingCount() == 2);
+
+	queue.endFrame(); // end of frame 1, frame 0 may still be in flight
+	REQUIRE(destroyed.empty());
+
+	queue.endFrame(); // end of frame 2, the fence for frame 0 has been waited on
+	REQUIRE(destroyed == std::vector<int>{0});
+
+	queue.endFrame();
+	REQUIRE(destroyed == std::vector<int>{0, 1});
+	REQUIRE(queue.pendingCount() == 0);
+
+	queue.enqueue([&]() { destroyed.push_back(2); });
+	queue.flush();
+	REQUIRE(destroyed == std::vector<int>{0, 1, 2});
+}
+
+TEST_CASE("DeletionQueueStage", "[DeletionQueue][Basic]")
+{
+	auto program =
+		bainangua::QuickCreateContext()
+		| bainangua::DeletionQueueStage(2)
+		| RowType::RowWrapLambda<bainangua::bng_expected<std::string>>([](auto row) {
+			vk::Device device = boost::hana::at_key(row, BOOST_HANA_STRING("device"));
+			std::shared_ptr<bainangua::DeletionQueue> deletionQueue = boost::hana::at_key(row, BOOST_HANA_STRING("deletionQueue"));
+			std::coroutine_handle<> endOfFrame = boost::hana::at_key(row, BOOST_HANA_STRING("endOfFrameCallback"));
+
+			// the counter outlives this lambda, since the last entries are flushed when the stage exits
+			auto destroyCount = std::make_shared<int>(0);
+			for (int frame = 0; frame < 5; frame++) {
+				vk::Semaphore s = device.createSemaphore({});
+				deletionQueue->enqueue([device, s, destroyCount]() { device.destroySemaphore(s); (*destroyCount)++; });
+				endOfFrame();
+			}
+			// frames 0-2 are known to be complete by the end of frame 4
+			if (*destroyCount != 3) {
+				return bainangua::bng_expected<std::string>(std::format("expected 3 destroyed semaphores, got {}", *destroyCount));
+			}
+
+			return bainangua::bng_expected<std::string>("DeletionQueue success");
+		});
+
+	REQUIRE(program.applyRow(testConfig()) == "DeletionQueue success");
+}
+
+TEST_CASE("DeletionQueueTimeline", "[DeletionQueue][Basic]")
+{
+	auto program =
+		bainangua::QuickCreateContext()
+		| RowType::RowWrapLambda<bainangua::bng_expected<std::string>>([](auto row) {
+			vk::Device device = boost::hana::at_key(row, BOOST_HANA_STRING("device"));
+			bainangua::DeletionQueue deletionQueue(device, 2);
+
+			vk::SemaphoreTypeCreateInfo timelineInfo(vk::SemaphoreType::eTimeline, 0);
+			vk::Semaphore timeline = device.createSemaphore(vk::SemaphoreCreateInfo({}, &timelineInfo));
+
+			int destroyCount = 0;
+			vk::Semaphore s = device.createSemaphore({});
+			deletionQueue.enqueue(timeline, 2, [device, s, &destroyCount]() { device.destroySemaphore(s); destroyCount++; });
+
+			// frames going by don't matter, only the semaphore's value does
+			for (int frame = 0; frame < 4; frame++) {
+				deletionQueue.endFrame();
+			}
+			device.signalSemaphore(vk::SemaphoreSignalInfo(timeline, 1));
+			deletionQueue.endFrame();
+			int destroyedEarly = destroyCount;
+
+			device.signalSemaphore(vk::SemaphoreSignalInfo(timeline, 2));
+			deletionQueue.endFrame();
+			int destroyedOnTime = destroyCount;
+
+			device.destroySemaphore(timeline);
+
+			if (destroyedEarly != 0 || destroyedOnTime != 1) {
+				return bainangua::bng_expected<std::string>(std::format("destroyed {} before the wait value and {} after", destroyedEarly, destroyedOnTime));
+			}
+			return bainangua::bng_expected<std::string>("DeletionQueue timeline success");
+		});
+
+	bainangua::VulkanContextConfig newConfig = boost::hana::at_key(testConfig(), BOOST_HANA_STRING("config"));
+	newConfig.useTimelineSemaphores = true;
+
+	auto testConfig2 = boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("config"), newConfig));
+
+	REQUIRE(program.applyRow(testConfig2) == "DeletionQueue timeline success");
+}
+
+}
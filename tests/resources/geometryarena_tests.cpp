@@ -0,0 +1,328 @@
+#include "expected.hpp" // using tl::expected since this is C++20
+#include "RowType.hpp"
+
+#include <array>
+#include <coroutine>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <utility>
+#include <vector>
+#include <boost/hana/map.hpp>
+#include <boost/hana/hash.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <coro/coro.hpp>
+
+#include "nangua_tests.hpp" // this has to be after the coro include, or else wonky double-include occurs...
+
+import VulkanContext;
+import CommandQueue;
+import PerFramePool;
+import GeometryArena;
+import DeletionQueue;
+import GPUProfiler;
+
+
+struct ArenaVertex {
+	float pos[3];
+};
+
+struct ArenaContents {
+	std::vector<ArenaVertex> vertices;
+	std::vector<uint32_t> indices;
+};
+
+// copies a mesh's vertices and indices back out of the arena
+auto readMesh(VmaAllocator vma, const bainangua::GeometryArena& arena, const bainangua::MeshHandle& mesh, vk::CommandBuffer cmd, std::shared_ptr<bainangua::CommandQueueFunnel> queue, coro::thread_pool& threads) -> coro::task<bainangua::bng_expected<ArenaContents>> {
+	size_t vertexBytes = mesh.vertexCount * sizeof(ArenaVertex);
+	size_t indexBytes = mesh.indexCount * sizeof(uint32_t);
+
+	VkBufferCreateInfo bufferInfo{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = vertexBytes + indexBytes,
+		.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE
+	};
+	VmaAllocationCreateInfo allocationInfo{
+		.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		.usage = VMA_MEMORY_USAGE_AUTO
+	};
+	VkBuffer buffer;
+	VmaAllocation allocation;
+	VmaAllocationInfo mapped;
+	if (vmaCreateBuffer(vma, &bufferInfo, &allocationInfo, &buffer, &allocation, &mapped) != VK_SUCCESS) {
+		co_return bainangua::bng_unexpected("could not create readback buffer");
+	}
+
+	cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	vk::BufferCopy vertexRegion(mesh.vertexOffset * sizeof(ArenaVertex), 0, vertexBytes);
+	cmd.copyBuffer(arena.vertexBuffer(), buffer, 1, &vertexRegion);
+	vk::BufferCopy indexRegion(mesh.firstIndex * sizeof(uint32_t), vertexBytes, indexBytes);
+	cmd.copyBuffer(arena.indexBuffer(), buffer, 1, &indexRegion);
+	vk::BufferMemoryBarrier hostBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, buffer, 0, VK_WHOLE_SIZE);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, 0, nullptr, 1, &hostBarrier, 0, nullptr);
+	cmd.end();
+
+	vk::SubmitInfo submitInfo(0, nullptr, nullptr, 1, &cmd, 0, nullptr);
+	auto submitResult = co_await queue->awaitCommand(submitInfo, threads);
+	if (!submitResult) {
+		vmaDestroyBuffer(vma, buffer, allocation);
+		co_return bainangua::bng_unexpected(submitResult.error());
+	}
+
+	vmaInvalidateAllocation(vma, allocation, 0, VK_WHOLE_SIZE);
+	ArenaContents contents{ std::vector<ArenaVertex>(mesh.vertexCount), std::vector<uint32_t>(mesh.indexCount) };
+	std::memcpy(contents.vertices.data(), mapped.pMappedData, vertexBytes);
+	std::memcpy(contents.indices.data(), static_cast<const std::byte*>(mapped.pMappedData) + vertexBytes, indexBytes);
+	vmaDestroyBuffer(vma, buffer, allocation);
+	co_return contents;
+}
+
+bool sameVertices(const std::vector<ArenaVertex>& a, const std::vector<ArenaVertex>& b) {
+	return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(ArenaVertex)) == 0;
+}
+
+TEST_CASE("GeometryArena", "[Buffers][GeometryArena]")
+{
+	auto arena_test =
+		bainangua::QuickCreateContext()
+		| bainangua::CreateQueueFunnels()
+		| bainangua::CreatePerFramePool()
+		| bainangua::CreateGeometryArena(sizeof(ArenaVertex), 64, 256)
+		| RowType::RowWrapLambda<bainangua::bng_expected<std::string>>([](auto row) {
+			vk::Device device = boost::hana::at_key(row, BOOST_HANA_STRING("device"));
+			std::shared_ptr<bainangua::PerFramePool> perFramePool = boost::hana::at_key(row, BOOST_HANA_STRING("perFramePool"));
+			std::shared_ptr<bainangua::CommandQueueFunnel> graphicsQueue = boost::hana::at_key(row, BOOST_HANA_STRING("graphicsFunnel"));
+			std::shared_ptr<bainangua::GeometryArena> arena = boost::hana::at_key(row, BOOST_HANA_STRING("geometryArena"));
+			VmaAllocator vma = boost::hana::at_key(row, BOOST_HANA_STRING("vmaAllocator"));
+
+			coro::thread_pool local_thread{ coro::thread_pool::options{1} };
+
+			auto runFrame = [](auto perFramePool, auto graphicsQueue, std::shared_ptr<bainangua::GeometryArena> arena, VmaAllocator vma, coro::thread_pool& threads) -> coro::task<bainangua::bng_expected<void>> {
+				auto pfdResult = co_await perFramePool->acquirePerFrameData();
+				if (!pfdResult) { co_return bainangua::bng_unexpected("failed to acquire PerFrameData"); }
+				std::shared_ptr<bainangua::PerFramePool::PerFrameData> pfd = pfdResult.value();
+
+				// one command buffer per upload
+				std::array<vk::CommandBuffer, 6> cmds;
+				for (auto& cmd : cmds) {
+					auto cmdResult = co_await pfd->acquireCommandBuffer();
+					if (!cmdResult) { co_return bainangua::bng_unexpected("failed to acquire command buffer"); }
+					cmd = cmdResult.value();
+				}
+
+				std::vector<ArenaVertex> quad{ {0,0,0}, {1,0,0}, {1,1,0}, {0,1,0} };
+				std::vector<uint32_t> quadIndices{ 0, 1, 2, 2, 3, 0 };
+				std::vector<ArenaVertex> triangle{ {0,0,0}, {1,0,0}, {0,1,0} };
+				std::vector<uint32_t> triangleIndices{ 0, 1, 2 };
+
+				bainangua::bng_expected<void> returnResult{};
+				auto check = [&](bool condition, std::string_view message) {
+					if (returnResult && !condition) { returnResult = bainangua::bng_unexpected(std::string(message)); }
+				};
+
+				auto first = co_await arena->uploadMesh(quad, quadIndices, cmds[0], graphicsQueue, threads);
+				auto second = co_await arena->uploadMesh(triangle, triangleIndices, cmds[1], graphicsQueue, threads);
+
+				if (!first || !second) {
+					co_await perFramePool->releasePerFrameData(pfd);
+					co_return bainangua::bng_unexpected(!first ? first.error() : second.error());
+				}
+
+				// the two meshes are packed side by side into the same buffers
+				check(first.value().indexCount == 6 && second.value().indexCount == 3, "wrong index counts");
+				check(first.value().vertexOffset != second.value().vertexOffset, "meshes share a vertex range");
+				check(first.value().firstIndex != second.value().firstIndex, "meshes share an index range");
+				check(arena->usedVertices() == 7 && arena->usedIndices() == 9, "arena usage doesn't add up");
+
+				// what landed in the buffers is what was uploaded
+				auto firstContents = co_await readMesh(vma, *arena, first.value(), cmds[2], graphicsQueue, threads);
+				auto secondContents = co_await readMesh(vma, *arena, second.value(), cmds[3], graphicsQueue, threads);
+				check(firstContents.has_value() && secondContents.has_value(), "readback failed");
+				if (firstContents && secondContents) {
+					check(sameVertices(firstContents.value().vertices, quad) && firstContents.value().indices == quadIndices, "first mesh's data is wrong");
+					check(sameVertices(secondContents.value().vertices, triangle) && secondContents.value().indices == triangleIndices, "second mesh's data is wrong");
+				}
+
+				// a mesh that doesn't fit is refused rather than overflowing the buffer
+				std::vector<ArenaVertex> tooMany(100);
+				auto overflow = co_await arena->uploadMesh(tooMany, triangleIndices, cmds[4], graphicsQueue, threads);
+				check(!overflow.has_value(), "oversized mesh was accepted");
+				check(arena->usedVertices() == 7 && arena->usedIndices() == 9, "failed upload leaked space");
+
+				// so is an empty one
+				auto empty = co_await arena->uploadMesh(std::vector<ArenaVertex>{}, std::vector<uint32_t>{}, cmds[5], graphicsQueue, threads);
+				check(!empty.has_value(), "empty mesh was accepted");
+
+				// freed space goes back to the arena
+				arena->free(first.value());
+				arena->free(second.value());
+				check(arena->usedVertices() == 0 && arena->usedIndices() == 0, "freed meshes still hold space");
+
+				co_await perFramePool->releasePerFrameData(pfd);
+
+				co_return returnResult;
+			};
+
+			bainangua::bng_expected<void> syncResult = coro::sync_wait(runFrame(perFramePool, graphicsQueue, arena, vma, local_thread));
+
+			device.waitIdle();
+
+			return syncResult ? "Arena success" : syncResult.error();
+		});
+
+	REQUIRE(arena_test.applyRow(testConfig()) == "Arena success");
+}
+
+TEST_CASE("GeometryArenaDeferredFree", "[Buffers][GeometryArena][DeletionQueue]")
+{
+	auto arena_test =
+		bainangua::QuickCreateContext()
+		| bainangua::CreateQueueFunnels()
+		| bainangua::CreatePerFramePool()
+		| bainangua::CreateGeometryArena(sizeof(ArenaVertex), 64, 256)
+		| RowType::RowWrapLambda<bainangua::bng_expected<std::string>>([](auto row) {
+			vk::Device device = boost::hana::at_key(row, BOOST_HANA_STRING("device"));
+			std::shared_ptr<bainangua::PerFramePool> perFramePool = boost::hana::at_key(row, BOOST_HANA_STRING("perFramePool"));
+			std::shared_ptr<bainangua::CommandQueueFunnel> graphicsQueue = boost::hana::at_key(row, BOOST_HANA_STRING("graphicsFunnel"));
+			std::shared_ptr<bainangua::GeometryArena> arena = boost::hana::at_key(row, BOOST_HANA_STRING("geometryArena"));
+
+			coro::thread_pool local_thread{ coro::thread_pool::options{1} };
+
+			auto uploadMeshes = [](auto perFramePool, auto graphicsQueue, std::shared_ptr<bainangua::GeometryArena> arena, coro::thread_pool& threads) -> coro::task<bainangua::bng_expected<std::pair<bainangua::MeshHandle, bainangua::MeshHandle>>> {
+				auto pfdResult = co_await perFramePool->acquirePerFrameData();
+				if (!pfdResult) { co_return bainangua::bng_unexpected("failed to acquire PerFrameData"); }
+				std::shared_ptr<bainangua::PerFramePool::PerFrameData> pfd = pfdResult.value();
+
+				auto firstCmd = co_await pfd->acquireCommandBuffer();
+				auto secondCmd = co_await pfd->acquireCommandBuffer();
+				if (!firstCmd || !secondCmd) {
+					co_await perFramePool->releasePerFrameData(pfd);
+					co_return bainangua::bng_unexpected("failed to acquire command buffer");
+				}
+
+				std::vector<ArenaVertex> quad{ {0,0,0}, {1,0,0}, {1,1,0}, {0,1,0} };
+				std::vector<uint32_t> quadIndices{ 0, 1, 2, 2, 3, 0 };
+				std::vector<ArenaVertex> triangle{ {0,0,0}, {1,0,0}, {0,1,0} };
+				std::vector<uint32_t> triangleIndices{ 0, 1, 2 };
+				auto first = co_await arena->uploadMesh(quad, quadIndices, firstCmd.value(), graphicsQueue, threads);
+				auto second = co_await arena->uploadMesh(triangle, triangleIndices, secondCmd.value(), graphicsQueue, threads);
+				co_await perFramePool->releasePerFrameData(pfd);
+
+				if (!first || !second) {
+					co_return bainangua::bng_unexpected(!first ? first.error() : second.error());
+				}
+				co_return std::make_pair(first.value(), second.value());
+			};
+
+			auto meshes = coro::sync_wait(uploadMeshes(perFramePool, graphicsQueue, arena, local_thread));
+			if (!meshes) {
+				return bainangua::bng_expected<std::string>(meshes.error());
+			}
+			auto [quad, triangle] = meshes.value();
+
+			bainangua::DeletionQueue deletionQueue(device, 2);
+			vk::SemaphoreTypeCreateInfo timelineInfo(vk::SemaphoreType::eTimeline, 0);
+			vk::Semaphore timeline = device.createSemaphore(vk::SemaphoreCreateInfo({}, &timelineInfo));
+
+			// the quad is dropped during frame 0, the triangle once some later submission signals the timeline
+			arena->free(quad, deletionQueue);
+			arena->free(triangle, deletionQueue, timeline, 1);
+			bool handlesCleared = quad.indexCount == 0 && triangle.indexCount == 0;
+
+			// frame 0's fence isn't waited on until frame 2 starts, so its draws may still read the quad until then
+			deletionQueue.endFrame();
+			deletionQueue.endFrame();
+			uint64_t heldThroughFence = arena->usedVertices();
+
+			deletionQueue.endFrame();
+			uint64_t afterFence = arena->usedVertices();
+
+			device.signalSemaphore(vk::SemaphoreSignalInfo(timeline, 1));
+			deletionQueue.endFrame();
+			uint64_t afterTimeline = arena->usedVertices();
+
+			device.destroySemaphore(timeline);
+
+			if (!handlesCleared) {
+				return bainangua::bng_expected<std::string>("freed handles weren't cleared");
+			}
+			if (heldThroughFence != 7 || afterFence != 3 || afterTimeline != 0) {
+				return bainangua::bng_expected<std::string>(std::format("arena held {} vertices before frame 0's fence, {} after it and {} after the timeline signal", heldThroughFence, afterFence, afterTimeline));
+			}
+			return bainangua::bng_expected<std::string>("Deferred free success");
+		});
+
+	bainangua::VulkanContextConfig newConfig = boost::hana::at_key(testConfig(), BOOST_HANA_STRING("config"));
+	newConfig.useTimelineSemaphores = true;
+
+	auto testConfig2 = boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("config"), newConfig));
+
+	REQUIRE(arena_test.applyRow(testConfig2) == "Deferred free success");
+}
+
+TEST_CASE("GeometryArenaProfiledUploads", "[Buffers][GeometryArena]")
+{
+	std::shared_ptr<bainangua::GPUProfiler> profiler;
+
+	auto arena_test =
+		bainangua::QuickCreateContext()
+		| bainangua::CreateQueueFunnels()
+		| bainangua::CreatePerFramePool()
+		| bainangua::GPUProfilerStage(bainangua::MultiFrameCount)
+		| bainangua::CreateGeometryArena(sizeof(ArenaVertex), 64, 256)
+		| RowType::RowWrapLambda<bainangua::bng_expected<std::string>>([&profiler](auto row) {
+			std::shared_ptr<bainangua::PerFramePool> perFramePool = boost::hana::at_key(row, BOOST_HANA_STRING("perFramePool"));
+			std::shared_ptr<bainangua::CommandQueueFunnel> graphicsQueue = boost::hana::at_key(row, BOOST_HANA_STRING("graphicsFunnel"));
+			std::shared_ptr<bainangua::GeometryArena> arena = boost::hana::at_key(row, BOOST_HANA_STRING("geometryArena"));
+			profiler = boost::hana::at_key(row, BOOST_HANA_STRING("gpuProfiler"));
+
+			coro::thread_pool uploadThreads{ coro::thread_pool::options{2} };
+
+			// two uploads in flight at the same time, each with its own queries
+			auto uploadBoth = [](auto perFramePool, auto graphicsQueue, std::shared_ptr<bainangua::GeometryArena> arena, coro::thread_pool& threads) -> coro::task<bainangua::bng_expected<void>> {
+				auto pfdResult = co_await perFramePool->acquirePerFrameData();
+				if (!pfdResult) { co_return bainangua::bng_unexpected("failed to acquire PerFrameData"); }
+				std::shared_ptr<bainangua::PerFramePool::PerFrameData> pfd = pfdResult.value();
+
+				auto firstCmd = co_await pfd->acquireCommandBuffer();
+				auto secondCmd = co_await pfd->acquireCommandBuffer();
+				if (!firstCmd || !secondCmd) {
+					co_await perFramePool->releasePerFrameData(pfd);
+					co_return bainangua::bng_unexpected("failed to acquire command buffer");
+				}
+
+				std::vector<ArenaVertex> quad{ {0,0,0}, {1,0,0}, {1,1,0}, {0,1,0} };
+				std::vector<uint32_t> quadIndices{ 0, 1, 2, 2, 3, 0 };
+				std::vector<ArenaVertex> triangle{ {0,0,0}, {1,0,0}, {0,1,0} };
+				std::vector<uint32_t> triangleIndices{ 0, 1, 2 };
+				auto [first, second] = co_await coro::when_all(
+					arena->uploadMesh(quad, quadIndices, firstCmd.value(), graphicsQueue, threads),
+					arena->uploadMesh(triangle, triangleIndices, secondCmd.value(), graphicsQueue, threads));
+				co_await perFramePool->releasePerFrameData(pfd);
+
+				bainangua::bng_expected<bainangua::MeshHandle> firstMesh = first.return_value();
+				bainangua::bng_expected<bainangua::MeshHandle> secondMesh = second.return_value();
+				if (!firstMesh || !secondMesh) {
+					co_return bainangua::bng_unexpected(!firstMesh ? firstMesh.error() : secondMesh.error());
+				}
+				arena->free(firstMesh.value());
+				arena->free(secondMesh.value());
+				co_return bainangua::bng_expected<void>{};
+			};
+
+			auto uploadResult = coro::sync_wait(uploadBoth(perFramePool, graphicsQueue, arena, uploadThreads));
+			return uploadResult ? bainangua::bng_expected<std::string>("Profiled uploads success") : bainangua::bng_expected<std::string>(bainangua::bng_unexpected(uploadResult.error()));
+		});
+
+	REQUIRE(arena_test.applyRow(testConfig()) == "Profiled uploads success");
+
+	// uploads are collected as soon as they finish, without any frames going by
+	REQUIRE(profiler);
+	if (profiler->enabled()) {
+		auto statistics = profiler->statistics();
+		REQUIRE(statistics.contains("GeometryArena upload"));
+		REQUIRE(statistics["GeometryArena upload"].sampleCount == 2);
+	}
+}
@@ -0,0 +1,174 @@
+#include "expected.hpp" // using tl::expected since this is C++20
+#include "RowType.hpp"
+
+#include <coroutine>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <optional>
+#include <string>
+#include <boost/hana/map.hpp>
+#include <boost/hana/hash.hpp>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <coro/coro.hpp>
+
+#include "nangua_tests.hpp" // this has to be after the coro include, or else wonky double-include occurs...
+
+import VulkanContext;
+import CommandQueue;
+import ResourceLoader;
+import GltfModel;
+import TextureImage;
+import DescriptorSets;
+
+
+namespace GltfModelTests {
+
+constexpr auto gltfLoaderLookup = boost::hana::make_map(
+	bainangua::gltfDocumentLoader,
+	bainangua::gltfTextureLoader,
+	bainangua::gltfModelLoader
+);
+
+auto gltfLoaderStorage = bainangua::createLoaderStorage(gltfLoaderLookup);
+
+// TexturedQuad is a quad made of two triangles with six separate vertices, under a parent node, with one textured
+// material whose texture uses a nearest-filtered sampler that clamps in U and mirrors in V
+auto checkTexturedQuad(const bainangua::GltfModel& model) -> bainangua::bng_expected<void> {
+	if (model.meshes.size() != 1 || model.meshes[0].primitives.size() != 1) { return bainangua::bng_unexpected("wrong mesh count"); }
+
+	const bainangua::GltfPrimitive& quad = model.meshes[0].primitives[0];
+	if (quad.indexCount != 6 || quad.material != 0) { return bainangua::bng_unexpected("wrong primitive"); }
+	// the duplicated corners get merged when the mesh is processed
+	if (model.vertexCount != 4) { return bainangua::bng_unexpected(std::format("expected 4 vertices, got {}", model.vertexCount)); }
+	if (model.indexType != vk::IndexType::eUint16) { return bainangua::bng_unexpected("expected 16-bit indices"); }
+	if (!model.vertexBuffer.buffer_handle_ || !model.indexBuffer.buffer_handle_) { return bainangua::bng_unexpected("geometry not uploaded"); }
+
+	if (model.materials.size() != 1 || model.materials[0].baseColorTexture != 0 || model.materials[0].roughnessFactor != 0.5f) {
+		return bainangua::bng_unexpected("wrong material");
+	}
+	if (model.textures.size() != 1 || model.textures[0].image.width != 2 || model.textures[0].image.height != 2 || !model.textures[0].image.imageView) {
+		return bainangua::bng_unexpected("wrong texture");
+	}
+	if (!model.textures[0].sampler) { return bainangua::bng_unexpected("texture has no sampler"); }
+
+	if (model.nodes.size() != 2 || model.rootNodes.size() != 1 || model.rootNodes[0] != 0) { return bainangua::bng_unexpected("wrong node hierarchy"); }
+	const bainangua::GltfNode& child = model.nodes[1];
+	if (child.parent != 0 || child.mesh != 0 || model.nodes[0].children.size() != 1) { return bainangua::bng_unexpected("wrong node links"); }
+	if (glm::vec3(child.worldTransform[3]) != glm::vec3(1.0f, 2.0f, 0.0f)) { return bainangua::bng_unexpected("wrong world transform"); }
+
+	return {};
+}
+
+TEST_CASE("GltfModel", "[ResourceLoader][GltfModel]")
+{
+	auto gltf_test =
+		bainangua::QuickCreateContext()
+		| bainangua::CreateQueueFunnels()
+		| bainangua::SamplerCacheStage()
+		| bainangua::ResourceLoaderStage(gltfLoaderLookup, gltfLoaderStorage)
+		| RowType::RowWrapLambda<bainangua::bng_expected<std::string>>([](auto row) -> bainangua::bng_expected<std::string> {
+			auto loader = boost::hana::at_key(row, BOOST_HANA_STRING("resourceLoader"));
+			std::shared_ptr<bainangua::SamplerCache> samplerCache = boost::hana::at_key(row, BOOST_HANA_STRING("samplerCache"));
+
+			bainangua::GltfModelKey textKey{ std::filesystem::path(MODELS_DIR) / "TexturedQuad.gltf" };
+			bainangua::GltfModelKey binaryKey{ std::filesystem::path(MODELS_DIR) / "TexturedQuad.glb" };
+
+			// both forms load at the same time
+			auto [textResult, binaryResult] = coro::sync_wait(coro::when_all(loader->loadResource(textKey), loader->loadResource(binaryKey)));
+
+			bainangua::bng_expected<void> check =
+				textResult.return_value()
+				.and_then([](auto model) { return checkTexturedQuad(*model); })
+				.and_then([&]() { return binaryResult.return_value(); })
+				.and_then([](auto model) { return checkTexturedQuad(*model); })
+				.and_then([&]() -> bainangua::bng_expected<void> {
+					// both files ask for the same sampler, so the cache only makes one
+					if (textResult.return_value().value()->textures[0].sampler != binaryResult.return_value().value()->textures[0].sampler || samplerCache->createCount() != 1) {
+						return bainangua::bng_unexpected("the two models don't share a sampler");
+					}
+					return {};
+				});
+
+			// the quad's only image is a base color texture
+			bainangua::GltfDocumentKey documentKey{ textKey.key };
+			auto documentResult = coro::sync_wait(loader->loadResource(documentKey));
+			check = check
+				.and_then([&]() { return documentResult; })
+				.and_then([](auto document) -> bainangua::bng_expected<void> {
+					if (bainangua::gltfImageFormat(*document, 0) != vk::Format::eR8G8B8A8Srgb) { return bainangua::bng_unexpected("base color texture should be sRGB"); }
+					vk::SamplerCreateInfo sampler = bainangua::gltfSamplerInfo(*document, 0, vk::SamplerCreateInfo());
+					if (sampler.magFilter != vk::Filter::eNearest || sampler.minFilter != vk::Filter::eNearest
+						|| sampler.addressModeU != vk::SamplerAddressMode::eClampToEdge || sampler.addressModeV != vk::SamplerAddressMode::eMirroredRepeat) {
+						return bainangua::bng_unexpected("glTF sampler wasn't translated");
+					}
+					return {};
+				});
+			coro::sync_wait(loader->unloadResource(documentKey));
+
+			coro::sync_wait(loader->unloadResource(textKey));
+			coro::sync_wait(loader->unloadResource(binaryKey));
+
+			// models, textures and documents should all be gone
+			size_t stillLoaded = loader->measureLoad();
+
+			if (!check) {
+				return bainangua::bng_unexpected(check.error());
+			}
+			return std::format("glTF success, loaded={}", stillLoaded);
+		});
+
+	REQUIRE(gltf_test.applyRow(testConfig()) == "glTF success, loaded=0");
+}
+
+TEST_CASE("GltfModelBindless", "[ResourceLoader][GltfModel]")
+{
+	auto gltf_test =
+		bainangua::QuickCreateContext()
+		| bainangua::CreateQueueFunnels()
+		| bainangua::SamplerCacheStage()
+		| bainangua::BindlessTableStage(4, 1)
+		| bainangua::ResourceLoaderStage(gltfLoaderLookup, gltfLoaderStorage)
+		| RowType::RowWrapLambda<bainangua::bng_expected<std::string>>([](auto row) -> bainangua::bng_expected<std::string> {
+			auto loader = boost::hana::at_key(row, BOOST_HANA_STRING("resourceLoader"));
+
+			bainangua::GltfModelKey textKey{ std::filesystem::path(MODELS_DIR) / "TexturedQuad.gltf" };
+			bainangua::GltfModelKey binaryKey{ std::filesystem::path(MODELS_DIR) / "TexturedQuad.glb" };
+
+			auto [textResult, binaryResult] = coro::sync_wait(coro::when_all(loader->loadResource(textKey), loader->loadResource(binaryKey)));
+			if (!textResult.return_value() || !binaryResult.return_value()) {
+				return bainangua::bng_unexpected(!textResult.return_value() ? textResult.return_value().error() : binaryResult.return_value().error());
+			}
+			std::optional<uint32_t> textIndex = textResult.return_value().value()->textures[0].textureIndex;
+			std::optional<uint32_t> binaryIndex = binaryResult.return_value().value()->textures[0].textureIndex;
+
+			coro::sync_wait(loader->unloadResource(textKey));
+			coro::sync_wait(loader->unloadResource(binaryKey));
+
+			// unloading gave both slots back, so loading again reuses one instead of taking a third
+			auto reloaded = coro::sync_wait(loader->loadResource(textKey));
+			std::optional<uint32_t> reloadedIndex = reloaded ? reloaded.value()->textures[0].textureIndex : std::nullopt;
+			coro::sync_wait(loader->unloadResource(textKey));
+
+			if (!textIndex || !binaryIndex || textIndex == binaryIndex) {
+				return bainangua::bng_unexpected("textures didn't get their own bindless slots");
+			}
+			if (!reloadedIndex || reloadedIndex.value() > 1) {
+				return bainangua::bng_unexpected("bindless slots weren't given back on unload");
+			}
+			return std::format("glTF bindless success, loaded={}", loader->measureLoad());
+		});
+
+	bainangua::VulkanContextConfig newConfig = boost::hana::at_key(testConfig(), BOOST_HANA_STRING("config"));
+	newConfig.useBindless = true;
+
+	auto testConfig2 = boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("config"), newConfig));
+
+	REQUIRE(gltf_test.applyRow(testConfig2) == "glTF bindless success, loaded=0");
+}
+
+}
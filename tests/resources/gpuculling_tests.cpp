@@ -0,0 +1,133 @@
+#include "expected.hpp" // using tl::expected since this is C++20
+#include "RowType.hpp"
+
+#include <algorithm>
+#include <coroutine>
+#include <cstdint>
+#include <format>
+#include <random>
+#include <vector>
+#include <boost/hana/map.hpp>
+#include <boost/hana/hash.hpp>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <coro/coro.hpp>
+
+#include "nangua_tests.hpp" // this has to be after the coro include, or else wonky double-include occurs...
+
+import VulkanContext;
+import CommandQueue;
+import PerFramePool;
+import Pipeline;
+import MeshProcessing;
+import SceneCulling;
+import GpuCulling;
+
+
+namespace GpuCullingTests {
+
+TEST_CASE("GpuCulling", "[Rendering][GpuCulling]")
+{
+	constexpr uint32_t objectCount = 1000;
+
+	auto gpuculling_test =
+		bainangua::QuickCreateContext()
+		| bainangua::CreateQueueFunnels()
+		| bainangua::CreatePerFramePool()
+		| bainangua::GpuCullPipelineStage(SHADER_DIR)
+		| bainangua::GpuCullerStage(objectCount, true)
+		| RowType::RowWrapLambda<bainangua::bng_expected<std::string>>([](auto row) -> bainangua::bng_expected<std::string> {
+			vk::Device device = boost::hana::at_key(row, BOOST_HANA_STRING("device"));
+			std::shared_ptr<bainangua::PerFramePool> perFramePool = boost::hana::at_key(row, BOOST_HANA_STRING("perFramePool"));
+			std::shared_ptr<bainangua::CommandQueueFunnel> graphicsQueue = boost::hana::at_key(row, BOOST_HANA_STRING("graphicsFunnel"));
+			bainangua::ComputePipelineBundle pipeline = boost::hana::at_key(row, BOOST_HANA_STRING("cullPipelineBundle"));
+			std::shared_ptr<bainangua::GpuCuller> culler = boost::hana::at_key(row, BOOST_HANA_STRING("gpuCuller"));
+
+			// objects scattered around the camera, each with its own index range so draws can be matched back up
+			std::mt19937 random(99);
+			std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+			std::uniform_real_distribution<float> radius(0.1f, 3.0f);
+			std::vector<bainangua::GpuCullObject> objects;
+			for (uint32_t i = 0; i < objectCount; i++) {
+				objects.push_back({ glm::vec4(position(random), position(random), position(random), radius(random)), 3 * (i + 1), 3 * i, int32_t(i), i });
+			}
+			culler->write(0, objects);
+
+			glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 20.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+			glm::mat4 projection = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 60.0f);
+			auto frustum = bainangua::Frustum::fromViewProjection(projection * view);
+
+			coro::thread_pool local_thread{ coro::thread_pool::options{1} };
+
+			auto runFrame = [](auto perFramePool, auto graphicsQueue, auto culler, bainangua::ComputePipelineBundle pipeline, bainangua::Frustum frustum, coro::thread_pool& pool) -> coro::task<bainangua::bng_expected<void>> {
+				auto pfdResult = co_await perFramePool->acquirePerFrameData();
+				if (!pfdResult) { co_return bainangua::bng_unexpected("failed to acquire PerFrameData"); }
+				std::shared_ptr<bainangua::PerFramePool::PerFrameData> pfd = pfdResult.value();
+
+				auto cmdResult = co_await pfd->acquireCommandBuffer();
+				if (!cmdResult) { co_return bainangua::bng_unexpected("failed to acquire command buffer"); }
+				vk::CommandBuffer cmd = cmdResult.value();
+
+				vk::CommandBufferBeginInfo beginInfo({}, {});
+				cmd.begin(beginInfo);
+				culler->cull(cmd, 0, pipeline.computePipeline, pipeline.pipelineLayout, frustum);
+				cmd.end();
+
+				vk::SubmitInfo submit(0, nullptr, {}, 1, &cmd, 0, nullptr, nullptr);
+				co_await graphicsQueue->awaitCommand(submit, pool);
+
+				co_await perFramePool->releasePerFrameData(pfd);
+				co_return bainangua::bng_expected<void>();
+			};
+
+			bainangua::bng_expected<void> frameResult = coro::sync_wait(runFrame(perFramePool, graphicsQueue, culler, pipeline, frustum, local_thread));
+			device.waitIdle();
+			if (!frameResult) {
+				return bainangua::bng_unexpected(frameResult.error());
+			}
+
+			auto drawsResult = culler->readDraws(0);
+			if (!drawsResult) {
+				return bainangua::bng_unexpected(drawsResult.error());
+			}
+
+			// the GPU appends in whatever order its threads finish, so compare sorted by object
+			std::vector<vk::DrawIndexedIndirectCommand> draws = drawsResult.value();
+			std::ranges::sort(draws, {}, &vk::DrawIndexedIndirectCommand::firstInstance);
+
+			std::vector<uint32_t> expected;
+			for (const auto& object : objects) {
+				if (frustum.contains(bainangua::BoundingSphere{ glm::vec3(object.sphere), object.sphere.w })) {
+					expected.push_back(object.firstInstance);
+				}
+			}
+			if (expected.empty() || expected.size() == objects.size()) {
+				return bainangua::bng_unexpected("test frustum should see some but not all objects");
+			}
+			if (draws.size() != expected.size()) {
+				return bainangua::bng_unexpected(std::format("expected {} draws, got {}", expected.size(), draws.size()));
+			}
+			for (size_t i = 0; i < draws.size(); i++) {
+				const auto& draw = draws[i];
+				const auto& object = objects[expected[i]];
+				if (draw.firstInstance != expected[i] || draw.instanceCount != 1 || draw.indexCount != object.indexCount
+					|| draw.firstIndex != object.firstIndex || draw.vertexOffset != object.vertexOffset) {
+					return bainangua::bng_unexpected(std::format("draw {} doesn't match its object", i));
+				}
+			}
+			return std::string("GpuCulling success");
+		});
+
+	bainangua::VulkanContextConfig newConfig = boost::hana::at_key(testConfig(), BOOST_HANA_STRING("config"));
+	newConfig.useIndirectCount = true;
+
+	auto testConfig2 = boost::hana::make_map(boost::hana::make_pair(BOOST_HANA_STRING("config"), newConfig));
+
+	REQUIRE(gpuculling_test.applyRow(testConfig2) == "GpuCulling success");
+}
+
+}
@@ -0,0 +1,264 @@
+#include "bainangua.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <variant>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <coro/coro.hpp>
+
+import MeshProcessing;
+import GeometryArena;
+
+
+namespace MeshProcessingTests {
+
+	struct GridVertex {
+		float x;
+		float y;
+
+		bool operator==(const GridVertex&) const = default;
+	};
+
+	// an N x N grid of quads where every quad has its own four vertices, with the triangles shuffled: the worst case
+	// an exporter can hand us
+	void makeShuffledGrid(uint32_t n, std::vector<GridVertex>& vertices, std::vector<uint32_t>& indices) {
+		std::vector<std::array<uint32_t, 3>> triangles;
+		for (uint32_t y = 0; y < n; y++) {
+			for (uint32_t x = 0; x < n; x++) {
+				uint32_t base = static_cast<uint32_t>(vertices.size());
+				vertices.push_back({ float(x), float(y) });
+				vertices.push_back({ float(x + 1), float(y) });
+				vertices.push_back({ float(x + 1), float(y + 1) });
+				vertices.push_back({ float(x), float(y + 1) });
+				triangles.push_back({ base, base + 1, base + 2 });
+				triangles.push_back({ base + 2, base + 3, base });
+			}
+		}
+		std::shuffle(triangles.begin(), triangles.end(), std::mt19937(1234));
+		for (const auto& t : triangles) {
+			indices.insert(indices.end(), t.begin(), t.end());
+		}
+	}
+
+	// triangles as vertex values, rotated so the smallest corner comes first; equal lists mean the same mesh with
+	// the same winding
+	std::vector<std::array<GridVertex, 3>> canonicalTriangles(const std::vector<GridVertex>& vertices, const std::vector<uint32_t>& indices) {
+		auto less = [](const GridVertex& a, const GridVertex& b) { return a.x < b.x || (a.x == b.x && a.y < b.y); };
+		std::vector<std::array<GridVertex, 3>> triangles;
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			std::array<GridVertex, 3> t{ vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]] };
+			while (less(t[1], t[0]) || less(t[2], t[0])) {
+				std::rotate(t.begin(), t.begin() + 1, t.end());
+			}
+			triangles.push_back(t);
+		}
+		std::sort(triangles.begin(), triangles.end(), [&](const auto& a, const auto& b) {
+			return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), less);
+		});
+		return triangles;
+	}
+
+	TEST_CASE("ACMR", "[MeshProcessing]")
+	{
+		// no triangle shares a vertex: every vertex misses
+		std::vector<uint32_t> separate{ 0, 1, 2, 3, 4, 5 };
+		REQUIRE(bainangua::computeACMR(separate, 6) == 3.0f);
+
+		// a quad as two triangles sharing an edge
+		std::vector<uint32_t> quad{ 0, 1, 2, 2, 3, 0 };
+		REQUIRE(bainangua::computeACMR(quad, 4) == 2.0f);
+	}
+
+	TEST_CASE("Vertex deduplication", "[MeshProcessing]")
+	{
+		std::vector<GridVertex> vertices;
+		std::vector<uint32_t> indices;
+		makeShuffledGrid(4, vertices, indices);
+		auto before = canonicalTriangles(vertices, indices);
+
+		REQUIRE(bainangua::deduplicateVertices(vertices, indices) == 25);
+		REQUIRE(canonicalTriangles(vertices, indices) == before);
+	}
+
+	TEST_CASE("Vertex cache and fetch optimization", "[MeshProcessing]")
+	{
+		std::vector<GridVertex> vertices;
+		std::vector<uint32_t> indices;
+		makeShuffledGrid(64, vertices, indices);
+		auto before = canonicalTriangles(vertices, indices);
+
+		auto processed = bainangua::processMesh(vertices, indices);
+
+		REQUIRE(processed.stats.verticesBefore == 64 * 64 * 4);
+		REQUIRE(processed.stats.verticesAfter == 65 * 65);
+		REQUIRE(processed.stats.acmrBefore > 2.9f);
+		REQUIRE(processed.stats.acmrAfter < 0.8f);
+
+		// small enough for 16-bit indices
+		REQUIRE(bainangua::indexType(processed.indices) == vk::IndexType::eUint16);
+		REQUIRE(bainangua::indexCount(processed.indices) == indices.size());
+		const auto& indices16 = std::get<std::vector<uint16_t>>(processed.indices);
+		std::vector<uint32_t> optimized(indices16.begin(), indices16.end());
+
+		// fetch order: each new vertex is the next one in the buffer
+		uint32_t highest = 0;
+		for (uint32_t index : optimized) {
+			REQUIRE(index <= highest + 1);
+			highest = std::max(highest, index);
+		}
+
+		REQUIRE(canonicalTriangles(processed.vertices, optimized) == before);
+	}
+
+	TEST_CASE("Index width", "[MeshProcessing]")
+	{
+		std::vector<uint32_t> indices{ 0, 1, 65535 };
+		REQUIRE(bainangua::indexType(bainangua::compactIndices(indices, 65536)) == vk::IndexType::eUint16);
+
+		indices.push_back(65536);
+		auto wide = bainangua::compactIndices(indices, 65537);
+		REQUIRE(bainangua::indexType(wide) == vk::IndexType::eUint32);
+		REQUIRE(std::get<std::vector<uint32_t>>(wide).back() == 65536);
+	}
+
+	TEST_CASE("Mesh processing on a thread pool", "[MeshProcessing]")
+	{
+		std::vector<GridVertex> vertices;
+		std::vector<uint32_t> indices;
+		makeShuffledGrid(16, vertices, indices);
+
+		coro::thread_pool pool{ coro::thread_pool::options{.thread_count = 2} };
+		auto processed = coro::sync_wait(bainangua::processMeshAsync(pool, vertices, indices));
+
+		REQUIRE(processed.stats.verticesAfter == 17 * 17);
+		REQUIRE(processed.stats.acmrAfter < processed.stats.acmrBefore);
+	}
+
+	struct LodVertex {
+		glm::vec3 pos3;
+	};
+
+	// a closed unit sphere with one vertex per position, so nothing is locked by seams or borders
+	void makeSphere(uint32_t rings, uint32_t segments, std::vector<LodVertex>& vertices, std::vector<uint32_t>& indices) {
+		const float pi = 3.14159265f;
+		vertices.push_back({ glm::vec3(0.0f, 0.0f, 1.0f) });
+		for (uint32_t r = 1; r < rings; r++) {
+			for (uint32_t s = 0; s < segments; s++) {
+				float theta = pi * r / rings, phi = 2.0f * pi * s / segments;
+				vertices.push_back({ glm::vec3(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta)) });
+			}
+		}
+		vertices.push_back({ glm::vec3(0.0f, 0.0f, -1.0f) });
+		uint32_t south = static_cast<uint32_t>(vertices.size() - 1);
+
+		auto at = [&](uint32_t r, uint32_t s) { return 1 + (r - 1) * segments + (s % segments); };
+		for (uint32_t s = 0; s < segments; s++) {
+			indices.insert(indices.end(), { 0, at(1, s), at(1, s + 1) });
+			indices.insert(indices.end(), { south, at(rings - 1, s + 1), at(rings - 1, s) });
+		}
+		for (uint32_t r = 1; r + 1 < rings; r++) {
+			for (uint32_t s = 0; s < segments; s++) {
+				uint32_t a = at(r, s), b = at(r, s + 1), c = at(r + 1, s + 1), d = at(r + 1, s);
+				indices.insert(indices.end(), { a, d, c, c, b, a });
+			}
+		}
+	}
+
+	TEST_CASE("Mesh simplification", "[MeshProcessing]")
+	{
+		SECTION("flat grid") {
+			// a flat surface simplifies without any error; only its outline is kept
+			std::vector<LodVertex> vertices;
+			std::vector<uint32_t> indices;
+			const uint32_t n = 32;
+			for (uint32_t y = 0; y <= n; y++) {
+				for (uint32_t x = 0; x <= n; x++) {
+					vertices.push_back({ glm::vec3(float(x), float(y), 0.0f) });
+				}
+			}
+			for (uint32_t y = 0; y < n; y++) {
+				for (uint32_t x = 0; x < n; x++) {
+					uint32_t a = y * (n + 1) + x, b = a + 1, c = a + n + 2, d = a + n + 1;
+					indices.insert(indices.end(), { a, b, c, c, d, a });
+				}
+			}
+
+			std::vector<glm::vec3> positions;
+			for (const LodVertex& v : vertices) { positions.push_back(v.pos3); }
+			auto simplified = bainangua::simplifyMesh(positions, indices, indices.size() / 4);
+			REQUIRE(simplified.indices.size() <= indices.size() / 4);
+			REQUIRE(simplified.error == 0.0f);
+		}
+
+		SECTION("sphere") {
+			std::vector<LodVertex> vertices;
+			std::vector<uint32_t> indices;
+			makeSphere(32, 64, vertices, indices);
+
+			auto lods = bainangua::generateLods(vertices, indices, 5);
+			REQUIRE(lods.size() == 5);
+			REQUIRE(lods[0].indices == indices);
+			for (size_t i = 1; i < lods.size(); i++) {
+				// each LOD is about half the last, and a bit further from the real surface
+				REQUIRE(lods[i].indices.size() <= lods[i - 1].indices.size() * 6 / 10);
+				REQUIRE(lods[i].error > lods[i - 1].error);
+				REQUIRE(lods[i].error < 0.25f);
+				for (uint32_t index : lods[i].indices) {
+					REQUIRE(index < vertices.size());
+				}
+			}
+
+			// an error budget stops the simplification early
+			std::vector<glm::vec3> positions;
+			for (const LodVertex& v : vertices) { positions.push_back(v.pos3); }
+			auto limited = bainangua::simplifyMesh(positions, indices, 0, lods[1].error);
+			auto unlimited = bainangua::simplifyMesh(positions, indices, 0);
+			REQUIRE(limited.error <= lods[1].error);
+			REQUIRE(limited.indices.size() > unlimited.indices.size());
+		}
+	}
+
+	TEST_CASE("LOD selection", "[MeshProcessing][GeometryArena]")
+	{
+		bainangua::LodMeshHandle mesh{
+			.mesh = {},
+			.lods = {
+				{ 0, 3000, 0.0f },
+				{ 3000, 1500, 0.01f },
+				{ 4500, 700, 0.05f },
+				{ 5200, 300, 0.2f } },
+			.bounds = { glm::vec3(0.0f), 1.0f }
+		};
+
+		// 90 degree field of view, 1000 pixels tall: one unit at distance 1 covers 500 pixels
+		auto selector = bainangua::LodSelector::fromCamera(glm::vec3(0.0f), glm::radians(90.0f), 1000.0f);
+		auto at = [](float z, float scale = 1.0f) {
+			return glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -z)), glm::vec3(scale));
+		};
+
+		REQUIRE(selector.select(mesh, at(0.5f)) == 0);   // camera inside the bounds
+		REQUIRE(selector.select(mesh, at(3.0f)) == 0);   // 0.01 error * 250 px per unit = 2.5 px
+		REQUIRE(selector.select(mesh, at(8.0f)) == 1);   // 0.01 * ~71 px per unit is under a pixel
+		REQUIRE(selector.select(mesh, at(40.0f)) == 2);
+		REQUIRE(selector.select(mesh, at(1000.0f)) == 3);
+
+		// a mesh scaled up 10x needs 10x the distance for the same LOD
+		REQUIRE(selector.select(mesh, at(80.0f, 10.0f)) == 1);
+		REQUIRE(selector.select(mesh, at(400.0f, 10.0f)) == 2);
+
+		std::vector<glm::mat4> transforms{ at(3.0f), at(8.0f), at(1000.0f) };
+		std::vector<uint32_t> lods(transforms.size());
+		selector.select(mesh, transforms, lods);
+		REQUIRE(lods == std::vector<uint32_t>{ 0, 1, 3 });
+	}
+
+}
@@ -18,6 +18,7 @@
 #include <catch2/generators/catch_generators_random.hpp>
 #include <catch2/generators/catch_generators_adapters.hpp>
 #include <coro/coro.hpp>
+#include "ParallelStages.hpp"
 
 #include "nangua_tests.hpp" // this has to be after the coro include, or else wonky double-include occurs...
 
@@ -77,4 +78,24 @@ TEST_CASE("PerFramePool", "[PerFramePool][Basic]")
 	REQUIRE(perframepool_test.applyRow(testConfig()) == "PerFramePool success");
 }
 
-}
\ No newline at end of file
+TEST_CASE("PerFramePool with parallel setup", "[PerFramePool][Basic]")
+{
+	// the funnels and the pool don't need each other's fields, so they can be set up side by side
+	auto parallel_test =
+		bainangua::QuickCreateContext()
+		| (bainangua::CreateQueueFunnels() & bainangua::CreatePerFramePool())
+		| RowType::RowWrapLambda<bainangua::bng_expected<std::string>>([](auto row) {
+			std::shared_ptr<bainangua::PerFramePool> perFramePool = boost::hana::at_key(row, BOOST_HANA_STRING("perFramePool"));
+			std::shared_ptr<bainangua::CommandQueueFunnel> graphicsQueue = boost::hana::at_key(row, BOOST_HANA_STRING("graphicsFunnel"));
+			std::shared_ptr<bainangua::CommandQueueFunnel> presentQueue = boost::hana::at_key(row, BOOST_HANA_STRING("presentFunnel"));
+
+			if (!perFramePool || !graphicsQueue || !presentQueue) {
+				return bainangua::bng_expected<std::string>(bainangua::bng_unexpected("missing parallel stage field"));
+			}
+			return bainangua::bng_expected<std::string>("parallel setup success");
+		});
+
+	REQUIRE(parallel_test.applyRow(testConfig()) == "parallel setup success");
+}
+
+}
@@ -4,6 +4,7 @@
 #include "RowType.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <coroutine>
 #include <cstdint>
@@ -56,6 +57,12 @@ using VariableLoadKey = bainangua::SingleResourceKey<int, VariableLoadResult>;
 struct BadUnloadResult {};
 using BadUnloadKey = bainangua::SingleResourceKey<int, BadUnloadResult>;
 
+// Counted unloader. The unloader bumps countedUnloads, so we can see that the loader unloads resources that are
+// still loaded when it goes away.
+struct CountedUnloadResult {};
+using CountedUnloadKey = bainangua::SingleResourceKey<int, CountedUnloadResult>;
+std::atomic<int> countedUnloads{ 0 };
+
 
 
 constexpr auto testLoaderLookup = boost::hana::make_map(
@@ -178,6 +185,20 @@ constexpr auto testLoaderLookup = boost::hana::make_map(
 				}(loader)
 			};
 		}
+	),
+
+	// counted unloader
+	boost::hana::make_pair(
+		boost::hana::type_c<CountedUnloadKey>,
+		[](auto& loader, CountedUnloadKey key) -> bainangua::LoaderRoutine<CountedUnloadResult> {
+			co_return bainangua::LoaderResults<CountedUnloadResult>{
+				CountedUnloadResult{},
+				[]() -> coro::task<bainangua::bng_expected<void>> {
+					countedUnloads++;
+					co_return bainangua::bng_expected<void>();
+				}()
+			};
+		}
 	)
 );
 
@@ -256,6 +277,41 @@ TEST_CASE("ResourceLoaderBasicLoadUnload", "[ResourceLoader][Basic]")
 }
 
 
+struct LeftLoadedTest {
+	using row_tag = RowType::RowFunctionTag;
+	using return_type = bainangua::bng_expected<std::string>;
+
+	template <typename Row>
+	constexpr bainangua::bng_expected<std::string> applyRow(Row r) {
+		auto loader = boost::hana::at_key(r, BOOST_HANA_STRING("resourceLoader"));
+
+		// loaded twice and never unloaded
+		(void)coro::sync_wait(loader->loadResource(CountedUnloadKey{ 1 }));
+		(void)coro::sync_wait(loader->loadResource(CountedUnloadKey{ 1 }));
+		(void)coro::sync_wait(loader->loadResource(CountedUnloadKey{ 2 }));
+		(void)coro::sync_wait(loader->loadResource(ChainLoadKey{ 4 }));
+
+		return std::format("storage count={}", loader->measureLoad());
+	}
+};
+
+TEST_CASE("ResourceLoaderUnloadsLeftovers", "[ResourceLoader][Basic]")
+{
+	countedUnloads = 0;
+
+	auto left_loaded_test =
+		bainangua::QuickCreateContext()
+		| bainangua::ResourceLoaderStage(testLoaderLookup, testLoaderStorage)
+		| LeftLoadedTest();
+
+	// chain key 4 pulls in keys 0-3 as well
+	REQUIRE(left_loaded_test.applyRow(testConfig()) == "storage count=7");
+
+	// the loader went away with the stage, unloading each resource once
+	REQUIRE(countedUnloads == 2);
+}
+
+
 struct VariableLoadTest {
 	VariableLoadTest(int k) : variableKey_(k) {}
 
@@ -0,0 +1,202 @@
+#include "bainangua.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <coro/coro.hpp>
+
+import MeshProcessing;
+import SceneCulling;
+
+
+namespace SceneCullingTests {
+
+	// spheres scattered through a cube around the origin
+	std::vector<bainangua::BoundingSphere> randomScene(size_t count, float extent, uint32_t seed) {
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<float> position(-extent, extent);
+		std::uniform_real_distribution<float> radius(0.1f, 2.0f);
+		std::vector<bainangua::BoundingSphere> spheres(count);
+		for (auto& sphere : spheres) {
+			sphere = { glm::vec3(position(random), position(random), position(random)), radius(random) };
+		}
+		return spheres;
+	}
+
+	bainangua::Frustum testFrustum() {
+		glm::mat4 view = glm::lookAt(glm::vec3(10.0f, 20.0f, 30.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+		return bainangua::Frustum::fromViewProjection(projection * view);
+	}
+
+	std::vector<uint32_t> sorted(std::vector<uint32_t> ids) {
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+
+	// the answer without any tree or SIMD
+	std::vector<uint32_t> bruteForce(const bainangua::SceneCulling& scene, const std::vector<uint32_t>& ids, const bainangua::Frustum& frustum) {
+		std::vector<uint32_t> visible;
+		for (uint32_t id : ids) {
+			if (frustum.contains(scene.bounds(id))) {
+				visible.push_back(id);
+			}
+		}
+		return sorted(visible);
+	}
+
+	TEST_CASE("Frustum planes", "[SceneCulling]")
+	{
+		glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 1.0f, 10.0f);
+		auto frustum = bainangua::Frustum::fromViewProjection(projection);
+
+		// the camera looks down -z
+		REQUIRE(frustum.contains({ glm::vec3(0.0f, 0.0f, -5.0f), 0.1f }));
+		REQUIRE_FALSE(frustum.contains({ glm::vec3(0.0f, 0.0f, 5.0f), 0.1f }));
+		REQUIRE_FALSE(frustum.contains({ glm::vec3(0.0f, 0.0f, -20.0f), 0.1f }));
+		REQUIRE_FALSE(frustum.contains({ glm::vec3(10.0f, 0.0f, -5.0f), 0.1f }));
+		// outside the far plane, but big enough to reach back into the frustum
+		REQUIRE(frustum.contains({ glm::vec3(0.0f, 0.0f, -12.0f), 3.0f }));
+	}
+
+	TEST_CASE("BVH culling", "[SceneCulling]")
+	{
+		auto spheres = randomScene(10000, 60.0f, 42);
+		bainangua::SceneCulling scene;
+		std::vector<uint32_t> ids;
+		for (const auto& sphere : spheres) {
+			ids.push_back(scene.add(sphere));
+		}
+		auto frustum = testFrustum();
+
+		// nothing built yet: every object goes through the SIMD kernel
+		auto expected = bruteForce(scene, ids, frustum);
+		REQUIRE(!expected.empty());
+		REQUIRE(expected.size() < ids.size());
+		REQUIRE(sorted(scene.cull(frustum)) == expected);
+
+		scene.rebuild();
+		REQUIRE(sorted(scene.cull(frustum)) == expected);
+
+		SECTION("moved objects") {
+			std::mt19937 random(7);
+			std::uniform_real_distribution<float> offset(-20.0f, 20.0f);
+			for (size_t i = 0; i < ids.size(); i += 3) {
+				auto sphere = scene.bounds(ids[i]);
+				sphere.center += glm::vec3(offset(random), offset(random), offset(random));
+				scene.update(ids[i], sphere);
+			}
+			scene.refit();
+			REQUIRE(sorted(scene.cull(frustum)) == bruteForce(scene, ids, frustum));
+		}
+
+		SECTION("added and removed objects") {
+			// removed objects vanish straight away; added ones are culled outside the tree until the next rebuild
+			std::vector<uint32_t> removed(expected.begin(), expected.begin() + expected.size() / 2);
+			for (uint32_t id : removed) {
+				scene.remove(id);
+				ids.erase(std::find(ids.begin(), ids.end(), id));
+			}
+			for (const auto& sphere : randomScene(500, 60.0f, 43)) {
+				ids.push_back(scene.add(sphere));
+			}
+			REQUIRE(scene.size() == ids.size());
+			scene.refit();
+
+			auto visible = sorted(scene.cull(frustum));
+			REQUIRE(visible == bruteForce(scene, ids, frustum));
+
+			scene.rebuild();
+			REQUIRE(sorted(scene.cull(frustum)) == visible);
+		}
+	}
+
+	TEST_CASE("Culling kernels", "[SceneCulling]")
+	{
+		// an odd count, so every kernel also leaves a few spheres for the scalar loop
+		auto spheres = randomScene(10003, 60.0f, 5);
+		bainangua::SceneCulling scene;
+		std::vector<uint32_t> ids;
+		for (const auto& sphere : spheres) {
+			ids.push_back(scene.add(sphere));
+		}
+		auto frustum = testFrustum();
+		auto expected = bruteForce(scene, ids, frustum);
+
+		REQUIRE(scene.kernel() == bainangua::fastestCullKernel());
+
+		// without a tree every object goes through the kernel; each one this CPU can run has to agree
+		for (auto kernel : { bainangua::CullKernel::Scalar, bainangua::CullKernel::SSE, bainangua::CullKernel::AVX }) {
+			if (kernel > bainangua::fastestCullKernel()) {
+				continue;
+			}
+			INFO(static_cast<int>(kernel));
+			scene.setKernel(kernel);
+			REQUIRE(scene.kernel() == kernel);
+			REQUIRE(sorted(scene.cull(frustum)) == expected);
+		}
+
+		scene.setKernel(bainangua::CullKernel::AVX);
+		REQUIRE(scene.kernel() == bainangua::fastestCullKernel());
+	}
+
+	TEST_CASE("Parallel culling", "[SceneCulling]")
+	{
+		bainangua::SceneCulling scene;
+		for (const auto& sphere : randomScene(50000, 60.0f, 1)) {
+			scene.add(sphere);
+		}
+		scene.rebuild();
+		// a few extra outside the tree
+		for (const auto& sphere : randomScene(100, 60.0f, 2)) {
+			scene.add(sphere);
+		}
+		auto frustum = testFrustum();
+
+		coro::thread_pool pool{ coro::thread_pool::options{.thread_count = 4} };
+		auto parallel = coro::sync_wait(scene.cullParallel(frustum, pool));
+		REQUIRE(parallel == scene.cull(frustum));
+	}
+
+#ifdef NDEBUG // skip benchmarks in debug builds
+	TEST_CASE("Culling benchmarks", "[SceneCulling][!benchmark]")
+	{
+		bainangua::SceneCulling scene;
+		for (const auto& sphere : randomScene(200000, 200.0f, 3)) {
+			scene.add(sphere);
+		}
+		scene.rebuild();
+		glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		auto frustum = bainangua::Frustum::fromViewProjection(glm::perspective(glm::radians(70.0f), 16.0f / 9.0f, 0.1f, 150.0f) * view);
+		std::vector<uint32_t> visible;
+		visible.reserve(200000);
+
+		BENCHMARK_ADVANCED("cull 200k spheres")(Catch::Benchmark::Chronometer meter) {
+			meter.measure([&] { visible.clear(); scene.cull(frustum, visible); return visible.size(); });
+		};
+
+		coro::thread_pool pool;
+		BENCHMARK_ADVANCED("cull 200k spheres in parallel")(Catch::Benchmark::Chronometer meter) {
+			meter.measure([&] { return coro::sync_wait(scene.cullParallel(frustum, pool)).size(); });
+		};
+
+		BENCHMARK_ADVANCED("refit 200k spheres")(Catch::Benchmark::Chronometer meter) {
+			meter.measure([&] {
+				for (uint32_t id = 0; id < 200000; id += 16) {
+					scene.update(id, scene.bounds(id));
+				}
+				scene.refit();
+			});
+		};
+	}
+#endif
+
+}
@@ -0,0 +1,201 @@
+#include "bainangua.hpp"
+#include "CpuFeatures.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+import VertexBuffer;
+
+
+namespace VertexBufferTests {
+
+	struct PackedVertex {
+		bainangua::PackedHalf4 pos3h;
+		bainangua::PackedHalf2 uvh;
+		bainangua::Packed1010102 normal10;
+		bainangua::PackedUnorm8x4 color8;
+	};
+
+	TEST_CASE("Packed vertex attributes", "[VertexBuffer]")
+	{
+		auto attributes = bainangua::reflectAttributes<PackedVertex>();
+
+		REQUIRE(attributes.size() == 4);
+		REQUIRE(attributes[0].format == vk::Format::eR16G16B16A16Sfloat);
+		REQUIRE(attributes[1].format == vk::Format::eR16G16Sfloat);
+		REQUIRE(attributes[2].format == vk::Format::eA2B10G10R10UnormPack32);
+		REQUIRE(attributes[3].format == vk::Format::eR8G8B8A8Unorm);
+		REQUIRE(attributes[3].offset == offsetof(PackedVertex, color8));
+		REQUIRE(sizeof(PackedVertex) == 20);
+	}
+
+	TEST_CASE("Instance attributes", "[VertexBuffer]")
+	{
+		// a per-vertex struct in binding 0 and a transform per instance in binding 1
+		constexpr uint32_t firstLocation = static_cast<uint32_t>(bainangua::locationCount<PackedVertex>());
+		REQUIRE(firstLocation == 4);
+
+		auto [binding, attributes] = bainangua::reflectInstanceInput<bainangua::InstanceTransform>(1, firstLocation);
+		REQUIRE(binding.binding == 1);
+		REQUIRE(binding.inputRate == vk::VertexInputRate::eInstance);
+		REQUIRE(binding.stride == sizeof(glm::mat4));
+
+		// one location per matrix column
+		REQUIRE(attributes.size() == 4);
+		for (uint32_t column = 0; column < 4; column++) {
+			REQUIRE(attributes[column].binding == 1);
+			REQUIRE(attributes[column].location == firstLocation + column);
+			REQUIRE(attributes[column].format == vk::Format::eR32G32B32A32Sfloat);
+			REQUIRE(attributes[column].offset == column * sizeof(glm::vec4));
+		}
+	}
+
+	struct MeshVertex {
+		glm::vec3 pos3;
+		glm::vec3 normal3;
+		glm::vec2 uv;
+	};
+
+	TEST_CASE("Split vertex streams", "[VertexBuffer]")
+	{
+		auto layout = bainangua::reflectStreams<MeshVertex>();
+
+		// positions on their own, everything else packed together
+		REQUIRE(layout.streamStrides[0] == 12);
+		REQUIRE(layout.streamStrides[1] == 20);
+
+		auto [bindings, attributes] = layout.vertexInput();
+		REQUIRE(bindings.size() == 2);
+		REQUIRE(attributes.size() == 3);
+
+		// locations match the interleaved layout, so the shaders don't change
+		auto interleaved = bainangua::reflectAttributes<MeshVertex>();
+		for (size_t i = 0; i < attributes.size(); i++) {
+			REQUIRE(attributes[i].location == interleaved[i].location);
+			REQUIRE(attributes[i].format == interleaved[i].format);
+		}
+		REQUIRE(attributes[1].binding == 1);
+		REQUIRE(attributes[1].offset == 0);
+		REQUIRE(attributes[2].offset == 12);
+
+		// a position-only pass reads 12 bytes a vertex instead of 32
+		auto [positionBinding, positionAttributes] = layout.streamInput(0);
+		REQUIRE(positionBinding.stride == 12);
+		REQUIRE(positionAttributes.size() == 1);
+		REQUIRE(positionAttributes[0].location == 0);
+
+		std::vector<MeshVertex> vertices{
+			{ {1, 2, 3}, {0, 0, 1}, {0.25f, 0.75f} },
+			{ {4, 5, 6}, {0, 1, 0}, {0.5f, 0.5f} }
+		};
+		auto streams = bainangua::splitVertexStreams(vertices, layout);
+		REQUIRE(streams.size() == 2);
+		REQUIRE(streams[0].size() == 24);
+		REQUIRE(streams[1].size() == 40);
+
+		const float* positions = reinterpret_cast<const float*>(streams[0].data());
+		REQUIRE(positions[3] == 4.0f);
+		REQUIRE(positions[5] == 6.0f);
+		const float* rest = reinterpret_cast<const float*>(streams[1].data());
+		REQUIRE(rest[2] == 1.0f);  // first normal's z
+		REQUIRE(rest[4] == 0.75f); // first uv's v
+		REQUIRE(rest[6] == 1.0f);  // second normal's y
+	}
+
+	TEST_CASE("Half conversion", "[VertexBuffer]")
+	{
+		// every finite half survives a round trip through float
+		for (uint32_t h = 0; h < 0x10000; h++) {
+			if (((h >> 10) & 0x1f) == 0x1f) { continue; }
+			uint16_t half = static_cast<uint16_t>(h);
+			REQUIRE((bainangua::floatToHalf(bainangua::halfToFloat(half)) == half || bainangua::halfToFloat(half) == 0.0f));
+		}
+
+		REQUIRE(bainangua::floatToHalf(1.0f) == 0x3c00);
+		REQUIRE(bainangua::floatToHalf(-2.0f) == 0xc000);
+		REQUIRE(bainangua::floatToHalf(100000.0f) == 0x7c00);
+
+		// the bulk converter agrees with the scalar one, including the leftover elements, whichever kernel it uses
+		INFO("F16C: " << bainangua::cpuSupportsF16c());
+		std::vector<float> src(37);
+		for (size_t i = 0; i < src.size(); i++) { src[i] = static_cast<float>(i) * 0.37f - 5.0f; }
+		// ties that round to even, half denormals, overflow and the infinities
+		src.insert(src.end(), { 1.0f + std::ldexp(1.0f, -11), 1.0f + 3.0f * std::ldexp(1.0f, -11), std::ldexp(1.0f, -20), -std::ldexp(3.0f, -25),
+			-0.0f, 65504.0f, 65520.0f, -1.0e6f, INFINITY, -INFINITY });
+		std::vector<uint16_t> dst(src.size());
+		bainangua::floatsToHalf(src.data(), dst.data(), src.size());
+		for (size_t i = 0; i < src.size(); i++) {
+			REQUIRE(dst[i] == bainangua::floatToHalf(src[i]));
+		}
+	}
+
+	TEST_CASE("Vertex packers", "[VertexBuffer]")
+	{
+		const size_t count = 70; // more than one chunk, and not a multiple of the SIMD width
+
+		std::vector<glm::vec3> positions(count);
+		std::vector<glm::vec2> uvs(count);
+		std::vector<glm::vec3> normals(count);
+		std::vector<glm::vec4> colors(count);
+		for (size_t i = 0; i < count; i++) {
+			float t = static_cast<float>(i) / count;
+			positions[i] = glm::vec3(t * 10.0f, -t, 0.5f);
+			uvs[i] = glm::vec2(t, 1.0f - t);
+			normals[i] = glm::normalize(glm::vec3(std::cos(t * 6.0f), std::sin(t * 6.0f), t - 0.5f));
+			colors[i] = glm::vec4(t, 0.5f, 1.0f - t, 1.0f);
+		}
+
+		std::vector<PackedVertex> vertices(count);
+		bainangua::packPositionsHalf(std::span<const glm::vec3>(positions), std::span(vertices), &PackedVertex::pos3h);
+		bainangua::packUVsHalf(std::span<const glm::vec2>(uvs), std::span(vertices), &PackedVertex::uvh);
+		bainangua::packNormals1010102(std::span<const glm::vec3>(normals), std::span(vertices), &PackedVertex::normal10);
+		bainangua::packColorsUnorm8(std::span<const glm::vec4>(colors), std::span(vertices), &PackedVertex::color8);
+
+		for (size_t i = 0; i < count; i++) {
+			const PackedVertex& v = vertices[i];
+
+			REQUIRE(std::abs(bainangua::halfToFloat(v.pos3h.v[0]) - positions[i].x) < 0.01f);
+			REQUIRE(std::abs(bainangua::halfToFloat(v.pos3h.v[1]) - positions[i].y) < 0.001f);
+			REQUIRE(std::abs(bainangua::halfToFloat(v.uvh.v[1]) - uvs[i].y) < 0.001f);
+
+			// decode the way a shader would: unorm, then n * 2 - 1
+			uint32_t n = v.normal10.v;
+			glm::vec3 decoded(
+				(n & 0x3ff) / 1023.0f * 2.0f - 1.0f,
+				((n >> 10) & 0x3ff) / 1023.0f * 2.0f - 1.0f,
+				((n >> 20) & 0x3ff) / 1023.0f * 2.0f - 1.0f);
+			REQUIRE(glm::length(decoded - normals[i]) < 0.005f);
+
+			REQUIRE(std::abs(v.color8.v[0] / 255.0f - colors[i].x) < 0.005f);
+			REQUIRE(v.color8.v[3] == 255);
+		}
+	}
+
+	TEST_CASE("Octahedral normals", "[VertexBuffer]")
+	{
+		struct OctVertex {
+			bainangua::PackedSnorm16x2 normalOct;
+		};
+
+		std::vector<glm::vec3> normals{
+			{0, 0, 1}, {0, 0, -1}, {1, 0, 0}, {0, -1, 0},
+			glm::normalize(glm::vec3(1, 1, 1)), glm::normalize(glm::vec3(-1, 2, -3)), glm::normalize(glm::vec3(0.3f, -0.2f, -0.9f))
+		};
+		std::vector<OctVertex> vertices(normals.size());
+		bainangua::packNormalsOctahedral(std::span<const glm::vec3>(normals), std::span(vertices), &OctVertex::normalOct);
+
+		for (size_t i = 0; i < normals.size(); i++) {
+			glm::vec2 p(vertices[i].normalOct.v[0] / 32767.0f, vertices[i].normalOct.v[1] / 32767.0f);
+			REQUIRE(glm::length(bainangua::octDecode(p) - normals[i]) < 0.001f);
+		}
+	}
+
+}